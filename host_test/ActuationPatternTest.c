@@ -0,0 +1,172 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// RMT items compiled by ActuationPattern and their simulated playback, at the 100 us tick of the actuator.
+
+#include "ActuationPattern.h"
+#include "Test.h"
+
+#define kTickUs ((uint32_t) 100)
+
+/**
+ * Half of an RMT item: 15 bits of duration in ticks and the level.
+ */
+#define HALF(level, ticks) ((uint32_t)(ticks) | (uint32_t)(level) << 15)
+
+/**
+ * RMT item in rmt_item32_t layout.
+ */
+#define ITEM(level0, ticks0, level1, ticks1) (HALF(level0, ticks0) | HALF(level1, ticks1) << 16)
+
+typedef struct {
+    const char* description;
+    HAPError err;
+    uint32_t items[kActuationPattern_MaxItems];
+    size_t numItems;
+    uint32_t durationUs;
+} Case;
+
+static const Case kCases[] = {
+    // Plain press. 5 s are 50000 ticks, more than one half holds.
+    { "1:5000", kHAPError_None, { ITEM(1, 0x7FFF, 1, 50000 - 0x7FFF), 0 }, 2, 5000000 },
+    // Just below and just above the 15 bit limit.
+    { "1:3276", kHAPError_None, { ITEM(1, 32760, 0, 0) }, 1, 3276000 },
+    { "1:3277", kHAPError_None, { ITEM(1, 0x7FFF, 1, 3), 0 }, 2, 3277000 },
+    // Repetition. The pattern ends low after its last step either way.
+    { "1:300,0:300*2", kHAPError_None, { ITEM(1, 3000, 0, 3000), ITEM(1, 3000, 0, 3000), 0 }, 3, 1200000 },
+    { "1:300*3", kHAPError_None, { ITEM(1, 9000, 0, 0) }, 1, 900000 },
+    // Adjacent steps of the same level are merged, leading low steps are kept.
+    { "1:100,1:200", kHAPError_None, { ITEM(1, 3000, 0, 0) }, 1, 300000 },
+    { "0:500,1:300", kHAPError_None, { ITEM(0, 5000, 1, 3000), 0 }, 2, 800000 },
+    // Durations are rounded to ticks. 1 ms is the shortest step.
+    { "1:1", kHAPError_None, { ITEM(1, 10, 0, 0) }, 1, 1000 },
+    // The longest step takes 19 halves: 18 full ones and the remainder.
+    { "1:60000",
+      kHAPError_None,
+      { ITEM(1, 0x7FFF, 1, 0x7FFF),
+        ITEM(1, 0x7FFF, 1, 0x7FFF),
+        ITEM(1, 0x7FFF, 1, 0x7FFF),
+        ITEM(1, 0x7FFF, 1, 0x7FFF),
+        ITEM(1, 0x7FFF, 1, 0x7FFF),
+        ITEM(1, 0x7FFF, 1, 0x7FFF),
+        ITEM(1, 0x7FFF, 1, 0x7FFF),
+        ITEM(1, 0x7FFF, 1, 0x7FFF),
+        ITEM(1, 0x7FFF, 1, 0x7FFF),
+        ITEM(1, 600000 - 18 * 0x7FFF, 0, 0) },
+      10,
+      60000000 },
+    // Item cap: 124 halves and the end marker fill 63 items.
+    { "1:60000,0:39320*4", kHAPError_None, { 0 }, 63, 4 * 99320000 },
+    // 125 halves fit 63 items, the last one ends with a zero duration.
+    { "1:60000,0:19660*5", kHAPError_None, { 0 }, 63, 5 * 79660000 },
+    // 126 halves fill 63 items and leave no room for the end marker.
+    { "1:60000,0:6000*6", kHAPError_OutOfResources, { 0 }, 0, 0 },
+    { "1:60000,0:60000*16", kHAPError_OutOfResources, { 0 }, 0, 0 },
+    // Malformed.
+    { "", kHAPError_InvalidData, { 0 }, 0, 0 },
+    { "2:100", kHAPError_InvalidData, { 0 }, 0, 0 },
+    { "1:", kHAPError_InvalidData, { 0 }, 0, 0 },
+    { "1:0", kHAPError_InvalidData, { 0 }, 0, 0 },
+    { "1:60001", kHAPError_InvalidData, { 0 }, 0, 0 },
+    { "1:100,", kHAPError_InvalidData, { 0 }, 0, 0 },
+    { "1:100 ", kHAPError_InvalidData, { 0 }, 0, 0 },
+    { "1:300*", kHAPError_InvalidData, { 0 }, 0, 0 },
+    { "1:300*0", kHAPError_InvalidData, { 0 }, 0, 0 },
+    { "1:300*17", kHAPError_InvalidData, { 0 }, 0, 0 },
+    { "1:300*2,0:300", kHAPError_InvalidData, { 0 }, 0, 0 },
+    { "1:1,0:1,1:1,0:1,1:1,0:1,1:1,0:1,1:1,0:1,1:1,0:1,1:1,0:1,1:1,0:1,1:1", kHAPError_InvalidData, { 0 }, 0, 0 },
+};
+
+static void TestCompile(void) {
+    for (size_t i = 0; i < HAPArrayCount(kCases); i++) {
+        const Case* c = &kCases[i];
+        ActuationPattern pattern;
+        HAPError err = ActuationPatternCompile(c->description, kTickUs, &pattern);
+        if (err != c->err) {
+            fprintf(stderr, "\"%s\": %u instead of %u.\n", c->description, err, c->err);
+            numFailedChecks++;
+            continue;
+        }
+        if (err) {
+            continue;
+        }
+        TEST_CHECK_EQUAL(pattern.numItems, c->numItems);
+        TEST_CHECK_EQUAL(pattern.durationUs, c->durationUs);
+        // Cases at the item cap are checked for their end only.
+        bool hasItems = c->numItems < kActuationPattern_MaxItems;
+        for (size_t j = 0; hasItems && j < c->numItems; j++) {
+            if (pattern.items[j] != c->items[j]) {
+                fprintf(stderr,
+                        "\"%s\": Item %zu is 0x%08X instead of 0x%08X.\n",
+                        c->description,
+                        j,
+                        (unsigned) pattern.items[j],
+                        (unsigned) c->items[j]);
+                numFailedChecks++;
+            }
+        }
+        // The transmission ends with a zero duration, in the upper half of the last item or in an item of its own.
+        TEST_CHECK_EQUAL(pattern.items[pattern.numItems - 1] >> 16 & 0x7FFF, 0);
+    }
+
+    // Cap: 125 halves end with a lone half, 124 halves with an end marker.
+    ActuationPattern pattern;
+    TEST_CHECK_EQUAL(ActuationPatternCompile("1:60000,0:19660*5", kTickUs, &pattern), kHAPError_None);
+    TEST_CHECK_EQUAL(pattern.items[62], HALF(0, 196600 - 5 * 0x7FFF));
+    TEST_CHECK_EQUAL(ActuationPatternCompile("1:60000,0:39320*4", kTickUs, &pattern), kHAPError_None);
+    TEST_CHECK_EQUAL(pattern.items[62], 0);
+}
+
+typedef struct {
+    bool levels[8];
+    uint32_t durationsUs[8];
+    size_t numSteps;
+} Steps;
+
+static void RecordStep(void* _Nullable context, bool level, uint32_t durationUs, bool* shouldContinue) {
+    Steps* steps = context;
+    if (steps->numSteps == HAPArrayCount(steps->levels)) {
+        *shouldContinue = false;
+        return;
+    }
+    steps->levels[steps->numSteps] = level;
+    steps->durationsUs[steps->numSteps] = durationUs;
+    steps->numSteps++;
+}
+
+static void CheckPlayback(const char* description, const Steps* expected) {
+    ActuationPattern pattern;
+    TEST_CHECK_EQUAL(ActuationPatternCompile(description, kTickUs, &pattern), kHAPError_None);
+    Steps steps = { .numSteps = 0 };
+    ActuationPatternEnumerateSteps(&pattern, kTickUs, RecordStep, &steps);
+    TEST_CHECK_EQUAL(steps.numSteps, expected->numSteps);
+    for (size_t i = 0; i < steps.numSteps && i < expected->numSteps; i++) {
+        TEST_CHECK_EQUAL(steps.levels[i], expected->levels[i]);
+        TEST_CHECK_EQUAL(steps.durationsUs[i], expected->durationsUs[i]);
+    }
+}
+
+static void TestPlayback(void) {
+    // Halves split at the 15 bit limit play as one step.
+    CheckPlayback("1:5000", &(const Steps) { { 1 }, { 5000000 }, 1 });
+    CheckPlayback("1:60000", &(const Steps) { { 1 }, { 60000000 }, 1 });
+    CheckPlayback("1:300,0:300*2", &(const Steps) { { 1, 0, 1, 0 }, { 300000, 300000, 300000, 300000 }, 4 });
+    CheckPlayback("0:500,1:300", &(const Steps) { { 0, 1 }, { 500000, 300000 }, 2 });
+    CheckPlayback("1:100,1:200", &(const Steps) { { 1 }, { 300000 }, 1 });
+
+    // The enumeration can be stopped.
+    ActuationPattern pattern;
+    TEST_CHECK_EQUAL(ActuationPatternCompile("1:10,0:10*8", kTickUs, &pattern), kHAPError_None);
+    Steps steps = { .numSteps = 0 };
+    ActuationPatternEnumerateSteps(&pattern, kTickUs, RecordStep, &steps);
+    TEST_CHECK_EQUAL(steps.numSteps, HAPArrayCount(steps.levels));
+}
+
+int main(void) {
+    TestCompile();
+    TestPlayback();
+    return TEST_RESULT();
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Minimal harness for the host benchmarks. Results are printed in the format of the on-device suite (Benchmark.h),
+// one line per benchmark:
+//
+//   BENCH name=<benchmark> n=<samples> min_ns=<n> p50_ns=<n> mean_ns=<n> max_ns=<n>
+//
+// A sample times a batch of iterations, since a single iteration is often shorter than the clock resolution. Times
+// are per iteration. Host numbers compare implementations with each other, not with the device.
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <time.h>
+
+#include "HAP.h"
+
+/**
+ * Number of samples per benchmark.
+ */
+#define kBench_NumSamples ((size_t) 101)
+
+/**
+ * Result of a benchmark, per iteration.
+ */
+typedef struct {
+    uint64_t minNs;
+    uint64_t p50Ns;
+    uint64_t meanNs;
+    uint64_t maxNs;
+} BenchResult;
+
+static uint64_t BenchGetTimeNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000 * 1000 * 1000 + (uint64_t) now.tv_nsec;
+}
+
+static int BenchCompare(const void* sample, const void* otherSample) {
+    uint64_t a = *(const uint64_t*) sample;
+    uint64_t b = *(const uint64_t*) otherSample;
+    return a < b ? -1 : a > b;
+}
+
+/**
+ * Runs a benchmark and prints its result.
+ *
+ * @param      name                 Benchmark name.
+ * @param      numIterations        Number of iterations per sample.
+ * @param      run                  Runs one iteration.
+ * @param      context              Context passed to run.
+ *
+ * @return Result, per iteration.
+ */
+static BenchResult BenchRun(const char* name, size_t numIterations, void (*run)(void* context), void* context) {
+    HAPPrecondition(numIterations);
+
+    uint64_t samples[kBench_NumSamples];
+    uint64_t totalNs = 0;
+    for (size_t i = 0; i < kBench_NumSamples; i++) {
+        uint64_t startedAt = BenchGetTimeNs();
+        for (size_t j = 0; j < numIterations; j++) {
+            run(context);
+        }
+        samples[i] = (BenchGetTimeNs() - startedAt) / numIterations;
+        totalNs += samples[i];
+    }
+    qsort(samples, kBench_NumSamples, sizeof samples[0], BenchCompare);
+
+    BenchResult result = { .minNs = samples[0],
+                           .p50Ns = samples[kBench_NumSamples / 2],
+                           .meanNs = totalNs / kBench_NumSamples,
+                           .maxNs = samples[kBench_NumSamples - 1] };
+    printf("BENCH name=%s n=%zu min_ns=%llu p50_ns=%llu mean_ns=%llu max_ns=%llu\n",
+           name,
+           kBench_NumSamples,
+           (unsigned long long) result.minNs,
+           (unsigned long long) result.p50Ns,
+           (unsigned long long) result.meanNs,
+           (unsigned long long) result.maxNs);
+    return result;
+}
+
+#endif
@@ -0,0 +1,136 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "FakeKeyValueStore.h"
+
+struct HAPPlatformKeyValueStore {
+    struct {
+        bool isUsed;
+        HAPPlatformKeyValueStoreDomain domain;
+        HAPPlatformKeyValueStoreKey key;
+        size_t numBytes;
+        uint8_t bytes[kFakeKeyValueStore_MaxValueBytes];
+    } entries[kFakeKeyValueStore_MaxEntries];
+
+    bool isFailing;
+    FakeKeyValueStoreStats stats;
+};
+
+struct HAPPlatformKeyValueStore fakeKeyValueStore;
+
+void FakeKeyValueStoreReset(void) {
+    HAPRawBufferZero(&fakeKeyValueStore, sizeof fakeKeyValueStore);
+}
+
+void FakeKeyValueStoreSetFailing(bool isFailing) {
+    fakeKeyValueStore.isFailing = isFailing;
+}
+
+void FakeKeyValueStoreGetStats(FakeKeyValueStoreStats* stats) {
+    HAPPrecondition(stats);
+
+    *stats = fakeKeyValueStore.stats;
+}
+
+/**
+ * Finds the index of an entry, like the linear search of NVS over its entries.
+ *
+ * @return Index, or kFakeKeyValueStore_MaxEntries if the key is not stored.
+ */
+static size_t FindEntry(HAPPlatformKeyValueStoreDomain domain, HAPPlatformKeyValueStoreKey key) {
+    for (size_t i = 0; i < kFakeKeyValueStore_MaxEntries; i++) {
+        if (fakeKeyValueStore.entries[i].isUsed && fakeKeyValueStore.entries[i].domain == domain &&
+            fakeKeyValueStore.entries[i].key == key) {
+            return i;
+        }
+    }
+    return kFakeKeyValueStore_MaxEntries;
+}
+
+HAPError __real_HAPPlatformKeyValueStoreGet(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        void* _Nullable bytes,
+        size_t maxBytes,
+        size_t* _Nullable numBytes,
+        bool* found) {
+    HAPPrecondition(keyValueStore == &fakeKeyValueStore);
+    HAPPrecondition(found);
+
+    fakeKeyValueStore.stats.numGets++;
+    if (fakeKeyValueStore.isFailing) {
+        return kHAPError_Unknown;
+    }
+    size_t i = FindEntry(domain, key);
+    *found = i < kFakeKeyValueStore_MaxEntries;
+    if (*found && bytes) {
+        size_t n = HAPMin(maxBytes, fakeKeyValueStore.entries[i].numBytes);
+        HAPRawBufferCopyBytes(HAPNonnull(bytes), fakeKeyValueStore.entries[i].bytes, n);
+        *HAPNonnull(numBytes) = n;
+    }
+    return kHAPError_None;
+}
+
+HAPError __real_HAPPlatformKeyValueStoreSet(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* bytes,
+        size_t numBytes) {
+    HAPPrecondition(keyValueStore == &fakeKeyValueStore);
+    HAPPrecondition(numBytes <= kFakeKeyValueStore_MaxValueBytes);
+
+    fakeKeyValueStore.stats.numSets++;
+    size_t i = FindEntry(domain, key);
+    if (i == kFakeKeyValueStore_MaxEntries) {
+        for (i = 0; i < kFakeKeyValueStore_MaxEntries && fakeKeyValueStore.entries[i].isUsed; i++) {
+        }
+        if (i == kFakeKeyValueStore_MaxEntries) {
+            return kHAPError_OutOfResources;
+        }
+    }
+    fakeKeyValueStore.entries[i].isUsed = true;
+    fakeKeyValueStore.entries[i].domain = domain;
+    fakeKeyValueStore.entries[i].key = key;
+    fakeKeyValueStore.entries[i].numBytes = numBytes;
+    HAPRawBufferCopyBytes(fakeKeyValueStore.entries[i].bytes, bytes, numBytes);
+    return fakeKeyValueStore.isFailing ? kHAPError_Unknown : kHAPError_None;
+}
+
+HAPError __real_HAPPlatformKeyValueStoreRemove(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key) {
+    HAPPrecondition(keyValueStore == &fakeKeyValueStore);
+
+    fakeKeyValueStore.stats.numRemoves++;
+    if (fakeKeyValueStore.isFailing) {
+        return kHAPError_Unknown;
+    }
+    size_t i = FindEntry(domain, key);
+    if (i < kFakeKeyValueStore_MaxEntries) {
+        fakeKeyValueStore.entries[i].isUsed = false;
+    }
+    return kHAPError_None;
+}
+
+HAPError __real_HAPPlatformKeyValueStorePurgeDomain(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain) {
+    HAPPrecondition(keyValueStore == &fakeKeyValueStore);
+
+    fakeKeyValueStore.stats.numPurges++;
+    if (fakeKeyValueStore.isFailing) {
+        return kHAPError_Unknown;
+    }
+    for (size_t i = 0; i < kFakeKeyValueStore_MaxEntries; i++) {
+        if (fakeKeyValueStore.entries[i].domain == domain) {
+            fakeKeyValueStore.entries[i].isUsed = false;
+        }
+    }
+    return kHAPError_None;
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// In-memory key-value store behind KeyValueStoreCache on the host. It implements the __real_HAPPlatformKeyValueStore
+// functions that the cache wraps, and counts the calls that reach it.
+
+#ifndef FAKE_KEY_VALUE_STORE_H
+#define FAKE_KEY_VALUE_STORE_H
+
+#include "HAP.h"
+
+/**
+ * Maximum number of stored entries.
+ */
+#define kFakeKeyValueStore_MaxEntries ((size_t) 64)
+
+/**
+ * Maximum size of a stored value.
+ */
+#define kFakeKeyValueStore_MaxValueBytes ((size_t) 256)
+
+/**
+ * Calls that reached the store.
+ */
+typedef struct {
+    size_t numGets;
+    size_t numSets;
+    size_t numRemoves;
+    size_t numPurges;
+} FakeKeyValueStoreStats;
+
+/**
+ * The store. Pass it as the HAPPlatformKeyValueStoreRef.
+ */
+extern struct HAPPlatformKeyValueStore fakeKeyValueStore;
+
+/**
+ * Removes all entries and resets the counters.
+ */
+void FakeKeyValueStoreReset(void);
+
+/**
+ * Makes the next operations fail with kHAPError_Unknown, e.g. to simulate a flash error. A failing Set still
+ * stores the value, as a write may reach flash before the error is detected.
+ */
+void FakeKeyValueStoreSetFailing(bool isFailing);
+
+/**
+ * Gets the counters.
+ */
+void FakeKeyValueStoreGetStats(FakeKeyValueStoreStats* stats);
+
+// Functions of the store, as wrapped by KeyValueStoreCache.c.
+HAPError __real_HAPPlatformKeyValueStoreGet(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        void* _Nullable bytes,
+        size_t maxBytes,
+        size_t* _Nullable numBytes,
+        bool* found);
+HAPError __real_HAPPlatformKeyValueStoreSet(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* bytes,
+        size_t numBytes);
+HAPError __real_HAPPlatformKeyValueStoreRemove(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key);
+HAPError __real_HAPPlatformKeyValueStorePurgeDomain(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain);
+
+// The wrapped functions, as the accessory server calls them.
+HAPError __wrap_HAPPlatformKeyValueStoreGet(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        void* _Nullable bytes,
+        size_t maxBytes,
+        size_t* _Nullable numBytes,
+        bool* found);
+HAPError __wrap_HAPPlatformKeyValueStoreSet(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* bytes,
+        size_t numBytes);
+HAPError __wrap_HAPPlatformKeyValueStoreRemove(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key);
+HAPError __wrap_HAPPlatformKeyValueStorePurgeDomain(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain);
+
+#endif
@@ -0,0 +1,86 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Key-value store cache on the host, in front of an in-memory store (FakeKeyValueStore.h). The store is much faster
+// than flash, so the numbers show the overhead of the cache rather than its gain; kvs_get and kvs_get_backend of the
+// on-device suite (Benchmark.h) show the gain.
+//
+//   kvs_get                   Reading a cached 32 byte entry.
+//   kvs_get_backend           Reading the same entry from the store directly.
+//   kvs_get_miss              Reading entries that are never cached in time, since more keys are read round-robin
+//                             than the cache holds.
+
+#include "FakeKeyValueStore.h"
+#include "KeyValueStoreCache.h"
+#include "Bench.h"
+
+/**
+ * Domain of the entries.
+ */
+#define kDomain ((HAPPlatformKeyValueStoreDomain) 0x10)
+
+/**
+ * Number of keys read round-robin by kvs_get_miss.
+ */
+#define kNumMissKeys ((size_t) CONFIG_GARAGE_KVS_CACHE_ENTRIES + 1)
+
+static size_t numIterations;
+static size_t numErrors;
+
+/**
+ * Reads a 32 byte entry through the cache or from the store directly.
+ */
+static void Get(bool isCached, HAPPlatformKeyValueStoreKey key) {
+    uint8_t bytes[32];
+    size_t numBytes;
+    bool found;
+    HAPError err = isCached ?
+                           __wrap_HAPPlatformKeyValueStoreGet(
+                                   &fakeKeyValueStore, kDomain, key, bytes, sizeof bytes, &numBytes, &found) :
+                           __real_HAPPlatformKeyValueStoreGet(
+                                   &fakeKeyValueStore, kDomain, key, bytes, sizeof bytes, &numBytes, &found);
+    if (err || !found || numBytes != sizeof bytes) {
+        numErrors++;
+    }
+}
+
+static void GetCached(void* context HAP_UNUSED) {
+    Get(true, 0);
+}
+
+static void GetFromBackend(void* context HAP_UNUSED) {
+    Get(false, 0);
+}
+
+static void GetMiss(void* context HAP_UNUSED) {
+    Get(true, (HAPPlatformKeyValueStoreKey)(1 + numIterations++ % kNumMissKeys));
+}
+
+int main(void) {
+    FakeKeyValueStoreReset();
+    uint8_t bytes[32] = { 0 };
+    for (size_t key = 0; key <= kNumMissKeys; key++) {
+        HAPError err = __real_HAPPlatformKeyValueStoreSet(
+                &fakeKeyValueStore, kDomain, (HAPPlatformKeyValueStoreKey) key, bytes, sizeof bytes);
+        HAPAssert(!err);
+    }
+
+    BenchRun("kvs_get", 1000, GetCached, NULL);
+    BenchRun("kvs_get_backend", 1000, GetFromBackend, NULL);
+    BenchRun("kvs_get_miss", 1000, GetMiss, NULL);
+
+    KeyValueStoreCacheStats stats;
+    KeyValueStoreCacheGetStats(&stats);
+    printf("  cache: %lu hits, %lu misses, %lu evictions\n",
+           (unsigned long) stats.numHits,
+           (unsigned long) stats.numMisses,
+           (unsigned long) stats.numEvictions);
+    if (numErrors) {
+        fprintf(stderr, "%zu failed reads\n", numErrors);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Replays the key reads of HAP connections through KeyValueStoreCache against a counting in-memory store
+// (FakeKeyValueStore.h), and compares the reads that reach the store with and without the cache. Also checks that
+// writes, removals, purges, failures and evictions keep the cache consistent with the store.
+
+#include "FakeKeyValueStore.h"
+#include "KeyValueStoreCache.h"
+#include "Test.h"
+
+// Domains and keys of the accessory server (HAPPlatformKeyValueStore+Init.h of the ADK).
+#define kDomain_Provisioning  ((HAPPlatformKeyValueStoreDomain) 0x80)
+#define kDomain_Configuration ((HAPPlatformKeyValueStoreDomain) 0x90)
+#define kDomain_Pairings      ((HAPPlatformKeyValueStoreDomain) 0xA0)
+
+typedef struct {
+    HAPPlatformKeyValueStoreDomain domain;
+    HAPPlatformKeyValueStoreKey key;
+    /** Size of the stored value, 0 if the key is absent. */
+    size_t numBytes;
+} Read;
+
+/**
+ * Reads of one connection, from accepting it to the first request after Pair Verify: the setup information and
+ * software token, the long-term secret key, the pairings searched for the controller, the configuration number and
+ * the characteristic configuration.
+ */
+static const Read kConnectionReads[] = {
+    { kDomain_Provisioning, 0x00, 24 },   // Setup information.
+    { kDomain_Provisioning, 0x04, 200 },  // Software token, too large to cache.
+    { kDomain_Configuration, 0x02, 32 },  // Long-term secret key.
+    { kDomain_Pairings, 0x00, 70 },       // Admin pairing.
+    { kDomain_Pairings, 0x01, 70 },       // Second controller.
+    { kDomain_Pairings, 0x02, 0 },        // Free pairing slot.
+    { kDomain_Configuration, 0x01, 4 },   // Configuration number.
+    { kDomain_Configuration, 0x01, 4 },   // Configuration number, again for /accessories.
+    { kDomain_Configuration, 0x05, 0 },   // Characteristic configuration, never written.
+};
+
+/**
+ * Number of connections replayed, e.g. controllers reconnecting after the Wi-Fi came back.
+ */
+#define kNumConnections ((size_t) 10)
+
+static void FillValue(uint8_t* bytes, size_t numBytes, HAPPlatformKeyValueStoreDomain domain, uint8_t seed) {
+    for (size_t i = 0; i < numBytes; i++) {
+        bytes[i] = (uint8_t)(domain ^ seed ^ i);
+    }
+}
+
+static void PopulateStore(void) {
+    FakeKeyValueStoreReset();
+    for (size_t i = 0; i < HAPArrayCount(kConnectionReads); i++) {
+        const Read* read = &kConnectionReads[i];
+        if (read->numBytes) {
+            uint8_t bytes[kFakeKeyValueStore_MaxValueBytes];
+            FillValue(bytes, read->numBytes, read->domain, read->key);
+            HAPError err = __real_HAPPlatformKeyValueStoreSet(
+                    &fakeKeyValueStore, read->domain, read->key, bytes, read->numBytes);
+            HAPAssert(!err);
+        }
+    }
+}
+
+/**
+ * Replays the connections with or without the cache and checks every value.
+ *
+ * @return Number of reads that reached the store.
+ */
+static size_t ReplayConnections(bool isCached) {
+    FakeKeyValueStoreStats before;
+    FakeKeyValueStoreGetStats(&before);
+    for (size_t c = 0; c < kNumConnections; c++) {
+        for (size_t i = 0; i < HAPArrayCount(kConnectionReads); i++) {
+            const Read* read = &kConnectionReads[i];
+            uint8_t bytes[kFakeKeyValueStore_MaxValueBytes];
+            size_t numBytes = 0;
+            bool found;
+            HAPError err = (isCached ? __wrap_HAPPlatformKeyValueStoreGet : __real_HAPPlatformKeyValueStoreGet)(
+                    &fakeKeyValueStore, read->domain, read->key, bytes, sizeof bytes, &numBytes, &found);
+            TEST_CHECK(!err);
+            TEST_CHECK_EQUAL(found, read->numBytes != 0);
+            if (found) {
+                uint8_t expectedBytes[kFakeKeyValueStore_MaxValueBytes];
+                FillValue(expectedBytes, read->numBytes, read->domain, read->key);
+                TEST_CHECK_EQUAL(numBytes, read->numBytes);
+                TEST_CHECK(HAPRawBufferAreEqual(bytes, expectedBytes, read->numBytes));
+            }
+        }
+    }
+    FakeKeyValueStoreStats after;
+    FakeKeyValueStoreGetStats(&after);
+    return after.numGets - before.numGets;
+}
+
+static void CheckConnections(void) {
+    PopulateStore();
+    size_t numUncachedReads = ReplayConnections(false);
+    size_t numCachedReads = ReplayConnections(true);
+    printf("  %zu connections: %zu store reads without the cache, %zu with it\n",
+           kNumConnections,
+           numUncachedReads,
+           numCachedReads);
+
+    // Without the cache every read goes to the store. With it, each cacheable key is read once, including the
+    // absent ones. The software token is read twice per connection: once to find it is too large, once in full.
+    TEST_CHECK_EQUAL(numUncachedReads, kNumConnections * HAPArrayCount(kConnectionReads));
+    TEST_CHECK_EQUAL(numCachedReads, 7 + 2 * kNumConnections);
+
+    KeyValueStoreCacheStats stats;
+    KeyValueStoreCacheGetStats(&stats);
+    TEST_CHECK_EQUAL(stats.numUncacheable, kNumConnections);
+    TEST_CHECK_EQUAL(stats.numNegativeHits, 2 * (kNumConnections - 1));
+    TEST_CHECK_EQUAL(stats.numEvictions, 0);
+}
+
+/**
+ * Reads a key through the cache.
+ *
+ * @return Size of the value, or -1 if the key is absent.
+ */
+static long GetValue(HAPPlatformKeyValueStoreDomain domain, HAPPlatformKeyValueStoreKey key, uint8_t* firstByte) {
+    uint8_t bytes[kFakeKeyValueStore_MaxValueBytes];
+    size_t numBytes;
+    bool found;
+    HAPError err = __wrap_HAPPlatformKeyValueStoreGet(
+            &fakeKeyValueStore, domain, key, bytes, sizeof bytes, &numBytes, &found);
+    TEST_CHECK(!err);
+    if (!found) {
+        return -1;
+    }
+    *firstByte = bytes[0];
+    return (long) numBytes;
+}
+
+static void CheckWrites(void) {
+    FakeKeyValueStoreReset();
+    HAPError err = __wrap_HAPPlatformKeyValueStorePurgeDomain(&fakeKeyValueStore, kDomain_Pairings);
+    TEST_CHECK(!err);
+
+    // Set is written through and served from the cache.
+    uint8_t value = 1;
+    uint8_t firstByte = 0;
+    err = __wrap_HAPPlatformKeyValueStoreSet(&fakeKeyValueStore, kDomain_Pairings, 0x10, &value, 1);
+    TEST_CHECK(!err);
+    FakeKeyValueStoreStats before;
+    FakeKeyValueStoreGetStats(&before);
+    TEST_CHECK_EQUAL(GetValue(kDomain_Pairings, 0x10, &firstByte), 1);
+    TEST_CHECK_EQUAL(firstByte, 1);
+
+    // Remove caches the absence.
+    err = __wrap_HAPPlatformKeyValueStoreRemove(&fakeKeyValueStore, kDomain_Pairings, 0x10);
+    TEST_CHECK(!err);
+    TEST_CHECK_EQUAL(GetValue(kDomain_Pairings, 0x10, &firstByte), -1);
+    FakeKeyValueStoreStats after;
+    FakeKeyValueStoreGetStats(&after);
+    TEST_CHECK_EQUAL(after.numGets, before.numGets);
+
+    // A failed write may still have reached the store, so the value is read from the store again.
+    value = 2;
+    err = __wrap_HAPPlatformKeyValueStoreSet(&fakeKeyValueStore, kDomain_Pairings, 0x10, &value, 1);
+    TEST_CHECK(!err);
+    FakeKeyValueStoreSetFailing(true);
+    value = 3;
+    err = __wrap_HAPPlatformKeyValueStoreSet(&fakeKeyValueStore, kDomain_Pairings, 0x10, &value, 1);
+    TEST_CHECK(err);
+    FakeKeyValueStoreSetFailing(false);
+    TEST_CHECK_EQUAL(GetValue(kDomain_Pairings, 0x10, &firstByte), 1);
+    TEST_CHECK_EQUAL(firstByte, 3);
+
+    // Purging a domain drops its entries, also those of keys that the cache knew to be absent.
+    err = __real_HAPPlatformKeyValueStoreSet(&fakeKeyValueStore, kDomain_Pairings, 0x11, &value, 1);
+    TEST_CHECK(!err);
+    TEST_CHECK_EQUAL(GetValue(kDomain_Pairings, 0x11, &firstByte), 1);
+    err = __wrap_HAPPlatformKeyValueStorePurgeDomain(&fakeKeyValueStore, kDomain_Pairings);
+    TEST_CHECK(!err);
+    TEST_CHECK_EQUAL(GetValue(kDomain_Pairings, 0x10, &firstByte), -1);
+    TEST_CHECK_EQUAL(GetValue(kDomain_Pairings, 0x11, &firstByte), -1);
+}
+
+static void CheckEviction(void) {
+    FakeKeyValueStoreReset();
+    KeyValueStoreCacheStats before;
+    KeyValueStoreCacheGetStats(&before);
+
+    // One more key than the cache holds. The least recently used key is evicted, the one read in between is kept.
+    uint8_t firstByte;
+    for (size_t key = 0; key < CONFIG_GARAGE_KVS_CACHE_ENTRIES; key++) {
+        TEST_CHECK_EQUAL(GetValue(kDomain_Configuration, (HAPPlatformKeyValueStoreKey)(0x40 + key), &firstByte), -1);
+    }
+    TEST_CHECK_EQUAL(GetValue(kDomain_Configuration, 0x40, &firstByte), -1);
+    TEST_CHECK_EQUAL(GetValue(kDomain_Configuration, 0x40 + CONFIG_GARAGE_KVS_CACHE_ENTRIES, &firstByte), -1);
+
+    FakeKeyValueStoreStats stats;
+    FakeKeyValueStoreGetStats(&stats);
+    TEST_CHECK_EQUAL(GetValue(kDomain_Configuration, 0x40, &firstByte), -1);
+    TEST_CHECK_EQUAL(GetValue(kDomain_Configuration, 0x41, &firstByte), -1);
+    FakeKeyValueStoreStats after;
+    FakeKeyValueStoreGetStats(&after);
+    TEST_CHECK_EQUAL(after.numGets - stats.numGets, 1);
+
+    KeyValueStoreCacheStats cacheStats;
+    KeyValueStoreCacheGetStats(&cacheStats);
+    TEST_CHECK(cacheStats.numEvictions > before.numEvictions);
+    TEST_CHECK(cacheStats.numEntries <= cacheStats.maxEntries);
+}
+
+int main(void) {
+    CheckConnections();
+    CheckWrites();
+    CheckEviction();
+    return TEST_RESULT();
+}
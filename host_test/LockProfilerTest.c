@@ -0,0 +1,173 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Aggregation and serialization of LockProfiler with a scripted sequence of acquisitions and releases, as
+// LockProfilerWrappers.c reports them on the device.
+
+#include "LockProfiler.h"
+#include "Test.h"
+
+// Lock and task handles, only compared by address.
+static const uint8_t locks[kLockProfiler_MaxLocks + 2];
+static const uint8_t tasks[kLockProfiler_MaxBlockers + 2];
+
+#define kSite ((uintptr_t) 0x400d1234)
+
+/**
+ * Names of the tasks. The last task has been deleted.
+ */
+static const char* _Nullable GetTaskName(void* _Nullable context, const void* task) {
+    static const char* const names[] = { "hap", "door", "mqtt", "httpd" };
+    HAP_STATIC_ASSERT(HAPArrayCount(names) == HAPArrayCount(tasks) - 1, names_cover_all_but_one_task);
+
+    (*(size_t*) HAPNonnull(context))++;
+    for (size_t i = 0; i < HAPArrayCount(names); i++) {
+        if (task == &tasks[i]) {
+            return names[i];
+        }
+    }
+    return NULL;
+}
+
+static void Serialize(const LockProfiler* profiler, size_t maxLocks, char* bytes, size_t maxBytes) {
+    size_t numLookups = 0;
+    size_t numBytes;
+    HAPError err = LockProfilerSerialize(profiler, maxLocks, GetTaskName, &numLookups, bytes, maxBytes, &numBytes);
+    TEST_CHECK(!err);
+    TEST_CHECK_EQUAL(numBytes, strlen(bytes));
+    TEST_CHECK(numLookups > 0);
+}
+
+static void CheckContention(void) {
+    static LockProfiler profiler;
+    HAPRawBufferZero(&profiler, sizeof profiler);
+
+    // An uncontended acquisition, held for 100 us.
+    LockProfilerHandleAcquired(&profiler, &locks[0], kSite, &tasks[0], NULL, 0, 1000);
+    LockProfilerHandleReleased(&profiler, &locks[0], 1100);
+
+    // Task 1 waits 500 us for task 0, task 2 waits 300 us for task 1, task 1 waits 200 us for task 0 again.
+    LockProfilerHandleAcquired(&profiler, &locks[0], kSite + 4, &tasks[1], &tasks[0], 500, 2000);
+    LockProfilerHandleReleased(&profiler, &locks[0], 2050);
+    LockProfilerHandleAcquired(&profiler, &locks[0], kSite, &tasks[2], &tasks[1], 300, 3000);
+    LockProfilerHandleReleased(&profiler, &locks[0], 3010);
+    LockProfilerHandleAcquired(&profiler, &locks[0], kSite, &tasks[1], &tasks[0], 200, 4000);
+
+    // The clock wraps around while the lock is held.
+    LockProfilerHandleReleased(&profiler, &locks[0], 4000);
+    LockProfilerHandleAcquired(&profiler, &locks[0], kSite, &tasks[0], NULL, 0, UINT32_MAX - 9);
+    LockProfilerHandleReleased(&profiler, &locks[0], 10);
+
+    // Releases of untracked locks, or of locks that are not held, are ignored.
+    LockProfilerHandleReleased(&profiler, &locks[1], 5000);
+    LockProfilerHandleReleased(&profiler, &locks[0], 5000);
+
+    TEST_CHECK_EQUAL(profiler.numLocks, 1);
+    const LockProfile* profile = &profiler.locks[0];
+    TEST_CHECK(profile->lock == &locks[0]);
+    TEST_CHECK_EQUAL(profile->site, kSite);
+    TEST_CHECK(profile->firstTask == &tasks[0]);
+    TEST_CHECK_EQUAL(profile->numAcquisitions, 5);
+    TEST_CHECK_EQUAL(profile->numContended, 3);
+    TEST_CHECK_EQUAL(profile->wait.count, 3);
+    TEST_CHECK_EQUAL(profile->wait.sumUs, 1000);
+    TEST_CHECK_EQUAL(profile->wait.maxUs, 500);
+    TEST_CHECK_EQUAL(profile->hold.count, 5);
+    TEST_CHECK_EQUAL(profile->hold.sumUs, 100 + 50 + 10 + 0 + 20);
+    TEST_CHECK_EQUAL(profile->hold.maxUs, 100);
+    TEST_CHECK(!profile->isHeld);
+
+    // Wait time is blamed on the holder.
+    TEST_CHECK(profile->blockers[0].task == &tasks[0]);
+    TEST_CHECK_EQUAL(profile->blockers[0].waitUs, 700);
+    TEST_CHECK(profile->blockers[1].task == &tasks[1]);
+    TEST_CHECK_EQUAL(profile->blockers[1].waitUs, 300);
+    TEST_CHECK_EQUAL(profile->blockers[2].waitUs, 0);
+
+    char bytes[1024];
+    Serialize(&profiler, 4, bytes, sizeof bytes);
+    printf("  %s\n", bytes);
+    TEST_CHECK(strstr(bytes, "{\"tracked\":1,\"dropped\":0,\"locks\":[{"));
+    TEST_CHECK(strstr(bytes, "\"site\":\"0x400d1234\",\"firstTask\":\"hap\",\"acquisitions\":5,\"contended\":3,"));
+    TEST_CHECK(strstr(bytes, "\"waitTotalUs\":1000,"));
+    TEST_CHECK(strstr(bytes, "\"waitMax\":500,"));
+    TEST_CHECK(strstr(bytes, "\"holdMax\":100,"));
+    TEST_CHECK(strstr(bytes, "\"blockers\":[{\"task\":\"hap\",\"waitUs\":700},{\"task\":\"door\",\"waitUs\":300}]}]}"));
+}
+
+static void CheckBlockerReplacement(void) {
+    static LockProfiler profiler;
+    HAPRawBufferZero(&profiler, sizeof profiler);
+
+    // More holders than are tracked. Once the table is full, the holder with the least wait time is replaced.
+    static const struct {
+        size_t holder;
+        uint32_t waitUs;
+    } waits[] = { { 0, 300 }, { 1, 100 }, { 2, 200 }, { 3, 400 }, { 0, 50 } };
+    for (size_t i = 0; i < HAPArrayCount(waits); i++) {
+        LockProfilerHandleAcquired(
+                &profiler, &locks[0], kSite, &tasks[0], &tasks[waits[i].holder], waits[i].waitUs, (uint32_t) i * 1000);
+        LockProfilerHandleReleased(&profiler, &locks[0], (uint32_t) i * 1000 + 1);
+    }
+
+    // Tasks 0 (300 + 50), 3 (400) and 2 (200) are kept, task 1 (100) was replaced.
+    const LockProfile* profile = &profiler.locks[0];
+    uint64_t totalWaitUs = 0;
+    bool isTracked[HAPArrayCount(tasks)] = { false };
+    for (size_t i = 0; i < kLockProfiler_MaxBlockers; i++) {
+        totalWaitUs += profile->blockers[i].waitUs;
+        for (size_t t = 0; t < HAPArrayCount(tasks); t++) {
+            isTracked[t] |= profile->blockers[i].task == &tasks[t];
+        }
+    }
+    TEST_CHECK_EQUAL(totalWaitUs, 350 + 400 + 200);
+    TEST_CHECK(isTracked[0] && !isTracked[1] && isTracked[2] && isTracked[3]);
+
+    // Deleted tasks are reported as such.
+    LockProfilerHandleAcquired(&profiler, &locks[1], kSite, &tasks[4], &tasks[4], 10, 0);
+    char bytes[2048];
+    Serialize(&profiler, 4, bytes, sizeof bytes);
+    TEST_CHECK(strstr(bytes, "\"firstTask\":\"(deleted)\""));
+    TEST_CHECK(strstr(bytes, "{\"task\":\"(deleted)\",\"waitUs\":10}"));
+}
+
+static void CheckSelectionAndLimits(void) {
+    static LockProfiler profiler;
+    HAPRawBufferZero(&profiler, sizeof profiler);
+
+    // Every lock waits its index in microseconds. Locks beyond the table are dropped.
+    for (size_t i = 0; i < HAPArrayCount(locks); i++) {
+        LockProfilerHandleAcquired(&profiler, &locks[i], kSite + i, &tasks[0], &tasks[1], (uint32_t) i, 0);
+        LockProfilerHandleReleased(&profiler, &locks[i], 1);
+    }
+    TEST_CHECK_EQUAL(profiler.numLocks, kLockProfiler_MaxLocks);
+    TEST_CHECK_EQUAL(profiler.numDropped, HAPArrayCount(locks) - kLockProfiler_MaxLocks);
+
+    // Only the locks with the highest total wait time are serialized, worst first.
+    char bytes[4096];
+    Serialize(&profiler, 2, bytes, sizeof bytes);
+    TEST_CHECK(strstr(bytes, "{\"tracked\":16,\"dropped\":2,\"locks\":["));
+    const char* first = strstr(bytes, "\"waitTotalUs\":15,");
+    const char* second = strstr(bytes, "\"waitTotalUs\":14,");
+    TEST_CHECK(first && second && first < second);
+    TEST_CHECK(!strstr(bytes, "\"waitTotalUs\":13,"));
+
+    // A buffer that is too small is reported, also when it is cut off within the first lock.
+    size_t numBytes = strlen(bytes);
+    for (size_t maxBytes = 1; maxBytes <= numBytes; maxBytes += 7) {
+        size_t numLookups = 0;
+        size_t n;
+        HAPError err = LockProfilerSerialize(&profiler, 2, GetTaskName, &numLookups, bytes, maxBytes, &n);
+        TEST_CHECK_EQUAL(err, kHAPError_OutOfResources);
+    }
+}
+
+int main(void) {
+    CheckContention();
+    CheckBlockerReplacement();
+    CheckSelectionAndLimits();
+    return TEST_RESULT();
+}
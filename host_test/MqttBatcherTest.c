@@ -0,0 +1,186 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Batching and offline queue of the MQTT bridge (MqttBatcher.h) against a client that records what it publishes and
+// can be made to reject messages, like esp-mqtt when its outbox is full.
+
+#include "MqttBatcher.h"
+#include "Test.h"
+
+/**
+ * Offline queue length, small enough to overflow.
+ */
+#define kQueueLength ((size_t) 3)
+
+#define kMaxMessages ((size_t) 64)
+
+static struct {
+    bool isRejecting;
+
+    /** Number of messages to accept before rejecting, if isRejecting. */
+    size_t numAccepted;
+
+    struct {
+        MqttBatcherTopic topic;
+        char bytes[kMqttBatcher_MaxBatchBytes + 1];
+    } messages[kMaxMessages];
+    size_t numMessages;
+} client;
+
+static bool Publish(void* _Nullable context HAP_UNUSED, MqttBatcherTopic topic, const char* bytes, size_t numBytes) {
+    HAPAssert(numBytes <= kMqttBatcher_MaxBatchBytes);
+    if (client.isRejecting) {
+        if (!client.numAccepted) {
+            return false;
+        }
+        client.numAccepted--;
+    }
+    HAPAssert(client.numMessages < kMaxMessages);
+    client.messages[client.numMessages].topic = topic;
+    HAPRawBufferCopyBytes(client.messages[client.numMessages].bytes, bytes, numBytes);
+    client.messages[client.numMessages].bytes[numBytes] = '\0';
+    client.numMessages++;
+    return true;
+}
+
+static MqttBatcher batcher;
+static MqttBatch queueBatches[kQueueLength];
+
+static void Reset(void) {
+    HAPRawBufferZero(&client, sizeof client);
+    MqttBatcherCreate(&batcher, queueBatches, HAPArrayCount(queueBatches), Publish, NULL);
+}
+
+static void CheckMessage(size_t index, MqttBatcherTopic topic, const char* bytes) {
+    TEST_CHECK(index < client.numMessages);
+    if (index < client.numMessages) {
+        TEST_CHECK_EQUAL(client.messages[index].topic, topic);
+        if (strcmp(client.messages[index].bytes, bytes) != 0) {
+            fprintf(stderr, "  message %zu: %s, expected %s\n", index, client.messages[index].bytes, bytes);
+            TEST_CHECK(false);
+        }
+    }
+}
+
+static void CheckBatchWindow(void) {
+    Reset();
+    MqttBatcherHandleConnected(&batcher, 1, 1);
+    CheckMessage(0, kMqttBatcherTopic_State, "{\"currentDoorState\":1,\"targetDoorState\":1}");
+
+    // State changes are coalesced, events are batched.
+    MqttBatcherHandleCommand(&batcher, 1000, "hap", 0);
+    MqttBatcherHandleDoorStateChanged(&batcher, 1, 0);
+    MqttBatcherHandleDoorStateChanged(&batcher, 2, 0);
+    MqttBatcherHandleCommand(&batcher, 1200, "mqtt", 1);
+    TEST_CHECK_EQUAL(client.numMessages, 1);
+    MqttBatcherFlush(&batcher);
+    TEST_CHECK_EQUAL(client.numMessages, 3);
+    CheckMessage(1, kMqttBatcherTopic_State, "{\"currentDoorState\":2,\"targetDoorState\":0}");
+    CheckMessage(
+            2,
+            kMqttBatcherTopic_Events,
+            "[{\"t\":1000,\"source\":\"hap\",\"targetDoorState\":0},"
+            "{\"t\":1200,\"source\":\"mqtt\",\"targetDoorState\":1}]");
+
+    // Nothing to publish.
+    MqttBatcherFlush(&batcher);
+    TEST_CHECK_EQUAL(client.numMessages, 3);
+}
+
+static void CheckFullBatch(void) {
+    Reset();
+    MqttBatcherHandleConnected(&batcher, 1, 1);
+
+    // A full batch is published before the event that does not fit. Every event arrives exactly once and in order.
+    size_t numEvents = 20;
+    for (size_t i = 0; i < numEvents; i++) {
+        MqttBatcherHandleCommand(&batcher, (int64_t) i, "local", (uint8_t)(i % 2));
+    }
+    MqttBatcherFlush(&batcher);
+    TEST_CHECK(client.numMessages > 2);
+
+    size_t numFound = 0;
+    for (size_t m = 1; m < client.numMessages; m++) {
+        const char* bytes = client.messages[m].bytes;
+        size_t numBytes = strlen(bytes);
+        TEST_CHECK_EQUAL(client.messages[m].topic, kMqttBatcherTopic_Events);
+        TEST_CHECK(numBytes <= kMqttBatcher_MaxBatchBytes);
+        TEST_CHECK(bytes[0] == '[' && bytes[numBytes - 1] == ']');
+        for (const char* event = strstr(bytes, "{\"t\":"); event; event = strstr(event + 1, "{\"t\":")) {
+            TEST_CHECK_EQUAL(strtol(event + 5, NULL, 10), numFound);
+            numFound++;
+        }
+    }
+    TEST_CHECK_EQUAL(numFound, numEvents);
+}
+
+static void CheckOfflineQueue(void) {
+    Reset();
+
+    // While disconnected, the state stays pending and batches are queued, the oldest dropped first.
+    for (size_t i = 0; i < kQueueLength + 2; i++) {
+        MqttBatcherHandleCommand(&batcher, (int64_t) i, "hap", 0);
+        MqttBatcherHandleDoorStateChanged(&batcher, 0, 0);
+        MqttBatcherFlush(&batcher);
+    }
+    TEST_CHECK_EQUAL(client.numMessages, 0);
+    TEST_CHECK_EQUAL(batcher.queue.count, kQueueLength);
+    TEST_CHECK_EQUAL(batcher.queue.numDropped, 2);
+
+    // On reconnect the current state goes out first and supersedes the pending change, then the queued batches.
+    MqttBatcherHandleConnected(&batcher, 3, 1);
+    TEST_CHECK_EQUAL(client.numMessages, 1 + kQueueLength);
+    CheckMessage(0, kMqttBatcherTopic_State, "{\"currentDoorState\":3,\"targetDoorState\":1}");
+    CheckMessage(1, kMqttBatcherTopic_Events, "[{\"t\":2,\"source\":\"hap\",\"targetDoorState\":0}]");
+    CheckMessage(3, kMqttBatcherTopic_Events, "[{\"t\":4,\"source\":\"hap\",\"targetDoorState\":0}]");
+    TEST_CHECK_EQUAL(batcher.queue.count, 0);
+    MqttBatcherFlush(&batcher);
+    TEST_CHECK_EQUAL(client.numMessages, 1 + kQueueLength);
+
+    // After a disconnect, changes are held back again.
+    MqttBatcherHandleDisconnected(&batcher);
+    MqttBatcherHandleCommand(&batcher, 5, "hap", 1);
+    MqttBatcherFlush(&batcher);
+    TEST_CHECK_EQUAL(client.numMessages, 1 + kQueueLength);
+    TEST_CHECK_EQUAL(batcher.queue.count, 1);
+}
+
+static void CheckRejectedPublish(void) {
+    Reset();
+    MqttBatcherHandleConnected(&batcher, 1, 1);
+
+    // Batches that the client rejects while connected are queued as well.
+    client.isRejecting = true;
+    MqttBatcherHandleCommand(&batcher, 1, "hap", 0);
+    MqttBatcherFlush(&batcher);
+    MqttBatcherHandleCommand(&batcher, 2, "hap", 1);
+    MqttBatcherFlush(&batcher);
+    TEST_CHECK_EQUAL(client.numMessages, 1);
+    TEST_CHECK_EQUAL(batcher.queue.count, 2);
+
+    // Draining stops at the first rejected batch, which stays queued with the ones after it.
+    MqttBatcherHandleDisconnected(&batcher);
+    client.numAccepted = 2;
+    MqttBatcherHandleConnected(&batcher, 1, 0);
+    TEST_CHECK_EQUAL(client.numMessages, 3);
+    CheckMessage(2, kMqttBatcherTopic_Events, "[{\"t\":1,\"source\":\"hap\",\"targetDoorState\":0}]");
+    TEST_CHECK_EQUAL(batcher.queue.count, 1);
+
+    client.isRejecting = false;
+    MqttBatcherHandleDisconnected(&batcher);
+    MqttBatcherHandleConnected(&batcher, 1, 0);
+    CheckMessage(4, kMqttBatcherTopic_Events, "[{\"t\":2,\"source\":\"hap\",\"targetDoorState\":1}]");
+    TEST_CHECK_EQUAL(batcher.queue.count, 0);
+    TEST_CHECK_EQUAL(batcher.queue.numDropped, 0);
+}
+
+int main(void) {
+    CheckBatchWindow();
+    CheckFullBatch();
+    CheckOfflineQueue();
+    CheckRejectedPublish();
+    return TEST_RESULT();
+}
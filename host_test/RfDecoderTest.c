@@ -0,0 +1,183 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Replays 433 MHz remote transmissions through the RfDecoder, split into captures as the RMT receiver does.
+//
+//   RfDecoderTest                Checks synthetic transmissions over the range of unit times.
+//   RfDecoderTest <file>         Also replays a recorded capture, one "<level> <duration in us>" per line with a
+//                                duration of 0 at the end of each capture (as in the RMT items), and prints the codes.
+
+#include "RfDecoder.h"
+#include "Test.h"
+
+// RfReceiver.c.
+#define kIdleThresholdUs ((uint32_t) 8000)
+
+/**
+ * Receivers stretch the high levels and shorten the low levels by about this much.
+ */
+#define kDistortionUs ((uint32_t) 40)
+
+#define kCode ((uint32_t) 0xA5C3E1)
+
+typedef struct {
+    RfDecoder decoder;
+    uint32_t seed;
+    uint32_t jitterPercent;
+
+    size_t numCodes;
+    RfCode code;
+} Receiver;
+
+static uint32_t Jitter(Receiver* receiver, uint32_t durationUs) {
+    if (!receiver->jitterPercent) {
+        return durationUs;
+    }
+    receiver->seed = receiver->seed * 1103515245 + 12345;
+    int32_t percent = (int32_t)((receiver->seed >> 16) % (2 * receiver->jitterPercent + 1)) -
+                      (int32_t) receiver->jitterPercent;
+    return (uint32_t)((int64_t) durationUs * (100 + percent) / 100);
+}
+
+static void Feed(Receiver* receiver, bool level, uint32_t durationUs) {
+    RfCode code;
+    if (RfDecoderFeed(&receiver->decoder, level, durationUs, &code)) {
+        receiver->numCodes++;
+        receiver->code = code;
+    }
+}
+
+/**
+ * Sends a level through the receiver. A low level of the idle threshold or longer ends the capture.
+ */
+static void Send(Receiver* receiver, bool level, uint32_t durationUs) {
+    durationUs = Jitter(receiver, durationUs);
+    if (level) {
+        Feed(receiver, true, durationUs + kDistortionUs);
+        return;
+    }
+    durationUs = durationUs > kDistortionUs ? durationUs - kDistortionUs : 1;
+    Feed(receiver, false, durationUs >= kIdleThresholdUs ? kRfDecoder_EndOfCaptureUs : durationUs);
+}
+
+static void SendSync(Receiver* receiver, uint32_t unitUs) {
+    Send(receiver, true, unitUs);
+    Send(receiver, false, 31 * unitUs);
+}
+
+static void SendFrame(Receiver* receiver, uint32_t code, uint32_t unitUs) {
+    for (int i = kRfDecoder_NumBits - 1; i >= 0; i--) {
+        bool bit = code >> i & 1;
+        Send(receiver, true, (bit ? 3 : 1) * unitUs);
+        Send(receiver, false, (bit ? 1 : 3) * unitUs);
+    }
+    SendSync(receiver, unitUs);
+}
+
+static void Create(Receiver* receiver, uint32_t jitterPercent) {
+    HAPRawBufferZero(receiver, sizeof *receiver);
+    RfDecoderReset(&receiver->decoder);
+    receiver->seed = 1;
+    receiver->jitterPercent = jitterPercent;
+}
+
+/**
+ * A button press: the frame repeated while the button is held, and the line idle afterwards.
+ */
+static void CheckPress(uint32_t unitUs, uint32_t jitterPercent) {
+    Receiver receiver;
+    Create(&receiver, jitterPercent);
+    SendSync(&receiver, unitUs);
+    for (int i = 0; i < 4; i++) {
+        SendFrame(&receiver, kCode, unitUs);
+    }
+    Feed(&receiver, false, kRfDecoder_EndOfCaptureUs);
+
+    if (!receiver.numCodes || receiver.code.code != kCode) {
+        fprintf(stderr, "T = %lu us, jitter %lu%%: not decoded\n", (unsigned long) unitUs, (unsigned long) jitterPercent);
+        numFailedChecks++;
+        return;
+    }
+    // Without jitter, every frame after the first agrees with its predecessor.
+    TEST_CHECK(jitterPercent || receiver.numCodes == 3);
+    uint32_t measuredUs = receiver.code.unitUs;
+    TEST_CHECK(measuredUs + unitUs / 4 >= unitUs && measuredUs <= unitUs + unitUs / 4 + kDistortionUs);
+}
+
+static void CheckSingleFrame(uint32_t unitUs) {
+    Receiver receiver;
+    Create(&receiver, 0);
+    SendSync(&receiver, unitUs);
+    SendFrame(&receiver, kCode, unitUs);
+    Feed(&receiver, false, kRfDecoder_EndOfCaptureUs);
+    TEST_CHECK_EQUAL(receiver.numCodes, (size_t) 0);
+}
+
+static void CheckDisagreeingFrames(uint32_t unitUs) {
+    Receiver receiver;
+    Create(&receiver, 0);
+    SendSync(&receiver, unitUs);
+    SendFrame(&receiver, kCode, unitUs);
+    SendFrame(&receiver, kCode ^ 0x10, unitUs);
+    SendFrame(&receiver, kCode, unitUs);
+    TEST_CHECK_EQUAL(receiver.numCodes, (size_t) 0);
+}
+
+static void CheckNoise(uint32_t unitUs) {
+    Receiver receiver;
+    Create(&receiver, 0);
+    // Receiver noise while no remote is sending: short pulses without a usable sync.
+    for (uint32_t i = 0; i < 200; i++) {
+        Send(&receiver, true, 30 + i * 7 % 300);
+        Send(&receiver, false, 50 + i * 13 % 900);
+    }
+    TEST_CHECK_EQUAL(receiver.numCodes, (size_t) 0);
+    SendSync(&receiver, unitUs);
+    SendFrame(&receiver, kCode, unitUs);
+    SendFrame(&receiver, kCode, unitUs);
+    TEST_CHECK_EQUAL(receiver.numCodes, (size_t) 1);
+    TEST_CHECK_EQUAL(receiver.code.code, kCode);
+}
+
+static void ReplayFile(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        numFailedChecks++;
+        return;
+    }
+    RfDecoder decoder;
+    RfDecoderReset(&decoder);
+    unsigned level;
+    unsigned long durationUs;
+    size_t numCodes = 0;
+    while (fscanf(file, "%u %lu", &level, &durationUs) == 2) {
+        RfCode code;
+        if (RfDecoderFeed(&decoder, level, durationUs ? (uint32_t) durationUs : kRfDecoder_EndOfCaptureUs, &code)) {
+            printf("  %s: code 0x%06lx, T = %u us\n", path, (unsigned long) code.code, code.unitUs);
+            numCodes++;
+        }
+    }
+    fclose(file);
+    printf("  %s: %zu codes\n", path, numCodes);
+}
+
+int main(int argc, char* argv[]) {
+    // The documented range of remotes and the limits of the decoder.
+    static const uint32_t unitTimes[] = { 150, 200, 250, 300, 350, 400, 450, 500, 600, 800, 900 };
+    for (size_t i = 0; i < HAPArrayCount(unitTimes); i++) {
+        CheckPress(unitTimes[i], 0);
+        CheckPress(unitTimes[i], 10);
+        CheckSingleFrame(unitTimes[i]);
+        CheckDisagreeingFrames(unitTimes[i]);
+        CheckNoise(unitTimes[i]);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        ReplayFile(argv[i]);
+    }
+    return TEST_RESULT();
+}
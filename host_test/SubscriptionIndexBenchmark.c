@@ -0,0 +1,155 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Event fan-out on the host, with the workload of event_fanout_index and event_fanout_scan of the on-device suite
+// (Benchmark.h): one of 100 characteristics changes, with GARAGE_HAP_SESSIONS synthetic sessions. One session is
+// subscribed to everything, the others to a quarter of the characteristics.
+//
+//   event_fanout_index        Finding the subscribers in the subscription index (SubscriptionIndex.h).
+//   event_fanout_scan         Searching the event notification table of every session, as
+//                             HAPAccessoryServerRaiseEvent does.
+//   event_fanout_{index,scan}_s<sessions>_c<count>
+//                             Both swept over 1, 2, 4 and GARAGE_HAP_SESSIONS sessions and 10, 30 and 100
+//                             characteristics.
+
+#include "SubscriptionIndex.h"
+#include "Bench.h"
+
+/**
+ * Number of characteristics, similar to a bridge with a few dozen accessories.
+ */
+#define kNumCharacteristics ((size_t) 100)
+
+/**
+ * Points of the sweep, as in Benchmark.c.
+ */
+static const size_t kSessionCounts[] = { 1, 2, 4, CONFIG_GARAGE_HAP_SESSIONS };
+static const size_t kCharacteristicCounts[] = { 10, 30, kNumCharacteristics };
+
+/**
+ * Synthetic database and sessions. Characteristics and sessions are only compared by address, never accessed.
+ */
+static struct {
+    /** Sessions and characteristics in use. */
+    size_t numSessions;
+    size_t numCharacteristics;
+
+    uint8_t characteristics[kNumCharacteristics];
+    uint64_t sessions[CONFIG_GARAGE_HAP_SESSIONS];
+
+    /** Per session, the subscribed characteristics, like the event notification table of a HAP session. */
+    const HAPCharacteristic* subscriptions[CONFIG_GARAGE_HAP_SESSIONS][kNumCharacteristics];
+    size_t numSubscriptions[CONFIG_GARAGE_HAP_SESSIONS];
+
+    SubscriptionIndexEntry entries[kNumCharacteristics];
+    SubscriptionIndexTable table;
+
+    size_t numIterations;
+    size_t numErrors;
+} fanout;
+
+// The accessory's own index is not used.
+void HAPAccessoryServerRaiseEvent(
+        HAPAccessoryServerRef* server HAP_UNUSED,
+        const HAPCharacteristic* characteristic HAP_UNUSED,
+        const HAPService* service HAP_UNUSED,
+        const HAPAccessory* accessory HAP_UNUSED) {
+    HAPFatalError();
+}
+
+void HAPAccessoryServerRaiseEventOnSession(
+        HAPAccessoryServerRef* server HAP_UNUSED,
+        const HAPCharacteristic* characteristic HAP_UNUSED,
+        const HAPService* service HAP_UNUSED,
+        const HAPAccessory* accessory HAP_UNUSED,
+        const HAPSessionRef* session HAP_UNUSED) {
+    HAPFatalError();
+}
+
+static bool IsSubscribed(size_t session, size_t characteristic) {
+    return session == 0 || (session + characteristic) % 4 == 0;
+}
+
+static size_t GetNumSubscribers(size_t characteristic) {
+    size_t numSubscribers = 0;
+    for (size_t s = 0; s < fanout.numSessions; s++) {
+        numSubscribers += IsSubscribed(s, characteristic);
+    }
+    return numSubscribers;
+}
+
+static void Prepare(size_t numSessions, size_t numCharacteristics) {
+    size_t numErrors = fanout.numErrors;
+    HAPRawBufferZero(&fanout, sizeof fanout);
+    fanout.numErrors = numErrors;
+    fanout.numSessions = numSessions;
+    fanout.numCharacteristics = numCharacteristics;
+    fanout.table.entries = fanout.entries;
+    fanout.table.maxEntries = HAPArrayCount(fanout.entries);
+    for (size_t c = 0; c < numCharacteristics; c++) {
+        for (size_t s = 0; s < numSessions; s++) {
+            if (IsSubscribed(s, c)) {
+                fanout.subscriptions[s][fanout.numSubscriptions[s]++] = &fanout.characteristics[c];
+                SubscriptionIndexTableSubscribe(
+                        &fanout.table, &fanout.characteristics[c], (HAPSessionRef*) &fanout.sessions[s]);
+            }
+        }
+    }
+}
+
+static void CountDelivery(void* _Nullable context, HAPSessionRef* session HAP_UNUSED) {
+    (*(size_t*) HAPNonnull(context))++;
+}
+
+static void RaiseEventIndexed(void* context HAP_UNUSED) {
+    size_t index = fanout.numIterations++ % fanout.numCharacteristics;
+    size_t numDeliveries = 0;
+    bool isIndexed = SubscriptionIndexTableEnumerate(
+            &fanout.table, &fanout.characteristics[index], CountDelivery, &numDeliveries);
+    if (!isIndexed || numDeliveries != GetNumSubscribers(index)) {
+        fanout.numErrors++;
+    }
+}
+
+static void RaiseEventScan(void* context HAP_UNUSED) {
+    size_t index = fanout.numIterations++ % fanout.numCharacteristics;
+    const HAPCharacteristic* characteristic = &fanout.characteristics[index];
+    size_t numDeliveries = 0;
+    for (size_t s = 0; s < fanout.numSessions; s++) {
+        for (size_t i = 0; i < fanout.numSubscriptions[s]; i++) {
+            if (fanout.subscriptions[s][i] == characteristic) {
+                CountDelivery(&numDeliveries, (HAPSessionRef*) &fanout.sessions[s]);
+                break;
+            }
+        }
+    }
+    if (numDeliveries != GetNumSubscribers(index)) {
+        fanout.numErrors++;
+    }
+}
+
+int main(void) {
+    Prepare(CONFIG_GARAGE_HAP_SESSIONS, kNumCharacteristics);
+    BenchRun("event_fanout_index", kNumCharacteristics, RaiseEventIndexed, NULL);
+    BenchRun("event_fanout_scan", kNumCharacteristics, RaiseEventScan, NULL);
+
+    for (size_t i = 0; i < HAPArrayCount(kSessionCounts); i++) {
+        for (size_t j = 0; j < HAPArrayCount(kCharacteristicCounts); j++) {
+            Prepare(kSessionCounts[i], kCharacteristicCounts[j]);
+            char name[48];
+            snprintf(name, sizeof name, "event_fanout_index_s%zu_c%zu", kSessionCounts[i], kCharacteristicCounts[j]);
+            BenchRun(name, kCharacteristicCounts[j], RaiseEventIndexed, NULL);
+            snprintf(name, sizeof name, "event_fanout_scan_s%zu_c%zu", kSessionCounts[i], kCharacteristicCounts[j]);
+            BenchRun(name, kCharacteristicCounts[j], RaiseEventScan, NULL);
+        }
+    }
+
+    if (fanout.numErrors) {
+        fprintf(stderr, "%zu wrong deliveries\n", fanout.numErrors);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
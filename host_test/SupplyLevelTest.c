@@ -0,0 +1,124 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Replays supply voltage traces through the SupplyLevel classifier.
+//
+//   SupplyLevelTest              Checks the built-in traces.
+//   SupplyLevelTest <file>       Also replays a recorded trace, one averaged voltage in millivolts per line, and
+//                                prints the level changes.
+
+#include "SupplyLevel.h"
+#include "Test.h"
+
+// Kconfig defaults.
+#define kLowMV        ((uint32_t) 11500)
+#define kCriticalMV   ((uint32_t) 10800)
+#define kHysteresisMV ((uint32_t) 300)
+
+#define N kSupplyLevel_Normal
+#define L kSupplyLevel_Low
+#define C kSupplyLevel_Critical
+
+typedef struct {
+    uint32_t supplyMV;
+    SupplyLevel level;
+} TracePoint;
+
+/**
+ * Sag of a car socket supply while cranking, and a slow recovery that hovers around the thresholds.
+ */
+static const TracePoint kCrankingTrace[] = {
+    // Resting, then dropping through both thresholds. Levels drop right away, thresholds are exclusive.
+    { 12600, N },
+    { 12400, N },
+    { 11600, N },
+    { 11500, N },
+    { 11499, L },
+    { 11300, L },
+    { 10900, L },
+    { 10800, L },
+    { 10799, C },
+    { 10200, C },
+    // Recovering from critical needs the critical threshold plus the hysteresis.
+    { 10500, C },
+    { 11000, C },
+    { 11099, C },
+    { 11100, L },
+    // Recovering from low needs the low threshold plus the hysteresis.
+    { 11500, L },
+    { 11799, L },
+    { 11600, L },
+    { 11450, L },
+    { 11800, N },
+    // Hovering just above the low threshold does not toggle.
+    { 11700, N },
+    { 11520, N },
+    { 11480, L },
+    { 11790, L },
+    { 11810, N },
+    { 12600, N },
+};
+
+/**
+ * Sags straight to critical, recovering past both thresholds at once or only past the critical one.
+ */
+static const TracePoint kBrownOutTrace[] = {
+    { 12600, N }, { 10500, C }, { 12000, N }, { 10500, C }, { 11500, L }, { 11799, L }, { 11800, N },
+    { 10000, C }, { 11100, L }, { 10799, C }, { 11799, L }, { 0, C },     { 12000, N },
+};
+
+static void Replay(const char* name, const TracePoint* trace, size_t numPoints) {
+    SupplyLevelClassifier classifier;
+    SupplyLevelClassifierCreate(&classifier, kLowMV, kCriticalMV, kHysteresisMV);
+    SupplyLevel previousLevel = classifier.level;
+    for (size_t i = 0; i < numPoints; i++) {
+        bool isChanged = SupplyLevelClassifierFeed(&classifier, trace[i].supplyMV);
+        if (classifier.level != trace[i].level) {
+            fprintf(stderr,
+                    "%s[%zu]: %lu mV classified %s instead of %s.\n",
+                    name,
+                    i,
+                    (unsigned long) trace[i].supplyMV,
+                    SupplyLevelGetName(classifier.level),
+                    SupplyLevelGetName(trace[i].level));
+            numFailedChecks++;
+        }
+        TEST_CHECK_EQUAL(isChanged, classifier.level != previousLevel);
+        previousLevel = classifier.level;
+    }
+}
+
+static void ReplayFile(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        numFailedChecks++;
+        return;
+    }
+    SupplyLevelClassifier classifier;
+    SupplyLevelClassifierCreate(&classifier, kLowMV, kCriticalMV, kHysteresisMV);
+    size_t numSamples = 0;
+    size_t numChanges = 0;
+    unsigned long supplyMV;
+    while (fscanf(file, "%lu", &supplyMV) == 1) {
+        if (SupplyLevelClassifierFeed(&classifier, (uint32_t) supplyMV)) {
+            printf("  %zu: %lu mV, %s\n", numSamples, supplyMV, SupplyLevelGetName(classifier.level));
+            numChanges++;
+        }
+        numSamples++;
+    }
+    fclose(file);
+    printf("  %s: %zu samples, %zu level changes\n", path, numSamples, numChanges);
+}
+
+int main(int argc, char** argv) {
+    Replay("cranking", kCrankingTrace, HAPArrayCount(kCrankingTrace));
+    Replay("brown-out", kBrownOutTrace, HAPArrayCount(kBrownOutTrace));
+    for (int i = 1; i < argc; i++) {
+        ReplayFile(argv[i]);
+    }
+    return TEST_RESULT();
+}
@@ -0,0 +1,84 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Telemetry codec on the host, with the workload of telemetry_append and telemetry_decode of the on-device suite
+// (Benchmark.h).
+//
+//   telemetry_append          Appending a sample with two integer and two float columns, including the occasional
+//                             merge of old blocks.
+//   telemetry_decode          Decoding a full block of such samples.
+
+#include "TelemetryStore.h"
+#include "Bench.h"
+
+static const TelemetryColumnType kColumnTypes[] = {
+    kTelemetryColumnType_Int,
+    kTelemetryColumnType_Int,
+    kTelemetryColumnType_Float,
+    kTelemetryColumnType_Float,
+};
+
+static struct {
+    TelemetryStore store;
+    TelemetryBlock blocks[4];
+    uint8_t order[4];
+    uint32_t numSamples;
+
+    /** Copy of a full block. */
+    TelemetryBlock block;
+    size_t numErrors;
+} telemetry;
+
+static void AppendSample(void* context HAP_UNUSED) {
+    // Like the sampler: a steady interval with jitter, slowly changing integers and floats.
+    uint32_t i = telemetry.numSamples++;
+    TelemetryValue values[HAPArrayCount(kColumnTypes)];
+    values[0].intValue = (int32_t)(i % 50);
+    values[1].intValue = -(int32_t)(i * 1237);
+    values[2].floatValue = 20.0f + (float) (i % 40) * 0.125f;
+    values[3].floatValue = i % 10 < 5 ? 3.3f : -1.0e6f / (float) (i + 1);
+    TelemetryStoreAppend(&telemetry.store, i * 10000 + i % 7, values);
+}
+
+static void CountSample(
+        void* _Nullable context,
+        uint32_t time HAP_UNUSED,
+        const TelemetryValue* values HAP_UNUSED,
+        uint8_t level HAP_UNUSED,
+        bool* shouldContinue HAP_UNUSED) {
+    (*(size_t*) HAPNonnull(context))++;
+}
+
+static void DecodeBlock(void* context HAP_UNUSED) {
+    size_t numSamples = 0;
+    TelemetryBlockEnumerateSamples(
+            &telemetry.block, kColumnTypes, HAPArrayCount(kColumnTypes), CountSample, &numSamples);
+    if (numSamples != telemetry.block.numSamples) {
+        telemetry.numErrors++;
+    }
+}
+
+int main(void) {
+    TelemetryStoreCreate(
+            &telemetry.store,
+            kColumnTypes,
+            HAPArrayCount(kColumnTypes),
+            telemetry.blocks,
+            telemetry.order,
+            HAPArrayCount(telemetry.blocks));
+    BenchRun("telemetry_append", 1000, AppendSample, NULL);
+
+    // The newest block is only partially filled, the one before it is full.
+    telemetry.block = *HAPNonnull(TelemetryStoreGetBlock(&telemetry.store, telemetry.store.numUsedBlocks - 2));
+    BenchRun("telemetry_decode", 100, DecodeBlock, NULL);
+    printf("  %u samples per block\n", (unsigned) telemetry.block.numSamples);
+
+    if (telemetry.numErrors) {
+        fprintf(stderr, "%zu decoding errors\n", telemetry.numErrors);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
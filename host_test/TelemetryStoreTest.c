@@ -0,0 +1,177 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Round trip and merging of TelemetryStore with both column types.
+
+#include "TelemetryStore.h"
+#include "Test.h"
+
+#include <limits.h>
+
+static const TelemetryColumnType kColumnTypes[] = {
+    kTelemetryColumnType_Int,
+    kTelemetryColumnType_Int,
+    kTelemetryColumnType_Float,
+    kTelemetryColumnType_Float,
+};
+#define kNumColumns HAPArrayCount(kColumnTypes)
+
+/**
+ * Timestamp of the i-th sample: a steady 10 s interval with some jitter and a gap of a day.
+ */
+static uint32_t GetTime(size_t i) {
+    uint32_t time = 1000000 + (uint32_t) i * 10000;
+    if (i % 17 == 5) {
+        time += 37;
+    }
+    if (i >= 300) {
+        time += 86400000;
+    }
+    return time;
+}
+
+/**
+ * Values of the sample at a timestamp. Derived from the timestamp only, so decimated samples can be checked too.
+ */
+static void GetValues(uint32_t time, TelemetryValue* values) {
+    uint32_t t = time / 10000;
+
+    // Small deltas, zero deltas and jumps across the whole range.
+    values[0].intValue = (int32_t)(t % 50 < 25 ? t % 50 : 7);
+    values[1].intValue = t % 23 == 0 ? INT32_MIN : t % 23 == 1 ? INT32_MAX : -(int32_t)(t * 1237);
+
+    // Values that reuse the XOR window, repeat, or need a new window.
+    values[2].floatValue = 20.0f + (float) (t % 40) * 0.125f;
+    values[3].floatValue = t % 10 < 5 ? 3.3f : -1.0e6f / (float) (t + 1);
+}
+
+typedef struct {
+    size_t numSamples;
+    size_t numMismatches;
+    uint32_t previousTime;
+    uint8_t previousLevel;
+
+    /** Expected timestamps in order, or NULL if samples may have been decimated. */
+    const uint32_t* _Nullable times;
+} Decoded;
+
+static void CheckSample(
+        void* _Nullable context,
+        uint32_t time,
+        const TelemetryValue* values,
+        uint8_t level,
+        bool* shouldContinue HAP_UNUSED) {
+    Decoded* decoded = context;
+
+    if (decoded->times) {
+        TEST_CHECK_EQUAL(time, decoded->times[decoded->numSamples]);
+    } else if (decoded->numSamples) {
+        // Oldest first, and resolution never increases with age.
+        TEST_CHECK(time > decoded->previousTime);
+        TEST_CHECK(level <= decoded->previousLevel);
+    }
+    decoded->previousTime = time;
+    decoded->previousLevel = level;
+    decoded->numSamples++;
+
+    TelemetryValue expected[kNumColumns];
+    GetValues(time, expected);
+    // Floats must survive bit for bit.
+    if (memcmp(values, expected, sizeof expected) != 0) {
+        decoded->numMismatches++;
+    }
+}
+
+static void CountSealedBlock(void* _Nullable context, const TelemetryBlock* block) {
+    size_t* numSealedBlocks = context;
+    (*numSealedBlocks)++;
+    TEST_CHECK(block->numSamples > 0);
+}
+
+static void TestRoundTrip(void) {
+    static TelemetryBlock blocks[64];
+    static uint8_t order[HAPArrayCount(blocks)];
+    TelemetryStore store;
+    TelemetryStoreCreate(&store, kColumnTypes, kNumColumns, blocks, order, HAPArrayCount(blocks));
+    size_t numSealedBlocks = 0;
+    TelemetryStoreSetBlockSealedCallback(&store, CountSealedBlock, &numSealedBlocks);
+
+    uint32_t times[600];
+    for (size_t i = 0; i < HAPArrayCount(times); i++) {
+        times[i] = GetTime(i);
+        TelemetryValue values[kNumColumns];
+        GetValues(times[i], values);
+        TelemetryStoreAppend(&store, times[i], values);
+    }
+
+    Decoded decoded = { .times = times };
+    TelemetryStoreEnumerateSamples(&store, CheckSample, &decoded);
+    TEST_CHECK_EQUAL(decoded.numSamples, HAPArrayCount(times));
+    TEST_CHECK_EQUAL(decoded.numMismatches, 0);
+    TEST_CHECK_EQUAL(store.numDroppedSamples, 0);
+    TEST_CHECK(store.numUsedBlocks > 1);
+    TEST_CHECK_EQUAL(numSealedBlocks, store.numUsedBlocks - 1);
+
+    // Every block decodes on its own, also from a copy.
+    size_t numSamples = 0;
+    for (size_t age = 0; age < store.numUsedBlocks; age++) {
+        TelemetryBlock copy = *TelemetryStoreGetBlock(&store, age);
+        TEST_CHECK_EQUAL(copy.level, 0);
+        Decoded block = { .times = &times[numSamples] };
+        TEST_CHECK(TelemetryBlockEnumerateSamples(&copy, kColumnTypes, kNumColumns, CheckSample, &block));
+        TEST_CHECK_EQUAL(block.numSamples, copy.numSamples);
+        TEST_CHECK_EQUAL(block.numMismatches, 0);
+        numSamples += block.numSamples;
+    }
+    TEST_CHECK_EQUAL(numSamples, HAPArrayCount(times));
+
+    size_t numUsedSamples, numBytes;
+    TelemetryStoreGetUsage(&store, &numUsedSamples, &numBytes);
+    TEST_CHECK_EQUAL(numUsedSamples, HAPArrayCount(times));
+    printf("  round trip: %zu samples of %zu columns, %.2f bytes/sample\n",
+           numUsedSamples,
+           kNumColumns,
+           (double) numBytes / (double) numUsedSamples);
+}
+
+static void TestMerge(void) {
+    TelemetryBlock blocks[4];
+    uint8_t order[HAPArrayCount(blocks)];
+    TelemetryStore store;
+    TelemetryStoreCreate(&store, kColumnTypes, kNumColumns, blocks, order, HAPArrayCount(blocks));
+
+    const size_t numAppended = 5000;
+    for (size_t i = 0; i < numAppended; i++) {
+        TelemetryValue values[kNumColumns];
+        GetValues(GetTime(i), values);
+        TelemetryStoreAppend(&store, GetTime(i), values);
+    }
+
+    Decoded decoded = { .previousLevel = kTelemetryStore_MaxLevel };
+    TelemetryStoreEnumerateSamples(&store, CheckSample, &decoded);
+    TEST_CHECK_EQUAL(decoded.numMismatches, 0);
+    TEST_CHECK_EQUAL(decoded.previousTime, GetTime(numAppended - 1));
+
+    // Older history has been merged to lower resolution, the newest block is at full resolution.
+    TEST_CHECK(TelemetryStoreGetBlock(&store, 0)->level > 0);
+    TEST_CHECK_EQUAL(TelemetryStoreGetBlock(&store, store.numUsedBlocks - 1)->level, 0);
+    TEST_CHECK(decoded.numSamples + store.numDroppedSamples < numAppended);
+
+    size_t numUsedSamples, numBytes;
+    TelemetryStoreGetUsage(&store, &numUsedSamples, &numBytes);
+    TEST_CHECK_EQUAL(numUsedSamples, decoded.numSamples);
+    printf("  merge: %zu of %zu samples kept in %zu bytes, %lu dropped\n",
+           numUsedSamples,
+           numAppended,
+           numBytes,
+           (unsigned long) store.numDroppedSamples);
+}
+
+int main(void) {
+    TestRoundTrip();
+    TestMerge();
+    return TEST_RESULT();
+}
@@ -0,0 +1,46 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Minimal checks for the host tests. A failed check reports its location and fails the test at exit.
+
+#ifndef TEST_H
+#define TEST_H
+
+#include "HAP.h"
+
+static int numFailedChecks;
+
+#define TEST_CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: Check failed: %s\n", __FILE__, __LINE__, #condition); \
+            numFailedChecks++; \
+        } \
+    } while (0)
+
+#define TEST_CHECK_EQUAL(actual, expected) \
+    do { \
+        long long actual_ = (long long) (actual); \
+        long long expected_ = (long long) (expected); \
+        if (actual_ != expected_) { \
+            fprintf(stderr, \
+                    "%s:%d: Check failed: %s == %s (%lld != %lld)\n", \
+                    __FILE__, \
+                    __LINE__, \
+                    #actual, \
+                    #expected, \
+                    actual_, \
+                    expected_); \
+            numFailedChecks++; \
+        } \
+    } while (0)
+
+/**
+ * Exit status of a test.
+ */
+#define TEST_RESULT() (numFailedChecks ? EXIT_FAILURE : EXIT_SUCCESS)
+
+#endif
@@ -0,0 +1,139 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Replays link sequences through the WifiReachability tracker: the access point going away and coming back, SoftAP
+// clients joining and leaving, and the fallback timer racing the station, in each Wi-Fi mode.
+
+#include "WifiReachability.h"
+#include "Test.h"
+
+#define S(seconds) ((int64_t)(seconds) *1000 * 1000)
+
+// Expected actions.
+#define NONE         0
+#define START_TIMER  (1 << 0)
+#define STOP_TIMER   (1 << 1)
+#define START_SOFTAP (1 << 2)
+#define STOP_SOFTAP  (1 << 3)
+
+typedef struct {
+    int64_t nowUs;
+    WifiReachabilityEvent event;
+    unsigned actions;
+    /** Expected time to reachable, -1 if the accessory does not become reachable. */
+    int64_t reachableAfterUs;
+} Step;
+
+/**
+ * No access point at boot. The SoftAP is started after the timeout, and stopped once the access point is back and
+ * the last client has left.
+ */
+static const Step kFallbackFromBoot[] = {
+    { S(2), kWifiReachabilityEvent_StationLost, NONE, -1 },
+    { S(5), kWifiReachabilityEvent_StationLost, NONE, -1 },
+    { S(30), kWifiReachabilityEvent_FallbackTimeout, START_SOFTAP, -1 },
+    { S(35), kWifiReachabilityEvent_StationLost, NONE, -1 },
+    { S(41), kWifiReachabilityEvent_ClientJoined, NONE, -1 },
+    { S(42), kWifiReachabilityEvent_ClientAddress, NONE, S(42) },
+    { S(90), kWifiReachabilityEvent_StationAddress, NONE, -1 },
+    { S(95), kWifiReachabilityEvent_ClientLeft, STOP_SOFTAP, -1 },
+};
+
+/**
+ * The access point is reachable at boot, goes away and comes back while the SoftAP has no clients.
+ */
+static const Step kFallbackAfterLoss[] = {
+    { S(3), kWifiReachabilityEvent_StationAddress, STOP_TIMER, S(3) },
+    { S(100), kWifiReachabilityEvent_StationLost, START_TIMER, -1 },
+    { S(101), kWifiReachabilityEvent_StationLost, NONE, -1 },
+    { S(130), kWifiReachabilityEvent_FallbackTimeout, START_SOFTAP, -1 },
+    { S(140), kWifiReachabilityEvent_ClientJoined, NONE, -1 },
+    { S(141), kWifiReachabilityEvent_ClientAddress, NONE, S(41) },
+    // The accessory is unreachable again once the last client has left.
+    { S(150), kWifiReachabilityEvent_ClientLeft, NONE, -1 },
+    { S(160), kWifiReachabilityEvent_StationAddress, STOP_SOFTAP, S(10) },
+};
+
+/**
+ * The station gets its address back before the timeout, or just after the timer has expired.
+ */
+static const Step kFallbackRace[] = {
+    { S(1), kWifiReachabilityEvent_StationAddress, STOP_TIMER, S(1) },
+    { S(10), kWifiReachabilityEvent_StationLost, START_TIMER, -1 },
+    { S(20), kWifiReachabilityEvent_StationAddress, STOP_TIMER, S(10) },
+    { S(30), kWifiReachabilityEvent_StationLost, START_TIMER, -1 },
+    { S(60), kWifiReachabilityEvent_StationAddress, STOP_TIMER, S(30) },
+    { S(60), kWifiReachabilityEvent_FallbackTimeout, NONE, -1 },
+    { S(70), kWifiReachabilityEvent_StationLost, START_TIMER, -1 },
+};
+
+/**
+ * The SoftAP is always up and is never started or stopped.
+ */
+static const Step kConcurrent[] = {
+    { S(2), kWifiReachabilityEvent_ClientJoined, NONE, -1 },
+    { S(3), kWifiReachabilityEvent_ClientAddress, NONE, S(3) },
+    { S(4), kWifiReachabilityEvent_StationAddress, NONE, -1 },
+    { S(5), kWifiReachabilityEvent_ClientLeft, NONE, -1 },
+    { S(6), kWifiReachabilityEvent_StationLost, NONE, -1 },
+    { S(7), kWifiReachabilityEvent_ClientJoined, NONE, -1 },
+    { S(8), kWifiReachabilityEvent_ClientAddress, NONE, S(2) },
+};
+
+/**
+ * Without a SoftAP only the station makes the accessory reachable.
+ */
+static const Step kStation[] = {
+    { S(2), kWifiReachabilityEvent_StationLost, NONE, -1 },
+    { S(9), kWifiReachabilityEvent_StationAddress, NONE, S(9) },
+    { S(20), kWifiReachabilityEvent_StationLost, NONE, -1 },
+    { S(21), kWifiReachabilityEvent_StationAddress, NONE, S(1) },
+};
+
+static unsigned GetActions(const WifiReachabilityActions* actions) {
+    return (actions->startFallbackTimer ? START_TIMER : 0) | (actions->stopFallbackTimer ? STOP_TIMER : 0) |
+           (actions->startSoftAP ? START_SOFTAP : 0) | (actions->stopSoftAP ? STOP_SOFTAP : 0);
+}
+
+static void Replay(const char* name, WifiReachabilityMode mode, const Step* steps, size_t numSteps) {
+    WifiReachability reachability;
+    WifiReachabilityCreate(&reachability, mode);
+    for (size_t i = 0; i < numSteps; i++) {
+        WifiReachabilityActions actions;
+        WifiReachabilityHandleEvent(&reachability, steps[i].event, steps[i].nowUs, &actions);
+        if (GetActions(&actions) != steps[i].actions || actions.reachableAfterUs != steps[i].reachableAfterUs) {
+            fprintf(stderr,
+                    "%s: step %zu: actions 0x%x, reachable after %lld us, expected 0x%x, %lld us\n",
+                    name,
+                    i,
+                    GetActions(&actions),
+                    (long long) actions.reachableAfterUs,
+                    steps[i].actions,
+                    (long long) steps[i].reachableAfterUs);
+            numFailedChecks++;
+        }
+    }
+}
+
+int main(void) {
+    Replay("FallbackFromBoot", kWifiReachabilityMode_Fallback, kFallbackFromBoot, HAPArrayCount(kFallbackFromBoot));
+    Replay("FallbackAfterLoss",
+           kWifiReachabilityMode_Fallback,
+           kFallbackAfterLoss,
+           HAPArrayCount(kFallbackAfterLoss));
+    Replay("FallbackRace", kWifiReachabilityMode_Fallback, kFallbackRace, HAPArrayCount(kFallbackRace));
+    Replay("Concurrent", kWifiReachabilityMode_Concurrent, kConcurrent, HAPArrayCount(kConcurrent));
+    Replay("Station", kWifiReachabilityMode_Station, kStation, HAPArrayCount(kStation));
+
+    // The fallback timer is running from boot and the SoftAP is only up in concurrent mode.
+    WifiReachability reachability;
+    WifiReachabilityCreate(&reachability, kWifiReachabilityMode_Fallback);
+    TEST_CHECK(reachability.isFallbackTimerActive && !reachability.isSoftAPActive);
+    WifiReachabilityCreate(&reachability, kWifiReachabilityMode_Concurrent);
+    TEST_CHECK(!reachability.isFallbackTimerActive && reachability.isSoftAPActive);
+
+    return TEST_RESULT();
+}
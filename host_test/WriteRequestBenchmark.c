@@ -0,0 +1,56 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Compares the fast write parser with the generic one, on the host (write_parse_fast and write_parse_generic of the
+// on-device suite, Benchmark.h).
+//
+//   write_parse_fast          Parsing a door command body with the fast path.
+//   write_parse_generic       Parsing the same body with the generic JSON parser.
+//   write_parse_fallback      Parsing a body that the fast path declines (keys in another order), i.e. the cost
+//                             of trying the fast path first and falling back to the generic parser.
+
+#include "WriteRequest.h"
+#include "Bench.h"
+
+static const char kBody[] = "{\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":1}]}";
+static const char kReorderedBody[] = "{\"characteristics\":[{\"iid\":52,\"aid\":1,\"value\":1}]}";
+
+static size_t numErrors;
+
+static void ParseFast(void* context HAP_UNUSED) {
+    WriteRequest request;
+    if (!WriteRequestParseFast(kBody, sizeof kBody - 1, &request)) {
+        numErrors++;
+    }
+}
+
+static void ParseGeneric(void* context HAP_UNUSED) {
+    WriteRequest request;
+    if (WriteRequestParse(kBody, &request)) {
+        numErrors++;
+    }
+}
+
+static void ParseFallback(void* context HAP_UNUSED) {
+    WriteRequest request;
+    if (WriteRequestParseFast(kReorderedBody, sizeof kReorderedBody - 1, &request) ||
+        WriteRequestParse(kReorderedBody, &request)) {
+        numErrors++;
+    }
+}
+
+int main(void) {
+    BenchResult fast = BenchRun("write_parse_fast", 10000, ParseFast, NULL);
+    BenchResult generic = BenchRun("write_parse_generic", 1000, ParseGeneric, NULL);
+    BenchRun("write_parse_fallback", 1000, ParseFallback, NULL);
+    printf("  fast path: %.1fx faster than the generic parser (p50)\n",
+           (double) generic.p50Ns / (double) (fast.p50Ns ? fast.p50Ns : 1));
+    if (numErrors) {
+        fprintf(stderr, "%zu parse errors\n", numErrors);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
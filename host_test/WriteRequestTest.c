@@ -0,0 +1,151 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Checks that the fast write parser accepts the common shape of a door command, declines everything unusual, and
+// agrees with the generic parser on every body it accepts, including mutations of the common shape.
+
+#include "WriteRequest.h"
+#include "Test.h"
+
+#define kCommonBody "{\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":1}]}"
+
+typedef struct {
+    const char* body;
+    /** Whether the fast path accepts the body. */
+    bool isFast;
+    /** Whether the generic parser accepts the body. */
+    bool isValid;
+    uint64_t aid;
+    uint64_t iid;
+    int32_t value;
+} Case;
+
+static const Case kCases[] = {
+    { kCommonBody, true, true, 1, 52, 1 },
+    { "{\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":0}]}", true, true, 1, 52, 0 },
+    { " { \"characteristics\" : [ { \"aid\" : 1 , \"iid\" : 52 , \"value\" : 1 } ] }\r\n", true, true, 1, 52, 1 },
+    { "{\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":1}],\"pid\":11122333}", true, true, 1, 52, 1 },
+    { "{\"characteristics\":[{\"aid\":999999999999999,\"iid\":2147483647,\"value\":2147483647}]}",
+      true,
+      true,
+      999999999999999,
+      2147483647,
+      2147483647 },
+
+    // Valid, but left to the generic parser.
+    { "{\"characteristics\":[{\"iid\":52,\"aid\":1,\"value\":1}]}", false, true, 1, 52, 1 },
+    { "{\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":1,\"ev\":false}]}", false, true, 1, 52, 1 },
+    { "{\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":-1}]}", false, true, 1, 52, -1 },
+    { "{\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":1.0}]}", false, true, 1, 52, 1 },
+    { "{\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":1e0}]}", false, true, 1, 52, 1 },
+    { "{\"characteristics\":[{\"aid\":1,\"iid\":052,\"value\":1}]}", false, true, 1, 52, 1 },
+    { "{\"characteristics\":[{\"a\\u0069d\":1,\"iid\":52,\"value\":1}]}", false, true, 1, 52, 1 },
+    { "{\"pid\":1,\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":1}]}", false, true, 1, 52, 1 },
+    { "{\"characteristics\":[{\"aid\":1000000000000000,\"iid\":52,\"value\":1}]}", false, true, 1000000000000000, 52, 1 },
+
+    // Invalid.
+    { "", false, false, 0, 0, 0 },
+    { "{\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":1}]", false, false, 0, 0, 0 },
+    { "{\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":1}]}x", false, false, 0, 0, 0 },
+    { "{\"characteristics\":[]}", false, false, 0, 0, 0 },
+    { "{\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":1},{\"aid\":1,\"iid\":52,\"value\":0}]}",
+      false,
+      false,
+      0,
+      0,
+      0 },
+    { "{\"characteristics\":[{\"aid\":1,\"iid\":52}]}", false, false, 0, 0, 0 },
+    { "{\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":true}]}", false, false, 0, 0, 0 },
+    { "{\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":0.5}]}", false, false, 0, 0, 0 },
+    { "{\"characteristics\":[{\"aid\":-1,\"iid\":52,\"value\":1}]}", false, false, 0, 0, 0 },
+    { "{\"characteristics\":[{\"aid\":1.5,\"iid\":52,\"value\":1}]}", false, false, 0, 0, 0 },
+    { "{\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":2147483648}]}", false, false, 0, 0, 0 },
+};
+
+/**
+ * Parses a body with both parsers and checks that the fast path only accepts what the generic parser accepts alike.
+ *
+ * @return Whether the fast path accepted the body.
+ */
+static bool CheckAgreement(const char* body, size_t numBytes) {
+    WriteRequest fast;
+    if (!WriteRequestParseFast(body, numBytes, &fast)) {
+        return false;
+    }
+    WriteRequest generic;
+    HAPError err = WriteRequestParse(body, &generic);
+    if (err || fast.aid != generic.aid || fast.iid != generic.iid || fast.value != generic.value) {
+        fprintf(stderr, "Parsers disagree on: %s\n", body);
+        numFailedChecks++;
+    }
+    return true;
+}
+
+static void CheckCase(const Case* testCase) {
+    size_t numBytes = strlen(testCase->body);
+    WriteRequest request;
+    bool isFast = WriteRequestParseFast(testCase->body, numBytes, &request);
+    if (isFast != testCase->isFast) {
+        fprintf(stderr, "Fast path %s: %s\n", isFast ? "accepted" : "declined", testCase->body);
+        numFailedChecks++;
+    }
+    HAPError err = WriteRequestParse(testCase->body, &request);
+    if ((err == kHAPError_None) != testCase->isValid) {
+        fprintf(stderr, "Generic parser %s: %s\n", err ? "rejected" : "accepted", testCase->body);
+        numFailedChecks++;
+    } else if (testCase->isValid) {
+        TEST_CHECK_EQUAL(request.aid, testCase->aid);
+        TEST_CHECK_EQUAL(request.iid, testCase->iid);
+        TEST_CHECK_EQUAL(request.value, testCase->value);
+    }
+    (void) CheckAgreement(testCase->body, numBytes);
+}
+
+/**
+ * Replaces, inserts and deletes single bytes of the common body, and truncates it.
+ */
+static void CheckMutations(void) {
+    static const char kBytes[] = " \t\n{}[]:,\"-+.0123456789eEaidvlupx\\";
+    const char* body = kCommonBody;
+    size_t numBytes = sizeof kCommonBody - 1;
+    char mutated[sizeof kCommonBody + 1];
+    size_t numAccepted = 0;
+    size_t numMutations = 0;
+    for (size_t i = 0; i <= numBytes; i++) {
+        for (size_t j = 0; j < sizeof kBytes - 1; j++) {
+            if (i < numBytes) {
+                memcpy(mutated, body, numBytes + 1);
+                mutated[i] = kBytes[j];
+                numAccepted += CheckAgreement(mutated, numBytes);
+                numMutations++;
+            }
+            memcpy(mutated, body, i);
+            mutated[i] = kBytes[j];
+            memcpy(&mutated[i + 1], &body[i], numBytes - i + 1);
+            numAccepted += CheckAgreement(mutated, numBytes + 1);
+            numMutations++;
+        }
+        if (i < numBytes) {
+            memcpy(mutated, body, i);
+            memcpy(&mutated[i], &body[i + 1], numBytes - i);
+            numAccepted += CheckAgreement(mutated, numBytes - 1);
+            memcpy(mutated, body, i);
+            mutated[i] = '\0';
+            numAccepted += CheckAgreement(mutated, i);
+            numMutations += 2;
+        }
+    }
+    printf("  mutations: %zu of %zu accepted by the fast path\n", numAccepted, numMutations);
+    TEST_CHECK(numAccepted > 0 && numAccepted < numMutations);
+}
+
+int main(void) {
+    for (size_t i = 0; i < HAPArrayCount(kCases); i++) {
+        CheckCase(&kCases[i]);
+    }
+    CheckMutations();
+    return TEST_RESULT();
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Subset of the ADK's HAP.h for the platform-independent modules that are built on the host.
+//
+// Preconditions and assertions abort, so a violated contract fails the test instead of going unnoticed.
+
+#ifndef HAP_H
+#define HAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef __has_feature
+#define __has_feature(x) 0
+#endif
+#if !__has_feature(nullability)
+#define _Nullable
+#define _Nonnull
+#endif
+
+#define HAP_RESULT_USE_CHECK __attribute__((warn_unused_result))
+#define HAP_UNUSED           __attribute__((unused))
+
+#define HAP_STATIC_ASSERT(condition, name) _Static_assert(condition, #name)
+
+#define HAPArrayCount(array) (sizeof(array) / sizeof((array)[0]))
+
+#define HAPNonnull(value) (value)
+
+#define HAPMin(value, otherValue) ((value) < (otherValue) ? (value) : (otherValue))
+
+typedef enum {
+    kHAPError_None,
+    kHAPError_Unknown,
+    kHAPError_InvalidState,
+    kHAPError_InvalidData,
+    kHAPError_OutOfResources,
+    kHAPError_NotAuthorized,
+    kHAPError_Busy
+} HAPError;
+
+#define HAPFatalError() \
+    do { \
+        fprintf(stderr, "%s:%d: Fatal error.\n", __FILE__, __LINE__); \
+        abort(); \
+    } while (0)
+
+#define HAPPrecondition(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: Precondition failed: %s\n", __FILE__, __LINE__, #condition); \
+            abort(); \
+        } \
+    } while (0)
+
+#define HAPAssert(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: Assertion failed: %s\n", __FILE__, __LINE__, #condition); \
+            abort(); \
+        } \
+    } while (0)
+
+#define HAPRawBufferZero(bytes, numBytes)                   memset((bytes), 0, (numBytes))
+#define HAPRawBufferCopyBytes(bytes, sourceBytes, numBytes) memmove((bytes), (sourceBytes), (numBytes))
+#define HAPRawBufferAreEqual(bytes, otherBytes, numBytes)   (memcmp((bytes), (otherBytes), (numBytes)) == 0)
+
+// Accessory server objects, only compared by address.
+typedef void HAPCharacteristic;
+typedef struct HAPService HAPService;
+typedef struct HAPAccessory HAPAccessory;
+typedef struct HAPSession HAPSessionRef;
+typedef struct HAPAccessoryServer HAPAccessoryServerRef;
+
+// Implemented by the test, as needed.
+void HAPAccessoryServerRaiseEvent(
+        HAPAccessoryServerRef* server,
+        const HAPCharacteristic* characteristic,
+        const HAPService* service,
+        const HAPAccessory* accessory);
+void HAPAccessoryServerRaiseEventOnSession(
+        HAPAccessoryServerRef* server,
+        const HAPCharacteristic* characteristic,
+        const HAPService* service,
+        const HAPAccessory* accessory,
+        const HAPSessionRef* session);
+
+typedef struct HAPPlatformKeyValueStore* HAPPlatformKeyValueStoreRef;
+typedef uint8_t HAPPlatformKeyValueStoreDomain;
+typedef uint8_t HAPPlatformKeyValueStoreKey;
+
+#endif
@@ -0,0 +1,22 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Subset of FreeRTOS.h for the modules that are built on the host. The tests are single-threaded, so critical sections
+// have no effect.
+
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+
+#define portENTER_CRITICAL_SAFE(mux) ((void) (mux))
+#define portEXIT_CRITICAL_SAFE(mux)  ((void) (mux))
+
+#endif
@@ -0,0 +1,212 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "ActuationPattern.h"
+
+/**
+ * Maximum number of steps of a pattern before repetition.
+ */
+#define kActuationPattern_MaxSteps ((size_t) 16)
+
+/**
+ * Maximum repeat count.
+ */
+#define kActuationPattern_MaxRepeat ((uint32_t) 16)
+
+/**
+ * Largest duration of one half of an RMT item, in ticks.
+ */
+#define kActuationPattern_MaxHalfTicks ((uint32_t) 0x7FFF)
+
+typedef struct {
+    bool level;
+    uint32_t ticks;
+} Step;
+
+/**
+ * Accumulates the output and packs it into RMT items.
+ */
+typedef struct {
+    ActuationPattern* pattern;
+    size_t numHalves;
+
+    /** Output that has not been packed yet, to merge adjacent steps of the same level. */
+    bool pendingLevel;
+    uint32_t pendingTicks;
+} Emitter;
+
+//----------------------------------------------------------------------------------------------------------------------
+
+HAP_RESULT_USE_CHECK
+static HAPError ParseUInt32(const char** cursor, uint32_t minimumValue, uint32_t maximumValue, uint32_t* value) {
+    const char* c = *cursor;
+    if (*c < '0' || *c > '9') {
+        return kHAPError_InvalidData;
+    }
+    uint32_t v = 0;
+    for (; *c >= '0' && *c <= '9'; c++) {
+        v = v * 10 + (uint32_t)(*c - '0');
+        if (v > maximumValue) {
+            return kHAPError_InvalidData;
+        }
+    }
+    if (v < minimumValue) {
+        return kHAPError_InvalidData;
+    }
+    *cursor = c;
+    *value = v;
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+static HAPError EmitHalf(Emitter* emitter, bool level, uint32_t ticks) {
+    uint32_t half = ticks | (uint32_t) level << 15;
+    if (emitter->numHalves % 2 == 0) {
+        if (emitter->pattern->numItems >= kActuationPattern_MaxItems) {
+            return kHAPError_OutOfResources;
+        }
+        emitter->pattern->items[emitter->pattern->numItems++] = half;
+    } else {
+        emitter->pattern->items[emitter->pattern->numItems - 1] |= half << 16;
+    }
+    emitter->numHalves++;
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+static HAPError FlushPending(Emitter* emitter) {
+    while (emitter->pendingTicks) {
+        uint32_t ticks = emitter->pendingTicks < kActuationPattern_MaxHalfTicks ? emitter->pendingTicks :
+                                                                                  kActuationPattern_MaxHalfTicks;
+        HAPError err = EmitHalf(emitter, emitter->pendingLevel, ticks);
+        if (err) {
+            return err;
+        }
+        emitter->pendingTicks -= ticks;
+    }
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+static HAPError Emit(Emitter* emitter, const Step* step) {
+    if (emitter->pendingTicks && emitter->pendingLevel != step->level) {
+        HAPError err = FlushPending(emitter);
+        if (err) {
+            return err;
+        }
+    }
+    emitter->pendingLevel = step->level;
+    emitter->pendingTicks += step->ticks;
+    emitter->pattern->durationUs += step->ticks;
+    return kHAPError_None;
+}
+
+HAPError ActuationPatternCompile(const char* description, uint32_t tickUs, ActuationPattern* pattern) {
+    HAPPrecondition(description);
+    HAPPrecondition(tickUs && tickUs <= 1000);
+    HAPPrecondition(pattern);
+
+    HAPError err;
+
+    Step steps[kActuationPattern_MaxSteps];
+    size_t numSteps = 0;
+    uint32_t repeat = 1;
+    const char* c = description;
+    for (;;) {
+        if (numSteps >= HAPArrayCount(steps) || (*c != '0' && *c != '1') || c[1] != ':') {
+            return kHAPError_InvalidData;
+        }
+        bool level = *c == '1';
+        c += 2;
+        uint32_t ms;
+        err = ParseUInt32(&c, 1, kActuationPattern_MaxStepMs, &ms);
+        if (err) {
+            return err;
+        }
+        uint32_t ticks = (ms * 1000 + tickUs / 2) / tickUs;
+        if (!ticks) {
+            return kHAPError_InvalidData;
+        }
+        steps[numSteps].level = level;
+        steps[numSteps].ticks = ticks;
+        numSteps++;
+
+        if (*c == ',') {
+            c++;
+            continue;
+        }
+        if (*c == '*') {
+            c++;
+            err = ParseUInt32(&c, 1, kActuationPattern_MaxRepeat, &repeat);
+            if (err) {
+                return err;
+            }
+        }
+        if (*c) {
+            return kHAPError_InvalidData;
+        }
+        break;
+    }
+
+    HAPRawBufferZero(pattern, sizeof *pattern);
+    Emitter emitter = { .pattern = pattern };
+    for (uint32_t i = 0; i < repeat; i++) {
+        for (size_t j = 0; j < numSteps; j++) {
+            err = Emit(&emitter, &steps[j]);
+            if (err) {
+                return err;
+            }
+        }
+    }
+    err = FlushPending(&emitter);
+    if (err) {
+        return err;
+    }
+
+    // A zero duration ends the transmission. After an odd number of halves the last item already ends with one.
+    if (emitter.numHalves % 2 == 0) {
+        if (pattern->numItems >= kActuationPattern_MaxItems) {
+            return kHAPError_OutOfResources;
+        }
+        pattern->items[pattern->numItems++] = 0;
+    }
+    pattern->durationUs *= tickUs;
+    return kHAPError_None;
+}
+
+void ActuationPatternEnumerateSteps(
+        const ActuationPattern* pattern,
+        uint32_t tickUs,
+        ActuationPatternEnumerateStepsCallback callback,
+        void* _Nullable context) {
+    HAPPrecondition(pattern);
+    HAPPrecondition(tickUs);
+    HAPPrecondition(callback);
+
+    bool level = false;
+    uint32_t durationUs = 0;
+    bool shouldContinue = true;
+    for (size_t i = 0; i < pattern->numItems * 2; i++) {
+        uint32_t half = (pattern->items[i / 2] >> (i % 2 * 16)) & 0xFFFF;
+        uint32_t ticks = half & kActuationPattern_MaxHalfTicks;
+        bool halfLevel = (half >> 15) & 1;
+        if (!ticks) {
+            break;
+        }
+        if (durationUs && halfLevel != level) {
+            callback(context, level, durationUs, &shouldContinue);
+            if (!shouldContinue) {
+                return;
+            }
+            durationUs = 0;
+        }
+        level = halfLevel;
+        durationUs += ticks * tickUs;
+    }
+    if (durationUs) {
+        callback(context, level, durationUs, &shouldContinue);
+    }
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Actuation patterns for the opener remote.
+//
+// A pattern is a comma-separated list of "<level>:<milliseconds>" steps, optionally followed by "*<count>" to repeat
+// the whole list. Examples:
+//
+//   1:5000            Hold the button for 5 seconds.
+//   1:300,0:300*2     Double press.
+//
+// Patterns are compiled into RMT items (rmt_item32_t layout) so the peripheral can play them without CPU involvement.
+// The output returns to low after the last step. This file is platform-independent and tested on the host
+// (host_test/ActuationPatternTest.c).
+
+#ifndef ACTUATION_PATTERN_H
+#define ACTUATION_PATTERN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Maximum number of RMT items of a compiled pattern, including the end marker. Stays below the 64 items of one RMT
+ * memory block, which the driver copies in full when starting, so the channel is not refilled while the pattern plays.
+ */
+#define kActuationPattern_MaxItems ((size_t) 63)
+
+/**
+ * Maximum duration of a single step.
+ */
+#define kActuationPattern_MaxStepMs ((uint32_t) 60000)
+
+/**
+ * Compiled pattern.
+ */
+typedef struct {
+    /** RMT items in rmt_item32_t layout, terminated by a zero duration. */
+    uint32_t items[kActuationPattern_MaxItems];
+    size_t numItems;
+
+    /** Total duration until the output returns to low for good. */
+    uint32_t durationUs;
+} ActuationPattern;
+
+/**
+ * Compiles a pattern.
+ *
+ * @param      description          Pattern, see above.
+ * @param      tickUs               Duration of one RMT tick in microseconds. At most 1000.
+ * @param[out] pattern              Compiled pattern.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_InvalidData    If the description is malformed.
+ * @return kHAPError_OutOfResources If the pattern does not fit kActuationPattern_MaxItems items.
+ */
+HAP_RESULT_USE_CHECK
+HAPError ActuationPatternCompile(const char* description, uint32_t tickUs, ActuationPattern* pattern);
+
+/**
+ * Callback for enumerating the output of a pattern.
+ *
+ * @param      context              Context.
+ * @param      level                Output level.
+ * @param      durationUs           How long the level is held.
+ * @param[in,out] shouldContinue    True if enumeration shall continue, False otherwise. Is set to true on input.
+ */
+typedef void (*ActuationPatternEnumerateStepsCallback)(
+        void* _Nullable context,
+        bool level,
+        uint32_t durationUs,
+        bool* shouldContinue);
+
+/**
+ * Simulates how the RMT peripheral plays a compiled pattern and reports the resulting output levels, merging adjacent
+ * items of the same level. Used to verify the generated timings.
+ *
+ * @param      pattern              Compiled pattern.
+ * @param      tickUs               Duration of one RMT tick in microseconds, as passed to ActuationPatternCompile.
+ * @param      callback             Function to call on each step.
+ * @param      context              Context passed to the callback.
+ */
+void ActuationPatternEnumerateSteps(
+        const ActuationPattern* pattern,
+        uint32_t tickUs,
+        ActuationPatternEnumerateStepsCallback callback,
+        void* _Nullable context);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
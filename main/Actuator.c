@@ -0,0 +1,113 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "Actuator.h"
+
+#include "ActuationPattern.h"
+
+#include <driver/rmt.h>
+#include <esp_attr.h>
+
+#define kActuator_Channel RMT_CHANNEL_0
+
+/**
+ * RMT clock divider. The channel runs from the 1 MHz REF_TICK, so a tick is 100 us and stays stable when the APB
+ * frequency changes.
+ */
+#define kActuator_ClockDivider ((uint8_t) 100)
+#define kActuator_TickUs       ((uint32_t) 100)
+
+HAP_STATIC_ASSERT(sizeof(rmt_item32_t) == sizeof(uint32_t), RMTItem_layout);
+
+static struct {
+    TaskHandle_t _Nullable completionTask;
+
+    /** Pattern that is played. Copied into RMT memory on start, so it can be replaced at any time. */
+    ActuationPattern pattern;
+} actuator;
+
+static void IRAM_ATTR HandleTransmissionEnd(rmt_channel_t channel, void* _Nullable arg HAP_UNUSED) {
+    if (channel != kActuator_Channel) {
+        return;
+    }
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(actuator.completionTask, &higherPriorityTaskWoken);
+    if (higherPriorityTaskWoken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+static void LogPatternStep(
+        void* _Nullable context HAP_UNUSED,
+        bool level,
+        uint32_t durationUs,
+        bool* shouldContinue HAP_UNUSED) {
+    HAPLogDebug(&kHAPLog_Default, "  %s for %u ms", level ? "press" : "release", (unsigned int) (durationUs / 1000));
+}
+
+HAPError ActuatorSetPattern(const char* description) {
+    HAPPrecondition(description);
+
+    ActuationPattern pattern;
+    HAPError err = ActuationPatternCompile(description, kActuator_TickUs, &pattern);
+    if (err) {
+        HAPLogError(&kHAPLog_Default, "%s: Invalid actuation pattern \"%s\": %u.", __func__, description, err);
+        return err;
+    }
+    actuator.pattern = pattern;
+    HAPLogInfo(
+            &kHAPLog_Default,
+            "Actuation pattern \"%s\": %u RMT items, %u ms.",
+            description,
+            (unsigned int) pattern.numItems,
+            (unsigned int) (pattern.durationUs / 1000));
+    ActuationPatternEnumerateSteps(&actuator.pattern, kActuator_TickUs, LogPatternStep, NULL);
+    return kHAPError_None;
+}
+
+uint32_t ActuatorGetPatternDurationUs(void) {
+    return actuator.pattern.durationUs;
+}
+
+void ActuatorInitialize(int gpioPin, TaskHandle_t completionTask) {
+    HAPPrecondition(completionTask);
+    HAPPrecondition(!actuator.completionTask);
+
+    actuator.completionTask = completionTask;
+    if (ActuatorSetPattern(CONFIG_GARAGE_ACTUATION_PATTERN)) {
+        HAPFatalError();
+    }
+
+    rmt_config_t config = RMT_DEFAULT_CONFIG_TX(gpioPin, kActuator_Channel);
+    config.clk_div = kActuator_ClockDivider;
+    config.flags = RMT_CHANNEL_FLAGS_AWARE_DFS;
+    config.tx_config.carrier_en = false;
+    config.tx_config.loop_en = false;
+    config.tx_config.idle_output_en = true;
+    config.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+    ESP_ERROR_CHECK(rmt_config(&config));
+    ESP_ERROR_CHECK(rmt_driver_install(kActuator_Channel, 0, 0));
+    rmt_register_tx_end_callback(HandleTransmissionEnd, NULL);
+}
+
+void ActuatorStart(void) {
+    HAPPrecondition(actuator.completionTask);
+
+    esp_err_t err = rmt_write_items(
+            kActuator_Channel,
+            (const rmt_item32_t*) actuator.pattern.items,
+            (int) actuator.pattern.numItems,
+            /* wait_tx_done: */ false);
+    if (err != ESP_OK) {
+        HAPLogError(&kHAPLog_Default, "%s: Failed to start pattern: %d.", __func__, err);
+    }
+}
+
+void ActuatorStop(void) {
+    HAPPrecondition(actuator.completionTask);
+
+    (void) rmt_tx_stop(kActuator_Channel);
+}
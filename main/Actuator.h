@@ -0,0 +1,70 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Opener remote actuation.
+//
+// Plays the configured actuation pattern (ActuationPattern.h) on the remote's button through an RMT channel. Once
+// started, the peripheral produces the whole pattern by itself; the CPU is only involved again when the end of
+// transmission interrupt notifies the completion task.
+
+#ifndef ACTUATOR_H
+#define ACTUATOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Sets up the RMT channel on the given pin and compiles the configured pattern.
+ *
+ * @param      gpioPin              Pin that operates the remote's button.
+ * @param      completionTask       Task that is notified (xTaskNotifyGive) from the ISR when a pattern has been played.
+ */
+void ActuatorInitialize(int gpioPin, TaskHandle_t completionTask);
+
+/**
+ * Replaces the pattern, e.g. with a calibrated one. Takes effect with the next activation.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_InvalidData    If the pattern is malformed.
+ * @return kHAPError_OutOfResources If the pattern is too long.
+ */
+HAP_RESULT_USE_CHECK
+HAPError ActuatorSetPattern(const char* description);
+
+/**
+ * Returns the total duration of the current pattern.
+ */
+uint32_t ActuatorGetPatternDurationUs(void);
+
+/**
+ * Starts playing the pattern.
+ */
+void ActuatorStart(void);
+
+/**
+ * Stops the pattern and releases the button. The completion task is not notified.
+ */
+void ActuatorStop(void);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -23,31 +23,63 @@
 
 #include "HAP.h"
 
+#include "Actuator.h"
 #include "App.h"
+#include "CharacteristicBinding.h"
+#include "CommandSlo.h"
 #include "DB.h"
+#include "DBHash.h"
+#include "DBSize.h"
+#include "FlashWriteScheduler.h"
+#include "Metrics.h"
+#include "PerfSnapshot.h"
+#include "SessionTracker.h"
+#include "SubscriptionIndex.h"
+#include "app_wifi.h"
+#if CONFIG_GARAGE_LOCAL_CONTROL
+#include "LocalControl.h"
+#endif
+#if CONFIG_GARAGE_MQTT
+#include "MqttBridge.h"
+#endif
+#if CONFIG_GARAGE_TELEMETRY
+#include "Telemetry.h"
+#endif
+#if CONFIG_GARAGE_RF_RECEIVER
+#include "RfCalibration.h"
+#include "RfCodeBook.h"
+#include "RfReceiver.h"
+#endif
+#if CONFIG_GARAGE_SUPPLY_MONITOR
+#include "SupplyMonitor.h"
+#endif
+#if CONFIG_GARAGE_HOTPATH_PROFILER
+#include "HotPathProfiler.h"
+#endif
+#if CONFIG_GARAGE_BENCHMARK
+#include "Benchmark.h"
+#endif
+#if CONFIG_GARAGE_OVERLOAD_CONTROL
+#include "Overload.h"
+#endif
 
 #include <esp_system.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <driver/gpio.h>
-#include "driver/timer.h"
 #include <esp_event.h>
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /**
- * Domain used in the key value store for application data.
- *
- * Purged: On factory reset.
+ * Time to stay away from flash after a HAP request, as controllers usually follow up with further requests.
  */
-#define kAppKeyValueStoreDomain_Configuration ((HAPPlatformKeyValueStoreDomain) 0x00)
+#define kAppFlashQuietAfterRequestMS ((HAPTime) 500)
 
 /**
- * Key used in the key value store to store the configuration state.
- *
- * Purged: On factory reset.
+ * Time to stay away from flash after a session has been accepted, covering the Pair Verify exchange.
  */
-#define kAppKeyValueStoreKey_Configuration_State ((HAPPlatformKeyValueStoreDomain) 0x00)
+#define kAppFlashQuietAfterSessionAcceptMS ((HAPTime) 2 * HAPSecond)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #define kLedGPIOPin 19
@@ -63,6 +95,16 @@ typedef struct {
     } state;
     HAPAccessoryServerRef* server;
     HAPPlatformKeyValueStoreRef keyValueStore;
+#if CONFIG_GARAGE_RF_RECEIVER
+    /** Reverts the door state after activity from another remote. */
+    HAPPlatformTimerRef doorActivityTimer;
+
+    /** Whether the door state shows activity from another remote instead of our own last command. */
+    bool isDoorActivityReported;
+#endif
+#if CONFIG_GARAGE_SUPPLY_MONITOR
+    SupplyLevel supplyLevel;
+#endif
 } AccessoryConfiguration;
 
 static AccessoryConfiguration accessoryConfiguration;
@@ -106,11 +148,12 @@ static void LoadAccessoryState(void) {
 }
 
 /**
- * Save the accessory state to persistent memory.
+ * Write the accessory state to persistent memory.
  */
-static void SaveAccessoryState(void) {
+static void WriteAccessoryState(void) {
     HAPPrecondition(accessoryConfiguration.keyValueStore);
 
+    int64_t startedAt = esp_timer_get_time();
     HAPError err;
     err = HAPPlatformKeyValueStoreSet(
             accessoryConfiguration.keyValueStore,
@@ -122,6 +165,16 @@ static void SaveAccessoryState(void) {
         HAPAssert(err == kHAPError_Unknown);
         HAPFatalError();
     }
+    PerfSnapshotTrace(kPerfSnapshotEvent_StateSaved, (uint32_t)(esp_timer_get_time() - startedAt));
+}
+
+static FlashWrite accessoryStateWrite = { .name = "accessory state", .callback = WriteAccessoryState };
+
+/**
+ * Save the accessory state to persistent memory once the accessory is quiet.
+ */
+static void SaveAccessoryState(void) {
+    FlashWriteSchedulerRequest(&accessoryStateWrite);
 }
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -158,31 +211,136 @@ void AccessoryNotification(
     HAPAccessoryServerRaiseEvent(accessoryConfiguration.server, characteristic, service, accessory);
 }
 
+static HAPError ValidateTargetDoorState(uint8_t value);
+static void HandleTargetDoorStateChange(HAPSessionRef* session, uint8_t value, int64_t receivedAt);
+
+static const char* const kCurrentDoorStateNames[] = {
+    [kHAPCharacteristicValue_CurrentDoorState_Open] = "Open",
+    [kHAPCharacteristicValue_CurrentDoorState_Closed] = "Closed",
+    [kHAPCharacteristicValue_CurrentDoorState_Opening] = "Opening",
+    [kHAPCharacteristicValue_CurrentDoorState_Closing] = "Closing",
+    [kHAPCharacteristicValue_CurrentDoorState_Stopped] = "Stopped",
+};
+
+static const char* const kTargetDoorStateNames[] = {
+    [kHAPCharacteristicValue_TargetDoorState_Open] = "Open",
+    [kHAPCharacteristicValue_TargetDoorState_Closed] = "Closed",
+};
+
+static const char* const kBoolNames[] = { "false", "true" };
+
 /**
- * Context for the HAP run loop callback that raises a characteristic changed event
- * with the specified data in the context.
+ * Characteristics of the Garage Door Opener service bound to the accessory state (CharacteristicBinding.h).
  */
-typedef struct {
-    HAPAccessory* accessory;
-    HAPService* service;
-    HAPCharacteristic* characteristic;
-} AccessoryNotificationCallbackContext;
+static const CharacteristicBinding currentDoorStateBinding = {
+    .name = "CurrentDoorState",
+    .characteristic = &garageDoorOpenerCurrentDoorStateCharacteristic,
+    .service = &garageDoorOpenerService,
+    .field = &accessoryConfiguration.state.currentDoorState,
+    .valueNames = kCurrentDoorStateNames,
+    .numValueNames = HAPArrayCount(kCurrentDoorStateNames),
+    .flashQuietMS = kAppFlashQuietAfterRequestMS,
+};
+
+static const CharacteristicBinding targetDoorStateBinding = {
+    .name = "TargetDoorState",
+    .characteristic = &garageDoorOpenerTargetDoorStateCharacteristic,
+    .service = &garageDoorOpenerService,
+    .field = &accessoryConfiguration.state.targetDoorState,
+    .valueNames = kTargetDoorStateNames,
+    .numValueNames = HAPArrayCount(kTargetDoorStateNames),
+    .flashQuietMS = kAppFlashQuietAfterRequestMS,
+    .validate = ValidateTargetDoorState,
+    .handleChange = HandleTargetDoorStateChange,
+};
+
+static const CharacteristicBinding obstructionDetectedBinding = {
+    .name = "ObstructionDetected",
+    .characteristic = &garageDoorOpenerObstructionDetectedCharacteristic,
+    .service = &garageDoorOpenerService,
+    .field = &accessoryConfiguration.state.obstructionDetected,
+    .valueNames = kBoolNames,
+    .numValueNames = HAPArrayCount(kBoolNames),
+    .flashQuietMS = kAppFlashQuietAfterRequestMS,
+};
+
+/**
+ * Bindings whose state fields change together with the door state.
+ */
+static const CharacteristicBinding* const kDoorStateBindings[] = {
+    &targetDoorStateBinding,
+    &currentDoorStateBinding,
+};
 
-void AccessoryNotificationRunLoopCallback(void* context, size_t context_size) {
-    AccessoryNotificationCallbackContext* c = (AccessoryNotificationCallbackContext *) context;
-    HAPAccessoryServerRaiseEvent(accessoryConfiguration.server, c->characteristic, c->service, c->accessory);
+/**
+ * Notify controllers and local clients that the door state changed. Must be called on the run loop.
+ */
+static void NotifyDoorStateChanged(void) {
+    CharacteristicBindingRaiseEvents(
+            accessoryConfiguration.server, kDoorStateBindings, HAPArrayCount(kDoorStateBindings), &accessory);
+#if CONFIG_GARAGE_LOCAL_CONTROL
+    LocalControlHandleDoorStateChanged(
+            accessoryConfiguration.state.currentDoorState, accessoryConfiguration.state.targetDoorState);
+#endif
+#if CONFIG_GARAGE_MQTT
+    MqttBridgeHandleDoorStateChanged(
+            accessoryConfiguration.state.currentDoorState, accessoryConfiguration.state.targetDoorState);
+#endif
 }
 
-void ScheduleAccessoryNotificationInRunLoop(
-        const HAPAccessory* accessory,
-        const HAPService* service,
-        const HAPCharacteristic* characteristic) {
-    AccessoryNotificationCallbackContext context = {
-        .accessory = accessory,
-        .service = service,
-        .characteristic = characteristic,
-    };
-    HAPPlatformRunLoopScheduleCallback(AccessoryNotificationRunLoopCallback, &context, sizeof context);
+/**
+ * Increment the configuration number if the attribute database changed since it was last persisted, so controllers
+ * only re-fetch the database when there is something new. Must be called before the accessory server is started.
+ */
+static void UpdateConfigurationNumber(void) {
+    HAPPrecondition(accessoryConfiguration.keyValueStore);
+
+    HAPError err;
+
+    uint32_t hash = DBHashAccessory(&accessory);
+    uint8_t hashBytes[sizeof hash];
+    HAPWriteLittleUInt32(hashBytes, hash);
+
+    uint8_t storedHashBytes[sizeof hashBytes];
+    bool found;
+    size_t numBytes;
+    err = HAPPlatformKeyValueStoreGet(
+            accessoryConfiguration.keyValueStore,
+            kAppKeyValueStoreDomain_Configuration,
+            kAppKeyValueStoreKey_Configuration_DatabaseHash,
+            storedHashBytes,
+            sizeof storedHashBytes,
+            &numBytes,
+            &found);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        HAPFatalError();
+    }
+    if (found && numBytes == sizeof storedHashBytes &&
+        HAPRawBufferAreEqual(storedHashBytes, hashBytes, sizeof hashBytes)) {
+        return;
+    }
+
+    // Without a stored hash it is unknown which database the current configuration number describes.
+    HAPLogInfo(
+            &kHAPLog_Default,
+            "Attribute database changed (hash %08lX). Incrementing configuration number.",
+            (unsigned long) hash);
+    err = HAPAccessoryServerIncrementCN(accessoryConfiguration.keyValueStore);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        HAPFatalError();
+    }
+    err = HAPPlatformKeyValueStoreSet(
+            accessoryConfiguration.keyValueStore,
+            kAppKeyValueStoreDomain_Configuration,
+            kAppKeyValueStoreKey_Configuration_DatabaseHash,
+            hashBytes,
+            sizeof hashBytes);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        HAPFatalError();
+    }
 }
 
 void AppCreate(HAPAccessoryServerRef* server, HAPPlatformKeyValueStoreRef keyValueStore) {
@@ -195,9 +353,27 @@ void AppCreate(HAPAccessoryServerRef* server, HAPPlatformKeyValueStoreRef keyVal
     accessoryConfiguration.server = server;
     accessoryConfiguration.keyValueStore = keyValueStore;
     LoadAccessoryState();
+    UpdateConfigurationNumber();
+    DBSizeLog(&accessory);
+#if CONFIG_GARAGE_RF_RECEIVER
+    RfCalibrationCreate(keyValueStore);
+    RfCodeBookCreate(keyValueStore);
+#endif
 }
 
 void AppRelease(void) {
+#if CONFIG_GARAGE_RF_RECEIVER
+    // AppCreate clears the configuration, the timer would be lost.
+    if (accessoryConfiguration.doorActivityTimer) {
+        HAPPlatformTimerDeregister(accessoryConfiguration.doorActivityTimer);
+        accessoryConfiguration.doorActivityTimer = 0;
+    }
+#endif
+    FlashWriteSchedulerFlush();
+}
+
+void AppPrepareFactoryReset(void) {
+    FlashWriteSchedulerDiscard(&accessoryStateWrite);
 }
 
 void AppAccessoryServerStart(void) {
@@ -209,74 +385,281 @@ void AppAccessoryServerStart(void) {
 void *switch_off_handler_task_ptr;
 
 
-static bool IRAM_ATTR switch_off_timer_callback(void *args){
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    vTaskNotifyGiveFromISR(switch_off_handler_task_ptr, &xHigherPriorityTaskWoken);
-    return xHigherPriorityTaskWoken == pdTRUE;
-}
+/**
+ * Completes an activation once the actuation pattern has been played. Executed on the run loop.
+ */
+static void HandleActuationFinished(void* _Nullable context, size_t contextSize) {
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(int64_t));
 
+    CommandSloHandleActuationFinished(*(const int64_t*) context);
+    if (((HAPCharacteristicValue_TargetDoorState) accessoryConfiguration.state.targetDoorState) == kHAPCharacteristicValue_TargetDoorState_Open) {
+        accessoryConfiguration.state.targetDoorState = kHAPCharacteristicValue_TargetDoorState_Closed;
+        accessoryConfiguration.state.currentDoorState = kHAPCharacteristicValue_CurrentDoorState_Closed;
+        SaveAccessoryState();
+        NotifyDoorStateChanged();
+    }
+}
 
+/**
+ * Notified by the actuator when the RMT channel has played the whole pattern.
+ */
 void switch_off_handler(void *args){
-    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-
     for(;;){
         ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-        timer_pause(TIMER_GROUP_0, TIMER_0); // todo: deinit timer by handle instead of hardcoding it here
-        if (((HAPCharacteristicValue_TargetDoorState) accessoryConfiguration.state.targetDoorState) == kHAPCharacteristicValue_TargetDoorState_Open) {
-            HAPLog(&kHAPLog_Default, "Cutting opener remote signal");
-            accessoryConfiguration.state.targetDoorState = kHAPCharacteristicValue_TargetDoorState_Closed;
-            accessoryConfiguration.state.currentDoorState = kHAPCharacteristicValue_CurrentDoorState_Closed;
-            SaveAccessoryState();
-            gpio_set_level(kLedGPIOPin, false);
-            ScheduleAccessoryNotificationInRunLoop(&accessory, &garageDoorOpenerService, &garageDoorOpenerTargetDoorStateCharacteristic);
-            ScheduleAccessoryNotificationInRunLoop(&accessory, &garageDoorOpenerService, &garageDoorOpenerCurrentDoorStateCharacteristic);
+        int64_t finishedAt = esp_timer_get_time();
+        HAPLog(&kHAPLog_Default, "Cutting opener remote signal");
+        PerfSnapshotTrace(kPerfSnapshotEvent_RelayOff, 0);
+
+        // State is owned by the run loop, hand the rest of the work over to it.
+        HAPError err = HAPPlatformRunLoopScheduleCallback(HandleActuationFinished, &finishedAt, sizeof finishedAt);
+        if (err) {
+            HAPLogError(&kHAPLog_Default, "Failed to schedule actuation completion: %u.", err);
         }
     }
 }
 
+//----------------------------------------------------------------------------------------------------------------------
 
+/**
+ * Whether the door already has the target state from one of our own commands. A state reported after activity from
+ * another remote does not count, so our own commands still operate the remote while it is shown.
+ */
+static bool IsTargetDoorStateCommanded(HAPCharacteristicValue_TargetDoorState targetState) {
+    if (accessoryConfiguration.state.targetDoorState != targetState) {
+        return false;
+    }
+#if CONFIG_GARAGE_RF_RECEIVER
+    return !accessoryConfiguration.isDoorActivityReported;
+#else
+    return true;
+#endif
+}
 
+/**
+ * Whether a command must not be carried out because the supply is about to brown out. Only opening operates the
+ * remote; stopping is always allowed.
+ */
+static bool IsActuationRefused(HAPCharacteristicValue_TargetDoorState targetState) {
+#if CONFIG_GARAGE_SUPPLY_MONITOR
+    return accessoryConfiguration.supplyLevel == kSupplyLevel_Critical &&
+           targetState == kHAPCharacteristicValue_TargetDoorState_Open && !IsTargetDoorStateCommanded(targetState);
+#else
+    return false;
+#endif
+}
 
-//----------------------------------------------------------------------------------------------------------------------
+/**
+ * Stops reporting activity from another remote, as our own command takes over the door state.
+ */
+static void EndDoorActivity(void) {
+#if CONFIG_GARAGE_RF_RECEIVER
+    if (accessoryConfiguration.doorActivityTimer) {
+        HAPPlatformTimerDeregister(accessoryConfiguration.doorActivityTimer);
+        accessoryConfiguration.doorActivityTimer = 0;
+    }
+    accessoryConfiguration.isDoorActivityReported = false;
+#endif
+}
 
-#define TIMER_DIVIDER         (16)  //  Hardware timer clock divider
-#define TIMER_SCALE           (TIMER_BASE_CLK / TIMER_DIVIDER)  // convert counter value to seconds
+/**
+ * Apply a new target door state and operate the remote. Must be called on the run loop.
+ *
+ * All command sources end up here so that HAP and local commands share one actuation path.
+ *
+ * @return Time the relay was switched, or 0 if the door already had the target state.
+ */
+static int64_t SetTargetDoorState(
+        HAPCharacteristicValue_TargetDoorState targetState,
+        AppCommandSource source,
+        int64_t receivedAt) {
+    PerfSnapshotTrace(kPerfSnapshotEvent_CommandReceived, (uint32_t) source << 8 | targetState);
+    if (IsTargetDoorStateCommanded(targetState)) {
+        return 0;
+    }
+    if (IsActuationRefused(targetState)) {
+        HAPLogError(&kHAPLog_Default, "%s: Supply voltage critical. Refusing to operate the remote.", __func__);
+        return 0;
+    }
 
-void set_timer(uint64_t timer_duration_in_ms, timer_isr_t isr_handler) {
-    /* Select and initialize basic parameters of the timer */
-        timer_config_t config = {
-            .divider = TIMER_DIVIDER,
-            .counter_dir = TIMER_COUNT_UP,
-            .counter_en = TIMER_PAUSE,
-            .alarm_en = TIMER_ALARM_EN,
-            .auto_reload = false,
-        }; // default clock source is APB
+    // this should be a a helper function for mapping the value and notifying current/target state
+    bool isConfirmationExpected = false;
+    switch (targetState) {
+        case kHAPCharacteristicValue_TargetDoorState_Open: {
+#if CONFIG_GARAGE_RF_RECEIVER
+            isConfirmationExpected = RfCalibrationHandleActuationStarting();
+#endif
+            // Keep the run loop responsive while the remote is pressed.
+            FlashWriteSchedulerDefer(ActuatorGetPatternDurationUs() / 1000);
+            ActuatorStart();
+            PerfSnapshotTrace(kPerfSnapshotEvent_RelayOn, 0);
+        } break;
+        case kHAPCharacteristicValue_TargetDoorState_Closed: {
+            ActuatorStop();
+            PerfSnapshotTrace(kPerfSnapshotEvent_RelayOff, 0);
+        } break;
+    }
+    int64_t actuatedAt = esp_timer_get_time();
+    CommandSloHandleActuationStarted(source, targetState, receivedAt, actuatedAt, isConfirmationExpected);
+    if (targetState == kHAPCharacteristicValue_TargetDoorState_Closed) {
+        // Releasing the remote completes right away.
+        CommandSloHandleActuationFinished(actuatedAt);
+    }
+    uint32_t latency = (uint32_t)(actuatedAt - receivedAt);
+    PerfSnapshotRecordCommand(source, targetState, latency);
+    switch (source) {
+        case kAppCommandSource_HAP: {
+            MetricsRecord(kMetric_CommandLatencyHAP, latency);
+        } break;
+        case kAppCommandSource_LocalControl: {
+            MetricsRecord(kMetric_CommandLatencyLocalControl, latency);
+        } break;
+        case kAppCommandSource_MQTT: {
+            MetricsRecord(kMetric_CommandLatencyMQTT, latency);
+        } break;
+    }
+    switch (app_wifi_get_link()) {
+        case APP_WIFI_LINK_STATION: {
+            MetricsRecord(kMetric_CommandLatencyStation, latency);
+        } break;
+        case APP_WIFI_LINK_SOFTAP: {
+            MetricsRecord(kMetric_CommandLatencySoftAP, latency);
+        } break;
+        case APP_WIFI_LINK_NONE: {
+        } break;
+    }
+#if CONFIG_GARAGE_MQTT
+    MqttBridgeHandleCommand(source, targetState);
+#endif
+
+    EndDoorActivity();
+    accessoryConfiguration.state.targetDoorState = targetState;
+    accessoryConfiguration.state.currentDoorState = targetState;
+    SaveAccessoryState();
+    NotifyDoorStateChanged();
+    return actuatedAt;
+}
 
-        // ESP_LOGI(LOGNAME, "created config\n");
+/**
+ * Context for the HAP run loop callback that applies a target door state requested from another task.
+ */
+typedef struct {
+    HAPCharacteristicValue_TargetDoorState targetState;
+    AppCommandSource source;
+    int64_t receivedAt;
+} ScheduledTargetDoorStateContext;
 
-        timer_init(TIMER_GROUP_0, TIMER_0, &config);
-        // ESP_LOGI(LOGNAME, "timer init\n");
-        HAPLogInfo(&kHAPLog_Default, "Timer initialized");
+static void ScheduledTargetDoorStateCallback(void* _Nullable context, size_t contextSize) {
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(ScheduledTargetDoorStateContext));
 
-        /* Timer's counter will initially start from value below.
-        Also, if auto_reload is set, this value will be automatically reload on alarm */
-        timer_set_counter_value(TIMER_GROUP_0, TIMER_0, 0);
-        // ESP_LOGI(LOGNAME, "timer counter value set to 0\n");
+    const ScheduledTargetDoorStateContext* c = (const ScheduledTargetDoorStateContext*) context;
+    (void) SetTargetDoorState(c->targetState, c->source, c->receivedAt);
+}
 
-        /* Configure the alarm value and the interrupt on alarm. */
-        timer_set_alarm_value(TIMER_GROUP_0, TIMER_0, timer_duration_in_ms / 1000 * TIMER_SCALE);
-        // ESP_LOGI(LOGNAME, "timer value set to 5 seconds\n");
+void AppScheduleTargetDoorState(
+        HAPCharacteristicValue_TargetDoorState targetState,
+        AppCommandSource source,
+        int64_t receivedAt) {
+    ScheduledTargetDoorStateContext context = {
+        .targetState = targetState,
+        .source = source,
+        .receivedAt = receivedAt,
+    };
+    HAPError err = HAPPlatformRunLoopScheduleCallback(ScheduledTargetDoorStateCallback, &context, sizeof context);
+    if (err) {
+        HAPLogError(&kHAPLog_Default, "%s: Failed to schedule door command: %u.", __func__, err);
+    }
+}
 
-        timer_enable_intr(TIMER_GROUP_0, TIMER_0);
-        // ESP_LOGI(LOGNAME, "timer enabled interruption \n");
+#if CONFIG_GARAGE_RF_RECEIVER
+static void HandleDoorActivityTimerExpired(HAPPlatformTimerRef timer HAP_UNUSED, void* _Nullable context HAP_UNUSED) {
+    accessoryConfiguration.doorActivityTimer = 0;
+    accessoryConfiguration.isDoorActivityReported = false;
+    if (accessoryConfiguration.state.targetDoorState == kHAPCharacteristicValue_TargetDoorState_Open) {
+        accessoryConfiguration.state.targetDoorState = kHAPCharacteristicValue_TargetDoorState_Closed;
+        accessoryConfiguration.state.currentDoorState = kHAPCharacteristicValue_CurrentDoorState_Closed;
+        SaveAccessoryState();
+        NotifyDoorStateChanged();
+    }
+}
 
-        timer_isr_callback_add(TIMER_GROUP_0, TIMER_0, isr_handler, NULL, 0);
+/**
+ * Reports the door as open after another resident's remote has been heard, and as closed again once the
+ * configured hold time has passed without further activity.
+ */
+static void HandleDoorActivity(int64_t receivedAt) {
+    if (accessoryConfiguration.doorActivityTimer) {
+        HAPPlatformTimerDeregister(accessoryConfiguration.doorActivityTimer);
+        accessoryConfiguration.doorActivityTimer = 0;
+    }
+    HAPError err = HAPPlatformTimerRegister(
+            &accessoryConfiguration.doorActivityTimer,
+            HAPPlatformClockGetCurrent() + CONFIG_GARAGE_RF_DOOR_ACTIVITY_HOLD_S * HAPSecond,
+            HandleDoorActivityTimerExpired,
+            NULL);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLogError(&kHAPLog_Default, "%s: Not enough timers available.", __func__);
+    }
+
+    if (accessoryConfiguration.state.targetDoorState == kHAPCharacteristicValue_TargetDoorState_Open) {
+        return;
+    }
+    HAPLogInfo(&kHAPLog_Default, "Door operated by another remote.");
+    accessoryConfiguration.isDoorActivityReported = true;
+    accessoryConfiguration.state.targetDoorState = kHAPCharacteristicValue_TargetDoorState_Open;
+    accessoryConfiguration.state.currentDoorState = kHAPCharacteristicValue_CurrentDoorState_Open;
+    NotifyDoorStateChanged();
+    MetricsRecord(kMetric_DoorActivityLatency, (uint32_t)(esp_timer_get_time() - receivedAt));
+    SaveAccessoryState();
+}
 
-        // ESP_LOGI(LOGNAME, "timer callback added\n");
-        
-        timer_start(TIMER_GROUP_0, TIMER_0);
-        HAPLogInfo(&kHAPLog_Default, "Timer started");
+/**
+ * Handles a code received by the 433 MHz receiver. Executed on the run loop.
+ */
+static void HandleRfCode(const RfCode* code, int64_t receivedAt) {
+    if (RfCalibrationHandleCode(code, receivedAt)) {
+        return;
+    }
+    if (RfCodeBookHandleCode(code, receivedAt)) {
+        HandleDoorActivity(receivedAt);
+    }
+}
+#endif
+
+#if CONFIG_GARAGE_SUPPLY_MONITOR
+/**
+ * Sheds load while the supply is weak. Executed on the run loop.
+ *
+ * - Low: Wi-Fi saves power and flash writes are held back, since a write interrupted by a brown-out is lost.
+ * - Critical: additionally, opening is refused. Pending state is written right away, as the supply is unlikely to
+ *   recover before it fails.
+ */
+static void HandleSupplyLevelChanged(SupplyLevel level, uint32_t supplyMV) {
+    HAPLogInfo(
+            &kHAPLog_Default,
+            "Supply %s: %lu mV.",
+            SupplyLevelGetName(level),
+            (unsigned long) supplyMV);
+    PerfSnapshotTrace(kPerfSnapshotEvent_SupplyLevelChanged, (uint32_t) level << 16 | (supplyMV & 0xFFFF));
+
+    accessoryConfiguration.supplyLevel = level;
+    app_wifi_set_low_power(level != kSupplyLevel_Normal);
+    FlashWriteSchedulerSetHeld(level != kSupplyLevel_Normal);
+    if (level == kSupplyLevel_Critical) {
+        FlashWriteSchedulerFlush();
+    }
+}
+#endif
+
+void AppGetDoorState(uint8_t* currentDoorState, uint8_t* targetDoorState) {
+    HAPPrecondition(currentDoorState);
+    HAPPrecondition(targetDoorState);
+
+    *currentDoorState = accessoryConfiguration.state.currentDoorState;
+    *targetDoorState = accessoryConfiguration.state.targetDoorState;
 }
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -292,114 +675,53 @@ HAPError IdentifyAccessory(
 
 
 /**
- * Handle read request to the 'Current Door State' characteristic of the Garage Door Opener service.
+ * Refuses to operate the remote while the supply is about to brown out.
  */
-HAP_RESULT_USE_CHECK
-HAPError HandleGarageDoorOpenerCurrentDoorStateRead(
-        HAPAccessoryServerRef* server HAP_UNUSED,
-        const HAPUInt8CharacteristicReadRequest* request HAP_UNUSED,
-        uint8_t* value,
-        void* _Nullable context HAP_UNUSED) {
-    HAPLogInfo(&kHAPLog_Default, "%s", __func__);
-    *value = accessoryConfiguration.state.currentDoorState;
-    switch (*value) {
-        case kHAPCharacteristicValue_CurrentDoorState_Open: {
-            HAPLogInfo(&kHAPLog_Default, "%s: %s", __func__, "CurrentDoorState_Open");
-        } break;
-        case kHAPCharacteristicValue_CurrentDoorState_Closed: {
-            HAPLogInfo(&kHAPLog_Default, "%s: %s", __func__, "CurrentDoorState_Closed");
-        } break;
-        case kHAPCharacteristicValue_CurrentDoorState_Opening: {
-            HAPLogInfo(&kHAPLog_Default, "%s: %s", __func__, "CurrentDoorState_Opening");
-        } break;
-        case kHAPCharacteristicValue_CurrentDoorState_Closing: {
-            HAPLogInfo(&kHAPLog_Default, "%s: %s", __func__, "CurrentDoorState_Closing");
-        } break;
-        case kHAPCharacteristicValue_CurrentDoorState_Stopped: {
-            HAPLogInfo(&kHAPLog_Default, "%s: %s", __func__, "CurrentDoorState_Stopped");
-        } break;
+static HAPError ValidateTargetDoorState(uint8_t value) {
+    if (IsActuationRefused((HAPCharacteristicValue_TargetDoorState) value)) {
+        HAPLogError(&kHAPLog_Default, "%s: Supply voltage critical. Refusing to operate the remote.", __func__);
+        return kHAPError_Busy;
     }
     return kHAPError_None;
 }
 
 /**
- * Handle read request to the 'Target Door State' characteristic of the Garage Door Opener service.
+ * Applies a target door state written by a controller and records its latency by session class.
  */
-HAP_RESULT_USE_CHECK
-HAPError HandleGarageDoorOpenerTargetDoorStateRead(
-        HAPAccessoryServerRef* server HAP_UNUSED,
-        const HAPUInt8CharacteristicReadRequest* request HAP_UNUSED,
-        uint8_t* value,
-        void* _Nullable context HAP_UNUSED) {
-    HAPLogInfo(&kHAPLog_Default, "%s", __func__);
-    *value = accessoryConfiguration.state.targetDoorState;
-    switch (*value) {
-        case kHAPCharacteristicValue_TargetDoorState_Open: {
-            HAPLogInfo(&kHAPLog_Default, "%s: %s", __func__, "TargetDoorState_Open");
-        } break;
-        case kHAPCharacteristicValue_TargetDoorState_Closed: {
-            HAPLogInfo(&kHAPLog_Default, "%s: %s", __func__, "TargetDoorState_Closed");
-        } break;
+static void HandleTargetDoorStateChange(HAPSessionRef* session, uint8_t value, int64_t receivedAt) {
+    int64_t startedAt;
+    SessionClass sessionClass = SessionTrackerClassifyCommand(session, receivedAt, &startedAt);
+    int64_t actuatedAt =
+            SetTargetDoorState((HAPCharacteristicValue_TargetDoorState) value, kAppCommandSource_HAP, receivedAt);
+    if (actuatedAt) {
+        static const Metric sessionClassMetrics[] = {
+            [kSessionClass_Cold] = kMetric_CommandLatencyCold,
+            [kSessionClass_Warm] = kMetric_CommandLatencyWarm,
+            [kSessionClass_Idle] = kMetric_CommandLatencyIdle,
+        };
+        MetricsRecord(sessionClassMetrics[sessionClass], (uint32_t)(actuatedAt - startedAt));
     }
-    return kHAPError_None;
 }
 
-/**
- * Handle write request to the 'Target Door State' characteristic of the Garage Door Opener service.
- */
-HAP_RESULT_USE_CHECK
-HAPError HandleGarageDoorOpenerTargetDoorStateWrite(
-        HAPAccessoryServerRef* server,
-        const HAPUInt8CharacteristicWriteRequest* request,
-        uint8_t value,
-        void* _Nullable context HAP_UNUSED) {
-    HAPLogInfo(&kHAPLog_Default, "%s", __func__);
-    HAPCharacteristicValue_TargetDoorState targetState = (HAPCharacteristicValue_TargetDoorState) value;
-    switch (targetState) {
-        case kHAPCharacteristicValue_TargetDoorState_Open: {
-            HAPLogInfo(&kHAPLog_Default, "%s: %s", __func__, "TargetDoorState_Open");
-        } break;
-        case kHAPCharacteristicValue_TargetDoorState_Closed: {
-            HAPLogInfo(&kHAPLog_Default, "%s: %s", __func__, "TargetDoorState_Closed");
-        } break;
-    }
-
-    if (accessoryConfiguration.state.targetDoorState != targetState) {
-        accessoryConfiguration.state.targetDoorState = targetState;
-        accessoryConfiguration.state.currentDoorState = targetState;
-        SaveAccessoryState();
-        HAPAccessoryServerRaiseEvent(server, request->characteristic, request->service, request->accessory);
-        HAPAccessoryServerRaiseEvent(server, &garageDoorOpenerCurrentDoorStateCharacteristic, request->service, request->accessory);
-
-        // this should be a a helper function for mapping the value and notifying current/target state
-        switch (targetState) {
-            case kHAPCharacteristicValue_TargetDoorState_Open: {
-                gpio_set_level(kLedGPIOPin, true);
-                set_timer(5000, switch_off_timer_callback);
-            } break;
-            case kHAPCharacteristicValue_TargetDoorState_Closed: {
-                gpio_set_level(kLedGPIOPin, false);
-            } break;
-        }
-
-    }
+CHARACTERISTIC_BINDING_UINT8_READ(HandleGarageDoorOpenerCurrentDoorStateRead, currentDoorStateBinding)
+CHARACTERISTIC_BINDING_UINT8_READ(HandleGarageDoorOpenerTargetDoorStateRead, targetDoorStateBinding)
+CHARACTERISTIC_BINDING_UINT8_WRITE(HandleGarageDoorOpenerTargetDoorStateWrite, targetDoorStateBinding)
+CHARACTERISTIC_BINDING_BOOL_READ(HandleGarageDoorOpenerObstructionDetectedRead, obstructionDetectedBinding)
 
-    return kHAPError_None;
+void HandleGarageDoorOpenerDoorStateSubscribe(
+        HAPAccessoryServerRef* server HAP_UNUSED,
+        const HAPUInt8CharacteristicSubscriptionRequest* request,
+        void* _Nullable context HAP_UNUSED) {
+    SessionTrackerHandleRequest(request->session);
+    SubscriptionIndexHandleSubscribe(request->characteristic, request->session);
 }
 
-/**
- * Handle read request to the 'Obstruction Detected' characteristic of the Garage Door Opener service.
- */
-HAP_RESULT_USE_CHECK
-HAPError HandleGarageDoorOpenerObstructionDetectedRead(
+void HandleGarageDoorOpenerDoorStateUnsubscribe(
         HAPAccessoryServerRef* server HAP_UNUSED,
-        const HAPBoolCharacteristicReadRequest* request HAP_UNUSED,
-        bool* value,
+        const HAPUInt8CharacteristicSubscriptionRequest* request,
         void* _Nullable context HAP_UNUSED) {
-    *value = accessoryConfiguration.state.obstructionDetected;
-    HAPLogInfo(&kHAPLog_Default, "%s: %s", __func__, *value ? "true" : "false");
-
-    return kHAPError_None;
+    SessionTrackerHandleRequest(request->session);
+    SubscriptionIndexHandleUnsubscribe(request->characteristic, request->session);
 }
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -429,15 +751,56 @@ const HAPAccessory* AppGetAccessoryInfo() {
     return &accessory;
 }
 
+void AccessoryServerHandleSessionAccept(
+        HAPAccessoryServerRef* server HAP_UNUSED,
+        HAPSessionRef* session,
+        void* _Nullable context HAP_UNUSED) {
+    SessionTrackerHandleAccept(session);
+    // Pair Verify follows.
+    FlashWriteSchedulerDefer(kAppFlashQuietAfterSessionAcceptMS);
+}
+
+void AccessoryServerHandleSessionInvalidate(
+        HAPAccessoryServerRef* server HAP_UNUSED,
+        HAPSessionRef* session,
+        void* _Nullable context HAP_UNUSED) {
+    SessionTrackerHandleInvalidate(session);
+    SubscriptionIndexHandleSessionInvalidate(session);
+}
+
 void AppInitialize(
         HAPAccessoryServerOptions* hapAccessoryServerOptions,
         HAPPlatform* hapPlatform,
         HAPAccessoryServerCallbacks* hapAccessoryServerCallbacks) {
     HAPLogInfo(&kHAPLog_Default, "Initializing app and GPIO pin.");
-    gpio_pad_select_gpio(kLedGPIOPin);
-    gpio_set_direction(kLedGPIOPin, GPIO_MODE_OUTPUT);
-    gpio_set_level(kLedGPIOPin, 0);
     xTaskCreate(switch_off_handler, "switch_off_handler", 4 * 1024, NULL, 10, &switch_off_handler_task_ptr);
+    ActuatorInitialize(kLedGPIOPin, switch_off_handler_task_ptr);
+    hapAccessoryServerCallbacks->handleSessionAccept = AccessoryServerHandleSessionAccept;
+    hapAccessoryServerCallbacks->handleSessionInvalidate = AccessoryServerHandleSessionInvalidate;
+#if CONFIG_GARAGE_LOCAL_CONTROL
+    LocalControlStart();
+#endif
+#if CONFIG_GARAGE_MQTT
+    MqttBridgeStart();
+#endif
+#if CONFIG_GARAGE_TELEMETRY
+    TelemetryStart();
+#endif
+#if CONFIG_GARAGE_RF_RECEIVER
+    RfReceiverStart(HandleRfCode);
+#endif
+#if CONFIG_GARAGE_SUPPLY_MONITOR
+    SupplyMonitorStart(HandleSupplyLevelChanged);
+#endif
+#if CONFIG_GARAGE_HOTPATH_PROFILER
+    HotPathProfilerStart();
+#endif
+#if CONFIG_GARAGE_OVERLOAD_CONTROL
+    OverloadStart();
+#endif
+#if CONFIG_GARAGE_BENCHMARK
+    BenchmarkCreate(hapPlatform->keyValueStore);
+#endif
 }
 
 void AppDeinitialize() {
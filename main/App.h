@@ -23,6 +23,65 @@ extern "C" {
 #pragma clang assume_nonnull begin
 #endif
 
+/**
+ * Domain used in the key value store for application data.
+ *
+ * Purged: On factory reset.
+ */
+#define kAppKeyValueStoreDomain_Configuration ((HAPPlatformKeyValueStoreDomain) 0x00)
+
+/**
+ * Key used in the key value store to store the configuration state.
+ *
+ * Purged: On factory reset.
+ */
+#define kAppKeyValueStoreKey_Configuration_State ((HAPPlatformKeyValueStoreDomain) 0x00)
+
+/**
+ * Key used in the key value store to store the hash of the attribute database that the configuration number belongs
+ * to.
+ *
+ * Purged: On factory reset.
+ */
+#define kAppKeyValueStoreKey_Configuration_DatabaseHash ((HAPPlatformKeyValueStoreDomain) 0x01)
+
+/**
+ * Key used in the key value store to store the press length calibration of the RF receiver (RfCalibration.c).
+ * Format: 4 bytes code and 4 bytes press length in milliseconds, both little endian.
+ *
+ * Purged: On factory reset.
+ */
+#define kAppKeyValueStoreKey_Configuration_RfCalibration ((HAPPlatformKeyValueStoreKey) 0x02)
+
+/**
+ * Key used in the key value store to store the door codes learned by the RF receiver (RfCodeBook.c).
+ * Format: 4 bytes little endian per learned code.
+ *
+ * Purged: On factory reset.
+ */
+#define kAppKeyValueStoreKey_Configuration_RfCodeBook ((HAPPlatformKeyValueStoreKey) 0x03)
+
+/**
+ * Key used in the key value store by the key-value store benchmarks (Benchmark.c). Removed after each run.
+ *
+ * Purged: On factory reset.
+ */
+#define kAppKeyValueStoreKey_Configuration_Benchmark ((HAPPlatformKeyValueStoreKey) 0x10)
+
+/**
+ * Origin of a door command. Used to attribute latency measurements to the path that carried the command.
+ */
+typedef enum {
+    /** Write to the 'Target Door State' characteristic through the HAP accessory server. */
+    kAppCommandSource_HAP,
+
+    /** Request received by the local control server. */
+    kAppCommandSource_LocalControl,
+
+    /** Message received on the MQTT command topic. */
+    kAppCommandSource_MQTT
+} AppCommandSource;
+
 /**
  * Identify routine. Used to locate the accessory.
  */
@@ -62,6 +121,24 @@ HAPError HandleGarageDoorOpenerTargetDoorStateWrite(
         uint8_t value,
         void* _Nullable context);
 
+/**
+ * Handle subscribe request to the 'Current Door State' and 'Target Door State' characteristics of the Garage Door
+ * Opener service.
+ */
+void HandleGarageDoorOpenerDoorStateSubscribe(
+        HAPAccessoryServerRef* server,
+        const HAPUInt8CharacteristicSubscriptionRequest* request,
+        void* _Nullable context);
+
+/**
+ * Handle unsubscribe request to the 'Current Door State' and 'Target Door State' characteristics of the Garage Door
+ * Opener service.
+ */
+void HandleGarageDoorOpenerDoorStateUnsubscribe(
+        HAPAccessoryServerRef* server,
+        const HAPUInt8CharacteristicSubscriptionRequest* request,
+        void* _Nullable context);
+
 /**
  * Handle read request to the 'Obstruction Detected' characteristic of the Garage Door Opener service.
  */
@@ -72,6 +149,26 @@ HAPError HandleGarageDoorOpenerObstructionDetectedRead(
         bool* value,
         void* _Nullable context);
 
+/**
+ * Request a new target door state on behalf of a command source other than the HAP accessory server.
+ *
+ * The request is executed on the run loop through the same path as writes to the 'Target Door State'
+ * characteristic. May be called from any task.
+ *
+ * @param      targetState          Requested target door state.
+ * @param      source               Origin of the command.
+ * @param      receivedAt           Time at which the command was received, in microseconds (esp_timer_get_time).
+ */
+void AppScheduleTargetDoorState(
+        HAPCharacteristicValue_TargetDoorState targetState,
+        AppCommandSource source,
+        int64_t receivedAt);
+
+/**
+ * Returns the current and target door states.
+ */
+void AppGetDoorState(uint8_t* currentDoorState, uint8_t* targetDoorState);
+
 /**
  * Initialize the application.
  */
@@ -82,6 +179,12 @@ void AppCreate(HAPAccessoryServerRef* server, HAPPlatformKeyValueStoreRef keyVal
  */
 void AppRelease(void);
 
+/**
+ * Drop pending state that must not survive a factory reset. Must be called before the app's key-value store domain
+ * is purged, as AppRelease would write it back otherwise.
+ */
+void AppPrepareFactoryReset(void);
+
 /**
  * Start the accessory server for the app.
  */
@@ -0,0 +1,840 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "Benchmark.h"
+
+#include "HAPCrypto.h"
+
+#include "App.h"
+#include "DBSize.h"
+#include "Placement.h"
+#include "SubscriptionIndex.h"
+#if CONFIG_GARAGE_TELEMETRY
+#include "TelemetryStore.h"
+#endif
+#if CONFIG_GARAGE_OVERLOAD_CONTROL
+#include "Overload.h"
+#endif
+#if CONFIG_GARAGE_LOCAL_CONTROL
+#include "WriteRequest.h"
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <driver/gpio.h>
+#include <esp_chip_info.h>
+#include <esp_console.h>
+#include <esp_cpu.h>
+#include <esp_heap_caps.h>
+#include <esp_ota_ops.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#if CONFIG_GARAGE_KVS_CACHE
+HAPError __real_HAPPlatformKeyValueStoreGet(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        void* _Nullable bytes,
+        size_t maxBytes,
+        size_t* _Nullable numBytes,
+        bool* found);
+#endif
+
+/**
+ * Size of the key-value store entry, similar to a pairing.
+ */
+#define kBenchmark_KeyValueStoreBytes ((size_t) 32)
+
+/**
+ * Size of an encrypted HAP frame.
+ */
+#define kBenchmark_FrameBytes ((size_t) 1024)
+
+/**
+ * Size of the memory copy benchmarks.
+ */
+#define kBenchmark_CopyBytes ((size_t) 4096)
+
+/**
+ * Delay of the timer benchmark.
+ */
+#define kBenchmark_TimerDelayUs ((uint64_t) 1000)
+
+/**
+ * Number of characteristics of the fan-out benchmarks, similar to a bridge with a few dozen accessories.
+ */
+#define kBenchmark_FanoutCharacteristics ((size_t) 100)
+
+/**
+ * Session counts of the fan-out sweep, from a single controller to every session slot (at least 8).
+ */
+static const size_t kBenchmarkFanoutSessionCounts[] = { 1, 2, 4, CONFIG_GARAGE_HAP_SESSIONS };
+
+/**
+ * Characteristic counts of the fan-out sweep, from a single accessory to kBenchmark_FanoutCharacteristics.
+ */
+static const size_t kBenchmarkFanoutCharacteristicCounts[] = { 10, 30, kBenchmark_FanoutCharacteristics };
+
+/**
+ * Maximum number of iterations of a benchmark.
+ */
+#define kBenchmark_MaxIterations ((size_t) 1000)
+
+/**
+ * Operation that is measured. Returns its duration in nanoseconds.
+ */
+typedef uint32_t (*BenchmarkOperation)(void);
+
+/**
+ * Synthetic database and sessions of the fan-out benchmarks. Characteristics and sessions are only compared by
+ * address, never accessed.
+ */
+typedef struct {
+    /** Sessions and characteristics in use. */
+    size_t numSessions;
+    size_t numCharacteristics;
+
+    uint8_t characteristics[kBenchmark_FanoutCharacteristics];
+    uint64_t sessions[CONFIG_GARAGE_HAP_SESSIONS];
+
+    /** Characteristics in database order. */
+    const HAPCharacteristic* database[kBenchmark_FanoutCharacteristics];
+
+    /** Per session, the subscribed characteristics, like the event notification table of a HAP session. */
+    const HAPCharacteristic* subscriptions[CONFIG_GARAGE_HAP_SESSIONS][kBenchmark_FanoutCharacteristics];
+    size_t numSubscriptions[CONFIG_GARAGE_HAP_SESSIONS];
+
+    SubscriptionIndexEntry entries[kBenchmark_FanoutCharacteristics];
+    SubscriptionIndexTable table;
+} Fanout;
+
+#if CONFIG_GARAGE_TELEMETRY
+/**
+ * Store of the telemetry benchmarks, with two columns of each type.
+ */
+typedef struct {
+    TelemetryStore store;
+    TelemetryBlock blocks[4];
+    uint8_t order[4];
+} TelemetryBenchmark;
+
+static const TelemetryColumnType kBenchmarkTelemetryColumnTypes[] = {
+    kTelemetryColumnType_Int,
+    kTelemetryColumnType_Int,
+    kTelemetryColumnType_Float,
+    kTelemetryColumnType_Float,
+};
+#endif
+
+static struct {
+    HAPPlatformKeyValueStoreRef keyValueStore;
+
+    /** Protects the report and isRunning. */
+    SemaphoreHandle_t _Nullable lock;
+    bool isRunning;
+    bool hasReport;
+    size_t numReportBytes;
+
+    // Only accessed by the benchmark task and the callbacks it waits for.
+
+    /** Signalled by run loop and timer callbacks. */
+    SemaphoreHandle_t _Nullable done;
+    uint32_t result;
+    int64_t firedAt;
+    esp_timer_handle_t _Nullable timer;
+    uint8_t* _Nullable copyBytes;
+    Fanout* _Nullable fanout;
+#if CONFIG_GARAGE_TELEMETRY
+    TelemetryBenchmark* _Nullable telemetry;
+#endif
+    size_t numAccessoryBytes;
+    uint32_t numErrors;
+    uint32_t numIterations;
+} benchmark;
+
+/**
+ * Report of the most recent run. Protected by benchmark.lock.
+ */
+static EXT_RAM_ATTR char benchmarkReport[kBenchmark_MaxReportBytes];
+
+static struct {
+    uint8_t key[CHACHA20_POLY1305_KEY_BYTES];
+    uint8_t nonce[8];
+    uint8_t input[kBenchmark_FrameBytes];
+    uint8_t output[kBenchmark_FrameBytes];
+    uint8_t tag[CHACHA20_POLY1305_TAG_BYTES];
+    uint8_t secretKey[X25519_SCALAR_BYTES];
+    uint8_t publicKey[X25519_BYTES];
+    uint8_t digest[SHA512_BYTES];
+} buffers;
+
+static uint32_t CyclesToNs(uint32_t cycles) {
+    return (uint32_t)((uint64_t) cycles * 1000 / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+}
+
+static void AppendReport(const char* format, ...) {
+    char line[160];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof line, format, args);
+    va_end(args);
+    HAPAssert(n > 0 && (size_t) n < sizeof line);
+    printf("%s", line);
+
+    xSemaphoreTake(benchmark.lock, portMAX_DELAY);
+    if ((size_t) n < sizeof benchmarkReport - benchmark.numReportBytes) {
+        HAPRawBufferCopyBytes(&benchmarkReport[benchmark.numReportBytes], line, (size_t) n);
+        benchmark.numReportBytes += (size_t) n;
+    } else {
+        benchmark.numErrors++;
+    }
+    xSemaphoreGive(benchmark.lock);
+}
+
+static int CompareSamples(const void* a, const void* b) {
+    uint32_t sampleA = *(const uint32_t*) a;
+    uint32_t sampleB = *(const uint32_t*) b;
+    return sampleA < sampleB ? -1 : sampleA > sampleB;
+}
+
+static void Run(const char* name, size_t numIterations, BenchmarkOperation operation, uint32_t* samples) {
+    HAPPrecondition(numIterations && numIterations <= kBenchmark_MaxIterations);
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < numIterations; i++) {
+        benchmark.numIterations = (uint32_t) i;
+        samples[i] = operation();
+        sum += samples[i];
+    }
+    qsort(samples, numIterations, sizeof samples[0], CompareSamples);
+    AppendReport(
+            "BENCH name=%s n=%u min_ns=%lu p50_ns=%lu mean_ns=%lu max_ns=%lu\n",
+            name,
+            (unsigned) numIterations,
+            (unsigned long) samples[0],
+            (unsigned long) samples[numIterations / 2],
+            (unsigned long) (sum / numIterations),
+            (unsigned long) samples[numIterations - 1]);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static uint32_t EncryptFrame(void) {
+    uint32_t startedAt = esp_cpu_get_ccount();
+    HAP_chacha20_poly1305_encrypt(
+            buffers.tag,
+            buffers.output,
+            buffers.input,
+            sizeof buffers.input,
+            buffers.nonce,
+            sizeof buffers.nonce,
+            buffers.key);
+    return CyclesToNs(esp_cpu_get_ccount() - startedAt);
+}
+
+/**
+ * Encrypts an /accessories response of the size of the attribute database, one HAP frame at a time.
+ */
+static uint32_t EncryptAccessories(void) {
+    uint32_t startedAt = esp_cpu_get_ccount();
+    for (size_t offset = 0; offset < benchmark.numAccessoryBytes; offset += kBenchmark_FrameBytes) {
+        HAP_chacha20_poly1305_encrypt(
+                buffers.tag,
+                buffers.output,
+                buffers.input,
+                HAPMin(kBenchmark_FrameBytes, benchmark.numAccessoryBytes - offset),
+                buffers.nonce,
+                sizeof buffers.nonce,
+                buffers.key);
+    }
+    return CyclesToNs(esp_cpu_get_ccount() - startedAt);
+}
+
+static uint32_t DerivePublicKey(void) {
+    uint32_t startedAt = esp_cpu_get_ccount();
+    HAP_X25519_scalarmult_base(buffers.publicKey, buffers.secretKey);
+    return CyclesToNs(esp_cpu_get_ccount() - startedAt);
+}
+
+static uint32_t HashFrame(void) {
+    uint32_t startedAt = esp_cpu_get_ccount();
+    HAP_sha512(buffers.digest, buffers.input, sizeof buffers.input);
+    return CyclesToNs(esp_cpu_get_ccount() - startedAt);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static void RunLoopOperationCallback(void* _Nullable context, size_t contextSize) {
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(BenchmarkOperation));
+
+    benchmark.result = (*(const BenchmarkOperation*) context)();
+    xSemaphoreGive(benchmark.done);
+}
+
+/**
+ * Runs an operation on the run loop and waits for it. The key-value store is only accessed on the run loop.
+ */
+static uint32_t RunOnRunLoop(BenchmarkOperation operation) {
+    if (HAPPlatformRunLoopScheduleCallback(RunLoopOperationCallback, &operation, sizeof operation)) {
+        benchmark.numErrors++;
+        return 0;
+    }
+    xSemaphoreTake(benchmark.done, portMAX_DELAY);
+    return benchmark.result;
+}
+
+static uint32_t SetKeyValueStoreEntryOnRunLoop(void) {
+    // Vary the value so that every iteration writes.
+    uint8_t bytes[kBenchmark_KeyValueStoreBytes];
+    HAPRawBufferZero(bytes, sizeof bytes);
+    HAPWriteLittleUInt32(bytes, benchmark.numIterations);
+
+    uint32_t startedAt = esp_cpu_get_ccount();
+    HAPError err = HAPPlatformKeyValueStoreSet(
+            benchmark.keyValueStore,
+            kAppKeyValueStoreDomain_Configuration,
+            kAppKeyValueStoreKey_Configuration_Benchmark,
+            bytes,
+            sizeof bytes);
+    uint32_t cycles = esp_cpu_get_ccount() - startedAt;
+    if (err) {
+        benchmark.numErrors++;
+    }
+    return CyclesToNs(cycles);
+}
+
+static uint32_t SetKeyValueStoreEntry(void) {
+    return RunOnRunLoop(SetKeyValueStoreEntryOnRunLoop);
+}
+
+static uint32_t GetKeyValueStoreEntryOnRunLoop(void) {
+    uint8_t bytes[kBenchmark_KeyValueStoreBytes];
+    size_t numBytes;
+    bool found;
+
+    uint32_t startedAt = esp_cpu_get_ccount();
+    HAPError err = HAPPlatformKeyValueStoreGet(
+            benchmark.keyValueStore,
+            kAppKeyValueStoreDomain_Configuration,
+            kAppKeyValueStoreKey_Configuration_Benchmark,
+            bytes,
+            sizeof bytes,
+            &numBytes,
+            &found);
+    uint32_t cycles = esp_cpu_get_ccount() - startedAt;
+    if (err || !found) {
+        benchmark.numErrors++;
+    }
+    return CyclesToNs(cycles);
+}
+
+static uint32_t GetKeyValueStoreEntry(void) {
+    return RunOnRunLoop(GetKeyValueStoreEntryOnRunLoop);
+}
+
+#if CONFIG_GARAGE_KVS_CACHE
+static uint32_t GetKeyValueStoreEntryFromBackendOnRunLoop(void) {
+    uint8_t bytes[kBenchmark_KeyValueStoreBytes];
+    size_t numBytes;
+    bool found;
+
+    uint32_t startedAt = esp_cpu_get_ccount();
+    HAPError err = __real_HAPPlatformKeyValueStoreGet(
+            benchmark.keyValueStore,
+            kAppKeyValueStoreDomain_Configuration,
+            kAppKeyValueStoreKey_Configuration_Benchmark,
+            bytes,
+            sizeof bytes,
+            &numBytes,
+            &found);
+    uint32_t cycles = esp_cpu_get_ccount() - startedAt;
+    if (err || !found) {
+        benchmark.numErrors++;
+    }
+    return CyclesToNs(cycles);
+}
+
+static uint32_t GetKeyValueStoreEntryFromBackend(void) {
+    return RunOnRunLoop(GetKeyValueStoreEntryFromBackendOnRunLoop);
+}
+#endif
+
+static uint32_t RemoveKeyValueStoreEntryOnRunLoop(void) {
+    if (HAPPlatformKeyValueStoreRemove(
+                benchmark.keyValueStore,
+                kAppKeyValueStoreDomain_Configuration,
+                kAppKeyValueStoreKey_Configuration_Benchmark)) {
+        benchmark.numErrors++;
+    }
+    return 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static uint32_t ToggleGpio(void) {
+    uint32_t startedAt = esp_cpu_get_ccount();
+    gpio_set_level(CONFIG_GARAGE_BENCHMARK_GPIO, benchmark.numIterations & 1);
+    return CyclesToNs(esp_cpu_get_ccount() - startedAt);
+}
+
+static void HandleTimerFired(void* arg HAP_UNUSED) {
+    benchmark.firedAt = esp_timer_get_time();
+    xSemaphoreGive(benchmark.done);
+}
+
+static uint32_t ArmTimer(void) {
+    uint32_t startedAt = esp_cpu_get_ccount();
+    esp_err_t err = esp_timer_start_once(HAPNonnull(benchmark.timer), kBenchmark_TimerDelayUs);
+    uint32_t cycles = esp_cpu_get_ccount() - startedAt;
+    if (err || esp_timer_stop(HAPNonnull(benchmark.timer))) {
+        benchmark.numErrors++;
+    }
+    return CyclesToNs(cycles);
+}
+
+static uint32_t FireTimer(void) {
+    int64_t armedAt = esp_timer_get_time();
+    if (esp_timer_start_once(HAPNonnull(benchmark.timer), kBenchmark_TimerDelayUs)) {
+        benchmark.numErrors++;
+        return 0;
+    }
+    xSemaphoreTake(benchmark.done, portMAX_DELAY);
+    int64_t lateness = benchmark.firedAt - armedAt - (int64_t) kBenchmark_TimerDelayUs;
+    return lateness > 0 ? (uint32_t) lateness * 1000 : 0;
+}
+
+static void SignalDone(void* _Nullable context HAP_UNUSED, size_t contextSize HAP_UNUSED) {
+    xSemaphoreGive(benchmark.done);
+}
+
+static uint32_t RoundTripRunLoop(void) {
+    uint32_t startedAt = esp_cpu_get_ccount();
+    if (HAPPlatformRunLoopScheduleCallback(SignalDone, NULL, 0)) {
+        benchmark.numErrors++;
+        return 0;
+    }
+    xSemaphoreTake(benchmark.done, portMAX_DELAY);
+    return CyclesToNs(esp_cpu_get_ccount() - startedAt);
+}
+
+static uint32_t Copy(void) {
+    uint8_t* bytes = HAPNonnull(benchmark.copyBytes);
+    uint32_t startedAt = esp_cpu_get_ccount();
+    memcpy(&bytes[kBenchmark_CopyBytes], bytes, kBenchmark_CopyBytes);
+    return CyclesToNs(esp_cpu_get_ccount() - startedAt);
+}
+
+#if CONFIG_GARAGE_LOCAL_CONTROL
+static const char kWriteRequestBody[] = "{\"characteristics\":[{\"aid\":1,\"iid\":52,\"value\":1}]}";
+
+static uint32_t ParseWriteRequestFast(void) {
+    WriteRequest request;
+    uint32_t startedAt = esp_cpu_get_ccount();
+    bool isRecognized = WriteRequestParseFast(kWriteRequestBody, sizeof kWriteRequestBody - 1, &request);
+    uint32_t cycles = esp_cpu_get_ccount() - startedAt;
+    if (!isRecognized) {
+        benchmark.numErrors++;
+    }
+    return CyclesToNs(cycles);
+}
+
+static uint32_t ParseWriteRequest(void) {
+    WriteRequest request;
+    uint32_t startedAt = esp_cpu_get_ccount();
+    HAPError err = WriteRequestParse(kWriteRequestBody, &request);
+    uint32_t cycles = esp_cpu_get_ccount() - startedAt;
+    if (err) {
+        benchmark.numErrors++;
+    }
+    return CyclesToNs(cycles);
+}
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Whether a session is subscribed to a characteristic. Session 0 is a home hub that subscribes to everything, the
+ * other sessions subscribe to a quarter of the characteristics.
+ */
+static bool IsFanoutSubscribed(size_t session, size_t characteristic) {
+    return session == 0 || (session + characteristic) % 4 == 0;
+}
+
+static void PrepareFanout(Fanout* fanout, size_t numSessions, size_t numCharacteristics) {
+    HAPPrecondition(numSessions <= CONFIG_GARAGE_HAP_SESSIONS);
+    HAPPrecondition(numCharacteristics <= kBenchmark_FanoutCharacteristics);
+
+    HAPRawBufferZero(fanout, sizeof *fanout);
+    fanout->numSessions = numSessions;
+    fanout->numCharacteristics = numCharacteristics;
+    fanout->table.entries = fanout->entries;
+    fanout->table.maxEntries = HAPArrayCount(fanout->entries);
+    for (size_t c = 0; c < numCharacteristics; c++) {
+        fanout->database[c] = &fanout->characteristics[c];
+        for (size_t s = 0; s < numSessions; s++) {
+            if (IsFanoutSubscribed(s, c)) {
+                fanout->subscriptions[s][fanout->numSubscriptions[s]++] = fanout->database[c];
+                SubscriptionIndexTableSubscribe(
+                        &fanout->table, fanout->database[c], (HAPSessionRef*) &fanout->sessions[s]);
+            }
+        }
+    }
+}
+
+static size_t GetNumFanoutSubscribers(const Fanout* fanout, size_t characteristic) {
+    size_t numSubscribers = 0;
+    for (size_t s = 0; s < fanout->numSessions; s++) {
+        numSubscribers += IsFanoutSubscribed(s, characteristic);
+    }
+    return numSubscribers;
+}
+
+static void CountDelivery(void* _Nullable context, HAPSessionRef* session HAP_UNUSED) {
+    (*(size_t*) HAPNonnull(context))++;
+}
+
+/**
+ * Raises an event through the subscription index (SubscriptionIndex.h).
+ */
+static uint32_t RaiseEventIndexed(void) {
+    const Fanout* fanout = HAPNonnull(benchmark.fanout);
+    size_t index = benchmark.numIterations % fanout->numCharacteristics;
+    size_t numDeliveries = 0;
+
+    uint32_t startedAt = esp_cpu_get_ccount();
+    bool isIndexed =
+            SubscriptionIndexTableEnumerate(&fanout->table, fanout->database[index], CountDelivery, &numDeliveries);
+    uint32_t cycles = esp_cpu_get_ccount() - startedAt;
+    if (!isIndexed || numDeliveries != GetNumFanoutSubscribers(fanout, index)) {
+        benchmark.numErrors++;
+    }
+    return CyclesToNs(cycles);
+}
+
+/**
+ * Raises an event the way HAPAccessoryServerRaiseEvent does: the event notification table of every session is
+ * searched for the characteristic.
+ */
+static uint32_t RaiseEventScan(void) {
+    const Fanout* fanout = HAPNonnull(benchmark.fanout);
+    size_t index = benchmark.numIterations % fanout->numCharacteristics;
+    const HAPCharacteristic* characteristic = fanout->database[index];
+    size_t numDeliveries = 0;
+
+    uint32_t startedAt = esp_cpu_get_ccount();
+    for (size_t s = 0; s < fanout->numSessions; s++) {
+        for (size_t i = 0; i < fanout->numSubscriptions[s]; i++) {
+            if (fanout->subscriptions[s][i] == characteristic) {
+                CountDelivery(&numDeliveries, (HAPSessionRef*) &fanout->sessions[s]);
+                break;
+            }
+        }
+    }
+    uint32_t cycles = esp_cpu_get_ccount() - startedAt;
+    if (numDeliveries != GetNumFanoutSubscribers(fanout, index)) {
+        benchmark.numErrors++;
+    }
+    return CyclesToNs(cycles);
+}
+
+/**
+ * Runs both fan-out benchmarks at every point of the sweep, named event_fanout_{index,scan}_s<sessions>_c<count>.
+ */
+static void RunFanoutSweep(uint32_t* samples) {
+    for (size_t i = 0; i < HAPArrayCount(kBenchmarkFanoutSessionCounts); i++) {
+        for (size_t j = 0; j < HAPArrayCount(kBenchmarkFanoutCharacteristicCounts); j++) {
+            size_t numSessions = kBenchmarkFanoutSessionCounts[i];
+            size_t numCharacteristics = kBenchmarkFanoutCharacteristicCounts[j];
+            PrepareFanout(HAPNonnull(benchmark.fanout), numSessions, numCharacteristics);
+
+            char name[48];
+            snprintf(name,
+                     sizeof name,
+                     "event_fanout_index_s%u_c%u",
+                     (unsigned) numSessions,
+                     (unsigned) numCharacteristics);
+            Run(name, numCharacteristics, RaiseEventIndexed, samples);
+            snprintf(name,
+                     sizeof name,
+                     "event_fanout_scan_s%u_c%u",
+                     (unsigned) numSessions,
+                     (unsigned) numCharacteristics);
+            Run(name, numCharacteristics, RaiseEventScan, samples);
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+#if CONFIG_GARAGE_TELEMETRY
+static uint32_t AppendTelemetrySample(void) {
+    // Like the sampler: a steady interval with jitter, slowly changing integers and floats.
+    uint32_t i = benchmark.numIterations;
+    TelemetryValue values[HAPArrayCount(kBenchmarkTelemetryColumnTypes)];
+    values[0].intValue = (int32_t)(i % 50);
+    values[1].intValue = -(int32_t)(i * 1237);
+    values[2].floatValue = 20.0f + (float) (i % 40) * 0.125f;
+    values[3].floatValue = i % 10 < 5 ? 3.3f : -1.0e6f / (float) (i + 1);
+
+    uint32_t startedAt = esp_cpu_get_ccount();
+    TelemetryStoreAppend(&HAPNonnull(benchmark.telemetry)->store, i * 10000 + i % 7, values);
+    return CyclesToNs(esp_cpu_get_ccount() - startedAt);
+}
+
+static void CountTelemetrySample(
+        void* _Nullable context,
+        uint32_t time HAP_UNUSED,
+        const TelemetryValue* values HAP_UNUSED,
+        uint8_t level HAP_UNUSED,
+        bool* shouldContinue HAP_UNUSED) {
+    (*(size_t*) HAPNonnull(context))++;
+}
+
+static uint32_t DecodeTelemetryBlock(void) {
+    // The newest block is only partially filled, the one before it is full.
+    const TelemetryStore* store = &HAPNonnull(benchmark.telemetry)->store;
+    const TelemetryBlock* block = HAPNonnull(TelemetryStoreGetBlock(store, store->numUsedBlocks - 2));
+    size_t numSamples = 0;
+
+    uint32_t startedAt = esp_cpu_get_ccount();
+    TelemetryBlockEnumerateSamples(
+            block,
+            kBenchmarkTelemetryColumnTypes,
+            HAPArrayCount(kBenchmarkTelemetryColumnTypes),
+            CountTelemetrySample,
+            &numSamples);
+    uint32_t cycles = esp_cpu_get_ccount() - startedAt;
+    if (numSamples != block->numSamples) {
+        benchmark.numErrors++;
+    }
+    return CyclesToNs(cycles);
+}
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static void AppendHeader(void) {
+    esp_chip_info_t chip;
+    esp_chip_info(&chip);
+    char elf[9];
+    esp_ota_get_app_elf_sha256(elf, sizeof elf);
+    AppendReport(
+            "BENCH suite=%d chip=%d rev=%d cores=%d mhz=%d psram=%u idf=%s app=%s elf=%s db=%u\n",
+            kBenchmark_SuiteVersion,
+            (int) chip.model,
+            (int) chip.revision,
+            (int) chip.cores,
+            CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+            (unsigned) heap_caps_get_total_size(MALLOC_CAP_SPIRAM),
+            esp_get_idf_version(),
+            esp_ota_get_app_description()->version,
+            elf,
+            (unsigned) benchmark.numAccessoryBytes);
+}
+
+static void RunSuite(uint32_t* samples) {
+    benchmark.numAccessoryBytes = DBSizeAccessory(AppGetAccessoryInfo());
+    AppendHeader();
+
+    for (size_t i = 0; i < sizeof buffers.input; i++) {
+        buffers.input[i] = (uint8_t) i;
+    }
+    HAPPlatformRandomNumberFill(buffers.key, sizeof buffers.key);
+    HAPPlatformRandomNumberFill(buffers.secretKey, sizeof buffers.secretKey);
+    Run("chacha20poly1305_1024", 200, EncryptFrame, samples);
+    Run("x25519", 20, DerivePublicKey, samples);
+    Run("sha512_1024", 200, HashFrame, samples);
+    Run("accessories_encrypt", 100, EncryptAccessories, samples);
+
+    Run("kvs_set", 20, SetKeyValueStoreEntry, samples);
+    Run("kvs_get", 100, GetKeyValueStoreEntry, samples);
+#if CONFIG_GARAGE_KVS_CACHE
+    Run("kvs_get_backend", 100, GetKeyValueStoreEntryFromBackend, samples);
+#endif
+    (void) RunOnRunLoop(RemoveKeyValueStoreEntryOnRunLoop);
+
+    gpio_reset_pin(CONFIG_GARAGE_BENCHMARK_GPIO);
+    gpio_set_direction(CONFIG_GARAGE_BENCHMARK_GPIO, GPIO_MODE_OUTPUT);
+    Run("gpio_toggle", 1000, ToggleGpio, samples);
+    gpio_reset_pin(CONFIG_GARAGE_BENCHMARK_GPIO);
+
+    const esp_timer_create_args_t timerArgs = { .callback = HandleTimerFired, .name = "benchmark" };
+    if (esp_timer_create(&timerArgs, &benchmark.timer)) {
+        benchmark.numErrors++;
+    } else {
+        Run("timer_arm", 100, ArmTimer, samples);
+        Run("timer_fire_late", 100, FireTimer, samples);
+        esp_timer_delete(HAPNonnull(benchmark.timer));
+        benchmark.timer = NULL;
+    }
+
+    Run("runloop_roundtrip", 100, RoundTripRunLoop, samples);
+
+    benchmark.copyBytes = PlacementAllocateBulk(2 * kBenchmark_CopyBytes);
+    if (benchmark.copyBytes) {
+        Run("copy_4k_bulk", 100, Copy, samples);
+        free(benchmark.copyBytes);
+    } else {
+        benchmark.numErrors++;
+    }
+    benchmark.copyBytes = heap_caps_malloc(2 * kBenchmark_CopyBytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (benchmark.copyBytes) {
+        Run("copy_4k_internal", 100, Copy, samples);
+        free(benchmark.copyBytes);
+    } else {
+        benchmark.numErrors++;
+    }
+    benchmark.copyBytes = NULL;
+
+#if CONFIG_GARAGE_LOCAL_CONTROL
+    Run("write_parse_fast", 1000, ParseWriteRequestFast, samples);
+    Run("write_parse_generic", 1000, ParseWriteRequest, samples);
+#endif
+
+    benchmark.fanout = calloc(1, sizeof *benchmark.fanout);
+    if (benchmark.fanout) {
+        PrepareFanout(HAPNonnull(benchmark.fanout), CONFIG_GARAGE_HAP_SESSIONS, kBenchmark_FanoutCharacteristics);
+        Run("event_fanout_index", kBenchmark_FanoutCharacteristics, RaiseEventIndexed, samples);
+        Run("event_fanout_scan", kBenchmark_FanoutCharacteristics, RaiseEventScan, samples);
+        RunFanoutSweep(samples);
+        free(benchmark.fanout);
+        benchmark.fanout = NULL;
+    } else {
+        benchmark.numErrors++;
+    }
+
+#if CONFIG_GARAGE_TELEMETRY
+    benchmark.telemetry = calloc(1, sizeof *benchmark.telemetry);
+    if (benchmark.telemetry) {
+        TelemetryBenchmark* telemetry = HAPNonnull(benchmark.telemetry);
+        TelemetryStoreCreate(
+                &telemetry->store,
+                kBenchmarkTelemetryColumnTypes,
+                HAPArrayCount(kBenchmarkTelemetryColumnTypes),
+                telemetry->blocks,
+                telemetry->order,
+                HAPArrayCount(telemetry->blocks));
+        Run("telemetry_append", 1000, AppendTelemetrySample, samples);
+        Run("telemetry_decode", 100, DecodeTelemetryBlock, samples);
+        free(benchmark.telemetry);
+        benchmark.telemetry = NULL;
+    } else {
+        benchmark.numErrors++;
+    }
+#endif
+}
+
+static void BenchmarkTask(void* _Nullable arg HAP_UNUSED) {
+    benchmark.numErrors = 0;
+    uint32_t* _Nullable samples = PlacementAllocateBulk(kBenchmark_MaxIterations * sizeof *samples);
+    if (samples) {
+        RunSuite(samples);
+        free(samples);
+    } else {
+        benchmark.numErrors++;
+    }
+    AppendReport("BENCH done errors=%lu\n", (unsigned long) benchmark.numErrors);
+
+    xSemaphoreTake(benchmark.lock, portMAX_DELAY);
+    benchmark.isRunning = false;
+    xSemaphoreGive(benchmark.lock);
+    vTaskDelete(NULL);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError BenchmarkStart(void) {
+    HAPPrecondition(benchmark.lock);
+
+#if CONFIG_GARAGE_OVERLOAD_CONTROL
+    if (OverloadIsDegraded()) {
+        return kHAPError_Busy;
+    }
+#endif
+
+    xSemaphoreTake(benchmark.lock, portMAX_DELAY);
+    if (benchmark.isRunning) {
+        xSemaphoreGive(benchmark.lock);
+        return kHAPError_InvalidState;
+    }
+    benchmark.isRunning = true;
+    benchmark.hasReport = true;
+    benchmark.numReportBytes = 0;
+    xSemaphoreGive(benchmark.lock);
+
+    // Below the run loop, and pinned so that cycle counts are always read from the same core.
+    if (xTaskCreatePinnedToCore(
+                BenchmarkTask, "benchmark", 6 * 1024, NULL, tskIDLE_PRIORITY + 2, NULL, portNUM_PROCESSORS - 1) !=
+        pdPASS) {
+        xSemaphoreTake(benchmark.lock, portMAX_DELAY);
+        benchmark.isRunning = false;
+        xSemaphoreGive(benchmark.lock);
+        return kHAPError_OutOfResources;
+    }
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError BenchmarkCopyReport(char* bytes, size_t maxBytes, size_t* numBytes) {
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+    HAPPrecondition(benchmark.lock);
+
+    HAPError err = kHAPError_None;
+    xSemaphoreTake(benchmark.lock, portMAX_DELAY);
+    if (!benchmark.hasReport) {
+        err = kHAPError_InvalidState;
+    } else if (benchmark.numReportBytes > maxBytes) {
+        err = kHAPError_OutOfResources;
+    } else {
+        HAPRawBufferCopyBytes(bytes, benchmarkReport, benchmark.numReportBytes);
+        *numBytes = benchmark.numReportBytes;
+    }
+    xSemaphoreGive(benchmark.lock);
+    return err;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static int HandleBenchCommand(int argc HAP_UNUSED, char** argv HAP_UNUSED) {
+    HAPError err = BenchmarkStart();
+    if (err) {
+        printf("Benchmark %s.\n",
+               err == kHAPError_InvalidState ? "already running" :
+                       err == kHAPError_Busy ? "suspended while overloaded" : "could not be started");
+        return 1;
+    }
+    return 0;
+}
+
+void BenchmarkCreate(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(!benchmark.lock);
+
+    benchmark.keyValueStore = keyValueStore;
+    benchmark.lock = xSemaphoreCreateMutex();
+    benchmark.done = xSemaphoreCreateBinary();
+    HAPAssert(benchmark.lock && benchmark.done);
+
+    esp_console_repl_t* repl = NULL;
+    esp_console_repl_config_t replConfig = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    replConfig.prompt = "garage>";
+    esp_console_dev_uart_config_t uartConfig = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_console_new_repl_uart(&uartConfig, &replConfig, &repl));
+    const esp_console_cmd_t command = {
+        .command = "bench",
+        .help = "Run the microbenchmark suite and print BENCH lines",
+        .func = HandleBenchCommand,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&command));
+    ESP_ERROR_CHECK(esp_console_start_repl(repl));
+}
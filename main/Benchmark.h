@@ -0,0 +1,119 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// On-device microbenchmarks.
+//
+// Runs a fixed suite on a dedicated task, so that hardware revisions and firmware builds can be compared in the
+// field. The suite is started with the "bench" console command or POST /bench on the local control API. Results
+// are printed to the console and kept for GET /bench, one line per result:
+//
+//   BENCH suite=<n> chip=<model> rev=<n> cores=<n> mhz=<n> psram=<bytes> idf=<version> app=<version> elf=<sha>
+//         db=<bytes>
+//   BENCH name=<benchmark> n=<iterations> min_ns=<n> p50_ns=<n> mean_ns=<n> max_ns=<n>
+//   BENCH done errors=<n>
+//
+// Benchmark names keep their meaning. Benchmarks are only ever added, and the suite number is incremented when one is
+// added or changed. Times are per iteration:
+//
+//   chacha20poly1305_1024  Encrypting a HAP frame of 1024 bytes.
+//   x25519                 X25519 public key derivation, as in Pair Verify.
+//   sha512_1024            SHA-512 of 1024 bytes.
+//   accessories_encrypt    Encrypting an /accessories response of db bytes, the size of the attribute database
+//                          without values (DBSize.h), in HAP frames.
+//   kvs_get, kvs_set       Reading and writing a 32 byte key-value store entry, on the run loop.
+//   kvs_get_backend        kvs_get bypassing the key-value store cache. Only with GARAGE_KVS_CACHE.
+//   gpio_toggle            Setting the level of GARAGE_BENCHMARK_GPIO.
+//   timer_arm              Arming a one-shot esp_timer.
+//   timer_fire_late        Delay of the timer callback beyond the requested 1 ms.
+//   runloop_roundtrip      Scheduling a run loop callback from another task until it has run.
+//   copy_4k_bulk           Copying 4 KB within memory from PlacementAllocateBulk (Placement.h).
+//   copy_4k_internal       Copying 4 KB within internal RAM.
+//   write_parse_fast       Parsing a door command body with the fast path (WriteRequest.h). Only with
+//                          GARAGE_LOCAL_CONTROL.
+//   write_parse_generic    Parsing the same body with the generic JSON parser. Only with GARAGE_LOCAL_CONTROL.
+//   event_fanout_index     Finding the subscribers of one of 100 characteristics with GARAGE_HAP_SESSIONS synthetic
+//                          sessions in the subscription index (SubscriptionIndex.h). One session is subscribed to
+//                          everything, the others to a quarter of the characteristics.
+//   event_fanout_scan      The same by searching the event notification table of every session, as
+//                          HAPAccessoryServerRaiseEvent does.
+//   event_fanout_index_s<sessions>_c<count>, event_fanout_scan_s<sessions>_c<count>
+//                          Both fan-out benchmarks swept over 1, 2, 4 and GARAGE_HAP_SESSIONS sessions and 10, 30
+//                          and 100 characteristics, to show where the index starts to pay off.
+//   telemetry_append       Appending a sample with two integer and two float columns to a telemetry store
+//                          (TelemetryStore.h), including the occasional merge of old blocks. Only with
+//                          GARAGE_TELEMETRY.
+//   telemetry_decode       Decoding a full block of such samples. Only with GARAGE_TELEMETRY.
+//
+// HAP requests are served while the suite runs, but may be delayed by the run loop benchmarks.
+//
+// The benchmarks of platform-independent code (kvs cache, write parse, event fan-out and telemetry) also run on the
+// host with the same workloads and names: make -C host_test bench.
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Version of the suite. Incremented when a benchmark is added or changed.
+ */
+#define kBenchmark_SuiteVersion 6
+
+/**
+ * Buffer size that fits the report of a run.
+ */
+#define kBenchmark_MaxReportBytes ((size_t) 6144)
+
+/**
+ * Prepares the suite and registers the "bench" console command. Must be called once, on the run loop.
+ *
+ * @param      keyValueStore        Key-value store used by the kvs benchmarks.
+ */
+void BenchmarkCreate(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Starts a run of the suite. May be called from any task.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_InvalidState   If a run is already in progress.
+ * @return kHAPError_Busy           If the accessory is overloaded (Overload.h).
+ * @return kHAPError_OutOfResources If the benchmark task could not be created.
+ */
+HAP_RESULT_USE_CHECK
+HAPError BenchmarkStart(void);
+
+/**
+ * Copies the report of the current or most recent run. May be called from any task. A run is complete once the
+ * report ends with the "BENCH done" line.
+ *
+ * @param[out] bytes                Buffer.
+ * @param      maxBytes             Capacity of buffer.
+ * @param[out] numBytes             Length of the report.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_InvalidState   If the suite has not been run yet.
+ * @return kHAPError_OutOfResources If the buffer is too small.
+ */
+HAP_RESULT_USE_CHECK
+HAPError BenchmarkCopyReport(char* bytes, size_t maxBytes, size_t* numBytes);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
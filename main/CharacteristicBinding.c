@@ -0,0 +1,99 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "CharacteristicBinding.h"
+#include "FlashWriteScheduler.h"
+#include "SessionTracker.h"
+#include "SubscriptionIndex.h"
+#if CONFIG_GARAGE_OVERLOAD_CONTROL
+#include "Overload.h"
+#endif
+
+#include <esp_timer.h>
+
+/**
+ * Whether per-request logging is skipped to shed load.
+ */
+static bool IsLogMuted(void) {
+#if CONFIG_GARAGE_OVERLOAD_CONTROL
+    return OverloadIsDegraded();
+#else
+    return false;
+#endif
+}
+
+static void LogValue(const CharacteristicBinding* binding, const char* access, uint8_t value) {
+    if (IsLogMuted()) {
+        return;
+    }
+    if (value < binding->numValueNames && HAPNonnull(binding->valueNames)[value]) {
+        HAPLogInfo(&kHAPLog_Default, "%s %s: %s", access, binding->name, HAPNonnull(binding->valueNames)[value]);
+    } else {
+        HAPLogInfo(&kHAPLog_Default, "%s %s: %u", access, binding->name, value);
+    }
+}
+
+HAP_RESULT_USE_CHECK
+HAPError CharacteristicBindingReadUInt8(const CharacteristicBinding* binding, HAPSessionRef* session, uint8_t* value) {
+    HAPPrecondition(binding);
+    HAPPrecondition(session);
+    HAPPrecondition(value);
+
+    // Event notifications are read on the session they are delivered to, so they count as activity, too.
+    SessionTrackerHandleRequest(session);
+    FlashWriteSchedulerDefer(binding->flashQuietMS);
+    *value = *(const uint8_t*) binding->field;
+    LogValue(binding, "Read", *value);
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError CharacteristicBindingReadBool(const CharacteristicBinding* binding, HAPSessionRef* session, bool* value) {
+    HAPPrecondition(binding);
+    HAPPrecondition(session);
+    HAPPrecondition(value);
+
+    SessionTrackerHandleRequest(session);
+    FlashWriteSchedulerDefer(binding->flashQuietMS);
+    *value = *(const bool*) binding->field;
+    LogValue(binding, "Read", *value);
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError CharacteristicBindingWriteUInt8(const CharacteristicBinding* binding, HAPSessionRef* session, uint8_t value) {
+    HAPPrecondition(binding);
+    HAPPrecondition(binding->handleChange);
+    HAPPrecondition(session);
+
+    int64_t receivedAt = esp_timer_get_time();
+    FlashWriteSchedulerDefer(binding->flashQuietMS);
+    LogValue(binding, "Write", value);
+    if (binding->validate) {
+        HAPError err = binding->validate(value);
+        if (err) {
+            HAPLogError(&kHAPLog_Default, "Write %s: Rejected (%u).", binding->name, err);
+            SessionTrackerHandleRequest(session);
+            return err;
+        }
+    }
+    binding->handleChange(session, value, receivedAt);
+    return kHAPError_None;
+}
+
+void CharacteristicBindingRaiseEvents(
+        HAPAccessoryServerRef* server,
+        const CharacteristicBinding* const* bindings,
+        size_t numBindings,
+        const HAPAccessory* accessory) {
+    HAPPrecondition(server);
+    HAPPrecondition(bindings);
+    HAPPrecondition(accessory);
+
+    for (size_t i = 0; i < numBindings; i++) {
+        SubscriptionIndexRaiseEvent(server, bindings[i]->characteristic, bindings[i]->service, accessory);
+    }
+}
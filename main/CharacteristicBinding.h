@@ -0,0 +1,165 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Characteristics bound to accessory state.
+//
+// A characteristic of the attribute database (DB.c) is bound to a field of the accessory state by a constant
+// CharacteristicBinding, optionally with a validator and a change hook for writes:
+//
+//   static const CharacteristicBinding targetDoorStateBinding = {
+//       .name = "TargetDoorState",
+//       .characteristic = &garageDoorOpenerTargetDoorStateCharacteristic,
+//       .service = &garageDoorOpenerService,
+//       .field = &accessoryConfiguration.state.targetDoorState,
+//       ...
+//   };
+//   CHARACTERISTIC_BINDING_UINT8_READ(HandleGarageDoorOpenerTargetDoorStateRead, targetDoorStateBinding)
+//   CHARACTERISTIC_BINDING_UINT8_WRITE(HandleGarageDoorOpenerTargetDoorStateWrite, targetDoorStateBinding)
+//
+// The macros define the HAP callbacks that DB.c refers to. Each is a single call with a constant binding, so a new
+// characteristic adds a few bytes of table instead of another handler. Values are logged by name from the binding's
+// value names instead of a switch per handler.
+//
+// All functions must be called on the run loop.
+
+#ifndef CHARACTERISTIC_BINDING_H
+#define CHARACTERISTIC_BINDING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Binding of a UInt8 or Bool characteristic to a field of the accessory state.
+ */
+typedef struct {
+    /** Name used in the log. */
+    const char* name;
+
+    /** Bound characteristic and the service it belongs to, used to raise events. */
+    const HAPCharacteristic* characteristic;
+    const HAPService* service;
+
+    /** State field. A uint8_t for UInt8 characteristics, a bool for Bool characteristics. */
+    void* field;
+
+    /** Log names of the values, indexed by value. Values without a name are logged as numbers. */
+    const char* const* _Nullable valueNames;
+    size_t numValueNames;
+
+    /** Time to stay away from flash after an access, as controllers usually follow up with further requests. */
+    HAPTime flashQuietMS;
+
+    /**
+     * Checks a written value before the change hook is called. NULL if every value within the characteristic's
+     * constraints is accepted.
+     *
+     * @return kHAPError_None if the value is accepted, or the error to return to the controller otherwise.
+     */
+    HAPError (*_Nullable validate)(uint8_t value);
+
+    /**
+     * Applies a written value. The hook owns the state field and is responsible for updating it and raising events.
+     * Required for writable characteristics.
+     *
+     * @param      session              Session the write arrived on.
+     * @param      value                Written value.
+     * @param      receivedAt           Time the write was received, from esp_timer_get_time.
+     */
+    void (*_Nullable handleChange)(HAPSessionRef* session, uint8_t value, int64_t receivedAt);
+} CharacteristicBinding;
+
+/**
+ * Reads the value of a bound UInt8 characteristic. Never throttled, also while overloaded (Overload.h): the ADK
+ * reads the door characteristics for events and write responses too, which must not fail.
+ *
+ * @return kHAPError_None           If successful.
+ */
+HAP_RESULT_USE_CHECK
+HAPError CharacteristicBindingReadUInt8(const CharacteristicBinding* binding, HAPSessionRef* session, uint8_t* value);
+
+/**
+ * Reads the value of a bound Bool characteristic. Never throttled (CharacteristicBindingReadUInt8).
+ *
+ * @return kHAPError_None           If successful.
+ */
+HAP_RESULT_USE_CHECK
+HAPError CharacteristicBindingReadBool(const CharacteristicBinding* binding, HAPSessionRef* session, bool* value);
+
+/**
+ * Validates a value written to a bound UInt8 characteristic and passes it to the change hook.
+ */
+HAP_RESULT_USE_CHECK
+HAPError CharacteristicBindingWriteUInt8(const CharacteristicBinding* binding, HAPSessionRef* session, uint8_t value);
+
+/**
+ * Raises events for bound characteristics, e.g. after the change hook has updated their state fields.
+ *
+ * @param      server               Accessory server.
+ * @param      bindings             Bindings whose characteristics changed.
+ * @param      numBindings          Number of bindings.
+ * @param      accessory            Accessory the characteristics belong to.
+ */
+void CharacteristicBindingRaiseEvents(
+        HAPAccessoryServerRef* server,
+        const CharacteristicBinding* const* bindings,
+        size_t numBindings,
+        const HAPAccessory* accessory);
+
+/**
+ * Defines the read callback of a bound UInt8 characteristic.
+ */
+#define CHARACTERISTIC_BINDING_UINT8_READ(handler, binding) \
+    HAP_RESULT_USE_CHECK \
+    HAPError handler( \
+            HAPAccessoryServerRef* server HAP_UNUSED, \
+            const HAPUInt8CharacteristicReadRequest* request, \
+            uint8_t* value, \
+            void* _Nullable context HAP_UNUSED) { \
+        return CharacteristicBindingReadUInt8(&(binding), request->session, value); \
+    }
+
+/**
+ * Defines the write callback of a bound UInt8 characteristic.
+ */
+#define CHARACTERISTIC_BINDING_UINT8_WRITE(handler, binding) \
+    HAP_RESULT_USE_CHECK \
+    HAPError handler( \
+            HAPAccessoryServerRef* server HAP_UNUSED, \
+            const HAPUInt8CharacteristicWriteRequest* request, \
+            uint8_t value, \
+            void* _Nullable context HAP_UNUSED) { \
+        return CharacteristicBindingWriteUInt8(&(binding), request->session, value); \
+    }
+
+/**
+ * Defines the read callback of a bound Bool characteristic.
+ */
+#define CHARACTERISTIC_BINDING_BOOL_READ(handler, binding) \
+    HAP_RESULT_USE_CHECK \
+    HAPError handler( \
+            HAPAccessoryServerRef* server HAP_UNUSED, \
+            const HAPBoolCharacteristicReadRequest* request, \
+            bool* value, \
+            void* _Nullable context HAP_UNUSED) { \
+        return CharacteristicBindingReadBool(&(binding), request->session, value); \
+    }
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
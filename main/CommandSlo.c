@@ -0,0 +1,287 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "CommandSlo.h"
+
+#include "Metrics.h"
+#include "ReportFormat.h"
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+#define kCommandSlo_TargetUs ((uint32_t) CONFIG_GARAGE_COMMAND_SLO_TARGET_MS * 1000)
+
+static const char* const sourceNames[] = {
+    [kAppCommandSource_HAP] = "hap",
+    [kAppCommandSource_LocalControl] = "local",
+    [kAppCommandSource_MQTT] = "mqtt",
+};
+
+static const char* const endNames[] = {
+    [kCommandSloEnd_RF] = "rf",
+    [kCommandSloEnd_Actuation] = "actuation",
+    [kCommandSloEnd_Timeout] = "timeout",
+    [kCommandSloEnd_Superseded] = "superseded",
+};
+
+/**
+ * Completed command in the window.
+ */
+typedef struct {
+    uint32_t latencyUs;
+    bool isMet;
+} WindowEntry;
+
+static struct {
+    /** Command in progress. Only accessed on the run loop. */
+    struct {
+        bool isActive;
+        bool isConfirmationExpected;
+        bool isFinished;
+        bool isConfirmed;
+        int64_t receivedAt;
+        int64_t confirmedAt;
+        CommandSloRecord record;
+        HAPPlatformTimerRef timer;
+    } command;
+
+    /** Oldest overwritten first. */
+    WindowEntry window[CONFIG_GARAGE_COMMAND_SLO_WINDOW];
+    size_t numWindowEntries;
+    size_t nextWindowEntry;
+
+    CommandSloRecord recent[kCommandSlo_NumRecentCommands];
+    size_t numRecent;
+    size_t nextRecent;
+
+    uint32_t numCompleted;
+    uint32_t numBreaches;
+    uint32_t numTimeouts;
+    uint32_t numSuperseded;
+} slo;
+
+/**
+ * Protects everything but the command in progress. Completions happen on the run loop, reads on consumer tasks.
+ */
+static portMUX_TYPE sloLock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t GetOffset(int64_t at) {
+    return at > slo.command.receivedAt ? (uint32_t)(at - slo.command.receivedAt) : 0;
+}
+
+static void Complete(CommandSloEnd end, int64_t endedAt) {
+    HAPPrecondition(slo.command.isActive);
+
+    if (slo.command.timer) {
+        HAPPlatformTimerDeregister(slo.command.timer);
+        slo.command.timer = 0;
+    }
+    slo.command.isActive = false;
+    CommandSloRecord* record = &slo.command.record;
+    record->end = end;
+    record->endUs = GetOffset(endedAt);
+
+    bool isBreach = end == kCommandSloEnd_Timeout || record->endUs > kCommandSlo_TargetUs;
+    portENTER_CRITICAL(&sloLock);
+    slo.recent[slo.nextRecent] = *record;
+    slo.nextRecent = (slo.nextRecent + 1) % kCommandSlo_NumRecentCommands;
+    if (slo.numRecent < kCommandSlo_NumRecentCommands) {
+        slo.numRecent++;
+    }
+    if (end == kCommandSloEnd_Superseded) {
+        slo.numSuperseded++;
+    } else {
+        slo.window[slo.nextWindowEntry] = (WindowEntry) { .latencyUs = record->endUs, .isMet = !isBreach };
+        slo.nextWindowEntry = (slo.nextWindowEntry + 1) % HAPArrayCount(slo.window);
+        if (slo.numWindowEntries < HAPArrayCount(slo.window)) {
+            slo.numWindowEntries++;
+        }
+        slo.numCompleted++;
+        slo.numBreaches += isBreach;
+        slo.numTimeouts += end == kCommandSloEnd_Timeout;
+    }
+    portEXIT_CRITICAL(&sloLock);
+
+    if (end == kCommandSloEnd_Superseded) {
+        return;
+    }
+    MetricsRecord(kMetric_CommandCompletion, record->endUs);
+    if (isBreach) {
+        HAPLogError(
+                &kHAPLog_Default,
+                "Command SLO breached: %s command to state %u ended by %s after %lu ms "
+                "(actuation started +%lu ms, finished +%lu ms, target %u ms).",
+                sourceNames[record->source],
+                record->targetState,
+                endNames[end],
+                (unsigned long) (record->endUs / 1000),
+                (unsigned long) (record->actuationStartedUs / 1000),
+                (unsigned long) (record->actuationFinishedUs / 1000),
+                CONFIG_GARAGE_COMMAND_SLO_TARGET_MS);
+    }
+}
+
+void CommandSloHandleActuationStarted(
+        AppCommandSource source,
+        uint8_t targetState,
+        int64_t receivedAt,
+        int64_t startedAt,
+        bool isConfirmationExpected) {
+    if (slo.command.isActive) {
+        Complete(kCommandSloEnd_Superseded, startedAt);
+    }
+    HAPRawBufferZero(&slo.command, sizeof slo.command);
+    slo.command.isActive = true;
+    slo.command.isConfirmationExpected = isConfirmationExpected;
+    slo.command.receivedAt = receivedAt;
+    slo.command.record.source = source;
+    slo.command.record.targetState = targetState;
+    slo.command.record.actuationStartedUs = GetOffset(startedAt);
+}
+
+static void HandleConfirmationTimerExpired(HAPPlatformTimerRef timer HAP_UNUSED, void* _Nullable context HAP_UNUSED) {
+    slo.command.timer = 0;
+    Complete(kCommandSloEnd_Timeout, esp_timer_get_time());
+}
+
+void CommandSloHandleActuationFinished(int64_t finishedAt) {
+    if (!slo.command.isActive || slo.command.isFinished) {
+        return;
+    }
+    slo.command.isFinished = true;
+    slo.command.record.actuationFinishedUs = GetOffset(finishedAt);
+
+    if (slo.command.isConfirmed) {
+        Complete(kCommandSloEnd_RF, slo.command.confirmedAt);
+        return;
+    }
+    if (!slo.command.isConfirmationExpected) {
+        Complete(kCommandSloEnd_Actuation, finishedAt);
+        return;
+    }
+    HAPError err = HAPPlatformTimerRegister(
+            &slo.command.timer,
+            HAPPlatformClockGetCurrent() + kCommandSlo_ConfirmationTimeoutMS,
+            HandleConfirmationTimerExpired,
+            NULL);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLogError(&kHAPLog_Default, "%s: Not enough timers available.", __func__);
+        Complete(kCommandSloEnd_Timeout, finishedAt);
+    }
+}
+
+void CommandSloHandleConfirmed(int64_t confirmedAt) {
+    if (!slo.command.isActive || slo.command.isConfirmed) {
+        return;
+    }
+    slo.command.isConfirmed = true;
+    slo.command.confirmedAt = confirmedAt;
+    if (slo.command.isFinished) {
+        Complete(kCommandSloEnd_RF, confirmedAt);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+void CommandSloGetSummary(CommandSloSummary* summary) {
+    HAPPrecondition(summary);
+
+    WindowEntry window[HAPArrayCount(slo.window)];
+    portENTER_CRITICAL(&sloLock);
+    size_t numLatencies = slo.numWindowEntries;
+    HAPRawBufferCopyBytes(window, slo.window, numLatencies * sizeof window[0]);
+    portEXIT_CRITICAL(&sloLock);
+
+    // Insertion sort. The window is small.
+    uint32_t latencies[HAPArrayCount(slo.window)];
+    size_t numMet = 0;
+    for (size_t i = 0; i < numLatencies; i++) {
+        uint32_t latency = window[i].latencyUs;
+        numMet += window[i].isMet;
+        size_t j = i;
+        for (; j > 0 && latencies[j - 1] > latency; j--) {
+            latencies[j] = latencies[j - 1];
+        }
+        latencies[j] = latency;
+    }
+
+    HAPRawBufferZero(summary, sizeof *summary);
+    summary->numCommands = (uint32_t) numLatencies;
+    summary->compliancePermille = 1000;
+    if (!numLatencies) {
+        return;
+    }
+    summary->compliancePermille = (uint16_t)(numMet * 1000 / numLatencies);
+    summary->p50Us = latencies[(numLatencies * 50 + 99) / 100 - 1];
+    summary->p95Us = latencies[(numLatencies * 95 + 99) / 100 - 1];
+    summary->maxUs = latencies[numLatencies - 1];
+}
+
+HAP_RESULT_USE_CHECK
+HAPError CommandSloSerialize(char* bytes, size_t maxBytes, size_t* numBytes) {
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    CommandSloSummary summary;
+    CommandSloGetSummary(&summary);
+
+    CommandSloRecord recent[kCommandSlo_NumRecentCommands];
+    portENTER_CRITICAL(&sloLock);
+    size_t numRecent = slo.numRecent;
+    for (size_t i = 0; i < numRecent; i++) {
+        // Newest first.
+        size_t index = (slo.nextRecent + kCommandSlo_NumRecentCommands - 1 - i) % kCommandSlo_NumRecentCommands;
+        recent[i] = slo.recent[index];
+    }
+    uint32_t numCompleted = slo.numCompleted;
+    uint32_t numBreaches = slo.numBreaches;
+    uint32_t numTimeouts = slo.numTimeouts;
+    uint32_t numSuperseded = slo.numSuperseded;
+    portEXIT_CRITICAL(&sloLock);
+
+    size_t offset = 0;
+    HAPError err = ReportFormatAppend(
+            bytes,
+            maxBytes,
+            &offset,
+            "{\"targetMs\":%u,\"window\":{\"commands\":%lu,\"compliancePermille\":%u,\"p50Us\":%lu,\"p95Us\":%lu,"
+            "\"maxUs\":%lu},\"completed\":%lu,\"breaches\":%lu,\"timeouts\":%lu,\"superseded\":%lu,\"recent\":[",
+            CONFIG_GARAGE_COMMAND_SLO_TARGET_MS,
+            (unsigned long) summary.numCommands,
+            summary.compliancePermille,
+            (unsigned long) summary.p50Us,
+            (unsigned long) summary.p95Us,
+            (unsigned long) summary.maxUs,
+            (unsigned long) numCompleted,
+            (unsigned long) numBreaches,
+            (unsigned long) numTimeouts,
+            (unsigned long) numSuperseded);
+    for (size_t i = 0; !err && i < numRecent; i++) {
+        const CommandSloRecord* record = &recent[i];
+        err = ReportFormatAppend(
+                bytes,
+                maxBytes,
+                &offset,
+                "%s{\"source\":\"%s\",\"targetState\":%u,\"end\":\"%s\",\"startedUs\":%lu,\"finishedUs\":%lu,"
+                "\"endUs\":%lu}",
+                i ? "," : "",
+                sourceNames[record->source],
+                record->targetState,
+                endNames[record->end],
+                (unsigned long) record->actuationStartedUs,
+                (unsigned long) record->actuationFinishedUs,
+                (unsigned long) record->endUs);
+    }
+    if (!err) {
+        err = ReportFormatAppend(bytes, maxBytes, &offset, "]}");
+    }
+    if (err) {
+        return err;
+    }
+    *numBytes = offset;
+    return kHAPError_None;
+}
@@ -0,0 +1,158 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Door command service level objective.
+//
+// A command meets the objective if its end state is confirmed within GARAGE_COMMAND_SLO_TARGET_MS of receiving it.
+// Each command that operates the remote is followed through its stages:
+//
+//   received -> actuation started -> actuation finished -> end state confirmed
+//
+// The end state is confirmed when the RF receiver hears our own remote (RfCalibration.h). Without a calibrated
+// receiver there is nothing to listen for, and the end of the actuation is taken as the end state. If a
+// confirmation is expected but not heard within kCommandSlo_ConfirmationTimeoutMS after the actuation, the command
+// ends by timeout and counts as a breach.
+//
+// Compliance and latency percentiles are kept over the most recent GARAGE_COMMAND_SLO_WINDOW commands. Breaches are
+// logged with their stage breakdown.
+//
+// All functions except CommandSloGetSummary and CommandSloSerialize must be called on the run loop.
+
+#ifndef COMMAND_SLO_H
+#define COMMAND_SLO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#include "App.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Time to wait for the confirmation after the actuation has finished.
+ */
+#define kCommandSlo_ConfirmationTimeoutMS ((HAPTime) 1500)
+
+/**
+ * Number of most recent commands that are reported with their stages.
+ */
+#define kCommandSlo_NumRecentCommands ((size_t) 8)
+
+/**
+ * Buffer size that fits the JSON object of CommandSloSerialize.
+ */
+#define kCommandSlo_MaxSerializedBytes ((size_t) 1536)
+
+/**
+ * How the end state of a command was established.
+ */
+typedef enum {
+    /** Our own remote was heard by the RF receiver. */
+    kCommandSloEnd_RF,
+
+    /** No confirmation source available. The end of the actuation is taken as the end state. */
+    kCommandSloEnd_Actuation,
+
+    /** A confirmation was expected but not received in time. */
+    kCommandSloEnd_Timeout,
+
+    /** Another command was started before the end state was established. Not counted towards the objective. */
+    kCommandSloEnd_Superseded
+} CommandSloEnd;
+
+/**
+ * Stages of a completed command. Times are relative to receiving the command.
+ */
+typedef struct {
+    AppCommandSource source;
+    uint8_t targetState;
+    CommandSloEnd end;
+    uint32_t actuationStartedUs;
+    uint32_t actuationFinishedUs;
+    uint32_t endUs;
+} CommandSloRecord;
+
+/**
+ * Objective compliance over the window.
+ */
+typedef struct {
+    /** Number of commands in the window. */
+    uint32_t numCommands;
+
+    /** Commands that met the objective, in permille of numCommands. 1000 if there are none. */
+    uint16_t compliancePermille;
+
+    /** Latency from receiving a command until its end state. */
+    uint32_t p50Us;
+    uint32_t p95Us;
+    uint32_t maxUs;
+} CommandSloSummary;
+
+/**
+ * Starts following a command whose actuation has just started. A command that is still in progress is superseded.
+ *
+ * @param      source               Source of the command.
+ * @param      targetState          Requested target door state.
+ * @param      receivedAt           Time the command was received, from esp_timer_get_time.
+ * @param      startedAt            Time the actuation started, from esp_timer_get_time.
+ * @param      isConfirmationExpected Whether CommandSloHandleConfirmed will be called for the command.
+ */
+void CommandSloHandleActuationStarted(
+        AppCommandSource source,
+        uint8_t targetState,
+        int64_t receivedAt,
+        int64_t startedAt,
+        bool isConfirmationExpected);
+
+/**
+ * Records the end of the actuation of the command in progress.
+ *
+ * @param      finishedAt           Time the actuation finished, from esp_timer_get_time.
+ */
+void CommandSloHandleActuationFinished(int64_t finishedAt);
+
+/**
+ * Records the confirmation of the command in progress. May arrive before the actuation has finished.
+ *
+ * @param      confirmedAt          Time of the confirmation, from esp_timer_get_time.
+ */
+void CommandSloHandleConfirmed(int64_t confirmedAt);
+
+/**
+ * Returns the compliance over the window. May be called from any task.
+ *
+ * @param[out] summary              Compliance.
+ */
+void CommandSloGetSummary(CommandSloSummary* summary);
+
+/**
+ * Serializes the compliance, lifetime counts and the most recent commands as a JSON object. May be called from any
+ * task.
+ *
+ * @param[out] bytes                Buffer.
+ * @param      maxBytes             Capacity of buffer.
+ * @param[out] numBytes             Length of the JSON object, excluding the NULL terminator.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the buffer is too small.
+ */
+HAP_RESULT_USE_CHECK
+HAPError CommandSloSerialize(char* bytes, size_t maxBytes, size_t* numBytes);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
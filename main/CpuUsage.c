@@ -0,0 +1,216 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "CpuUsage.h"
+
+#include "Placement.h"
+#include "ReportFormat.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#if !CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS || !CONFIG_FREERTOS_USE_TRACE_FACILITY
+#error "CPU usage requires FREERTOS_GENERATE_RUN_TIME_STATS and FREERTOS_USE_TRACE_FACILITY."
+#endif
+
+/**
+ * Usage of one task.
+ */
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t taskNumber;
+
+    /** Core the task is pinned to, -1 if it is not pinned. */
+    int8_t coreID;
+
+    /** Run-time counter at the end of the most recent window. */
+    uint32_t runTime;
+
+    /** Run time gained during each of the most recent windows, indexed like windowLengths. */
+    uint32_t windowRunTimes[kCpuUsage_NumWindows];
+} TaskUsage;
+
+static struct {
+    /** Protects everything below. Samples are taken on the run loop, serialization happens on consumer tasks. */
+    SemaphoreHandle_t _Nullable lock;
+
+    /** Tasks of the most recent sample, sized to the tasks that existed then. */
+    TaskUsage* _Nullable tasks;
+    size_t numTasks;
+
+    int64_t windowStartedAt;
+    uint32_t windowLengths[kCpuUsage_NumWindows];
+
+    /** Index of the most recent window. */
+    size_t windowIndex;
+    size_t numWindows;
+} cpuUsage;
+
+static uint16_t GetPermille(uint64_t runTime, uint64_t windowLength) {
+    if (!windowLength) {
+        return 0;
+    }
+    uint64_t permille = runTime * 1000 / windowLength;
+    return (uint16_t)(permille > 1000 ? 1000 : permille);
+}
+
+static TaskUsage* _Nullable FindTask(UBaseType_t taskNumber) {
+    for (size_t i = 0; i < cpuUsage.numTasks; i++) {
+        if (cpuUsage.tasks[i].taskNumber == taskNumber) {
+            return &cpuUsage.tasks[i];
+        }
+    }
+    return NULL;
+}
+
+void CpuUsageSample(CpuUsageSummary* summary) {
+    HAPPrecondition(summary);
+
+    HAPRawBufferZero(summary, sizeof *summary);
+    if (!cpuUsage.lock) {
+        cpuUsage.lock = xSemaphoreCreateMutex();
+        HAPAssert(cpuUsage.lock);
+    }
+
+    // Room for tasks created while the statuses are taken. Without it, uxTaskGetSystemState would fail altogether.
+    UBaseType_t maxTasks = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t* _Nullable taskStatuses = PlacementAllocateBulk(maxTasks * sizeof *taskStatuses);
+    TaskUsage* _Nullable sampledTasks = PlacementAllocateBulk(maxTasks * sizeof *sampledTasks);
+    if (!taskStatuses || !sampledTasks) {
+        // The window stays open until the next sample.
+        free(taskStatuses);
+        free(sampledTasks);
+        return;
+    }
+
+    // Taking the system state suspends the scheduler, so it is done before the lock is taken.
+    UBaseType_t numStatuses = uxTaskGetSystemState(taskStatuses, maxTasks, NULL);
+    int64_t now = esp_timer_get_time();
+    TaskHandle_t idleTasks[kCpuUsage_NumCores] = { NULL };
+    for (int core = 0; core < portNUM_PROCESSORS && core < (int) kCpuUsage_NumCores; core++) {
+        idleTasks[core] = xTaskGetIdleTaskHandleForCPU(core);
+    }
+
+    xSemaphoreTake(cpuUsage.lock, portMAX_DELAY);
+    bool isFirstSample = !cpuUsage.windowStartedAt;
+    uint32_t windowLength = (uint32_t)(now - cpuUsage.windowStartedAt);
+    cpuUsage.windowStartedAt = now;
+    size_t windowIndex = (cpuUsage.windowIndex + 1) % kCpuUsage_NumWindows;
+    if (!isFirstSample) {
+        cpuUsage.windowIndex = windowIndex;
+        cpuUsage.windowLengths[windowIndex] = windowLength;
+        if (cpuUsage.numWindows < kCpuUsage_NumWindows) {
+            cpuUsage.numWindows++;
+        }
+    }
+
+    // Tasks that no longer exist are dropped.
+    size_t numTasks = 0;
+    for (UBaseType_t i = 0; i < numStatuses; i++) {
+        const TaskStatus_t* status = &taskStatuses[i];
+        const TaskUsage* _Nullable previous = FindTask(status->xTaskNumber);
+        TaskUsage* task = &sampledTasks[numTasks++];
+        if (previous) {
+            *task = *previous;
+        } else {
+            HAPRawBufferZero(task, sizeof *task);
+            task->taskNumber = status->xTaskNumber;
+            strlcpy(task->name, status->pcTaskName, sizeof task->name);
+#if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+            task->coreID = status->xCoreID == tskNO_AFFINITY ? -1 : (int8_t) status->xCoreID;
+#else
+            task->coreID = -1;
+#endif
+        }
+        uint32_t runTime = status->ulRunTimeCounter - task->runTime;
+        task->runTime = status->ulRunTimeCounter;
+        if (isFirstSample) {
+            continue;
+        }
+        task->windowRunTimes[windowIndex] = runTime;
+
+        uint16_t permille = GetPermille(runTime, windowLength);
+        for (size_t core = 0; core < kCpuUsage_NumCores; core++) {
+            if (status->xHandle == idleTasks[core]) {
+                summary->idlePermille[core] = permille;
+            }
+        }
+        if (strcmp(task->name, "main_task") == 0) {
+            summary->runLoopPermille = permille;
+        } else if (strcmp(task->name, "wifi") == 0 || strcmp(task->name, "tiT") == 0) {
+            summary->networkPermille += permille;
+        }
+    }
+    TaskUsage* _Nullable previousTasks = cpuUsage.tasks;
+    cpuUsage.tasks = sampledTasks;
+    cpuUsage.numTasks = numTasks;
+    xSemaphoreGive(cpuUsage.lock);
+    free(previousTasks);
+    free(taskStatuses);
+}
+
+/**
+ * Returns the sum of the most recent windows' values.
+ */
+static uint64_t SumWindows(const uint32_t* values) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < cpuUsage.numWindows; i++) {
+        sum += values[(cpuUsage.windowIndex + kCpuUsage_NumWindows - i) % kCpuUsage_NumWindows];
+    }
+    return sum;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError CpuUsageSerialize(char* bytes, size_t maxBytes, size_t* numBytes) {
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    if (!cpuUsage.lock) {
+        return kHAPError_InvalidState;
+    }
+    xSemaphoreTake(cpuUsage.lock, portMAX_DELAY);
+    if (!cpuUsage.numWindows) {
+        xSemaphoreGive(cpuUsage.lock);
+        return kHAPError_InvalidState;
+    }
+
+    uint32_t windowLength = cpuUsage.windowLengths[cpuUsage.windowIndex];
+    uint64_t rollingLength = SumWindows(cpuUsage.windowLengths);
+    size_t offset = 0;
+    HAPError err = ReportFormatAppend(
+            bytes,
+            maxBytes,
+            &offset,
+            "{\"windowMs\":%lu,\"rollingMs\":%lu,\"tasks\":[",
+            (unsigned long) (windowLength / 1000),
+            (unsigned long) (rollingLength / 1000));
+    for (size_t i = 0; !err && i < cpuUsage.numTasks; i++) {
+        const TaskUsage* task = &cpuUsage.tasks[i];
+        err = ReportFormatAppend(
+                bytes,
+                maxBytes,
+                &offset,
+                "%s{\"name\":\"%s\",\"core\":%d,\"permille\":%u,\"rollingPermille\":%u}",
+                i ? "," : "",
+                task->name,
+                task->coreID,
+                GetPermille(task->windowRunTimes[cpuUsage.windowIndex], windowLength),
+                GetPermille(SumWindows(task->windowRunTimes), rollingLength));
+    }
+    if (!err) {
+        err = ReportFormatAppend(bytes, maxBytes, &offset, "]}");
+    }
+    xSemaphoreGive(cpuUsage.lock);
+    if (err) {
+        return err;
+    }
+    *numBytes = offset;
+    return kHAPError_None;
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Per-task CPU utilization.
+//
+// Uses the FreeRTOS run-time statistics, which count the microseconds each task has been running based on esp_timer
+// (FREERTOS_GENERATE_RUN_TIME_STATS, FREERTOS_RUN_TIME_STATS_USING_ESP_TIMER). Each sample closes a window: the run
+// time a task gained during the window relative to the window length is its utilization of one core. The most
+// recent kCpuUsage_NumWindows windows are kept to also report a rolling average.
+//
+// Utilizations are expressed in permille of one core.
+
+#ifndef CPU_USAGE_H
+#define CPU_USAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Number of windows in the rolling average.
+ */
+#define kCpuUsage_NumWindows ((size_t) 6)
+
+/**
+ * Number of cores that are reported.
+ */
+#define kCpuUsage_NumCores ((size_t) 2)
+
+/**
+ * Utilization of the most recent window.
+ */
+typedef struct {
+    /** Idle time of each core. 0 for cores that are not in use. */
+    uint16_t idlePermille[kCpuUsage_NumCores];
+
+    /** HAP run loop ("main_task"). */
+    uint16_t runLoopPermille;
+
+    /** Wi-Fi driver and lwIP TCP/IP tasks combined. */
+    uint16_t networkPermille;
+} CpuUsageSummary;
+
+/**
+ * Closes the current window and starts a new one. Must be called on the run loop. If out of memory, the current
+ * window stays open and the summary is zero.
+ *
+ * @param[out] summary              Utilization of the window that has been closed.
+ */
+void CpuUsageSample(CpuUsageSummary* summary);
+
+/**
+ * Serializes the utilization of every task as a JSON object. May be called from any task.
+ *
+ * @param[out] bytes                Buffer.
+ * @param      maxBytes             Capacity of buffer.
+ * @param[out] numBytes             Length of the JSON object, excluding the NULL terminator.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_InvalidState   If no window has been completed yet.
+ * @return kHAPError_OutOfResources If the buffer is too small.
+ */
+HAP_RESULT_USE_CHECK
+HAPError CpuUsageSerialize(char* bytes, size_t maxBytes, size_t* numBytes);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
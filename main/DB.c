@@ -6,9 +6,16 @@
 
 // This file contains the accessory attribute database that defines the accessory information service, HAP Protocol
 // Information Service, the Pairing service and finally the service signature exposed by the garage door opener.
+//
+// With GARAGE_LEAN_DB, optional characteristics that our controllers do not use are left out to keep the /accessories
+// response small. Instance IDs of the remaining attributes do not change.
 
 #include "App.h"
 #include "DB.h"
+#include "SessionTracker.h"
+#if CONFIG_GARAGE_OVERLOAD_CONTROL
+#include "Overload.h"
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -43,7 +50,44 @@
 #define kIID_GarageDoorOpenerTargetDoorState     ((uint64_t) 0x0034)
 #define kIID_GarageDoorOpenerObstructionDetected ((uint64_t) 0x0035)
 
+#if CONFIG_GARAGE_LEAN_DB
+HAP_STATIC_ASSERT(kAttributeCount == 7 + 2 + 5 + 4, AttributeCount_mismatch);
+#else
 HAP_STATIC_ASSERT(kAttributeCount == 9 + 3 + 5 + 6, AttributeCount_mismatch);
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Whether a controller read must be answered with kHAPError_Busy to shed load. Throttled reads are counted, not logged.
+ */
+static bool IsReadThrottled(HAPSessionRef* session) {
+#if CONFIG_GARAGE_OVERLOAD_CONTROL
+    return OverloadShouldThrottleRead(session);
+#else
+    return false;
+#endif
+}
+
+/**
+ * Defines a read callback that records session activity and sheds load in front of the ADK's read callback of an
+ * informational String characteristic. Only for characteristics that support neither events nor writes, so every read
+ * is a controller GET.
+ */
+#define THROTTLED_STRING_READ(handler, read) \
+    HAP_RESULT_USE_CHECK \
+    static HAPError handler( \
+            HAPAccessoryServerRef* server, \
+            const HAPStringCharacteristicReadRequest* request, \
+            char* value, \
+            size_t maxValueBytes, \
+            void* _Nullable context) { \
+        SessionTrackerHandleRequest(request->session); \
+        if (IsReadThrottled(request->session)) { \
+            return kHAPError_Busy; \
+        } \
+        return read(server, request, value, maxValueBytes, context); \
+    }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -67,6 +111,8 @@ const HAPBoolCharacteristic accessoryInformationIdentifyCharacteristic = {
     .callbacks = { .handleRead = NULL, .handleWrite = HAPHandleAccessoryInformationIdentifyWrite }
 };
 
+THROTTLED_STRING_READ(HandleAccessoryInformationManufacturerRead, HAPHandleAccessoryInformationManufacturerRead)
+
 const HAPStringCharacteristic accessoryInformationManufacturerCharacteristic = {
     .format = kHAPCharacteristicFormat_String,
     .iid = kIID_AccessoryInformationManufacturer,
@@ -85,9 +131,11 @@ const HAPStringCharacteristic accessoryInformationManufacturerCharacteristic = {
                              .readableWithoutSecurity = false,
                              .writableWithoutSecurity = false } },
     .constraints = { .maxLength = 64 },
-    .callbacks = { .handleRead = HAPHandleAccessoryInformationManufacturerRead, .handleWrite = NULL }
+    .callbacks = { .handleRead = HandleAccessoryInformationManufacturerRead, .handleWrite = NULL }
 };
 
+THROTTLED_STRING_READ(HandleAccessoryInformationModelRead, HAPHandleAccessoryInformationModelRead)
+
 const HAPStringCharacteristic accessoryInformationModelCharacteristic = {
     .format = kHAPCharacteristicFormat_String,
     .iid = kIID_AccessoryInformationModel,
@@ -106,9 +154,11 @@ const HAPStringCharacteristic accessoryInformationModelCharacteristic = {
                              .readableWithoutSecurity = false,
                              .writableWithoutSecurity = false } },
     .constraints = { .maxLength = 64 },
-    .callbacks = { .handleRead = HAPHandleAccessoryInformationModelRead, .handleWrite = NULL }
+    .callbacks = { .handleRead = HandleAccessoryInformationModelRead, .handleWrite = NULL }
 };
 
+THROTTLED_STRING_READ(HandleAccessoryInformationNameRead, HAPHandleAccessoryInformationNameRead)
+
 const HAPStringCharacteristic accessoryInformationNameCharacteristic = {
     .format = kHAPCharacteristicFormat_String,
     .iid = kIID_AccessoryInformationName,
@@ -127,9 +177,11 @@ const HAPStringCharacteristic accessoryInformationNameCharacteristic = {
                              .readableWithoutSecurity = false,
                              .writableWithoutSecurity = false } },
     .constraints = { .maxLength = 64 },
-    .callbacks = { .handleRead = HAPHandleAccessoryInformationNameRead, .handleWrite = NULL }
+    .callbacks = { .handleRead = HandleAccessoryInformationNameRead, .handleWrite = NULL }
 };
 
+THROTTLED_STRING_READ(HandleAccessoryInformationSerialNumberRead, HAPHandleAccessoryInformationSerialNumberRead)
+
 const HAPStringCharacteristic accessoryInformationSerialNumberCharacteristic = {
     .format = kHAPCharacteristicFormat_String,
     .iid = kIID_AccessoryInformationSerialNumber,
@@ -148,9 +200,11 @@ const HAPStringCharacteristic accessoryInformationSerialNumberCharacteristic = {
                              .readableWithoutSecurity = false,
                              .writableWithoutSecurity = false } },
     .constraints = { .maxLength = 64 },
-    .callbacks = { .handleRead = HAPHandleAccessoryInformationSerialNumberRead, .handleWrite = NULL }
+    .callbacks = { .handleRead = HandleAccessoryInformationSerialNumberRead, .handleWrite = NULL }
 };
 
+THROTTLED_STRING_READ(HandleAccessoryInformationFirmwareRevisionRead, HAPHandleAccessoryInformationFirmwareRevisionRead)
+
 const HAPStringCharacteristic accessoryInformationFirmwareRevisionCharacteristic = {
     .format = kHAPCharacteristicFormat_String,
     .iid = kIID_AccessoryInformationFirmwareRevision,
@@ -169,9 +223,12 @@ const HAPStringCharacteristic accessoryInformationFirmwareRevisionCharacteristic
                              .readableWithoutSecurity = false,
                              .writableWithoutSecurity = false } },
     .constraints = { .maxLength = 64 },
-    .callbacks = { .handleRead = HAPHandleAccessoryInformationFirmwareRevisionRead, .handleWrite = NULL }
+    .callbacks = { .handleRead = HandleAccessoryInformationFirmwareRevisionRead, .handleWrite = NULL }
 };
 
+#if !CONFIG_GARAGE_LEAN_DB
+THROTTLED_STRING_READ(HandleAccessoryInformationHardwareRevisionRead, HAPHandleAccessoryInformationHardwareRevisionRead)
+
 const HAPStringCharacteristic accessoryInformationHardwareRevisionCharacteristic = {
     .format = kHAPCharacteristicFormat_String,
     .iid = kIID_AccessoryInformationHardwareRevision,
@@ -190,8 +247,12 @@ const HAPStringCharacteristic accessoryInformationHardwareRevisionCharacteristic
                              .readableWithoutSecurity = false,
                              .writableWithoutSecurity = false } },
     .constraints = { .maxLength = 64 },
-    .callbacks = { .handleRead = HAPHandleAccessoryInformationHardwareRevisionRead, .handleWrite = NULL }
+    .callbacks = { .handleRead = HandleAccessoryInformationHardwareRevisionRead, .handleWrite = NULL }
 };
+#endif
+
+#if !CONFIG_GARAGE_LEAN_DB
+THROTTLED_STRING_READ(HandleAccessoryInformationADKVersionRead, HAPHandleAccessoryInformationADKVersionRead)
 
 const HAPStringCharacteristic accessoryInformationADKVersionCharacteristic = {
     .format = kHAPCharacteristicFormat_String,
@@ -211,8 +272,9 @@ const HAPStringCharacteristic accessoryInformationADKVersionCharacteristic = {
                              .readableWithoutSecurity = false,
                              .writableWithoutSecurity = false } },
     .constraints = { .maxLength = 64 },
-    .callbacks = { .handleRead = HAPHandleAccessoryInformationADKVersionRead, .handleWrite = NULL }
+    .callbacks = { .handleRead = HandleAccessoryInformationADKVersionRead, .handleWrite = NULL }
 };
+#endif
 
 const HAPService accessoryInformationService = {
     .iid = kIID_AccessoryInformation,
@@ -227,13 +289,16 @@ const HAPService accessoryInformationService = {
                                                             &accessoryInformationNameCharacteristic,
                                                             &accessoryInformationSerialNumberCharacteristic,
                                                             &accessoryInformationFirmwareRevisionCharacteristic,
+#if !CONFIG_GARAGE_LEAN_DB
                                                             &accessoryInformationHardwareRevisionCharacteristic,
                                                             &accessoryInformationADKVersionCharacteristic,
+#endif
                                                             NULL }
 };
 
 //----------------------------------------------------------------------------------------------------------------------
 
+#if !CONFIG_GARAGE_LEAN_DB
 static const HAPDataCharacteristic hapProtocolInformationServiceSignatureCharacteristic = {
     .format = kHAPCharacteristicFormat_Data,
     .iid = kIID_HAPProtocolInformationServiceSignature,
@@ -254,6 +319,9 @@ static const HAPDataCharacteristic hapProtocolInformationServiceSignatureCharact
     .constraints = { .maxLength = 2097152 },
     .callbacks = { .handleRead = HAPHandleServiceSignatureRead, .handleWrite = NULL }
 };
+#endif
+
+THROTTLED_STRING_READ(HandleHAPProtocolInformationVersionRead, HAPHandleHAPProtocolInformationVersionRead)
 
 static const HAPStringCharacteristic hapProtocolInformationVersionCharacteristic = {
     .format = kHAPCharacteristicFormat_String,
@@ -273,7 +341,7 @@ static const HAPStringCharacteristic hapProtocolInformationVersionCharacteristic
                              .readableWithoutSecurity = false,
                              .writableWithoutSecurity = false } },
     .constraints = { .maxLength = 64 },
-    .callbacks = { .handleRead = HAPHandleHAPProtocolInformationVersionRead, .handleWrite = NULL }
+    .callbacks = { .handleRead = HandleHAPProtocolInformationVersionRead, .handleWrite = NULL }
 };
 
 const HAPService hapProtocolInformationService = {
@@ -283,9 +351,12 @@ const HAPService hapProtocolInformationService = {
     .name = NULL,
     .properties = { .primaryService = false, .hidden = false, .ble = { .supportsConfiguration = true } },
     .linkedServices = NULL,
-    .characteristics = (const HAPCharacteristic* const[]) { &hapProtocolInformationServiceSignatureCharacteristic,
-                                                            &hapProtocolInformationVersionCharacteristic,
-                                                            NULL }
+    .characteristics = (const HAPCharacteristic* const[]) {
+#if !CONFIG_GARAGE_LEAN_DB
+            &hapProtocolInformationServiceSignatureCharacteristic,
+#endif
+            &hapProtocolInformationVersionCharacteristic,
+            NULL }
 };
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -393,6 +464,7 @@ const HAPService pairingService = {
 
 //----------------------------------------------------------------------------------------------------------------------
 
+#if !CONFIG_GARAGE_LEAN_DB
 /**
  * The 'Service Signature' characteristic of the Garage Door Opener service.
  */
@@ -416,6 +488,10 @@ static const HAPDataCharacteristic garageDoorOpenerServiceSignatureCharacteristi
     .constraints = { .maxLength = 2097152 },
     .callbacks = { .handleRead = HAPHandleServiceSignatureRead, .handleWrite = NULL }
 };
+#endif
+
+#if !CONFIG_GARAGE_LEAN_DB
+THROTTLED_STRING_READ(HandleGarageDoorOpenerNameRead, HAPHandleNameRead)
 
 /**
  * The 'Name' characteristic of the Garage Door Opener service.
@@ -438,8 +514,9 @@ static const HAPStringCharacteristic garageDoorOpenerNameCharacteristic = {
                              .readableWithoutSecurity = false,
                              .writableWithoutSecurity = false } },
     .constraints = { .maxLength = 64 },
-    .callbacks = { .handleRead = HAPHandleNameRead, .handleWrite = NULL }
+    .callbacks = { .handleRead = HandleGarageDoorOpenerNameRead, .handleWrite = NULL }
 };
+#endif
 
 /**
  * The 'Current State' characteristic of the Garage Door Opener service.
@@ -467,7 +544,10 @@ const HAPUInt8Characteristic garageDoorOpenerCurrentDoorStateCharacteristic = {
                      .stepValue = 1,
                      .validValues = NULL,
                      .validValuesRanges = NULL },
-    .callbacks = { .handleRead = HandleGarageDoorOpenerCurrentDoorStateRead, .handleWrite = NULL }
+    .callbacks = { .handleRead = HandleGarageDoorOpenerCurrentDoorStateRead,
+                   .handleWrite = NULL,
+                   .handleSubscribe = HandleGarageDoorOpenerDoorStateSubscribe,
+                   .handleUnsubscribe = HandleGarageDoorOpenerDoorStateUnsubscribe }
 };
 
 /**
@@ -497,7 +577,9 @@ const HAPUInt8Characteristic garageDoorOpenerTargetDoorStateCharacteristic = {
                      .validValues = NULL,
                      .validValuesRanges = NULL },
     .callbacks = { .handleRead = HandleGarageDoorOpenerTargetDoorStateRead,
-                   .handleWrite = HandleGarageDoorOpenerTargetDoorStateWrite }
+                   .handleWrite = HandleGarageDoorOpenerTargetDoorStateWrite,
+                   .handleSubscribe = HandleGarageDoorOpenerDoorStateSubscribe,
+                   .handleUnsubscribe = HandleGarageDoorOpenerDoorStateUnsubscribe }
 };
 
 
@@ -534,10 +616,13 @@ const HAPService garageDoorOpenerService = {
     .name = "Garage Door",
     .properties = { .primaryService = true, .hidden = false, .ble = { .supportsConfiguration = false } },
     .linkedServices = NULL,
-    .characteristics = (const HAPCharacteristic* const[]) { &garageDoorOpenerServiceSignatureCharacteristic,
-                                                            &garageDoorOpenerNameCharacteristic,
-                                                            &garageDoorOpenerCurrentDoorStateCharacteristic,
-                                                            &garageDoorOpenerTargetDoorStateCharacteristic,
-                                                            &garageDoorOpenerObstructionDetectedCharacteristic,
-                                                            NULL }
+    .characteristics = (const HAPCharacteristic* const[]) {
+#if !CONFIG_GARAGE_LEAN_DB
+            &garageDoorOpenerServiceSignatureCharacteristic,
+            &garageDoorOpenerNameCharacteristic,
+#endif
+            &garageDoorOpenerCurrentDoorStateCharacteristic,
+            &garageDoorOpenerTargetDoorStateCharacteristic,
+            &garageDoorOpenerObstructionDetectedCharacteristic,
+            NULL }
 };
@@ -22,7 +22,11 @@ extern "C" {
 /**
  * Total number of services and characteristics contained in the accessory.
  */
+#if CONFIG_GARAGE_LEAN_DB
+#define kAttributeCount ((size_t) 18)
+#else
 #define kAttributeCount ((size_t) 23)
+#endif
 
 /**
  * HomeKit Accessory Information service.
@@ -38,8 +42,10 @@ extern const HAPStringCharacteristic accessoryInformationModelCharacteristic;
 extern const HAPStringCharacteristic accessoryInformationNameCharacteristic;
 extern const HAPStringCharacteristic accessoryInformationSerialNumberCharacteristic;
 extern const HAPStringCharacteristic accessoryInformationFirmwareRevisionCharacteristic;
+#if !CONFIG_GARAGE_LEAN_DB
 extern const HAPStringCharacteristic accessoryInformationHardwareRevisionCharacteristic;
 extern const HAPStringCharacteristic accessoryInformationADKVersionCharacteristic;
+#endif
 
 /**
  * HAP Protocol Information service.
@@ -0,0 +1,175 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "DBHash.h"
+
+#define kFNV32_OffsetBasis ((uint32_t) 0x811C9DC5)
+#define kFNV32_Prime       ((uint32_t) 0x01000193)
+
+static void HashBytes(uint32_t* hash, const void* bytes, size_t numBytes) {
+    const uint8_t* b = bytes;
+    for (size_t i = 0; i < numBytes; i++) {
+        *hash ^= b[i];
+        *hash *= kFNV32_Prime;
+    }
+}
+
+/**
+ * Hash an integer in little-endian byte order, so the result does not depend on the host.
+ */
+static void HashUInt64(uint32_t* hash, uint64_t value) {
+    uint8_t bytes[8];
+    for (size_t i = 0; i < sizeof bytes; i++) {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+    HashBytes(hash, bytes, sizeof bytes);
+}
+
+static void HashFloat(uint32_t* hash, float value) {
+    uint32_t bits;
+    HAPRawBufferCopyBytes(&bits, &value, sizeof bits);
+    HashUInt64(hash, bits);
+}
+
+static void HashUUID(uint32_t* hash, const HAPUUID* uuid) {
+    HashBytes(hash, uuid->bytes, sizeof uuid->bytes);
+}
+
+static void HashProperties(uint32_t* hash, const HAPCharacteristicProperties* properties) {
+    HashUInt64(
+            hash,
+            (uint64_t) properties->readable << 0 | (uint64_t) properties->writable << 1 |
+                    (uint64_t) properties->supportsEventNotification << 2 | (uint64_t) properties->hidden << 3 |
+                    (uint64_t) properties->requiresTimedWrite << 4 |
+                    (uint64_t) properties->supportsAuthorizationData << 5 |
+                    (uint64_t) properties->ip.controlPoint << 6 | (uint64_t) properties->ip.supportsWriteResponse << 7);
+}
+
+/**
+ * Hash the common fields and the format-specific constraints of a characteristic.
+ */
+#define HASH_CHARACTERISTIC(hash, characteristic) \
+    do { \
+        HashUInt64((hash), (characteristic)->format); \
+        HashUInt64((hash), (characteristic)->iid); \
+        HashUUID((hash), (characteristic)->characteristicType); \
+        HashProperties((hash), &(characteristic)->properties); \
+    } while (0)
+
+#define HASH_NUMERIC_CONSTRAINTS(hash, characteristic, HashValue) \
+    do { \
+        HashUInt64((hash), (characteristic)->units); \
+        HashValue((hash), (characteristic)->constraints.minimumValue); \
+        HashValue((hash), (characteristic)->constraints.maximumValue); \
+        HashValue((hash), (characteristic)->constraints.stepValue); \
+    } while (0)
+
+static void HashCharacteristic(uint32_t* hash, const HAPCharacteristic* characteristic_) {
+    // All characteristic types start with the format.
+    switch (*(const HAPCharacteristicFormat*) characteristic_) {
+        case kHAPCharacteristicFormat_Data: {
+            const HAPDataCharacteristic* characteristic = characteristic_;
+            HASH_CHARACTERISTIC(hash, characteristic);
+            HashUInt64(hash, characteristic->constraints.maxLength);
+            return;
+        }
+        case kHAPCharacteristicFormat_Bool: {
+            const HAPBoolCharacteristic* characteristic = characteristic_;
+            HASH_CHARACTERISTIC(hash, characteristic);
+            return;
+        }
+        case kHAPCharacteristicFormat_UInt8: {
+            const HAPUInt8Characteristic* characteristic = characteristic_;
+            HASH_CHARACTERISTIC(hash, characteristic);
+            HASH_NUMERIC_CONSTRAINTS(hash, characteristic, HashUInt64);
+            if (characteristic->constraints.validValues) {
+                for (size_t i = 0; characteristic->constraints.validValues[i]; i++) {
+                    HashUInt64(hash, *characteristic->constraints.validValues[i]);
+                }
+            }
+            if (characteristic->constraints.validValuesRanges) {
+                for (size_t i = 0; characteristic->constraints.validValuesRanges[i]; i++) {
+                    HashUInt64(hash, characteristic->constraints.validValuesRanges[i]->start);
+                    HashUInt64(hash, characteristic->constraints.validValuesRanges[i]->end);
+                }
+            }
+            return;
+        }
+        case kHAPCharacteristicFormat_UInt16: {
+            const HAPUInt16Characteristic* characteristic = characteristic_;
+            HASH_CHARACTERISTIC(hash, characteristic);
+            HASH_NUMERIC_CONSTRAINTS(hash, characteristic, HashUInt64);
+            return;
+        }
+        case kHAPCharacteristicFormat_UInt32: {
+            const HAPUInt32Characteristic* characteristic = characteristic_;
+            HASH_CHARACTERISTIC(hash, characteristic);
+            HASH_NUMERIC_CONSTRAINTS(hash, characteristic, HashUInt64);
+            return;
+        }
+        case kHAPCharacteristicFormat_UInt64: {
+            const HAPUInt64Characteristic* characteristic = characteristic_;
+            HASH_CHARACTERISTIC(hash, characteristic);
+            HASH_NUMERIC_CONSTRAINTS(hash, characteristic, HashUInt64);
+            return;
+        }
+        case kHAPCharacteristicFormat_Int: {
+            const HAPIntCharacteristic* characteristic = characteristic_;
+            HASH_CHARACTERISTIC(hash, characteristic);
+            HASH_NUMERIC_CONSTRAINTS(hash, characteristic, HashUInt64);
+            return;
+        }
+        case kHAPCharacteristicFormat_Float: {
+            const HAPFloatCharacteristic* characteristic = characteristic_;
+            HASH_CHARACTERISTIC(hash, characteristic);
+            HASH_NUMERIC_CONSTRAINTS(hash, characteristic, HashFloat);
+            return;
+        }
+        case kHAPCharacteristicFormat_String: {
+            const HAPStringCharacteristic* characteristic = characteristic_;
+            HASH_CHARACTERISTIC(hash, characteristic);
+            HashUInt64(hash, characteristic->constraints.maxLength);
+            return;
+        }
+        case kHAPCharacteristicFormat_TLV8: {
+            const HAPTLV8Characteristic* characteristic = characteristic_;
+            HASH_CHARACTERISTIC(hash, characteristic);
+            return;
+        }
+    }
+    HAPFatalError();
+}
+
+static void HashService(uint32_t* hash, const HAPService* service) {
+    HashUInt64(hash, service->iid);
+    HashUUID(hash, service->serviceType);
+    HashUInt64(hash, (uint64_t) service->properties.primaryService << 0 | (uint64_t) service->properties.hidden << 1);
+    if (service->linkedServices) {
+        for (size_t i = 0; service->linkedServices[i]; i++) {
+            HashUInt64(hash, service->linkedServices[i]);
+        }
+    }
+    // Separates the linked services from the characteristics.
+    HashUInt64(hash, 0);
+    if (service->characteristics) {
+        for (size_t i = 0; service->characteristics[i]; i++) {
+            HashCharacteristic(hash, service->characteristics[i]);
+        }
+    }
+}
+
+uint32_t DBHashAccessory(const HAPAccessory* accessory) {
+    HAPPrecondition(accessory);
+
+    uint32_t hash = kFNV32_OffsetBasis;
+    HashUInt64(&hash, accessory->aid);
+    if (accessory->services) {
+        for (size_t i = 0; accessory->services[i]; i++) {
+            HashService(&hash, accessory->services[i]);
+        }
+    }
+    return hash;
+}
@@ -0,0 +1,44 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Hash of the accessory attribute database.
+//
+// Covers everything that controllers cache from the /accessories resource: instance IDs, types, properties, formats,
+// units and constraints of all services and characteristics. Characteristic values and callbacks are not covered, so
+// firmware updates that only change behavior keep the same hash.
+
+#ifndef DB_HASH_H
+#define DB_HASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Computes the hash of the attribute database of an accessory.
+ *
+ * @param      accessory            Accessory.
+ *
+ * @return 32-bit FNV-1a hash of the database.
+ */
+HAP_RESULT_USE_CHECK
+uint32_t DBHashAccessory(const HAPAccessory* accessory);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
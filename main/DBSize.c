@@ -0,0 +1,317 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "DBSize.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+/**
+ * Default maximum length of string values, which is not serialized.
+ */
+#define kDBSize_DefaultMaxStringLength ((uint32_t) 64)
+
+/**
+ * Default maximum length of data values, which is not serialized.
+ */
+#define kDBSize_DefaultMaxDataLength ((uint32_t) 2097152)
+
+static void Count(size_t* numBytes, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    HAPAssert(n >= 0);
+    *numBytes += (size_t) n;
+}
+
+/**
+ * Counts a type, which is serialized in short form if it is derived from the HAP base UUID.
+ */
+static void CountType(size_t* numBytes, const HAPUUID* uuid) {
+    // 0000xxxx-0000-1000-8000-0026BB765291, stored in reverse byte order.
+    static const uint8_t kBaseBytes[] = { 0x91, 0x52, 0x76, 0xBB, 0x26, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00 };
+    if (HAPRawBufferAreEqual(uuid->bytes, kBaseBytes, sizeof kBaseBytes) && !uuid->bytes[14] && !uuid->bytes[15]) {
+        Count(numBytes, ",\"type\":\"%X\"", (unsigned) HAPReadLittleUInt16(&uuid->bytes[12]));
+    } else {
+        Count(numBytes, ",\"type\":\"%s\"", "00000000-0000-0000-0000-000000000000");
+    }
+}
+
+static const char* GetFormatName(HAPCharacteristicFormat format) {
+    switch (format) {
+        case kHAPCharacteristicFormat_Data: {
+            return "data";
+        }
+        case kHAPCharacteristicFormat_Bool: {
+            return "bool";
+        }
+        case kHAPCharacteristicFormat_UInt8: {
+            return "uint8";
+        }
+        case kHAPCharacteristicFormat_UInt16: {
+            return "uint16";
+        }
+        case kHAPCharacteristicFormat_UInt32: {
+            return "uint32";
+        }
+        case kHAPCharacteristicFormat_UInt64: {
+            return "uint64";
+        }
+        case kHAPCharacteristicFormat_Int: {
+            return "int";
+        }
+        case kHAPCharacteristicFormat_Float: {
+            return "float";
+        }
+        case kHAPCharacteristicFormat_String: {
+            return "string";
+        }
+        case kHAPCharacteristicFormat_TLV8: {
+            return "tlv8";
+        }
+    }
+    HAPFatalError();
+}
+
+static void CountUnits(size_t* numBytes, HAPCharacteristicUnits units) {
+    switch (units) {
+        case kHAPCharacteristicUnits_None: {
+            return;
+        }
+        case kHAPCharacteristicUnits_Celsius: {
+            Count(numBytes, ",\"unit\":\"%s\"", "celsius");
+            return;
+        }
+        case kHAPCharacteristicUnits_ArcDegrees: {
+            Count(numBytes, ",\"unit\":\"%s\"", "arcdegrees");
+            return;
+        }
+        case kHAPCharacteristicUnits_Percentage: {
+            Count(numBytes, ",\"unit\":\"%s\"", "percentage");
+            return;
+        }
+        case kHAPCharacteristicUnits_Lux: {
+            Count(numBytes, ",\"unit\":\"%s\"", "lux");
+            return;
+        }
+        case kHAPCharacteristicUnits_Seconds: {
+            Count(numBytes, ",\"unit\":\"%s\"", "seconds");
+            return;
+        }
+    }
+    HAPFatalError();
+}
+
+static void CountProperties(size_t* numBytes, const HAPCharacteristicProperties* properties) {
+    const char* perms[7];
+    size_t numPerms = 0;
+    if (properties->readable) {
+        perms[numPerms++] = "pr";
+    }
+    if (properties->writable) {
+        perms[numPerms++] = "pw";
+    }
+    if (properties->supportsEventNotification) {
+        perms[numPerms++] = "ev";
+    }
+    if (properties->supportsAuthorizationData) {
+        perms[numPerms++] = "aa";
+    }
+    if (properties->requiresTimedWrite) {
+        perms[numPerms++] = "tw";
+    }
+    if (properties->hidden) {
+        perms[numPerms++] = "hd";
+    }
+    if (properties->ip.supportsWriteResponse) {
+        perms[numPerms++] = "wr";
+    }
+    Count(numBytes, ",\"perms\":[");
+    for (size_t i = 0; i < numPerms; i++) {
+        Count(numBytes, "%s\"%s\"", i ? "," : "", perms[i]);
+    }
+    Count(numBytes, "]");
+}
+
+/**
+ * Counts the common fields of a characteristic, up to the constraints.
+ */
+#define COUNT_CHARACTERISTIC(numBytes, characteristic) \
+    do { \
+        Count((numBytes), "{\"iid\":%llu", (unsigned long long) (characteristic)->iid); \
+        CountType((numBytes), (characteristic)->characteristicType); \
+        Count((numBytes), ",\"format\":\"%s\"", GetFormatName((characteristic)->format)); \
+        CountProperties((numBytes), &(characteristic)->properties); \
+    } while (0)
+
+#define COUNT_INTEGER_CONSTRAINTS(numBytes, characteristic, type, conversion) \
+    do { \
+        CountUnits((numBytes), (characteristic)->units); \
+        Count((numBytes), \
+              ",\"minValue\":%" conversion ",\"maxValue\":%" conversion ",\"minStep\":%" conversion, \
+              (type)(characteristic)->constraints.minimumValue, \
+              (type)(characteristic)->constraints.maximumValue, \
+              (type)(characteristic)->constraints.stepValue); \
+    } while (0)
+
+static void CountCharacteristic(size_t* numBytes, const HAPCharacteristic* characteristic_) {
+    // All characteristic types start with the format.
+    switch (*(const HAPCharacteristicFormat*) characteristic_) {
+        case kHAPCharacteristicFormat_Data: {
+            const HAPDataCharacteristic* characteristic = characteristic_;
+            COUNT_CHARACTERISTIC(numBytes, characteristic);
+            if (characteristic->constraints.maxLength != kDBSize_DefaultMaxDataLength) {
+                Count(numBytes, ",\"maxDataLen\":%lu", (unsigned long) characteristic->constraints.maxLength);
+            }
+            return;
+        }
+        case kHAPCharacteristicFormat_Bool: {
+            const HAPBoolCharacteristic* characteristic = characteristic_;
+            COUNT_CHARACTERISTIC(numBytes, characteristic);
+            return;
+        }
+        case kHAPCharacteristicFormat_UInt8: {
+            const HAPUInt8Characteristic* characteristic = characteristic_;
+            COUNT_CHARACTERISTIC(numBytes, characteristic);
+            COUNT_INTEGER_CONSTRAINTS(numBytes, characteristic, unsigned, "u");
+            if (characteristic->constraints.validValues) {
+                Count(numBytes, ",\"valid-values\":[");
+                for (size_t i = 0; characteristic->constraints.validValues[i]; i++) {
+                    Count(numBytes, "%s%u", i ? "," : "", *characteristic->constraints.validValues[i]);
+                }
+                Count(numBytes, "]");
+            }
+            if (characteristic->constraints.validValuesRanges) {
+                Count(numBytes, ",\"valid-values-range\":[");
+                for (size_t i = 0; characteristic->constraints.validValuesRanges[i]; i++) {
+                    Count(numBytes,
+                          "%s%u,%u",
+                          i ? "," : "",
+                          characteristic->constraints.validValuesRanges[i]->start,
+                          characteristic->constraints.validValuesRanges[i]->end);
+                }
+                Count(numBytes, "]");
+            }
+            return;
+        }
+        case kHAPCharacteristicFormat_UInt16: {
+            const HAPUInt16Characteristic* characteristic = characteristic_;
+            COUNT_CHARACTERISTIC(numBytes, characteristic);
+            COUNT_INTEGER_CONSTRAINTS(numBytes, characteristic, unsigned, "u");
+            return;
+        }
+        case kHAPCharacteristicFormat_UInt32: {
+            const HAPUInt32Characteristic* characteristic = characteristic_;
+            COUNT_CHARACTERISTIC(numBytes, characteristic);
+            COUNT_INTEGER_CONSTRAINTS(numBytes, characteristic, unsigned long, "lu");
+            return;
+        }
+        case kHAPCharacteristicFormat_UInt64: {
+            const HAPUInt64Characteristic* characteristic = characteristic_;
+            COUNT_CHARACTERISTIC(numBytes, characteristic);
+            COUNT_INTEGER_CONSTRAINTS(numBytes, characteristic, unsigned long long, "llu");
+            return;
+        }
+        case kHAPCharacteristicFormat_Int: {
+            const HAPIntCharacteristic* characteristic = characteristic_;
+            COUNT_CHARACTERISTIC(numBytes, characteristic);
+            COUNT_INTEGER_CONSTRAINTS(numBytes, characteristic, long, "ld");
+            return;
+        }
+        case kHAPCharacteristicFormat_Float: {
+            const HAPFloatCharacteristic* characteristic = characteristic_;
+            COUNT_CHARACTERISTIC(numBytes, characteristic);
+            CountUnits(numBytes, characteristic->units);
+            Count(numBytes,
+                  ",\"minValue\":%g,\"maxValue\":%g,\"minStep\":%g",
+                  (double) characteristic->constraints.minimumValue,
+                  (double) characteristic->constraints.maximumValue,
+                  (double) characteristic->constraints.stepValue);
+            return;
+        }
+        case kHAPCharacteristicFormat_String: {
+            const HAPStringCharacteristic* characteristic = characteristic_;
+            COUNT_CHARACTERISTIC(numBytes, characteristic);
+            if (characteristic->constraints.maxLength != kDBSize_DefaultMaxStringLength) {
+                Count(numBytes, ",\"maxLen\":%lu", (unsigned long) characteristic->constraints.maxLength);
+            }
+            return;
+        }
+        case kHAPCharacteristicFormat_TLV8: {
+            const HAPTLV8Characteristic* characteristic = characteristic_;
+            COUNT_CHARACTERISTIC(numBytes, characteristic);
+            return;
+        }
+    }
+    HAPFatalError();
+}
+
+HAP_RESULT_USE_CHECK
+size_t DBSizeService(const HAPService* service) {
+    HAPPrecondition(service);
+
+    size_t numBytes = 0;
+    Count(&numBytes, "{\"iid\":%llu", (unsigned long long) service->iid);
+    CountType(&numBytes, service->serviceType);
+    Count(&numBytes,
+          ",\"primary\":%s,\"hidden\":%s",
+          service->properties.primaryService ? "true" : "false",
+          service->properties.hidden ? "true" : "false");
+    if (service->linkedServices) {
+        Count(&numBytes, ",\"linked\":[");
+        for (size_t i = 0; service->linkedServices[i]; i++) {
+            Count(&numBytes, "%s%u", i ? "," : "", service->linkedServices[i]);
+        }
+        Count(&numBytes, "]");
+    }
+    Count(&numBytes, ",\"characteristics\":[");
+    if (service->characteristics) {
+        for (size_t i = 0; service->characteristics[i]; i++) {
+            if (i) {
+                Count(&numBytes, ",");
+            }
+            CountCharacteristic(&numBytes, service->characteristics[i]);
+            Count(&numBytes, "}");
+        }
+    }
+    Count(&numBytes, "]}");
+    return numBytes;
+}
+
+HAP_RESULT_USE_CHECK
+size_t DBSizeAccessory(const HAPAccessory* accessory) {
+    HAPPrecondition(accessory);
+
+    size_t numBytes = 0;
+    Count(&numBytes, "{\"aid\":%llu,\"services\":[", (unsigned long long) accessory->aid);
+    if (accessory->services) {
+        for (size_t i = 0; accessory->services[i]; i++) {
+            if (i) {
+                Count(&numBytes, ",");
+            }
+            numBytes += DBSizeService(accessory->services[i]);
+        }
+    }
+    Count(&numBytes, "]}");
+    return numBytes;
+}
+
+void DBSizeLog(const HAPAccessory* accessory) {
+    HAPPrecondition(accessory);
+
+    if (accessory->services) {
+        for (size_t i = 0; accessory->services[i]; i++) {
+            const HAPService* service = accessory->services[i];
+            HAPLogInfo(
+                    &kHAPLog_Default,
+                    "Attribute database: %s service %zu bytes.",
+                    service->debugDescription,
+                    DBSizeService(service));
+        }
+    }
+    HAPLogInfo(&kHAPLog_Default, "Attribute database: %zu bytes without values.", DBSizeAccessory(accessory));
+}
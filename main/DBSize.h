@@ -0,0 +1,62 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Size of the accessory attribute database in the /accessories response.
+//
+// Counts the JSON that the accessory server emits for the metadata of each service: instance IDs, types,
+// permissions, formats, units and constraints. Characteristic values are not counted, as they are the same with
+// every database profile. The count follows the serialization of the ADK's IP accessory server closely but is not
+// exact; it is meant to compare database profiles (GARAGE_LEAN_DB), not to size buffers.
+
+#ifndef DB_SIZE_H
+#define DB_SIZE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Counts the bytes of a service in the /accessories response, excluding characteristic values.
+ *
+ * @param      service              Service.
+ *
+ * @return Number of bytes.
+ */
+HAP_RESULT_USE_CHECK
+size_t DBSizeService(const HAPService* service);
+
+/**
+ * Counts the bytes of an accessory in the /accessories response, excluding characteristic values.
+ *
+ * @param      accessory            Accessory.
+ *
+ * @return Number of bytes.
+ */
+HAP_RESULT_USE_CHECK
+size_t DBSizeAccessory(const HAPAccessory* accessory);
+
+/**
+ * Logs the size of each service and of the whole accessory.
+ *
+ * @param      accessory            Accessory.
+ */
+void DBSizeLog(const HAPAccessory* accessory);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,158 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "FlashWriteScheduler.h"
+
+#include "Metrics.h"
+
+#include <esp_timer.h>
+
+/**
+ * Maximum number of distinct writes that can be pending at the same time.
+ */
+#define kFlashWriteScheduler_MaxPendingWrites ((size_t) 4)
+
+#define kFlashWriteScheduler_MaxDeferralUs ((int64_t) CONFIG_GARAGE_FLASH_WRITE_MAX_DEFERRAL_MS * 1000)
+
+static struct {
+    FlashWrite* _Nullable pendingWrites[kFlashWriteScheduler_MaxPendingWrites];
+    size_t numPendingWrites;
+
+    /** Writes are held back until this time, from esp_timer_get_time. */
+    int64_t busyUntil;
+
+    /** Writes are held back until released. */
+    bool isHeld;
+
+    HAPPlatformTimerRef timer;
+} scheduler;
+
+static void Reschedule(void);
+
+static void Perform(FlashWrite* write) {
+    int64_t startedAt = esp_timer_get_time();
+    write->callback();
+    int64_t finishedAt = esp_timer_get_time();
+
+    MetricsRecord(kMetric_FlashWriteStall, (uint32_t)(finishedAt - startedAt));
+    HAPLogDebug(
+            &kHAPLog_Default,
+            "Flash write %s: deferred %lld us, took %lld us.",
+            write->name,
+            (long long) (startedAt - write->requestedAt),
+            (long long) (finishedAt - startedAt));
+    write->requestedAt = 0;
+}
+
+void FlashWriteSchedulerFlush(void) {
+    if (scheduler.timer) {
+        HAPPlatformTimerDeregister(scheduler.timer);
+        scheduler.timer = 0;
+    }
+    for (size_t i = 0; i < scheduler.numPendingWrites; i++) {
+        Perform(HAPNonnull(scheduler.pendingWrites[i]));
+        scheduler.pendingWrites[i] = NULL;
+    }
+    scheduler.numPendingWrites = 0;
+}
+
+void FlashWriteSchedulerDiscard(FlashWrite* write) {
+    HAPPrecondition(write);
+
+    for (size_t i = 0; i < scheduler.numPendingWrites; i++) {
+        if (scheduler.pendingWrites[i] != write) {
+            continue;
+        }
+        HAPLogDebug(&kHAPLog_Default, "Flash write %s: discarded.", write->name);
+        write->requestedAt = 0;
+        scheduler.numPendingWrites--;
+        for (size_t j = i; j < scheduler.numPendingWrites; j++) {
+            scheduler.pendingWrites[j] = scheduler.pendingWrites[j + 1];
+        }
+        scheduler.pendingWrites[scheduler.numPendingWrites] = NULL;
+        // The oldest pending write determines the deadline.
+        Reschedule();
+        return;
+    }
+}
+
+static void HandleTimerExpired(HAPPlatformTimerRef timer HAP_UNUSED, void* _Nullable context HAP_UNUSED) {
+    scheduler.timer = 0;
+
+    int64_t now = esp_timer_get_time();
+    bool isOverdue = scheduler.numPendingWrites &&
+                     now - HAPNonnull(scheduler.pendingWrites[0])->requestedAt >= kFlashWriteScheduler_MaxDeferralUs;
+    if (now < scheduler.busyUntil && !isOverdue) {
+        Reschedule();
+        return;
+    }
+    FlashWriteSchedulerFlush();
+}
+
+/**
+ * Arms the timer for the earlier of the end of the busy period and the deadline of the oldest pending write.
+ */
+static void Reschedule(void) {
+    if (scheduler.timer) {
+        HAPPlatformTimerDeregister(scheduler.timer);
+        scheduler.timer = 0;
+    }
+    if (!scheduler.numPendingWrites || scheduler.isHeld) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    int64_t dueAt = HAPNonnull(scheduler.pendingWrites[0])->requestedAt + kFlashWriteScheduler_MaxDeferralUs;
+    if (scheduler.busyUntil < dueAt) {
+        dueAt = scheduler.busyUntil;
+    }
+    // Even when idle, the write runs from a timer so that the caller finishes its work first.
+    HAPTime delayMS = dueAt > now ? (HAPTime)((dueAt - now + 999) / 1000) : 0;
+    HAPError err = HAPPlatformTimerRegister(
+            &scheduler.timer, HAPPlatformClockGetCurrent() + delayMS, HandleTimerExpired, NULL);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLogError(&kHAPLog_Default, "%s: Not enough timers available. Writing now.", __func__);
+        FlashWriteSchedulerFlush();
+    }
+}
+
+void FlashWriteSchedulerRequest(FlashWrite* write) {
+    HAPPrecondition(write);
+    HAPPrecondition(write->callback);
+
+    if (write->requestedAt) {
+        return;
+    }
+    if (scheduler.numPendingWrites == kFlashWriteScheduler_MaxPendingWrites) {
+        HAPLogError(&kHAPLog_Default, "%s: Too many pending writes. Writing now.", __func__);
+        FlashWriteSchedulerFlush();
+    }
+    write->requestedAt = esp_timer_get_time();
+    scheduler.pendingWrites[scheduler.numPendingWrites++] = write;
+    if (scheduler.numPendingWrites == 1) {
+        Reschedule();
+    }
+}
+
+void FlashWriteSchedulerSetHeld(bool isHeld) {
+    if (isHeld == scheduler.isHeld) {
+        return;
+    }
+    scheduler.isHeld = isHeld;
+    Reschedule();
+}
+
+void FlashWriteSchedulerDefer(HAPTime durationMS) {
+    int64_t busyUntil = esp_timer_get_time() + (int64_t) durationMS * 1000;
+    if (busyUntil <= scheduler.busyUntil) {
+        return;
+    }
+    scheduler.busyUntil = busyUntil;
+    if (scheduler.numPendingWrites) {
+        Reschedule();
+    }
+}
@@ -0,0 +1,90 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Deferred flash writes.
+//
+// Writing or erasing flash disables the flash cache, which stalls both cores until the operation completes. Code
+// that is not in IRAM, including the HAP run loop and the Wi-Fi and lwIP tasks, cannot run in the meantime.
+// Writes that do not need to be durable right away are requested here instead of being performed in place. They
+// run once the accessory has been quiet for a moment, i.e. no HAP request, Pair Verify or remote press is expected,
+// and at the latest GARAGE_FLASH_WRITE_MAX_DEFERRAL_MS after they were first requested. Requesting a write that is
+// already pending coalesces both.
+//
+// The duration of every write is recorded as the flashWriteStall metric.
+//
+// All functions must be called on the run loop.
+
+#ifndef FLASH_WRITE_SCHEDULER_H
+#define FLASH_WRITE_SCHEDULER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Deferred write.
+ */
+typedef struct {
+    /** Name for logging. */
+    const char* name;
+
+    /** Performs the write. */
+    void (*callback)(void);
+
+    /** Time of the first request since the last write, from esp_timer_get_time. 0 if not pending. */
+    int64_t requestedAt;
+} FlashWrite;
+
+/**
+ * Requests a write.
+ *
+ * @param      write                Write. Must stay valid until it has been performed.
+ */
+void FlashWriteSchedulerRequest(FlashWrite* write);
+
+/**
+ * Postpones pending and future writes because activity is expected within the given time.
+ *
+ * @param      durationMS           Time to stay away from flash, in milliseconds.
+ */
+void FlashWriteSchedulerDefer(HAPTime durationMS);
+
+/**
+ * Holds pending and future writes back beyond the maximum deferral, e.g. while the supply is too weak to complete
+ * them safely. Flushing still performs them.
+ *
+ * @param      isHeld               Whether writes are held.
+ */
+void FlashWriteSchedulerSetHeld(bool isHeld);
+
+/**
+ * Performs all pending writes now.
+ */
+void FlashWriteSchedulerFlush(void);
+
+/**
+ * Drops a write without performing it, e.g. because the data it would persist has been purged. Does nothing if the
+ * write is not pending.
+ *
+ * @param      write                Write.
+ */
+void FlashWriteSchedulerDiscard(FlashWrite* write);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,270 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "HotPathProfiler.h"
+
+#include "Placement.h"
+#include "ReportFormat.h"
+
+#include <stdlib.h>
+#include <eri.h>
+#include <esp_cpu.h>
+#include <esp_ipc.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <xtensa_perfmon_access.h>
+#include <xtensa_perfmon_masks.h>
+#include <xtensa-debug-module.h>
+
+// This file is built without -finstrument-functions (see CMakeLists.txt). The hooks must not call instrumented code,
+// and must stay usable while the flash cache is disabled, so they only use IRAM and inline functions.
+
+/**
+ * Performance counter that counts instruction-side stalls.
+ */
+#define kHotPathProfiler_StallCounter 0
+
+/**
+ * Number of functions tracked per core. Further functions are counted as dropped.
+ */
+#define kHotPathProfiler_MaxFunctions ((size_t) 128)
+
+/**
+ * Maximum call depth that is tracked. Deeper calls are not measured.
+ */
+#define kHotPathProfiler_MaxDepth ((size_t) 24)
+
+typedef struct {
+    uintptr_t function;
+    uint32_t numCalls;
+    uint64_t cycles;
+    uint64_t stallCycles;
+} Function;
+
+typedef struct {
+    uintptr_t function;
+    uint32_t startCycles;
+    uint32_t startStalls;
+
+    /** Cycles and stalls spent in callees, which are excluded from the function. */
+    uint32_t childCycles;
+    uint32_t childStalls;
+} Frame;
+
+/**
+ * Profile of one core. Only accessed by that core, so the hooks need no lock.
+ */
+typedef struct {
+    Function functions[kHotPathProfiler_MaxFunctions];
+    uint32_t numDropped;
+
+    /** Calls in flight of the task that owns the stack. */
+    Frame frames[kHotPathProfiler_MaxDepth];
+    size_t depth;
+    TaskHandle_t _Nullable task;
+
+    /** Set while a hook runs, so interrupts that call instrumented functions do not corrupt the stack. */
+    volatile bool isBusy;
+} CoreProfile;
+
+static DRAM_ATTR CoreProfile cores[portNUM_PROCESSORS];
+static DRAM_ATTR volatile bool isStarted;
+
+void __cyg_profile_func_enter(void* function, void* callSite);
+void __cyg_profile_func_exit(void* function, void* callSite);
+
+/**
+ * Reads the stall counter. xtensa_perfmon_value is in flash.
+ */
+static inline uint32_t ReadStallCounter(void) {
+    return eri_read(ERI_PERFMON_PM0 + kHotPathProfiler_StallCounter * sizeof(uint32_t));
+}
+
+static IRAM_ATTR Function* _Nullable FindFunction(CoreProfile* core, uintptr_t address) {
+    // Open addressing on the function address. Instructions are at least 2 bytes apart.
+    size_t index = (address >> 1) % kHotPathProfiler_MaxFunctions;
+    for (size_t i = 0; i < kHotPathProfiler_MaxFunctions; i++) {
+        Function* function = &core->functions[index];
+        if (function->function == address) {
+            return function;
+        }
+        if (!function->function) {
+            function->function = address;
+            return function;
+        }
+        index = (index + 1) % kHotPathProfiler_MaxFunctions;
+    }
+    return NULL;
+}
+
+static IRAM_ATTR CoreProfile* _Nullable BeginHook(void) {
+    if (!isStarted || xPortInIsrContext()) {
+        return NULL;
+    }
+    CoreProfile* core = &cores[xPortGetCoreID()];
+    if (core->isBusy) {
+        return NULL;
+    }
+    core->isBusy = true;
+
+    // The stack is only valid for the task that built it.
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    if (core->task != task) {
+        core->task = task;
+        core->depth = 0;
+    }
+    return core;
+}
+
+void IRAM_ATTR __cyg_profile_func_enter(void* function, void* callSite HAP_UNUSED) {
+    CoreProfile* _Nullable core = BeginHook();
+    if (!core) {
+        return;
+    }
+    if (core->depth < kHotPathProfiler_MaxDepth) {
+        Frame* frame = &core->frames[core->depth];
+        frame->function = (uintptr_t) function;
+        frame->childCycles = 0;
+        frame->childStalls = 0;
+        frame->startStalls = ReadStallCounter();
+        frame->startCycles = esp_cpu_get_ccount();
+    }
+    core->depth++;
+    core->isBusy = false;
+}
+
+void IRAM_ATTR __cyg_profile_func_exit(void* function, void* callSite HAP_UNUSED) {
+    uint32_t endCycles = esp_cpu_get_ccount();
+    uint32_t endStalls = ReadStallCounter();
+
+    CoreProfile* _Nullable core = BeginHook();
+    if (!core) {
+        return;
+    }
+    if (!core->depth) {
+        // The task entered the function before its stack was reset.
+        core->isBusy = false;
+        return;
+    }
+    core->depth--;
+    if (core->depth < kHotPathProfiler_MaxDepth && core->frames[core->depth].function == (uintptr_t) function) {
+        const Frame* frame = &core->frames[core->depth];
+        uint32_t cycles = endCycles - frame->startCycles;
+        uint32_t stalls = endStalls - frame->startStalls;
+
+        Function* _Nullable entry = FindFunction(core, (uintptr_t) function);
+        if (entry) {
+            entry->numCalls++;
+            entry->cycles += cycles - frame->childCycles;
+            entry->stallCycles += stalls - frame->childStalls;
+        } else {
+            core->numDropped++;
+        }
+        if (core->depth) {
+            Frame* parent = &core->frames[core->depth - 1];
+            parent->childCycles += cycles;
+            parent->childStalls += stalls;
+        }
+    }
+    core->isBusy = false;
+}
+
+static void StartCounters(void* _Nullable arg HAP_UNUSED) {
+    ESP_ERROR_CHECK(xtensa_perfmon_init(
+            kHotPathProfiler_StallCounter, XTPERF_CNT_I_STALL, XTPERF_MASK_I_STALL_ANY, 0, -1));
+    ESP_ERROR_CHECK(xtensa_perfmon_reset(kHotPathProfiler_StallCounter));
+    xtensa_perfmon_start();
+}
+
+void HotPathProfilerStart(void) {
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        ESP_ERROR_CHECK(esp_ipc_call_blocking(core, StartCounters, NULL));
+    }
+    isStarted = true;
+}
+
+/**
+ * Merges the profiles of all cores. The tables are copied without stopping the hooks, so a function may be off by
+ * the call in progress.
+ */
+static size_t MergeProfiles(Function* merged, uint32_t* numDropped) {
+    size_t numMerged = 0;
+    *numDropped = 0;
+    for (size_t c = 0; c < portNUM_PROCESSORS; c++) {
+        *numDropped += cores[c].numDropped;
+        for (size_t i = 0; i < kHotPathProfiler_MaxFunctions; i++) {
+            Function function = cores[c].functions[i];
+            if (!function.function || !function.numCalls) {
+                continue;
+            }
+            size_t j = 0;
+            while (j < numMerged && merged[j].function != function.function) {
+                j++;
+            }
+            if (j == numMerged) {
+                merged[numMerged++] = function;
+            } else {
+                merged[j].numCalls += function.numCalls;
+                merged[j].cycles += function.cycles;
+                merged[j].stallCycles += function.stallCycles;
+            }
+        }
+    }
+    return numMerged;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HotPathProfilerSerialize(char* bytes, size_t maxBytes, size_t* numBytes) {
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    Function* merged = PlacementAllocateBulk(portNUM_PROCESSORS * kHotPathProfiler_MaxFunctions * sizeof *merged);
+    if (!merged) {
+        return kHAPError_OutOfResources;
+    }
+    uint32_t numDropped;
+    size_t numMerged = MergeProfiles(merged, &numDropped);
+
+    size_t offset = 0;
+    HAPError err = ReportFormatAppend(
+            bytes,
+            maxBytes,
+            &offset,
+            "{\"cpuFrequencyMHz\":%d,\"dropped\":%lu,\"functions\":[",
+            CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+            (unsigned long) numDropped);
+    // Selection by stall cycles, moving each pick to the front.
+    for (size_t n = 0; !err && n < numMerged && n < kHotPathProfiler_MaxReportedFunctions; n++) {
+        size_t worst = n;
+        for (size_t i = n + 1; i < numMerged; i++) {
+            if (merged[i].stallCycles > merged[worst].stallCycles) {
+                worst = i;
+            }
+        }
+        Function function = merged[worst];
+        merged[worst] = merged[n];
+        merged[n] = function;
+        err = ReportFormatAppend(
+                bytes,
+                maxBytes,
+                &offset,
+                "%s{\"address\":\"0x%08lx\",\"calls\":%lu,\"cycles\":%llu,\"stallCycles\":%llu}",
+                n ? "," : "",
+                (unsigned long) function.function,
+                (unsigned long) function.numCalls,
+                (unsigned long long) function.cycles,
+                (unsigned long long) function.stallCycles);
+    }
+    free(merged);
+    if (!err) {
+        err = ReportFormatAppend(bytes, maxBytes, &offset, "]}");
+    }
+    if (err) {
+        return err;
+    }
+    *numBytes = offset;
+    return kHAPError_None;
+}
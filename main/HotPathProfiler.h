@@ -0,0 +1,66 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Instruction fetch stall profiler.
+//
+// Code in flash is fetched through the flash cache. After idle periods and while flash is written, those fetches
+// stall the core; code in IRAM never does. To find the functions worth moving to IRAM, the components listed in
+// GARAGE_HOTPATH_PROFILER_COMPONENTS are built with -finstrument-functions. The entry and exit hooks read the CPU
+// cycle counter and a performance counter of instruction-side stalls (XTPERF_CNT_I_STALL), and attribute both to the
+// function, excluding its callees.
+//
+// Measurements of a call are dropped when its task is preempted before the call returns, so functions that block
+// are under-represented. This is fine for the handlers and inner loops the profile is meant to find.
+//
+// tools/hotpath_lf.py turns the report into main/hotpath.lf, a linker fragment that places the functions with the
+// most stall cycles in IRAM within GARAGE_HOTPATH_IRAM_BUDGET_BYTES. It is applied with GARAGE_HOTPATH_IRAM.
+
+#ifndef HOT_PATH_PROFILER_H
+#define HOT_PATH_PROFILER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Number of functions in the report.
+ */
+#define kHotPathProfiler_MaxReportedFunctions ((size_t) 48)
+
+/**
+ * Starts the performance counters on both cores. Functions are only profiled afterwards.
+ */
+void HotPathProfilerStart(void);
+
+/**
+ * Serializes the functions with the most instruction fetch stall cycles as a JSON object. May be called from any
+ * task.
+ *
+ * @param[out] bytes                Buffer.
+ * @param      maxBytes             Capacity of buffer.
+ * @param[out] numBytes             Length of the JSON object, excluding the NULL terminator.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the buffer is too small or out of memory.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HotPathProfilerSerialize(char* bytes, size_t maxBytes, size_t* numBytes);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
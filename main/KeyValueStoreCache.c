@@ -0,0 +1,259 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "KeyValueStoreCache.h"
+
+#include <esp_timer.h>
+
+HAPError __real_HAPPlatformKeyValueStoreGet(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        void* _Nullable bytes,
+        size_t maxBytes,
+        size_t* _Nullable numBytes,
+        bool* found);
+HAPError __real_HAPPlatformKeyValueStoreSet(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* bytes,
+        size_t numBytes);
+HAPError __real_HAPPlatformKeyValueStoreRemove(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key);
+HAPError __real_HAPPlatformKeyValueStorePurgeDomain(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain);
+
+/**
+ * Cached value or absence of one key.
+ */
+typedef struct {
+    HAPPlatformKeyValueStoreRef _Nullable keyValueStore;
+    HAPPlatformKeyValueStoreDomain domain;
+    HAPPlatformKeyValueStoreKey key;
+    bool found;
+    uint8_t numBytes;
+
+    /** Value of cache.clock when the entry was last used. */
+    uint32_t lastUsed;
+
+    uint8_t bytes[kKeyValueStoreCache_MaxValueBytes];
+} Entry;
+
+HAP_STATIC_ASSERT(kKeyValueStoreCache_MaxValueBytes <= UINT8_MAX, Entry_numBytes);
+
+static struct {
+    Entry entries[CONFIG_GARAGE_KVS_CACHE_ENTRIES];
+    uint32_t clock;
+    KeyValueStoreCacheStats stats;
+} cache = { .stats = { .maxEntries = CONFIG_GARAGE_KVS_CACHE_ENTRIES } };
+
+static Entry* _Nullable FindEntry(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key) {
+    for (size_t i = 0; i < HAPArrayCount(cache.entries); i++) {
+        Entry* entry = &cache.entries[i];
+        if (entry->keyValueStore == keyValueStore && entry->domain == domain && entry->key == key) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void RemoveEntry(Entry* entry) {
+    entry->keyValueStore = NULL;
+    cache.stats.numEntries--;
+}
+
+/**
+ * Returns the entry of a key, reusing a free or the least recently used entry if the key is not cached.
+ */
+static Entry* AllocateEntry(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key) {
+    Entry* _Nullable entry = FindEntry(keyValueStore, domain, key);
+    if (entry) {
+        return HAPNonnull(entry);
+    }
+    Entry* victim = &cache.entries[0];
+    for (size_t i = 0; i < HAPArrayCount(cache.entries); i++) {
+        Entry* candidate = &cache.entries[i];
+        if (!candidate->keyValueStore) {
+            victim = candidate;
+            break;
+        }
+        if ((uint32_t)(cache.clock - candidate->lastUsed) > (uint32_t)(cache.clock - victim->lastUsed)) {
+            victim = candidate;
+        }
+    }
+    if (victim->keyValueStore) {
+        cache.stats.numEvictions++;
+    } else {
+        cache.stats.numEntries++;
+    }
+    victim->keyValueStore = keyValueStore;
+    victim->domain = domain;
+    victim->key = key;
+    return victim;
+}
+
+static void StoreEntry(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* _Nullable bytes,
+        size_t numBytes,
+        bool found) {
+    HAPPrecondition(numBytes <= kKeyValueStoreCache_MaxValueBytes);
+
+    Entry* entry = AllocateEntry(keyValueStore, domain, key);
+    entry->found = found;
+    entry->numBytes = (uint8_t) numBytes;
+    if (numBytes) {
+        HAPRawBufferCopyBytes(entry->bytes, HAPNonnull(bytes), numBytes);
+    }
+    entry->lastUsed = cache.clock++;
+}
+
+static void InvalidateEntry(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key) {
+    Entry* _Nullable entry = FindEntry(keyValueStore, domain, key);
+    if (entry) {
+        RemoveEntry(HAPNonnull(entry));
+    }
+}
+
+HAPError __wrap_HAPPlatformKeyValueStoreGet(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        void* _Nullable bytes,
+        size_t maxBytes,
+        size_t* _Nullable numBytes,
+        bool* found);
+HAPError __wrap_HAPPlatformKeyValueStoreGet(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        void* _Nullable bytes,
+        size_t maxBytes,
+        size_t* _Nullable numBytes,
+        bool* found) {
+    HAPPrecondition(keyValueStore);
+    HAPPrecondition(!maxBytes || bytes);
+    HAPPrecondition((bytes == NULL) == (numBytes == NULL));
+    HAPPrecondition(found);
+
+    Entry* _Nullable entry = FindEntry(keyValueStore, domain, key);
+    if (entry) {
+        cache.stats.numHits++;
+        *found = entry->found;
+        if (!entry->found) {
+            cache.stats.numNegativeHits++;
+        } else if (bytes) {
+            size_t n = HAPMin(maxBytes, (size_t) entry->numBytes);
+            HAPRawBufferCopyBytes(HAPNonnull(bytes), entry->bytes, n);
+            *numBytes = n;
+        }
+        entry->lastUsed = cache.clock++;
+        return kHAPError_None;
+    }
+
+    // The value is read into a buffer one byte larger than any cached value to tell whether it fits. Stores that
+    // reject reads into short buffers fail this read, those values are then read directly.
+    cache.stats.numMisses++;
+    int64_t startedAt = esp_timer_get_time();
+    uint8_t value[kKeyValueStoreCache_MaxValueBytes + 1];
+    size_t numValueBytes = 0;
+    bool isFound;
+    HAPError err = __real_HAPPlatformKeyValueStoreGet(
+            keyValueStore, domain, key, value, sizeof value, &numValueBytes, &isFound);
+    if (err || (isFound && numValueBytes > kKeyValueStoreCache_MaxValueBytes)) {
+        cache.stats.numUncacheable++;
+        err = __real_HAPPlatformKeyValueStoreGet(keyValueStore, domain, key, bytes, maxBytes, numBytes, found);
+        cache.stats.backendReadUs += (uint64_t)(esp_timer_get_time() - startedAt);
+        return err;
+    }
+    cache.stats.backendReadUs += (uint64_t)(esp_timer_get_time() - startedAt);
+
+    StoreEntry(keyValueStore, domain, key, value, isFound ? numValueBytes : 0, isFound);
+    *found = isFound;
+    if (isFound && bytes) {
+        size_t n = HAPMin(maxBytes, numValueBytes);
+        HAPRawBufferCopyBytes(HAPNonnull(bytes), value, n);
+        *numBytes = n;
+    }
+    return kHAPError_None;
+}
+
+HAPError __wrap_HAPPlatformKeyValueStoreSet(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* bytes,
+        size_t numBytes);
+HAPError __wrap_HAPPlatformKeyValueStoreSet(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key,
+        const void* bytes,
+        size_t numBytes) {
+    HAPError err = __real_HAPPlatformKeyValueStoreSet(keyValueStore, domain, key, bytes, numBytes);
+    if (err || numBytes > kKeyValueStoreCache_MaxValueBytes) {
+        // After a failed write the stored value is unknown.
+        InvalidateEntry(keyValueStore, domain, key);
+        return err;
+    }
+    StoreEntry(keyValueStore, domain, key, bytes, numBytes, true);
+    return kHAPError_None;
+}
+
+HAPError __wrap_HAPPlatformKeyValueStoreRemove(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key);
+HAPError __wrap_HAPPlatformKeyValueStoreRemove(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain,
+        HAPPlatformKeyValueStoreKey key) {
+    HAPError err = __real_HAPPlatformKeyValueStoreRemove(keyValueStore, domain, key);
+    if (err) {
+        InvalidateEntry(keyValueStore, domain, key);
+        return err;
+    }
+    StoreEntry(keyValueStore, domain, key, NULL, 0, false);
+    return kHAPError_None;
+}
+
+HAPError __wrap_HAPPlatformKeyValueStorePurgeDomain(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain);
+HAPError __wrap_HAPPlatformKeyValueStorePurgeDomain(
+        HAPPlatformKeyValueStoreRef keyValueStore,
+        HAPPlatformKeyValueStoreDomain domain) {
+    // Invalidated even if the purge fails, since part of the domain may already be gone.
+    HAPError err = __real_HAPPlatformKeyValueStorePurgeDomain(keyValueStore, domain);
+    for (size_t i = 0; i < HAPArrayCount(cache.entries); i++) {
+        Entry* entry = &cache.entries[i];
+        if (entry->keyValueStore == keyValueStore && entry->domain == domain) {
+            RemoveEntry(entry);
+        }
+    }
+    return err;
+}
+
+void KeyValueStoreCacheGetStats(KeyValueStoreCacheStats* stats) {
+    HAPPrecondition(stats);
+
+    *stats = cache.stats;
+}
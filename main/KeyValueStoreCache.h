@@ -0,0 +1,79 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Read-through cache for the key-value store.
+//
+// Every connection makes the accessory server read the same few keys (configuration number, long-term secret key,
+// pairings, software token material), and every read is an NVS lookup in flash. The HAPPlatformKeyValueStore functions
+// are wrapped at link time (-Wl,--wrap, see CMakeLists.txt), so the reads of the accessory server are served from RAM
+// without changes to the ADK:
+//
+// - Get is read-through. Values of up to kKeyValueStoreCache_MaxValueBytes bytes are cached, as is the absence of a
+//   key. Larger values are always read from flash.
+// - Set and Remove are write-through. The store is updated first and the cache only if that succeeded.
+// - PurgeDomain drops every cached entry of the domain.
+// - Enumerate is passed through.
+//
+// At most GARAGE_KVS_CACHE_ENTRIES entries are kept; the least recently used one is evicted.
+//
+// Like the key-value store itself, the wrapped functions must be called on the run loop.
+
+#ifndef KEY_VALUE_STORE_CACHE_H
+#define KEY_VALUE_STORE_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Maximum size of a cached value. Pairings take 70 bytes.
+ */
+#define kKeyValueStoreCache_MaxValueBytes ((size_t) 80)
+
+/**
+ * Cache statistics.
+ */
+typedef struct {
+    /** Number of cached entries and capacity. */
+    size_t numEntries;
+    size_t maxEntries;
+
+    /** Reads served from the cache, including reads of keys known to be absent. */
+    uint32_t numHits;
+    uint32_t numNegativeHits;
+
+    /** Reads that went to flash, and the subset that was too large to cache. */
+    uint32_t numMisses;
+    uint32_t numUncacheable;
+
+    uint32_t numEvictions;
+
+    /** Time spent in flash reads. */
+    uint64_t backendReadUs;
+} KeyValueStoreCacheStats;
+
+/**
+ * Gets the cache statistics. May be called from any task; the counters may be slightly out of step with each other.
+ *
+ * @param[out] stats                Statistics.
+ */
+void KeyValueStoreCacheGetStats(KeyValueStoreCacheStats* stats);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
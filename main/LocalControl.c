@@ -0,0 +1,686 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "LocalControl.h"
+
+#include "App.h"
+#include "CommandSlo.h"
+#include "DB.h"
+#include "Metrics.h"
+#include "PerfSnapshot.h"
+#include "SessionTracker.h"
+#include "WriteRequest.h"
+#if CONFIG_GARAGE_TELEMETRY
+#include "CpuUsage.h"
+#include "Telemetry.h"
+#include "TelemetryJournal.h"
+#endif
+#if CONFIG_GARAGE_KVS_CACHE
+#include "KeyValueStoreCache.h"
+#endif
+#if CONFIG_GARAGE_LOCK_PROFILER
+#include "LockProfilerWrappers.h"
+#endif
+#if CONFIG_GARAGE_HOTPATH_PROFILER
+#include "HotPathProfiler.h"
+#endif
+#if CONFIG_GARAGE_BENCHMARK
+#include "Benchmark.h"
+#endif
+#if CONFIG_GARAGE_SUPPLY_MONITOR
+#include "SupplyMonitor.h"
+#endif
+#if CONFIG_GARAGE_OVERLOAD_CONTROL
+#include "Overload.h"
+#endif
+#if CONFIG_GARAGE_RF_RECEIVER
+#include "RfCalibration.h"
+#include "RfCodeBook.h"
+#include "RfReceiver.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_http_server.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lwip/sockets.h>
+
+/**
+ * Largest accepted request body.
+ */
+#define kLocalControl_MaxBodyBytes ((size_t) 256)
+
+/**
+ * Maximum number of WebSocket clients that receive door state events.
+ */
+#define kLocalControl_MaxEventClients ((size_t) 2)
+
+/**
+ * Buffer size for the CPU utilization report, about 90 bytes per task.
+ */
+#define kLocalControl_MaxCpuUsageBytes ((size_t) 2560)
+
+/**
+ * Buffer size for the lock contention report, about 350 bytes per lock.
+ */
+#define kLocalControl_MaxLockReportBytes ((size_t) 3072)
+
+/**
+ * Buffer size for the hot path report, up to 120 bytes per function.
+ */
+#define kLocalControl_MaxHotPathReportBytes ((size_t) 6144)
+
+/**
+ * Expected value of the Authorization header.
+ */
+static const char kAuthorization[] = "Bearer " CONFIG_GARAGE_LOCAL_CONTROL_PSK;
+
+static httpd_handle_t server;
+
+/**
+ * Sockets of authenticated WebSocket clients, -1 if unused. Only accessed from the HTTP server task.
+ */
+static int eventClients[kLocalControl_MaxEventClients] = { -1, -1 };
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Check the pre-shared key. The comparison time does not depend on the position of the first mismatch.
+ */
+static bool IsAuthorized(httpd_req_t* req) {
+    char value[sizeof kAuthorization + 1];
+    if (httpd_req_get_hdr_value_str(req, "Authorization", value, sizeof value) != ESP_OK) {
+        return false;
+    }
+    if (strlen(value) != sizeof kAuthorization - 1) {
+        return false;
+    }
+    uint8_t diff = 0;
+    for (size_t i = 0; i < sizeof kAuthorization - 1; i++) {
+        diff |= (uint8_t)(value[i] ^ kAuthorization[i]);
+    }
+    return diff == 0;
+}
+
+/**
+ * Whether per-request logging is skipped to shed load.
+ */
+static bool IsLogMuted(void) {
+#if CONFIG_GARAGE_OVERLOAD_CONTROL
+    return OverloadIsDegraded();
+#else
+    return false;
+#endif
+}
+
+static esp_err_t SendStatus(httpd_req_t* req, const char* status) {
+    httpd_resp_set_status(req, status);
+    return httpd_resp_send(req, NULL, 0);
+}
+
+static esp_err_t SendJSON(httpd_req_t* req, const char* bytes, size_t numBytes) {
+    httpd_resp_set_type(req, "application/hap+json");
+    return httpd_resp_send(req, bytes, (ssize_t) numBytes);
+}
+
+/**
+ * Serializes a report, e.g. MetricsSerialize.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_InvalidState   If there is nothing to report yet.
+ * @return kHAPError_OutOfResources If the buffer is too small or out of memory.
+ */
+typedef HAPError (*SerializeCallback)(char* bytes, size_t maxBytes, size_t* numBytes);
+
+/**
+ * Report served on a GET endpoint.
+ */
+typedef struct {
+    const char* uri;
+    const char* contentType;
+    SerializeCallback serialize;
+
+    /** Size of the buffer that the report is serialized into. */
+    size_t maxBytes;
+} Report;
+
+/**
+ * Serialize a report into a heap buffer and send it.
+ */
+static esp_err_t HandleReportGet(httpd_req_t* req) {
+    if (!IsAuthorized(req)) {
+        return SendStatus(req, "401 Unauthorized");
+    }
+    const Report* report = req->user_ctx;
+
+    char* bytes = malloc(report->maxBytes);
+    if (!bytes) {
+        return SendStatus(req, "503 Service Unavailable");
+    }
+    size_t numBytes;
+    esp_err_t err;
+    switch (report->serialize(bytes, report->maxBytes, &numBytes)) {
+        case kHAPError_None: {
+            httpd_resp_set_type(req, report->contentType);
+            err = httpd_resp_send(req, bytes, (ssize_t) numBytes);
+        } break;
+        case kHAPError_InvalidState: {
+            err = SendStatus(req, "404 Not Found");
+        } break;
+        default: {
+            err = SendStatus(req, "500 Internal Server Error");
+        } break;
+    }
+    free(bytes);
+    return err;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Validate a characteristic write request and hand it to the run loop.
+ *
+ * Only the 'Target Door State' characteristic of the Garage Door Opener service can be written. Bodies in the usual
+ * shape skip the generic JSON parser (WriteRequest.h).
+ */
+HAP_RESULT_USE_CHECK
+static HAPError HandleCharacteristicWrites(const char* body, size_t numBytes, int64_t receivedAt) {
+    WriteRequest request;
+    if (!WriteRequestParseFast(body, numBytes, &request)) {
+        HAPError err = WriteRequestParse(body, &request);
+        if (err) {
+            return err;
+        }
+    }
+
+    const HAPUInt8Characteristic* characteristic = &garageDoorOpenerTargetDoorStateCharacteristic;
+    if (request.aid != AppGetAccessoryInfo()->aid || request.iid != characteristic->iid) {
+        return kHAPError_NotAuthorized;
+    }
+    if (request.value < characteristic->constraints.minimumValue ||
+        request.value > characteristic->constraints.maximumValue) {
+        return kHAPError_InvalidData;
+    }
+    AppScheduleTargetDoorState(
+            (HAPCharacteristicValue_TargetDoorState) request.value, kAppCommandSource_LocalControl, receivedAt);
+    return kHAPError_None;
+}
+
+static esp_err_t HandleCharacteristicsPut(httpd_req_t* req) {
+    int64_t receivedAt = esp_timer_get_time();
+
+    if (!IsAuthorized(req)) {
+        return SendStatus(req, "401 Unauthorized");
+    }
+    if (!req->content_len || req->content_len >= kLocalControl_MaxBodyBytes) {
+        return SendStatus(req, "400 Bad Request");
+    }
+
+    char body[kLocalControl_MaxBodyBytes];
+    size_t numBytes = 0;
+    while (numBytes < req->content_len) {
+        int n = httpd_req_recv(req, &body[numBytes], req->content_len - numBytes);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (n <= 0) {
+            return ESP_FAIL;
+        }
+        numBytes += (size_t) n;
+    }
+    body[numBytes] = '\0';
+
+    switch (HandleCharacteristicWrites(body, numBytes, receivedAt)) {
+        case kHAPError_None: {
+            return SendStatus(req, "204 No Content");
+        }
+        case kHAPError_NotAuthorized: {
+            return SendStatus(req, "403 Forbidden");
+        }
+        default: {
+            return SendStatus(req, "400 Bad Request");
+        }
+    }
+}
+
+static esp_err_t HandleStateGet(httpd_req_t* req) {
+    if (!IsAuthorized(req)) {
+        return SendStatus(req, "401 Unauthorized");
+    }
+
+    uint8_t currentDoorState;
+    uint8_t targetDoorState;
+    AppGetDoorState(&currentDoorState, &targetDoorState);
+
+    char json[64];
+    int n = snprintf(
+            json, sizeof json, "{\"currentDoorState\":%u,\"targetDoorState\":%u}", currentDoorState, targetDoorState);
+    return SendJSON(req, json, (size_t) n);
+}
+
+#if CONFIG_GARAGE_KVS_CACHE
+static esp_err_t HandleKeyValueStoreGet(httpd_req_t* req) {
+    if (!IsAuthorized(req)) {
+        return SendStatus(req, "401 Unauthorized");
+    }
+
+    KeyValueStoreCacheStats stats;
+    KeyValueStoreCacheGetStats(&stats);
+
+    char json[192];
+    int n = snprintf(
+            json,
+            sizeof json,
+            "{\"entries\":%u,\"maxEntries\":%u,\"hits\":%lu,\"negativeHits\":%lu,\"misses\":%lu,"
+            "\"uncacheable\":%lu,\"evictions\":%lu,\"flashReadUs\":%llu}",
+            (unsigned) stats.numEntries,
+            (unsigned) stats.maxEntries,
+            (unsigned long) stats.numHits,
+            (unsigned long) stats.numNegativeHits,
+            (unsigned long) stats.numMisses,
+            (unsigned long) stats.numUncacheable,
+            (unsigned long) stats.numEvictions,
+            (unsigned long long) stats.backendReadUs);
+    return SendJSON(req, json, (size_t) n);
+}
+#endif
+
+static esp_err_t HandleSnapshotGet(httpd_req_t* req) {
+    if (!IsAuthorized(req)) {
+        return SendStatus(req, "401 Unauthorized");
+    }
+
+    char* _Nullable report = PerfSnapshotTakeReport();
+    if (!report) {
+        return SendStatus(req, "404 Not Found");
+    }
+    esp_err_t err = SendJSON(req, report, strlen(report));
+    free(report);
+    return err;
+}
+
+#if CONFIG_GARAGE_TELEMETRY
+static HAPError SendTelemetryChunk(void* _Nullable context, const char* bytes, size_t numBytes) {
+    HAPPrecondition(context);
+    httpd_req_t* req = context;
+
+    return httpd_resp_send_chunk(req, bytes, (ssize_t) numBytes) == ESP_OK ? kHAPError_None : kHAPError_Unknown;
+}
+
+static esp_err_t HandleTelemetryGet(httpd_req_t* req) {
+    if (!IsAuthorized(req)) {
+        return SendStatus(req, "401 Unauthorized");
+    }
+
+    httpd_resp_set_type(req, "text/csv");
+    if (TelemetryExportCSV(SendTelemetryChunk, req)) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static HAPError SendJournalChunk(void* _Nullable context, const void* bytes, size_t numBytes) {
+    HAPPrecondition(context);
+    httpd_req_t* req = context;
+
+    return httpd_resp_send_chunk(req, bytes, (ssize_t) numBytes) == ESP_OK ? kHAPError_None : kHAPError_Unknown;
+}
+
+/**
+ * Stream the telemetry journal partition, optionally resuming from "?offset=<n>".
+ *
+ * The server task runs at a lower priority than the HAP run loop, so an export only uses otherwise idle CPU time.
+ */
+static esp_err_t HandleJournalGet(httpd_req_t* req) {
+    if (!IsAuthorized(req)) {
+        return SendStatus(req, "401 Unauthorized");
+    }
+
+    unsigned long offset = 0;
+    char query[32];
+    char value[16];
+    if (httpd_req_get_url_query_str(req, query, sizeof query) == ESP_OK &&
+        httpd_query_key_value(query, "offset", value, sizeof value) == ESP_OK) {
+        char* end;
+        offset = strtoul(value, &end, 10);
+        if (end == value || *end) {
+            return SendStatus(req, "400 Bad Request");
+        }
+    }
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    switch (TelemetryJournalExport((size_t) offset, SendJournalChunk, req)) {
+        case kHAPError_None: {
+            return httpd_resp_send_chunk(req, NULL, 0);
+        }
+        case kHAPError_InvalidState: {
+            return SendStatus(req, "404 Not Found");
+        }
+        case kHAPError_InvalidData: {
+            return SendStatus(req, "416 Range Not Satisfiable");
+        }
+        case kHAPError_OutOfResources: {
+            return SendStatus(req, "503 Service Unavailable");
+        }
+        default: {
+            return ESP_FAIL;
+        }
+    }
+}
+#endif
+
+#if CONFIG_GARAGE_SUPPLY_MONITOR
+static esp_err_t HandleSupplyGet(httpd_req_t* req) {
+    if (!IsAuthorized(req)) {
+        return SendStatus(req, "401 Unauthorized");
+    }
+
+    SupplyMonitorStats stats;
+    SupplyMonitorGetStats(&stats);
+
+    char json[128];
+    int n = snprintf(
+            json,
+            sizeof json,
+            "{\"level\":\"%s\",\"supplyMV\":%lu,\"minSupplyMV\":%lu,\"frames\":%lu,\"levelChanges\":%lu}",
+            SupplyLevelGetName(stats.level),
+            (unsigned long) stats.supplyMV,
+            (unsigned long) stats.minSupplyMV,
+            (unsigned long) stats.numFrames,
+            (unsigned long) stats.numLevelChanges);
+    return SendJSON(req, json, (size_t) n);
+}
+#endif
+
+#if CONFIG_GARAGE_BENCHMARK
+static esp_err_t HandleBenchPost(httpd_req_t* req) {
+    if (!IsAuthorized(req)) {
+        return SendStatus(req, "401 Unauthorized");
+    }
+
+    switch (BenchmarkStart()) {
+        case kHAPError_None: {
+            return SendStatus(req, "202 Accepted");
+        }
+        case kHAPError_InvalidState: {
+            return SendStatus(req, "409 Conflict");
+        }
+        default: {
+            return SendStatus(req, "503 Service Unavailable");
+        }
+    }
+}
+
+#endif
+
+#if CONFIG_GARAGE_RF_RECEIVER
+static void StartRfCalibration(void* _Nullable context HAP_UNUSED, size_t contextSize HAP_UNUSED) {
+    HAPError err = RfCalibrationStart();
+    if (err) {
+        HAPAssert(err == kHAPError_InvalidState);
+        HAPLogInfo(&kHAPLog_Default, "%s: Calibration already running.", __func__);
+    }
+}
+
+static esp_err_t HandleRfCalibratePost(httpd_req_t* req) {
+    if (!IsAuthorized(req)) {
+        return SendStatus(req, "401 Unauthorized");
+    }
+
+    if (HAPPlatformRunLoopScheduleCallback(StartRfCalibration, NULL, 0)) {
+        return SendStatus(req, "503 Service Unavailable");
+    }
+    return SendStatus(req, "202 Accepted");
+}
+
+static void StartRfLearning(void* _Nullable context HAP_UNUSED, size_t contextSize HAP_UNUSED) {
+    HAPError err = RfCodeBookStartLearning();
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLogError(&kHAPLog_Default, "%s: Code book full.", __func__);
+    }
+}
+
+static esp_err_t HandleRfLearnPost(httpd_req_t* req) {
+    if (!IsAuthorized(req)) {
+        return SendStatus(req, "401 Unauthorized");
+    }
+
+    if (HAPPlatformRunLoopScheduleCallback(StartRfLearning, NULL, 0)) {
+        return SendStatus(req, "503 Service Unavailable");
+    }
+    return SendStatus(req, "202 Accepted");
+}
+
+static void ClearRfCodes(void* _Nullable context HAP_UNUSED, size_t contextSize HAP_UNUSED) {
+    RfCodeBookClear();
+}
+
+static esp_err_t HandleRfCodesDelete(httpd_req_t* req) {
+    if (!IsAuthorized(req)) {
+        return SendStatus(req, "401 Unauthorized");
+    }
+
+    if (HAPPlatformRunLoopScheduleCallback(ClearRfCodes, NULL, 0)) {
+        return SendStatus(req, "503 Service Unavailable");
+    }
+    return SendStatus(req, "202 Accepted");
+}
+
+static esp_err_t HandleRfGet(httpd_req_t* req) {
+    if (!IsAuthorized(req)) {
+        return SendStatus(req, "401 Unauthorized");
+    }
+
+    RfReceiverStats stats;
+    RfReceiverGetStats(&stats);
+
+    char json[384];
+    int n = snprintf(
+            json,
+            sizeof json,
+            "{\"receiver\":{\"captures\":%lu,\"codes\":%lu,\"busyUs\":%llu,\"cpuPermille\":%llu},\"calibration\":",
+            (unsigned long) stats.numCaptures,
+            (unsigned long) stats.numCodes,
+            (unsigned long long) stats.busyUs,
+            (unsigned long long) (stats.uptimeUs ? stats.busyUs * 1000 / stats.uptimeUs : 0));
+    size_t numBytes;
+    if (n < 0 || RfCalibrationSerialize(&json[n], sizeof json - (size_t) n, &numBytes)) {
+        return SendStatus(req, "500 Internal Server Error");
+    }
+    size_t offset = (size_t) n + numBytes;
+    n = snprintf(&json[offset], sizeof json - offset, ",\"codes\":");
+    offset += (size_t) n;
+    if (RfCodeBookSerialize(&json[offset], sizeof json - offset - 1, &numBytes)) {
+        return SendStatus(req, "500 Internal Server Error");
+    }
+    offset += numBytes;
+    json[offset++] = '}';
+    return SendJSON(req, json, offset);
+}
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static esp_err_t HandleEventsWebSocket(httpd_req_t* req) {
+    if (req->method == HTTP_GET) {
+        // Handshake. Returning an error closes the connection.
+        if (!IsAuthorized(req)) {
+            if (!IsLogMuted()) {
+                HAPLogInfo(&kHAPLog_Default, "%s: Rejecting unauthorized client.", __func__);
+            }
+            return ESP_FAIL;
+        }
+        int sockfd = httpd_req_to_sockfd(req);
+        for (size_t i = 0; i < kLocalControl_MaxEventClients; i++) {
+            if (eventClients[i] == -1) {
+                eventClients[i] = sockfd;
+                return ESP_OK;
+            }
+        }
+        HAPLogError(&kHAPLog_Default, "%s: Too many event clients.", __func__);
+        return ESP_FAIL;
+    }
+
+    // Clients are not expected to send anything, drain and discard.
+    uint8_t payload[16];
+    httpd_ws_frame_t frame = { .type = HTTPD_WS_TYPE_TEXT, .payload = payload };
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK || frame.len > sizeof payload) {
+        return ESP_FAIL;
+    }
+    return httpd_ws_recv_frame(req, &frame, sizeof payload);
+}
+
+static void HandleSessionClose(httpd_handle_t handle HAP_UNUSED, int sockfd) {
+    for (size_t i = 0; i < kLocalControl_MaxEventClients; i++) {
+        if (eventClients[i] == sockfd) {
+            eventClients[i] = -1;
+        }
+    }
+    close(sockfd);
+}
+
+/**
+ * Door state event queued to the HTTP server task.
+ */
+typedef struct {
+    size_t numBytes;
+    char bytes[64];
+} DoorStateEvent;
+
+static void SendDoorStateEvent(void* arg) {
+    DoorStateEvent* event = arg;
+    httpd_ws_frame_t frame = {
+        .final = true,
+        .fragmented = false,
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t*) event->bytes,
+        .len = event->numBytes,
+    };
+    for (size_t i = 0; i < kLocalControl_MaxEventClients; i++) {
+        if (eventClients[i] != -1) {
+            (void) httpd_ws_send_frame_async(server, eventClients[i], &frame);
+        }
+    }
+    free(event);
+}
+
+void LocalControlHandleDoorStateChanged(uint8_t currentDoorState, uint8_t targetDoorState) {
+    if (!server) {
+        return;
+    }
+
+    DoorStateEvent* event = malloc(sizeof *event);
+    if (!event) {
+        HAPLogError(&kHAPLog_Default, "%s: Out of memory.", __func__);
+        return;
+    }
+    event->numBytes = (size_t) snprintf(
+            event->bytes,
+            sizeof event->bytes,
+            "{\"currentDoorState\":%u,\"targetDoorState\":%u}",
+            currentDoorState,
+            targetDoorState);
+    if (httpd_queue_work(server, SendDoorStateEvent, event) != ESP_OK) {
+        free(event);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Reports served by HandleReportGet.
+ */
+static const Report reports[] = {
+    { "/metrics", "application/hap+json", MetricsSerialize, kMetrics_MaxSerializedBytes },
+    { "/slo", "application/hap+json", CommandSloSerialize, kCommandSlo_MaxSerializedBytes },
+    { "/sessions", "application/hap+json", SessionTrackerSerialize, kSessionTracker_MaxSerializedBytes },
+#if CONFIG_GARAGE_OVERLOAD_CONTROL
+    { "/overload", "application/hap+json", OverloadSerialize, kOverload_MaxSerializedBytes },
+#endif
+#if CONFIG_GARAGE_TELEMETRY
+    { "/cpu", "application/hap+json", CpuUsageSerialize, kLocalControl_MaxCpuUsageBytes },
+#endif
+#if CONFIG_GARAGE_LOCK_PROFILER
+    { "/locks", "application/hap+json", LockProfilerWrappersSerialize, kLocalControl_MaxLockReportBytes },
+#endif
+#if CONFIG_GARAGE_HOTPATH_PROFILER
+    { "/hotpaths", "application/hap+json", HotPathProfilerSerialize, kLocalControl_MaxHotPathReportBytes },
+#endif
+#if CONFIG_GARAGE_BENCHMARK
+    { "/bench", "text/plain", BenchmarkCopyReport, kBenchmark_MaxReportBytes },
+#endif
+};
+
+void LocalControlStart(void) {
+    HAPPrecondition(!server);
+
+    if (sizeof kAuthorization == sizeof "Bearer ") {
+        HAPLogError(&kHAPLog_Default, "%s: No pre-shared key configured. Local control disabled.", __func__);
+        return;
+    }
+
+    static const httpd_uri_t uris[] = {
+        { .uri = "/characteristics", .method = HTTP_PUT, .handler = HandleCharacteristicsPut },
+        { .uri = "/state", .method = HTTP_GET, .handler = HandleStateGet },
+        { .uri = "/snapshot", .method = HTTP_GET, .handler = HandleSnapshotGet },
+#if CONFIG_GARAGE_KVS_CACHE
+        { .uri = "/kvs", .method = HTTP_GET, .handler = HandleKeyValueStoreGet },
+#endif
+#if CONFIG_GARAGE_TELEMETRY
+        { .uri = "/telemetry", .method = HTTP_GET, .handler = HandleTelemetryGet },
+        { .uri = "/journal", .method = HTTP_GET, .handler = HandleJournalGet },
+#endif
+#if CONFIG_GARAGE_SUPPLY_MONITOR
+        { .uri = "/supply", .method = HTTP_GET, .handler = HandleSupplyGet },
+#endif
+#if CONFIG_GARAGE_BENCHMARK
+        { .uri = "/bench", .method = HTTP_POST, .handler = HandleBenchPost },
+#endif
+#if CONFIG_GARAGE_RF_RECEIVER
+        { .uri = "/rf", .method = HTTP_GET, .handler = HandleRfGet },
+        { .uri = "/rf/calibrate", .method = HTTP_POST, .handler = HandleRfCalibratePost },
+        { .uri = "/rf/learn", .method = HTTP_POST, .handler = HandleRfLearnPost },
+        { .uri = "/rf/codes", .method = HTTP_DELETE, .handler = HandleRfCodesDelete },
+#endif
+        { .uri = "/events", .method = HTTP_GET, .handler = HandleEventsWebSocket, .is_websocket = true },
+    };
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = CONFIG_GARAGE_LOCAL_CONTROL_PORT;
+    config.ctrl_port = config.ctrl_port + 1;
+    config.max_open_sockets = 2;
+    config.lru_purge_enable = true;
+    config.close_fn = HandleSessionClose;
+    config.max_uri_handlers = HAPArrayCount(uris) + HAPArrayCount(reports);
+    // Below the HAP run loop task, so long-running responses like journal exports never delay HomeKit requests.
+    config.task_priority = tskIDLE_PRIORITY + 5;
+
+    esp_err_t err = httpd_start(&server, &config);
+    if (err != ESP_OK) {
+        HAPLogError(&kHAPLog_Default, "%s: Failed to start server: %d.", __func__, err);
+        server = NULL;
+        return;
+    }
+
+    for (size_t i = 0; i < HAPArrayCount(uris); i++) {
+        ESP_ERROR_CHECK(httpd_register_uri_handler(server, &uris[i]));
+    }
+    for (size_t i = 0; i < HAPArrayCount(reports); i++) {
+        const httpd_uri_t uri = {
+            .uri = reports[i].uri,
+            .method = HTTP_GET,
+            .handler = HandleReportGet,
+            .user_ctx = (void*) &reports[i],
+        };
+        ESP_ERROR_CHECK(httpd_register_uri_handler(server, &uri));
+    }
+    HAPLogInfo(&kHAPLog_Default, "Local control listening on port %u.", config.server_port);
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Local control API.
+//
+// A small HTTP server on a separate port that lets hosts on the local network operate the door without going
+// through a HomeKit hub. Every request must carry the pre-shared key configured in the project configuration as
+// a bearer token ("Authorization: Bearer <key>").
+//
+//   PUT /characteristics  Body uses the HAP characteristic write format, e.g.
+//                         {"characteristics":[{"aid":1,"iid":52,"value":0}]}. Answers 204 once the command has
+//                         been handed to the run loop.
+//   GET /state            Current and target door state.
+//   GET /metrics          Command latency histograms of the HAP and local control paths, in microseconds.
+//                         tools/local_control_latency.py drives both paths and compares them.
+//   GET /slo              Door command objective compliance and the stages of the most recent commands
+//                         (CommandSlo.h).
+//   GET /sessions         HAP session slots, warm window and the age and idle time of every open session
+//                         (SessionTracker.h).
+//   GET /snapshot         Crash snapshot of the previous boot (PerfSnapshot.h). Handed out once, 404 afterwards.
+//   GET /overload         Degraded mode, the most recent probe and mode transitions (Overload.h). Only with
+//                         GARAGE_OVERLOAD_CONTROL.
+//   GET /kvs              Key-value store cache hit and miss counters and time spent reading flash
+//                         (KeyValueStoreCache.h).
+//   GET /telemetry        Telemetry history as CSV (Telemetry.h), oldest sample first.
+//   GET /journal          Raw telemetry journal partition in CRC-checked frames (TelemetryJournal.h). Resumable
+//                         with "?offset=<n>".
+//   GET /cpu              CPU utilization of every task over the last telemetry interval and a rolling average
+//                         (CpuUsage.h), in permille of one core.
+//   GET /supply           Supply voltage and level (SupplyMonitor.h). Only with GARAGE_SUPPLY_MONITOR.
+//   GET /locks            Wait and hold times of the most contended mutexes and the tasks that held them
+//                         (LockProfilerWrappers.h). Only with GARAGE_LOCK_PROFILER.
+//   GET /hotpaths         Functions with the most instruction fetch stalls, input for tools/hotpath_lf.py
+//                         (HotPathProfiler.h). Only with GARAGE_HOTPATH_PROFILER.
+//   POST /bench           Starts the microbenchmark suite (Benchmark.h). Answers 202, 409 while it is running or
+//                         503 while overloaded.
+//   GET /bench            BENCH lines of the current or most recent run as text. Only with GARAGE_BENCHMARK.
+//   GET /rf               RF receiver load, calibration and activation confirmation statistics (RfCalibration.h)
+//                         and learned door codes (RfCodeBook.h).
+//   POST /rf/calibrate    Starts a press length calibration. Operates the door several times. Answers 202.
+//   POST /rf/learn        Adds the next foreign code heard within 30 seconds to the door codes. Answers 202.
+//   DELETE /rf/codes      Forgets all learned door codes. Answers 202.
+//   GET /events           WebSocket. Pushes the door state on every change.
+
+#ifndef LOCAL_CONTROL_H
+#define LOCAL_CONTROL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Start the local control server.
+ */
+void LocalControlStart(void);
+
+/**
+ * Push the door state to all connected WebSocket clients. Must be called on the run loop.
+ */
+void LocalControlHandleDoorStateChanged(uint8_t currentDoorState, uint8_t targetDoorState);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,196 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "LockProfiler.h"
+
+#include "ReportFormat.h"
+
+static LockProfile* _Nullable FindLock(LockProfiler* profiler, const void* lock) {
+    for (size_t i = 0; i < profiler->numLocks; i++) {
+        if (profiler->locks[i].lock == lock) {
+            return &profiler->locks[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Adds wait time to the holder that caused it. Once the table is full, the holder with the least wait time is replaced.
+ */
+static void BlameHolder(LockProfile* profile, const void* task, uint32_t waitUs) {
+    LockProfilerBlocker* leastBlocker = &profile->blockers[0];
+    for (size_t i = 0; i < kLockProfiler_MaxBlockers; i++) {
+        LockProfilerBlocker* blocker = &profile->blockers[i];
+        if (blocker->task == task) {
+            blocker->waitUs += waitUs;
+            return;
+        }
+        if (blocker->waitUs < leastBlocker->waitUs) {
+            leastBlocker = blocker;
+        }
+    }
+    leastBlocker->task = task;
+    leastBlocker->waitUs = waitUs;
+}
+
+void LockProfilerHandleAcquired(
+        LockProfiler* profiler,
+        const void* lock,
+        uintptr_t site,
+        const void* task,
+        const void* _Nullable blocker,
+        uint32_t waitUs,
+        uint32_t nowUs) {
+    HAPPrecondition(profiler);
+    HAPPrecondition(lock);
+    HAPPrecondition(task);
+
+    LockProfile* _Nullable profile = FindLock(profiler, lock);
+    if (!profile) {
+        if (profiler->numLocks == kLockProfiler_MaxLocks) {
+            profiler->numDropped++;
+            return;
+        }
+        profile = &profiler->locks[profiler->numLocks++];
+        HAPRawBufferZero(profile, sizeof *profile);
+        profile->lock = lock;
+        profile->site = site;
+        profile->firstTask = task;
+    }
+
+    profile->numAcquisitions++;
+    if (blocker) {
+        profile->numContended++;
+        MetricsHistogramAdd(&profile->wait, waitUs);
+        BlameHolder(profile, HAPNonnull(blocker), waitUs);
+    }
+    profile->isHeld = true;
+    profile->acquiredAt = nowUs;
+}
+
+void LockProfilerHandleReleased(LockProfiler* profiler, const void* lock, uint32_t nowUs) {
+    HAPPrecondition(profiler);
+    HAPPrecondition(lock);
+
+    // Locks that were already held when profiling started are only tracked from their next acquisition.
+    LockProfile* _Nullable profile = FindLock(profiler, lock);
+    if (!profile || !profile->isHeld) {
+        return;
+    }
+    MetricsHistogramAdd(&profile->hold, nowUs - profile->acquiredAt);
+    profile->isHeld = false;
+}
+
+HAP_RESULT_USE_CHECK
+static const char* GetTaskName(
+        const void* _Nullable task,
+        LockProfilerGetTaskNameCallback getTaskName,
+        void* _Nullable context) {
+    const char* _Nullable name = task ? getTaskName(context, HAPNonnull(task)) : NULL;
+    return name ? HAPNonnull(name) : "(deleted)";
+}
+
+HAP_RESULT_USE_CHECK
+static HAPError SerializeLock(
+        const LockProfile* profile,
+        LockProfilerGetTaskNameCallback getTaskName,
+        void* _Nullable context,
+        char* bytes,
+        size_t maxBytes,
+        size_t* offset) {
+    HAPError err = ReportFormatAppend(
+            bytes,
+            maxBytes,
+            offset,
+            "{\"lock\":\"%p\",\"site\":\"0x%08lx\",\"firstTask\":\"%s\",\"acquisitions\":%lu,\"contended\":%lu,"
+            "\"waitTotalUs\":%llu,\"waitP50\":%lu,\"waitP99\":%lu,\"waitMax\":%lu,"
+            "\"holdP50\":%lu,\"holdP99\":%lu,\"holdMax\":%lu,\"blockers\":[",
+            profile->lock,
+            (unsigned long) profile->site,
+            GetTaskName(profile->firstTask, getTaskName, context),
+            (unsigned long) profile->numAcquisitions,
+            (unsigned long) profile->numContended,
+            (unsigned long long) profile->wait.sumUs,
+            (unsigned long) MetricsHistogramGetPercentile(&profile->wait, 50),
+            (unsigned long) MetricsHistogramGetPercentile(&profile->wait, 99),
+            (unsigned long) profile->wait.maxUs,
+            (unsigned long) MetricsHistogramGetPercentile(&profile->hold, 50),
+            (unsigned long) MetricsHistogramGetPercentile(&profile->hold, 99),
+            (unsigned long) profile->hold.maxUs);
+    bool isFirst = true;
+    for (size_t i = 0; !err && i < kLockProfiler_MaxBlockers; i++) {
+        const LockProfilerBlocker* blocker = &profile->blockers[i];
+        if (!blocker->waitUs) {
+            continue;
+        }
+        err = ReportFormatAppend(
+                bytes,
+                maxBytes,
+                offset,
+                "%s{\"task\":\"%s\",\"waitUs\":%llu}",
+                isFirst ? "" : ",",
+                GetTaskName(blocker->task, getTaskName, context),
+                (unsigned long long) blocker->waitUs);
+        isFirst = false;
+    }
+    if (!err) {
+        err = ReportFormatAppend(bytes, maxBytes, offset, "]}");
+    }
+    return err;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError LockProfilerSerialize(
+        const LockProfiler* profiler,
+        size_t maxLocks,
+        LockProfilerGetTaskNameCallback getTaskName,
+        void* _Nullable context,
+        char* bytes,
+        size_t maxBytes,
+        size_t* numBytes) {
+    HAPPrecondition(profiler);
+    HAPPrecondition(getTaskName);
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    size_t offset = 0;
+    HAPError err = ReportFormatAppend(
+            bytes,
+            maxBytes,
+            &offset,
+            "{\"tracked\":%lu,\"dropped\":%lu,\"locks\":[",
+            (unsigned long) profiler->numLocks,
+            (unsigned long) profiler->numDropped);
+
+    // Selection by total wait time. The table is small enough that repeated scans are cheaper than sorting a copy.
+    bool isReported[kLockProfiler_MaxLocks] = { false };
+    for (size_t n = 0; !err && n < maxLocks && n < profiler->numLocks; n++) {
+        const LockProfile* _Nullable worst = NULL;
+        size_t worstIndex = 0;
+        for (size_t i = 0; i < profiler->numLocks; i++) {
+            const LockProfile* profile = &profiler->locks[i];
+            if (!isReported[i] && (!worst || profile->wait.sumUs > HAPNonnull(worst)->wait.sumUs)) {
+                worst = profile;
+                worstIndex = i;
+            }
+        }
+        isReported[worstIndex] = true;
+        if (n) {
+            err = ReportFormatAppend(bytes, maxBytes, &offset, ",");
+        }
+        if (!err) {
+            err = SerializeLock(HAPNonnull(worst), getTaskName, context, bytes, maxBytes, &offset);
+        }
+    }
+    if (!err) {
+        err = ReportFormatAppend(bytes, maxBytes, &offset, "]}");
+    }
+    if (err) {
+        return err;
+    }
+    *numBytes = offset;
+    return kHAPError_None;
+}
@@ -0,0 +1,161 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Mutex contention statistics.
+//
+// Aggregates acquisitions and releases reported by instrumented lock wrappers: how long tasks waited for each lock,
+// how long it was held, and which holders made others wait. The aggregation is platform-independent and does not
+// synchronize. LockProfilerWrappers.h hooks it into the FreeRTOS mutexes on the device.
+//
+// Locks are identified by their handle and the call site of their first acquisition, which can be resolved with
+// addr2line. Tasks are identified by their handle, which is only resolved to a name when serializing, as the task may
+// have been deleted by then.
+
+#ifndef LOCK_PROFILER_H
+#define LOCK_PROFILER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#include "Metrics.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Maximum number of locks that are tracked. Further locks are counted as dropped.
+ */
+#define kLockProfiler_MaxLocks ((size_t) 16)
+
+/**
+ * Number of holders per lock that are blamed for waits.
+ */
+#define kLockProfiler_MaxBlockers ((size_t) 3)
+
+/**
+ * Maximum length of a task name, including the NULL terminator.
+ */
+#define kLockProfiler_MaxTaskNameBytes ((size_t) 16)
+
+/**
+ * Holder that made other tasks wait.
+ */
+typedef struct {
+    const void* _Nullable task;
+    uint64_t waitUs;
+} LockProfilerBlocker;
+
+/**
+ * Statistics of one lock.
+ */
+typedef struct {
+    const void* _Nullable lock;
+    uintptr_t site;
+    const void* _Nullable firstTask;
+
+    uint32_t numAcquisitions;
+    uint32_t numContended;
+
+    /** Wait time of contended acquisitions. */
+    MetricsHistogram wait;
+
+    /** Hold time of all acquisitions. */
+    MetricsHistogram hold;
+
+    LockProfilerBlocker blockers[kLockProfiler_MaxBlockers];
+
+    /** Current holder. */
+    bool isHeld;
+    uint32_t acquiredAt;
+} LockProfile;
+
+/**
+ * Profiler state.
+ */
+typedef struct {
+    LockProfile locks[kLockProfiler_MaxLocks];
+    size_t numLocks;
+    uint32_t numDropped;
+} LockProfiler;
+
+/**
+ * Records an acquisition.
+ *
+ * @param      profiler             Profiler.
+ * @param      lock                 Lock handle.
+ * @param      site                 Return address of the acquisition.
+ * @param      task                 Handle of the acquiring task.
+ * @param      blocker              Handle of the task that held the lock when the acquisition started, NULL if the
+ *                                  lock was free.
+ * @param      waitUs               Time spent waiting for the lock.
+ * @param      nowUs                Current time in microseconds. May wrap around.
+ */
+void LockProfilerHandleAcquired(
+        LockProfiler* profiler,
+        const void* lock,
+        uintptr_t site,
+        const void* task,
+        const void* _Nullable blocker,
+        uint32_t waitUs,
+        uint32_t nowUs);
+
+/**
+ * Records a release.
+ *
+ * @param      profiler             Profiler.
+ * @param      lock                 Lock handle.
+ * @param      nowUs                Current time in microseconds. May wrap around.
+ */
+void LockProfilerHandleReleased(LockProfiler* profiler, const void* lock, uint32_t nowUs);
+
+/**
+ * Resolves a task handle to its name.
+ *
+ * @param      context              Context.
+ * @param      task                 Task handle.
+ *
+ * @return Name of the task, or NULL if it no longer exists.
+ */
+typedef const char* _Nullable (*LockProfilerGetTaskNameCallback)(void* _Nullable context, const void* task);
+
+/**
+ * Serializes the locks with the highest total wait time as a JSON object. Tasks that no longer exist are reported as
+ * "(deleted)".
+ *
+ * @param      profiler             Profiler.
+ * @param      maxLocks             Maximum number of locks to include.
+ * @param      getTaskName          Resolves task handles to names.
+ * @param      context              Context passed to getTaskName.
+ * @param[out] bytes                Buffer.
+ * @param      maxBytes             Capacity of buffer.
+ * @param[out] numBytes             Length of the JSON object, excluding the NULL terminator.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the buffer is too small.
+ */
+HAP_RESULT_USE_CHECK
+HAPError LockProfilerSerialize(
+        const LockProfiler* profiler,
+        size_t maxLocks,
+        LockProfilerGetTaskNameCallback getTaskName,
+        void* _Nullable context,
+        char* bytes,
+        size_t maxBytes,
+        size_t* numBytes);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,212 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "LockProfilerWrappers.h"
+
+#include "LockProfiler.h"
+#include "Placement.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#if !CONFIG_FREERTOS_USE_TRACE_FACILITY
+#error "The lock profiler requires FREERTOS_USE_TRACE_FACILITY to tell mutexes from semaphores."
+#endif
+
+// Queue types from queue.h that are only visible inside FreeRTOS.
+#define kQueueType_Mutex          ((uint8_t) 1)
+#define kQueueType_RecursiveMutex ((uint8_t) 4)
+
+BaseType_t __real_xQueueSemaphoreTake(QueueHandle_t queue, TickType_t ticksToWait);
+BaseType_t __real_xQueueTakeMutexRecursive(QueueHandle_t mutex, TickType_t ticksToWait);
+BaseType_t __real_xQueueGenericSend(
+        QueueHandle_t queue,
+        const void* const _Nullable item,
+        TickType_t ticksToWait,
+        const BaseType_t copyPosition);
+BaseType_t __real_xQueueGiveMutexRecursive(QueueHandle_t mutex);
+
+/**
+ * Protects the profiler. A spinlock, because a mutex would profile itself.
+ */
+static portMUX_TYPE profilerLock = portMUX_INITIALIZER_UNLOCKED;
+static LockProfiler profiler;
+
+static bool IsProfiled(QueueHandle_t queue) {
+    if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) {
+        return false;
+    }
+    uint8_t type = ucQueueGetQueueType(queue);
+    return type == kQueueType_Mutex || type == kQueueType_RecursiveMutex;
+}
+
+static BaseType_t ProfileTake(
+        QueueHandle_t mutex,
+        TickType_t ticksToWait,
+        uintptr_t site,
+        BaseType_t (*take)(QueueHandle_t mutex, TickType_t ticksToWait)) {
+    // The holder may be deleted while the caller waits, so only its handle is recorded.
+    TaskHandle_t blocker = xQueueGetMutexHolder(mutex);
+    int64_t startedAt = esp_timer_get_time();
+    BaseType_t result = take(mutex, ticksToWait);
+    if (result != pdTRUE) {
+        return result;
+    }
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&profilerLock);
+    LockProfilerHandleAcquired(
+            &profiler,
+            mutex,
+            site,
+            xTaskGetCurrentTaskHandle(),
+            blocker,
+            (uint32_t)(now - startedAt),
+            (uint32_t) now);
+    portEXIT_CRITICAL(&profilerLock);
+    return result;
+}
+
+static void ProfileRelease(QueueHandle_t mutex) {
+    uint32_t now = (uint32_t) esp_timer_get_time();
+    portENTER_CRITICAL(&profilerLock);
+    LockProfilerHandleReleased(&profiler, mutex, now);
+    portEXIT_CRITICAL(&profilerLock);
+}
+
+BaseType_t __wrap_xQueueSemaphoreTake(QueueHandle_t queue, TickType_t ticksToWait);
+BaseType_t __wrap_xQueueSemaphoreTake(QueueHandle_t queue, TickType_t ticksToWait) {
+    if (!IsProfiled(queue)) {
+        return __real_xQueueSemaphoreTake(queue, ticksToWait);
+    }
+    return ProfileTake(
+            queue, ticksToWait, (uintptr_t) __builtin_return_address(0), __real_xQueueSemaphoreTake);
+}
+
+BaseType_t __wrap_xQueueTakeMutexRecursive(QueueHandle_t mutex, TickType_t ticksToWait);
+BaseType_t __wrap_xQueueTakeMutexRecursive(QueueHandle_t mutex, TickType_t ticksToWait) {
+    // Nested acquisitions neither wait nor start a new hold.
+    if (!IsProfiled(mutex) || xQueueGetMutexHolder(mutex) == xTaskGetCurrentTaskHandle()) {
+        return __real_xQueueTakeMutexRecursive(mutex, ticksToWait);
+    }
+    return ProfileTake(
+            mutex, ticksToWait, (uintptr_t) __builtin_return_address(0), __real_xQueueTakeMutexRecursive);
+}
+
+BaseType_t __wrap_xQueueGenericSend(
+        QueueHandle_t queue,
+        const void* const _Nullable item,
+        TickType_t ticksToWait,
+        const BaseType_t copyPosition);
+BaseType_t __wrap_xQueueGenericSend(
+        QueueHandle_t queue,
+        const void* const _Nullable item,
+        TickType_t ticksToWait,
+        const BaseType_t copyPosition) {
+    // xSemaphoreGive. Giving a recursive mutex calls the unwrapped function from within queue.c.
+    BaseType_t result = __real_xQueueGenericSend(queue, item, ticksToWait, copyPosition);
+    if (result == pdPASS && IsProfiled(queue)) {
+        ProfileRelease(queue);
+    }
+    return result;
+}
+
+BaseType_t __wrap_xQueueGiveMutexRecursive(QueueHandle_t mutex);
+BaseType_t __wrap_xQueueGiveMutexRecursive(QueueHandle_t mutex) {
+    BaseType_t result = __real_xQueueGiveMutexRecursive(mutex);
+    // Only the outermost give releases the mutex.
+    if (result == pdPASS && IsProfiled(mutex) && xQueueGetMutexHolder(mutex) != xTaskGetCurrentTaskHandle()) {
+        ProfileRelease(mutex);
+    }
+    return result;
+}
+
+/**
+ * Name of a task that existed when the report was serialized.
+ */
+typedef struct {
+    TaskHandle_t task;
+    char name[kLockProfiler_MaxTaskNameBytes];
+} TaskName;
+
+typedef struct {
+    const TaskName* names;
+    size_t numNames;
+} TaskNames;
+
+static const char* _Nullable GetTaskName(void* _Nullable context, const void* task) {
+    const TaskNames* taskNames = context;
+    for (size_t i = 0; i < taskNames->numNames; i++) {
+        if (taskNames->names[i].task == task) {
+            return taskNames->names[i].name;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Copies the names of all existing tasks. Released with free().
+ */
+static TaskName* _Nullable CopyTaskNames(size_t* numNames) {
+    // Room for tasks created while the statuses are taken.
+    UBaseType_t maxTasks = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t* statuses = PlacementAllocateBulk(maxTasks * sizeof *statuses);
+    TaskName* names = PlacementAllocateBulk(maxTasks * sizeof *names);
+    if (!statuses || !names) {
+        free(statuses);
+        free(names);
+        return NULL;
+    }
+    UBaseType_t numStatuses = uxTaskGetSystemState(statuses, maxTasks, NULL);
+    for (UBaseType_t i = 0; i < numStatuses; i++) {
+        names[i].task = statuses[i].xHandle;
+        strlcpy(names[i].name, statuses[i].pcTaskName, sizeof names[i].name);
+    }
+    free(statuses);
+    *numNames = numStatuses;
+    return names;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError LockProfilerWrappersSerialize(char* bytes, size_t maxBytes, size_t* numBytes) {
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    // Formatting takes too long to keep interrupts disabled, so a snapshot is taken first.
+    LockProfiler* snapshot = PlacementAllocateBulk(sizeof *snapshot);
+    if (!snapshot) {
+        return kHAPError_OutOfResources;
+    }
+    portENTER_CRITICAL(&profilerLock);
+    HAPRawBufferCopyBytes(snapshot, &profiler, sizeof profiler);
+    portEXIT_CRITICAL(&profilerLock);
+
+    // Task handles are only resolved now, against the tasks that still exist.
+    TaskNames taskNames;
+    size_t numNames;
+    TaskName* _Nullable names = CopyTaskNames(&numNames);
+    if (!names) {
+        free(snapshot);
+        return kHAPError_OutOfResources;
+    }
+    taskNames.names = names;
+    taskNames.numNames = numNames;
+
+    HAPError err = LockProfilerSerialize(
+            snapshot,
+            kLockProfilerWrappers_MaxReportedLocks,
+            GetTaskName,
+            &taskNames,
+            bytes,
+            maxBytes,
+            numBytes);
+    free(names);
+    free(snapshot);
+    return err;
+}
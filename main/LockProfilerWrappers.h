@@ -0,0 +1,57 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// FreeRTOS mutex instrumentation.
+//
+// The mutex functions are wrapped at link time (-Wl,--wrap, see CMakeLists.txt), so every mutex in the firmware is
+// profiled, including the ones inside NVS, lwIP (LWIP_TCPIP_CORE_LOCKING), newlib's stdio and esp_log that the
+// application cannot reach. Binary and counting semaphores are passed through untouched.
+//
+// Locks taken through newlib's _lock_acquire (NVS, stdio) share their call site in locks.c and are told apart by their
+// handle and the first task that took them.
+//
+// Profiling starts once the scheduler is running. Only built with GARAGE_LOCK_PROFILER.
+
+#ifndef LOCK_PROFILER_WRAPPERS_H
+#define LOCK_PROFILER_WRAPPERS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Number of locks in the report.
+ */
+#define kLockProfilerWrappers_MaxReportedLocks ((size_t) 8)
+
+/**
+ * Serializes the most contended locks as a JSON object (LockProfilerSerialize). May be called from any task.
+ *
+ * @param[out] bytes                Buffer.
+ * @param      maxBytes             Capacity of buffer.
+ * @param[out] numBytes             Length of the JSON object, excluding the NULL terminator.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the buffer is too small or out of memory.
+ */
+HAP_RESULT_USE_CHECK
+HAPError LockProfilerWrappersSerialize(char* bytes, size_t maxBytes, size_t* numBytes);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
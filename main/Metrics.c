@@ -0,0 +1,130 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "Metrics.h"
+
+#include <stdio.h>
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+
+static const char* const metricNames[kMetric_Count] = {
+    [kMetric_CommandLatencyHAP] = "commandLatencyHAP",
+    [kMetric_CommandLatencyLocalControl] = "commandLatencyLocalControl",
+    [kMetric_CommandLatencyMQTT] = "commandLatencyMQTT",
+    [kMetric_CommandLatencyCold] = "commandLatencyCold",
+    [kMetric_CommandLatencyWarm] = "commandLatencyWarm",
+    [kMetric_CommandLatencyIdle] = "commandLatencyIdle",
+    [kMetric_RfConfirmationLatency] = "rfConfirmationLatency",
+    [kMetric_DoorActivityLatency] = "doorActivityLatency",
+    [kMetric_FlashWriteStall] = "flashWriteStall",
+    [kMetric_TimeToReachableStation] = "timeToReachableStation",
+    [kMetric_TimeToReachableSoftAP] = "timeToReachableSoftAP",
+    [kMetric_CommandLatencyStation] = "commandLatencyStation",
+    [kMetric_CommandLatencySoftAP] = "commandLatencySoftAP",
+    [kMetric_CommandCompletion] = "commandCompletion",
+};
+
+static RTC_NOINIT_ATTR MetricsHistogram histograms[kMetric_Count];
+
+static portMUX_TYPE histogramsLock = portMUX_INITIALIZER_UNLOCKED;
+
+void MetricsClear(void) {
+    portENTER_CRITICAL_SAFE(&histogramsLock);
+    HAPRawBufferZero(histograms, sizeof histograms);
+    portEXIT_CRITICAL_SAFE(&histogramsLock);
+}
+
+void MetricsHistogramAdd(MetricsHistogram* histogram, uint32_t us) {
+    HAPPrecondition(histogram);
+
+    size_t bucket = (size_t)(31 - __builtin_clz(us | 1));
+    if (bucket >= kMetricsHistogramNumBuckets) {
+        bucket = kMetricsHistogramNumBuckets - 1;
+    }
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sumUs += us;
+    if (us > histogram->maxUs) {
+        histogram->maxUs = us;
+    }
+}
+
+void MetricsRecord(Metric metric, uint32_t us) {
+    HAPPrecondition(metric < kMetric_Count);
+
+    portENTER_CRITICAL_SAFE(&histogramsLock);
+    MetricsHistogramAdd(&histograms[metric], us);
+    portEXIT_CRITICAL_SAFE(&histogramsLock);
+}
+
+void MetricsGetHistogram(Metric metric, MetricsHistogram* histogram) {
+    HAPPrecondition(metric < kMetric_Count);
+    HAPPrecondition(histogram);
+
+    portENTER_CRITICAL_SAFE(&histogramsLock);
+    *histogram = histograms[metric];
+    portEXIT_CRITICAL_SAFE(&histogramsLock);
+}
+
+uint32_t MetricsHistogramGetPercentile(const MetricsHistogram* histogram, unsigned int percentile) {
+    HAPPrecondition(histogram);
+    HAPPrecondition(percentile <= 100);
+
+    if (!histogram->count) {
+        return 0;
+    }
+    uint64_t rank = ((uint64_t) histogram->count * percentile + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kMetricsHistogramNumBuckets; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            uint32_t upperBound = (uint32_t)((2ULL << i) - 1);
+            return upperBound < histogram->maxUs ? upperBound : histogram->maxUs;
+        }
+    }
+    return histogram->maxUs;
+}
+
+const char* MetricsGetName(Metric metric) {
+    HAPPrecondition(metric < kMetric_Count);
+
+    return metricNames[metric];
+}
+
+HAPError MetricsSerialize(char* bytes, size_t maxBytes, size_t* numBytes) {
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    size_t offset = 0;
+    for (Metric metric = 0; metric < kMetric_Count; metric++) {
+        MetricsHistogram histogram;
+        MetricsGetHistogram(metric, &histogram);
+
+        int n = snprintf(
+                &bytes[offset],
+                maxBytes - offset,
+                "%s\"%s\":{\"count\":%lu,\"mean\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"max\":%lu}",
+                metric == 0 ? "{" : ",",
+                MetricsGetName(metric),
+                (unsigned long) histogram.count,
+                (unsigned long) (histogram.count ? histogram.sumUs / histogram.count : 0),
+                (unsigned long) MetricsHistogramGetPercentile(&histogram, 50),
+                (unsigned long) MetricsHistogramGetPercentile(&histogram, 90),
+                (unsigned long) MetricsHistogramGetPercentile(&histogram, 99),
+                (unsigned long) histogram.maxUs);
+        if (n < 0 || (size_t) n >= maxBytes - offset) {
+            return kHAPError_OutOfResources;
+        }
+        offset += (size_t) n;
+    }
+    if (offset + 2 > maxBytes) {
+        return kHAPError_OutOfResources;
+    }
+    bytes[offset++] = '}';
+    bytes[offset] = '\0';
+    *numBytes = offset;
+    return kHAPError_None;
+}
@@ -0,0 +1,145 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Latency histograms for the door command paths.
+//
+// Buckets are powers of two in microseconds, so recording a sample is a handful of instructions and can be done
+// from any task. Snapshots are serialized as a compact JSON object for the local control and telemetry consumers.
+// The histograms live in RTC memory so that PerfSnapshot.h can report them after a crash.
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Number of buckets per histogram. Bucket i counts samples in [2^i, 2^(i + 1)) microseconds,
+ * the last bucket also collects everything above (~16 s).
+ */
+#define kMetricsHistogramNumBuckets ((size_t) 24)
+
+/**
+ * Recorded metrics.
+ */
+typedef enum {
+    /** Time from receiving a HAP write on 'Target Door State' until the relay is switched. */
+    kMetric_CommandLatencyHAP,
+
+    /** Time from receiving a local control request until the relay is switched. */
+    kMetric_CommandLatencyLocalControl,
+
+    /** Time from receiving an MQTT command until the relay is switched. */
+    kMetric_CommandLatencyMQTT,
+
+    /** Time from accepting the session until the relay is switched, for HAP writes that opened their session. */
+    kMetric_CommandLatencyCold,
+
+    /** Time from receiving a HAP write on a recently active session until the relay is switched. */
+    kMetric_CommandLatencyWarm,
+
+    /** Time from receiving a HAP write on a session idle beyond the warm window until the relay is switched. */
+    kMetric_CommandLatencyIdle,
+
+    /** Time from switching the relay until our own remote's code has been decoded by the RF receiver. */
+    kMetric_RfConfirmationLatency,
+
+    /** Time from decoding a learned door code until the door state events have been raised. */
+    kMetric_DoorActivityLatency,
+
+    /** Duration of a deferred flash write, during which the flash cache is disabled most of the time. */
+    kMetric_FlashWriteStall,
+
+    /** Time from boot or from losing every link until the station has an address. */
+    kMetric_TimeToReachableStation,
+
+    /** Time from boot or from losing every link until a SoftAP client has been assigned an address. */
+    kMetric_TimeToReachableSoftAP,
+
+    /** Command latency of any source while the station link is up. */
+    kMetric_CommandLatencyStation,
+
+    /** Command latency of any source while only SoftAP clients are connected. */
+    kMetric_CommandLatencySoftAP,
+
+    /** Time from receiving a command until its end state has been established (CommandSlo.h). */
+    kMetric_CommandCompletion,
+
+    kMetric_Count
+} Metric;
+
+/**
+ * Buffer size that fits the JSON object of MetricsSerialize.
+ */
+#define kMetrics_MaxSerializedBytes ((size_t) 2304)
+
+/**
+ * Latency histogram.
+ */
+typedef struct {
+    uint32_t buckets[kMetricsHistogramNumBuckets];
+    uint32_t count;
+    uint32_t maxUs;
+    uint64_t sumUs;
+} MetricsHistogram;
+
+/**
+ * Resets all histograms. Called once at boot by PerfSnapshotInitialize.
+ */
+void MetricsClear(void);
+
+/**
+ * Records a sample. May be called from any task.
+ */
+void MetricsRecord(Metric metric, uint32_t us);
+
+/**
+ * Copies a consistent snapshot of a histogram.
+ */
+void MetricsGetHistogram(Metric metric, MetricsHistogram* histogram);
+
+/**
+ * Adds a sample to a histogram that is not one of the recorded metrics. Not synchronized.
+ */
+void MetricsHistogramAdd(MetricsHistogram* histogram, uint32_t us);
+
+/**
+ * Returns the upper bound of the bucket that contains the given percentile, capped at the maximum sample.
+ */
+HAP_RESULT_USE_CHECK
+uint32_t MetricsHistogramGetPercentile(const MetricsHistogram* histogram, unsigned int percentile);
+
+/**
+ * Returns the name of a metric as used in serialized snapshots.
+ */
+HAP_RESULT_USE_CHECK
+const char* MetricsGetName(Metric metric);
+
+/**
+ * Serializes all metrics into a JSON object.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the buffer is not large enough.
+ */
+HAP_RESULT_USE_CHECK
+HAPError MetricsSerialize(char* bytes, size_t maxBytes, size_t* numBytes);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,127 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "MqttBatcher.h"
+
+#include <stdio.h>
+
+void MqttBatcherCreate(
+        MqttBatcher* batcher,
+        MqttBatch* queueBatches,
+        size_t maxQueueBatches,
+        MqttBatcherPublishCallback publish,
+        void* _Nullable context) {
+    HAPPrecondition(batcher);
+    HAPPrecondition(queueBatches);
+    HAPPrecondition(maxQueueBatches);
+    HAPPrecondition(publish);
+
+    HAPRawBufferZero(batcher, sizeof *batcher);
+    batcher->publish = publish;
+    batcher->context = context;
+    batcher->queue.batches = queueBatches;
+    batcher->queue.maxBatches = maxQueueBatches;
+}
+
+static void PublishState(MqttBatcher* batcher, uint8_t currentDoorState, uint8_t targetDoorState) {
+    char json[64];
+    int n = snprintf(
+            json, sizeof json, "{\"currentDoorState\":%u,\"targetDoorState\":%u}", currentDoorState, targetDoorState);
+    HAPAssert(n > 0 && (size_t) n < sizeof json);
+    // The client keeps retained messages until they are sent, so a rejected state is not retried.
+    (void) batcher->publish(batcher->context, kMqttBatcherTopic_State, json, (size_t) n);
+}
+
+/**
+ * Queues an event batch for later. Drops the oldest batch if the queue is full.
+ */
+static void QueueEventBatch(MqttBatcher* batcher, const MqttBatch* batch) {
+    if (batcher->queue.count == batcher->queue.maxBatches) {
+        batcher->queue.head = (batcher->queue.head + 1) % batcher->queue.maxBatches;
+        batcher->queue.count--;
+        batcher->queue.numDropped++;
+    }
+    size_t tail = (batcher->queue.head + batcher->queue.count) % batcher->queue.maxBatches;
+    batcher->queue.batches[tail] = *batch;
+    batcher->queue.count++;
+}
+
+static void PublishEventBatch(MqttBatcher* batcher, const MqttBatch* batch) {
+    if (!batcher->isConnected ||
+        !batcher->publish(batcher->context, kMqttBatcherTopic_Events, batch->bytes, batch->numBytes)) {
+        QueueEventBatch(batcher, batch);
+    }
+}
+
+void MqttBatcherFlush(MqttBatcher* batcher) {
+    HAPPrecondition(batcher);
+
+    if (batcher->pending.isStateChanged && batcher->isConnected) {
+        PublishState(batcher, batcher->pending.currentDoorState, batcher->pending.targetDoorState);
+        batcher->pending.isStateChanged = false;
+    }
+    if (batcher->pending.events.numBytes) {
+        MqttBatch* events = &batcher->pending.events;
+        events->bytes[events->numBytes++] = ']';
+        PublishEventBatch(batcher, events);
+        events->numBytes = 0;
+    }
+}
+
+void MqttBatcherHandleDoorStateChanged(MqttBatcher* batcher, uint8_t currentDoorState, uint8_t targetDoorState) {
+    HAPPrecondition(batcher);
+
+    batcher->pending.isStateChanged = true;
+    batcher->pending.currentDoorState = currentDoorState;
+    batcher->pending.targetDoorState = targetDoorState;
+}
+
+void MqttBatcherHandleCommand(MqttBatcher* batcher, int64_t timeMs, const char* sourceName, uint8_t targetDoorState) {
+    HAPPrecondition(batcher);
+    HAPPrecondition(sourceName);
+
+    char json[kMqttBatcher_MaxEventBytes];
+    int n = snprintf(
+            json,
+            sizeof json,
+            "{\"t\":%lld,\"source\":\"%s\",\"targetDoorState\":%u}",
+            (long long) timeMs,
+            sourceName,
+            targetDoorState);
+    HAPPrecondition(n > 0 && (size_t) n < sizeof json);
+
+    MqttBatch* events = &batcher->pending.events;
+    // Leave room for the separator and the closing bracket.
+    if (events->numBytes && events->numBytes + (size_t) n + 2 > sizeof events->bytes) {
+        MqttBatcherFlush(batcher);
+    }
+    char separator = events->numBytes ? ',' : '[';
+    events->bytes[events->numBytes++] = separator;
+    HAPRawBufferCopyBytes(&events->bytes[events->numBytes], json, (size_t) n);
+    events->numBytes += (size_t) n;
+}
+
+void MqttBatcherHandleConnected(MqttBatcher* batcher, uint8_t currentDoorState, uint8_t targetDoorState) {
+    HAPPrecondition(batcher);
+
+    batcher->isConnected = true;
+    batcher->pending.isStateChanged = false;
+    PublishState(batcher, currentDoorState, targetDoorState);
+    while (batcher->queue.count) {
+        const MqttBatch* batch = &batcher->queue.batches[batcher->queue.head];
+        if (!batcher->publish(batcher->context, kMqttBatcherTopic_Events, batch->bytes, batch->numBytes)) {
+            break;
+        }
+        batcher->queue.head = (batcher->queue.head + 1) % batcher->queue.maxBatches;
+        batcher->queue.count--;
+    }
+}
+
+void MqttBatcherHandleDisconnected(MqttBatcher* batcher) {
+    HAPPrecondition(batcher);
+
+    batcher->isConnected = false;
+}
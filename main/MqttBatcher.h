@@ -0,0 +1,158 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Batching and offline queue of the MQTT bridge.
+//
+// Door state changes are coalesced to the latest state, command events are appended to a JSON array, and both are
+// published together by MqttBatcherFlush. Event batches that cannot be published, because the client is disconnected
+// or rejects them, are kept in a bounded queue (oldest dropped first) and published on reconnect, after the latest
+// state.
+//
+// The batcher is platform-independent and does not synchronize. MqttBridge.c connects it to the esp-mqtt client, runs
+// the batch window timer and serializes access.
+
+#ifndef MQTT_BATCHER_H
+#define MQTT_BATCHER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Maximum size of one batch of command events, including the enclosing brackets.
+ */
+#define kMqttBatcher_MaxBatchBytes ((size_t) 256)
+
+/**
+ * Maximum size of one command event.
+ */
+#define kMqttBatcher_MaxEventBytes ((size_t) 64)
+
+/**
+ * Batch of command events, serialized as a JSON array.
+ */
+typedef struct {
+    size_t numBytes;
+    char bytes[kMqttBatcher_MaxBatchBytes];
+} MqttBatch;
+
+/**
+ * Topics published by the batcher.
+ */
+typedef enum {
+    /** {"currentDoorState":1,"targetDoorState":1}, retained. */
+    kMqttBatcherTopic_State,
+
+    /** Batch of command events, e.g. [{"t":1234,"source":"hap","targetDoorState":0}]. */
+    kMqttBatcherTopic_Events
+} MqttBatcherTopic;
+
+/**
+ * Publishes a message.
+ *
+ * @param      context              Context.
+ * @param      topic                Topic.
+ * @param      bytes                Payload.
+ * @param      numBytes             Length of the payload.
+ *
+ * @return true                     If the client has accepted the message.
+ * @return false                    Otherwise. Event batches are then queued.
+ */
+typedef bool (*MqttBatcherPublishCallback)(
+        void* _Nullable context,
+        MqttBatcherTopic topic,
+        const char* bytes,
+        size_t numBytes);
+
+/**
+ * Batcher state.
+ */
+typedef struct {
+    MqttBatcherPublishCallback publish;
+    void* _Nullable context;
+    bool isConnected;
+
+    /** Changes of the current batch window. */
+    struct {
+        bool isStateChanged;
+        uint8_t currentDoorState;
+        uint8_t targetDoorState;
+        MqttBatch events;
+    } pending;
+
+    /** Event batches that could not be published, oldest first. */
+    struct {
+        MqttBatch* batches;
+        size_t maxBatches;
+        size_t head;
+        size_t count;
+        uint32_t numDropped;
+    } queue;
+} MqttBatcher;
+
+/**
+ * Initializes a batcher. It starts disconnected.
+ *
+ * @param[out] batcher              Batcher.
+ * @param      queueBatches         Storage of the offline queue.
+ * @param      maxQueueBatches      Capacity of queueBatches.
+ * @param      publish              Publishes messages.
+ * @param      context              Context passed to publish.
+ */
+void MqttBatcherCreate(
+        MqttBatcher* batcher,
+        MqttBatch* queueBatches,
+        size_t maxQueueBatches,
+        MqttBatcherPublishCallback publish,
+        void* _Nullable context);
+
+/**
+ * Records a door state change. Only the latest state of a batch window is published.
+ */
+void MqttBatcherHandleDoorStateChanged(MqttBatcher* batcher, uint8_t currentDoorState, uint8_t targetDoorState);
+
+/**
+ * Appends a command event to the current batch. If the batch is full, it is flushed first.
+ *
+ * @param      batcher              Batcher.
+ * @param      timeMs               Time of the command in milliseconds.
+ * @param      sourceName           Name of the command source, e.g. "hap". Must not need escaping.
+ * @param      targetDoorState      Commanded target door state.
+ */
+void MqttBatcherHandleCommand(MqttBatcher* batcher, int64_t timeMs, const char* sourceName, uint8_t targetDoorState);
+
+/**
+ * Publishes everything that accumulated during the batch window. While disconnected, a state change stays pending
+ * and the event batch is queued.
+ */
+void MqttBatcherFlush(MqttBatcher* batcher);
+
+/**
+ * Publishes the current state, which supersedes a pending state change, and the queued event batches. Batches stay
+ * queued from the first one that the client rejects.
+ */
+void MqttBatcherHandleConnected(MqttBatcher* batcher, uint8_t currentDoorState, uint8_t targetDoorState);
+
+/**
+ * Records that the client has lost its connection.
+ */
+void MqttBatcherHandleDisconnected(MqttBatcher* batcher);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,250 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "MqttBridge.h"
+
+#include "Metrics.h"
+#include "MqttBatcher.h"
+#include "PerfSnapshot.h"
+#if CONFIG_GARAGE_OVERLOAD_CONTROL
+#include "Overload.h"
+#endif
+#if CONFIG_GARAGE_TELEMETRY
+#include "Telemetry.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <mqtt_client.h>
+
+#define kTopic_Availability CONFIG_GARAGE_MQTT_TOPIC_PREFIX "/availability"
+#define kTopic_State        CONFIG_GARAGE_MQTT_TOPIC_PREFIX "/state"
+#define kTopic_Events       CONFIG_GARAGE_MQTT_TOPIC_PREFIX "/events"
+#define kTopic_Health       CONFIG_GARAGE_MQTT_TOPIC_PREFIX "/health"
+#define kTopic_Set          CONFIG_GARAGE_MQTT_TOPIC_PREFIX "/set"
+#define kTopic_Snapshot     CONFIG_GARAGE_MQTT_TOPIC_PREFIX "/snapshot"
+
+static const char* const sourceNames[] = {
+    [kAppCommandSource_HAP] = "hap",
+    [kAppCommandSource_LocalControl] = "local",
+    [kAppCommandSource_MQTT] = "mqtt",
+};
+
+static struct {
+    esp_mqtt_client_handle_t client;
+    esp_timer_handle_t flushTimer;
+    esp_timer_handle_t healthTimer;
+
+    /** Protects everything below. */
+    SemaphoreHandle_t lock;
+    MqttBatcher batcher;
+    MqttBatch queueBatches[CONFIG_GARAGE_MQTT_OFFLINE_QUEUE_LENGTH];
+} bridge;
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static bool Publish(void* _Nullable context HAP_UNUSED, MqttBatcherTopic topic, const char* bytes, size_t numBytes) {
+    switch (topic) {
+        case kMqttBatcherTopic_State: {
+            return esp_mqtt_client_enqueue(bridge.client, kTopic_State, bytes, (int) numBytes, 1, 1, true) >= 0;
+        }
+        case kMqttBatcherTopic_Events: {
+            return esp_mqtt_client_enqueue(bridge.client, kTopic_Events, bytes, (int) numBytes, 1, 0, true) >= 0;
+        }
+    }
+    HAPFatalError();
+}
+
+static void HandleFlushTimer(void* arg HAP_UNUSED) {
+    xSemaphoreTake(bridge.lock, portMAX_DELAY);
+    MqttBatcherFlush(&bridge.batcher);
+    xSemaphoreGive(bridge.lock);
+}
+
+static void ScheduleFlush(void) {
+    // Fails while the timer is already armed, in which case the change goes out with the current batch.
+    (void) esp_timer_start_once(bridge.flushTimer, CONFIG_GARAGE_MQTT_BATCH_WINDOW_MS * 1000);
+}
+
+static void HandleHealthTimer(void* arg HAP_UNUSED) {
+#if CONFIG_GARAGE_OVERLOAD_CONTROL
+    // Diagnostics are suspended while overloaded.
+    if (OverloadIsDegraded()) {
+        return;
+    }
+#endif
+    xSemaphoreTake(bridge.lock, portMAX_DELAY);
+    bool isConnected = bridge.batcher.isConnected;
+    uint32_t numDropped = bridge.batcher.queue.numDropped;
+    xSemaphoreGive(bridge.lock);
+    if (!isConnected) {
+        return;
+    }
+
+    wifi_ap_record_t apInfo;
+    int rssi = esp_wifi_sta_get_ap_info(&apInfo) == ESP_OK ? apInfo.rssi : 0;
+
+    size_t telemetrySamples = 0;
+    size_t telemetryBytes = 0;
+#if CONFIG_GARAGE_TELEMETRY
+    TelemetryGetUsage(&telemetrySamples, &telemetryBytes);
+#endif
+
+    // Room for the fields before the metrics.
+    size_t maxBytes = kMetrics_MaxSerializedBytes + 256;
+    char* json = malloc(maxBytes);
+    if (!json) {
+        HAPLogError(&kHAPLog_Default, "%s: Out of memory.", __func__);
+        return;
+    }
+    int n = snprintf(
+            json,
+            maxBytes,
+            "{\"uptime\":%lld,\"freeHeap\":%u,\"minFreeHeap\":%u,\"rssi\":%d,\"droppedEventBatches\":%u,"
+            "\"telemetrySamples\":%u,\"telemetryBytes\":%u,\"metrics\":",
+            (long long) (esp_timer_get_time() / 1000000),
+            (unsigned int) esp_get_free_heap_size(),
+            (unsigned int) esp_get_minimum_free_heap_size(),
+            rssi,
+            (unsigned int) numDropped,
+            (unsigned int) telemetrySamples,
+            (unsigned int) telemetryBytes);
+    size_t numBytes;
+    if (n < 0 || MetricsSerialize(&json[n], maxBytes - (size_t) n - 1, &numBytes)) {
+        HAPLogError(&kHAPLog_Default, "%s: Health report too large.", __func__);
+        free(json);
+        return;
+    }
+    numBytes += (size_t) n;
+    json[numBytes++] = '}';
+    (void) esp_mqtt_client_enqueue(bridge.client, kTopic_Health, json, (int) numBytes, 0, 0, true);
+    free(json);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static void HandleCommandMessage(const char* bytes, size_t numBytes) {
+    int64_t receivedAt = esp_timer_get_time();
+
+    HAPCharacteristicValue_TargetDoorState targetState;
+    if ((numBytes == 4 && !memcmp(bytes, "open", 4)) || (numBytes == 1 && bytes[0] == '0')) {
+        targetState = kHAPCharacteristicValue_TargetDoorState_Open;
+    } else if ((numBytes == 5 && !memcmp(bytes, "close", 5)) || (numBytes == 1 && bytes[0] == '1')) {
+        targetState = kHAPCharacteristicValue_TargetDoorState_Closed;
+    } else {
+        HAPLogError(&kHAPLog_Default, "%s: Ignoring invalid command.", __func__);
+        return;
+    }
+    AppScheduleTargetDoorState(targetState, kAppCommandSource_MQTT, receivedAt);
+}
+
+static void HandleConnected(void) {
+    (void) esp_mqtt_client_subscribe(bridge.client, kTopic_Set, 1);
+    (void) esp_mqtt_client_enqueue(bridge.client, kTopic_Availability, "online", 0, 1, 1, true);
+
+    char* _Nullable report = PerfSnapshotTakeReport();
+    if (report) {
+        (void) esp_mqtt_client_enqueue(bridge.client, kTopic_Snapshot, report, 0, 1, 0, true);
+        free(report);
+    }
+
+    uint8_t currentDoorState;
+    uint8_t targetDoorState;
+    AppGetDoorState(&currentDoorState, &targetDoorState);
+
+    xSemaphoreTake(bridge.lock, portMAX_DELAY);
+    MqttBatcherHandleConnected(&bridge.batcher, currentDoorState, targetDoorState);
+    xSemaphoreGive(bridge.lock);
+}
+
+static void HandleMqttEvent(
+        void* _Nullable arg HAP_UNUSED,
+        esp_event_base_t base HAP_UNUSED,
+        int32_t eventID,
+        void* eventData) {
+    esp_mqtt_event_handle_t event = eventData;
+    switch ((esp_mqtt_event_id_t) eventID) {
+        case MQTT_EVENT_CONNECTED: {
+            HAPLogInfo(&kHAPLog_Default, "MQTT connected.");
+            HandleConnected();
+        } break;
+        case MQTT_EVENT_DISCONNECTED: {
+            HAPLogInfo(&kHAPLog_Default, "MQTT disconnected.");
+            xSemaphoreTake(bridge.lock, portMAX_DELAY);
+            MqttBatcherHandleDisconnected(&bridge.batcher);
+            xSemaphoreGive(bridge.lock);
+        } break;
+        case MQTT_EVENT_DATA: {
+            if (event->topic_len == sizeof kTopic_Set - 1 && !memcmp(event->topic, kTopic_Set, sizeof kTopic_Set - 1)) {
+                HandleCommandMessage(event->data, (size_t) event->data_len);
+            }
+        } break;
+        default: {
+        } break;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+void MqttBridgeHandleDoorStateChanged(uint8_t currentDoorState, uint8_t targetDoorState) {
+    if (!bridge.client) {
+        return;
+    }
+
+    xSemaphoreTake(bridge.lock, portMAX_DELAY);
+    MqttBatcherHandleDoorStateChanged(&bridge.batcher, currentDoorState, targetDoorState);
+    xSemaphoreGive(bridge.lock);
+    ScheduleFlush();
+}
+
+void MqttBridgeHandleCommand(AppCommandSource source, uint8_t targetDoorState) {
+    if (!bridge.client) {
+        return;
+    }
+
+    int64_t timeMs = esp_timer_get_time() / 1000;
+    xSemaphoreTake(bridge.lock, portMAX_DELAY);
+    MqttBatcherHandleCommand(&bridge.batcher, timeMs, sourceNames[source], targetDoorState);
+    xSemaphoreGive(bridge.lock);
+    ScheduleFlush();
+}
+
+void MqttBridgeStart(void) {
+    HAPPrecondition(!bridge.client);
+
+    bridge.lock = xSemaphoreCreateMutex();
+    HAPAssert(bridge.lock);
+    MqttBatcherCreate(
+            &bridge.batcher, bridge.queueBatches, HAPArrayCount(bridge.queueBatches), Publish, /* context: */ NULL);
+
+    const esp_timer_create_args_t flushTimerArgs = { .callback = HandleFlushTimer, .name = "mqtt_flush" };
+    ESP_ERROR_CHECK(esp_timer_create(&flushTimerArgs, &bridge.flushTimer));
+    const esp_timer_create_args_t healthTimerArgs = { .callback = HandleHealthTimer, .name = "mqtt_health" };
+    ESP_ERROR_CHECK(esp_timer_create(&healthTimerArgs, &bridge.healthTimer));
+
+    const esp_mqtt_client_config_t config = {
+        .uri = CONFIG_GARAGE_MQTT_BROKER_URI,
+        .username = CONFIG_GARAGE_MQTT_USERNAME[0] ? CONFIG_GARAGE_MQTT_USERNAME : NULL,
+        .password = CONFIG_GARAGE_MQTT_PASSWORD[0] ? CONFIG_GARAGE_MQTT_PASSWORD : NULL,
+        .lwt_topic = kTopic_Availability,
+        .lwt_msg = "offline",
+        .lwt_qos = 1,
+        .lwt_retain = 1,
+    };
+    bridge.client = esp_mqtt_client_init(&config);
+    HAPAssert(bridge.client);
+    ESP_ERROR_CHECK(esp_mqtt_client_register_event(bridge.client, ESP_EVENT_ANY_ID, HandleMqttEvent, NULL));
+    ESP_ERROR_CHECK(esp_mqtt_client_start(bridge.client));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(bridge.healthTimer, CONFIG_GARAGE_MQTT_HEALTH_INTERVAL_S * 1000000LL));
+
+    HAPLogInfo(&kHAPLog_Default, "MQTT bridge connecting to %s.", CONFIG_GARAGE_MQTT_BROKER_URI);
+}
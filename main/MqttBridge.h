@@ -0,0 +1,62 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// MQTT state and command bridge.
+//
+// Topics, relative to the configured prefix:
+//
+//   <prefix>/availability  "online" / "offline" (last will), retained.
+//   <prefix>/state         {"currentDoorState":1,"targetDoorState":1}, retained.
+//   <prefix>/events        Batch of command events, e.g. [{"t":1234,"source":"hap","targetDoorState":0}].
+//   <prefix>/health        Uptime, heap, RSSI, telemetry history usage and the command latency metrics. Suspended
+//                          while overloaded (Overload.h).
+//   <prefix>/set           Commands: "open", "close" or the raw 'Target Door State' value.
+//   <prefix>/snapshot      Crash snapshot of the previous boot (PerfSnapshot.h), published once.
+//
+// State changes and command events are collected for a short batch window and published together, so a burst of
+// changes costs one publish per topic. While the broker is unreachable, event batches are kept in a bounded queue
+// (oldest dropped first) and the latest state is republished on reconnect. The batching and the queue are
+// platform-independent (MqttBatcher.h); this module connects them to the esp-mqtt client.
+
+#ifndef MQTT_BRIDGE_H
+#define MQTT_BRIDGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#include "App.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Start the MQTT client. The client keeps reconnecting on its own.
+ */
+void MqttBridgeStart(void);
+
+/**
+ * Publish the door state. Coalesced with other changes within the batch window.
+ */
+void MqttBridgeHandleDoorStateChanged(uint8_t currentDoorState, uint8_t targetDoorState);
+
+/**
+ * Publish a command event. Batched with other events within the batch window.
+ */
+void MqttBridgeHandleCommand(AppCommandSource source, uint8_t targetDoorState);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,309 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "Overload.h"
+#include "FlashWriteScheduler.h"
+#include "PerfSnapshot.h"
+#include "ReportFormat.h"
+#include "SessionTracker.h"
+
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+#define kOverload_RunLoopLatencyUs ((uint32_t) CONFIG_GARAGE_OVERLOAD_RUN_LOOP_LATENCY_MS * 1000)
+
+/**
+ * Free internal heap required to resume normal operation.
+ */
+#define kOverload_ExitFreeHeapBytes ((uint32_t) CONFIG_GARAGE_OVERLOAD_MIN_FREE_HEAP_BYTES * 5 / 4)
+
+/**
+ * Mode transition.
+ */
+typedef struct {
+    /** Time of the transition, in milliseconds since boot. */
+    uint32_t timeMs;
+
+    /** Conditions of the probe that caused the transition. */
+    uint8_t conditions;
+    bool isDegraded;
+} Transition;
+
+/**
+ * Characteristic reads of a session in the current probe interval.
+ */
+typedef struct {
+    const HAPSessionRef* _Nullable session;
+    uint32_t numReads;
+} Reader;
+
+static struct {
+    esp_timer_handle_t timer;
+
+    /** Written on the run loop, read from any task. */
+    volatile bool isDegraded;
+
+    /** Set by the probe timer when a probe could not be scheduled, cleared by the next probe. */
+    volatile bool isProbeMissed;
+
+    // Only accessed on the run loop.
+
+    /** ESP-IDF log level before the degraded mode was entered. */
+    esp_log_level_t savedLogLevel;
+
+    uint32_t numOverloadedProbes;
+    uint32_t numCalmProbes;
+    Reader readers[CONFIG_GARAGE_HAP_SESSIONS];
+
+    // Protected by overloadLock.
+
+    int64_t degradedAt;
+    uint64_t degradedUs;
+    uint32_t numDegraded;
+    uint32_t numThrottledReads;
+    uint32_t numFailedProbes;
+
+    /** Most recent probe. */
+    uint8_t conditions;
+    uint32_t numSessions;
+    uint32_t runLoopLatencyUs;
+    uint32_t freeHeapBytes;
+
+    Transition transitions[kOverload_NumTransitions];
+    size_t numTransitions;
+    size_t nextTransition;
+} overload;
+
+static portMUX_TYPE overloadLock = portMUX_INITIALIZER_UNLOCKED;
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Returns the conditions that hold. With isDegraded, the stricter conditions for resuming normal operation apply.
+ */
+static uint8_t GetConditions(bool isDegraded, uint32_t numSessions, uint32_t runLoopLatencyUs, uint32_t freeHeapBytes) {
+    uint8_t conditions = 0;
+    if (numSessions + (isDegraded ? 2 : 1) > CONFIG_GARAGE_HAP_SESSIONS) {
+        conditions |= kOverloadCondition_Sessions;
+    }
+    if (runLoopLatencyUs > (isDegraded ? kOverload_RunLoopLatencyUs / 2 : kOverload_RunLoopLatencyUs)) {
+        conditions |= kOverloadCondition_RunLoopLatency;
+    }
+    if (freeHeapBytes < (isDegraded ? kOverload_ExitFreeHeapBytes : CONFIG_GARAGE_OVERLOAD_MIN_FREE_HEAP_BYTES)) {
+        conditions |= kOverloadCondition_Heap;
+    }
+    return conditions;
+}
+
+static void SetDegraded(bool isDegraded, uint8_t conditions, int64_t now) {
+    if (isDegraded) {
+        HAPLogError(
+                &kHAPLog_Default,
+                "Overloaded (sessions %d, run loop latency %d, heap %d). Entering degraded mode.",
+                (conditions & kOverloadCondition_Sessions) != 0,
+                (conditions & kOverloadCondition_RunLoopLatency) != 0,
+                (conditions & kOverloadCondition_Heap) != 0);
+        // HAP logs are compiled in at HAP_LOG_LEVEL and are muted by their callers, see OverloadIsDegraded.
+        // Setting the wildcard level also drops per-tag levels, which the app does not use.
+        overload.savedLogLevel = esp_log_level_get("*");
+        if (overload.savedLogLevel > ESP_LOG_ERROR) {
+            esp_log_level_set("*", ESP_LOG_ERROR);
+        }
+    } else {
+        if (overload.savedLogLevel > ESP_LOG_ERROR) {
+            esp_log_level_set("*", overload.savedLogLevel);
+        }
+        HAPLogInfo(&kHAPLog_Default, "Load back to normal. Leaving degraded mode.");
+    }
+    PerfSnapshotTrace(kPerfSnapshotEvent_OverloadChanged, (uint32_t) isDegraded << 8 | conditions);
+
+    portENTER_CRITICAL(&overloadLock);
+    if (isDegraded) {
+        overload.degradedAt = now;
+        overload.numDegraded++;
+    } else {
+        overload.degradedUs += (uint64_t)(now - overload.degradedAt);
+    }
+    overload.transitions[overload.nextTransition] = (Transition) {
+        .timeMs = (uint32_t)(now / 1000),
+        .conditions = conditions,
+        .isDegraded = isDegraded,
+    };
+    overload.nextTransition = (overload.nextTransition + 1) % kOverload_NumTransitions;
+    if (overload.numTransitions < kOverload_NumTransitions) {
+        overload.numTransitions++;
+    }
+    overload.isDegraded = isDegraded;
+    portEXIT_CRITICAL(&overloadLock);
+}
+
+static void Probe(void* _Nullable context, size_t contextSize) {
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(int64_t));
+
+    int64_t scheduledAt = *(const int64_t*) context;
+    int64_t now = esp_timer_get_time();
+    uint32_t numSessions = (uint32_t) SessionTrackerGetNumSessions();
+    uint32_t runLoopLatencyUs = (uint32_t)(now - scheduledAt);
+    uint32_t freeHeapBytes = (uint32_t) heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    bool isDegraded = overload.isDegraded;
+    uint8_t conditions = GetConditions(isDegraded, numSessions, runLoopLatencyUs, freeHeapBytes);
+    if (overload.isProbeMissed) {
+        overload.isProbeMissed = false;
+        conditions |= kOverloadCondition_RunLoopLatency;
+    }
+
+    portENTER_CRITICAL(&overloadLock);
+    overload.conditions = conditions;
+    overload.numSessions = numSessions;
+    overload.runLoopLatencyUs = runLoopLatencyUs;
+    overload.freeHeapBytes = freeHeapBytes;
+    portEXIT_CRITICAL(&overloadLock);
+
+    // Read budgets start over with every probe.
+    HAPRawBufferZero(overload.readers, sizeof overload.readers);
+
+    if (conditions) {
+        overload.numOverloadedProbes++;
+        overload.numCalmProbes = 0;
+    } else {
+        overload.numOverloadedProbes = 0;
+        overload.numCalmProbes++;
+    }
+    if (!isDegraded && overload.numOverloadedProbes >= kOverload_NumEnterProbes) {
+        SetDegraded(true, conditions, now);
+        isDegraded = true;
+    } else if (isDegraded && overload.numCalmProbes >= kOverload_NumExitProbes) {
+        SetDegraded(false, conditions, now);
+        isDegraded = false;
+    }
+    if (isDegraded) {
+        // Renewed with every probe, bounded by the scheduler's maximum deferral.
+        FlashWriteSchedulerDefer(2 * kOverload_ProbeIntervalMS);
+    }
+}
+
+static void HandleProbeTimer(void* arg HAP_UNUSED) {
+    // Probing on the run loop measures how long it takes to get there.
+    int64_t scheduledAt = esp_timer_get_time();
+    HAPError err = HAPPlatformRunLoopScheduleCallback(Probe, &scheduledAt, sizeof scheduledAt);
+    if (err) {
+        // The run loop queue is full, which is overloaded by any measure. Taken into account by the next probe.
+        overload.isProbeMissed = true;
+        portENTER_CRITICAL(&overloadLock);
+        overload.numFailedProbes++;
+        portEXIT_CRITICAL(&overloadLock);
+    }
+}
+
+void OverloadStart(void) {
+    HAPPrecondition(!overload.timer);
+
+    const esp_timer_create_args_t timerArgs = { .callback = HandleProbeTimer, .name = "overload" };
+    ESP_ERROR_CHECK(esp_timer_create(&timerArgs, &overload.timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(overload.timer, kOverload_ProbeIntervalMS * 1000));
+}
+
+bool OverloadIsDegraded(void) {
+    return overload.isDegraded;
+}
+
+bool OverloadShouldThrottleRead(const HAPSessionRef* session) {
+    HAPPrecondition(session);
+
+    if (!overload.isDegraded) {
+        return false;
+    }
+    Reader* _Nullable reader = NULL;
+    for (size_t i = 0; i < HAPArrayCount(overload.readers); i++) {
+        if (overload.readers[i].session == session) {
+            reader = &overload.readers[i];
+            break;
+        }
+        if (!reader && !overload.readers[i].session) {
+            reader = &overload.readers[i];
+        }
+    }
+    if (!reader) {
+        return false;
+    }
+    reader->session = session;
+    if (reader->numReads < CONFIG_GARAGE_OVERLOAD_SESSION_READS_PER_S) {
+        reader->numReads++;
+        return false;
+    }
+    portENTER_CRITICAL(&overloadLock);
+    overload.numThrottledReads++;
+    portEXIT_CRITICAL(&overloadLock);
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+HAP_RESULT_USE_CHECK
+HAPError OverloadSerialize(char* bytes, size_t maxBytes, size_t* numBytes) {
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    Transition transitions[kOverload_NumTransitions];
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&overloadLock);
+    bool isDegraded = overload.isDegraded;
+    uint64_t degradedUs = overload.degradedUs + (isDegraded ? (uint64_t)(now - overload.degradedAt) : 0);
+    uint32_t numDegraded = overload.numDegraded;
+    uint32_t numThrottledReads = overload.numThrottledReads;
+    uint32_t numFailedProbes = overload.numFailedProbes;
+    uint8_t conditions = overload.conditions;
+    uint32_t numSessions = overload.numSessions;
+    uint32_t runLoopLatencyUs = overload.runLoopLatencyUs;
+    uint32_t freeHeapBytes = overload.freeHeapBytes;
+    size_t numTransitions = overload.numTransitions;
+    for (size_t i = 0; i < numTransitions; i++) {
+        // Newest first.
+        size_t index = (overload.nextTransition + kOverload_NumTransitions - 1 - i) % kOverload_NumTransitions;
+        transitions[i] = overload.transitions[index];
+    }
+    portEXIT_CRITICAL(&overloadLock);
+
+    size_t offset = 0;
+    HAPError err = ReportFormatAppend(
+            bytes,
+            maxBytes,
+            &offset,
+            "{\"degraded\":%s,\"probe\":{\"conditions\":%u,\"sessions\":%lu,\"runLoopLatencyUs\":%lu,"
+            "\"freeHeap\":%lu},\"degradedCount\":%lu,\"degradedMs\":%llu,\"throttledReads\":%lu,"
+            "\"failedProbes\":%lu,\"transitions\":[",
+            isDegraded ? "true" : "false",
+            conditions,
+            (unsigned long) numSessions,
+            (unsigned long) runLoopLatencyUs,
+            (unsigned long) freeHeapBytes,
+            (unsigned long) numDegraded,
+            (unsigned long long) (degradedUs / 1000),
+            (unsigned long) numThrottledReads,
+            (unsigned long) numFailedProbes);
+    for (size_t i = 0; !err && i < numTransitions; i++) {
+        err = ReportFormatAppend(
+                bytes,
+                maxBytes,
+                &offset,
+                "%s{\"timeMs\":%lu,\"degraded\":%s,\"conditions\":%u}",
+                i ? "," : "",
+                (unsigned long) transitions[i].timeMs,
+                transitions[i].isDegraded ? "true" : "false",
+                transitions[i].conditions);
+    }
+    if (!err) {
+        err = ReportFormatAppend(bytes, maxBytes, &offset, "]}");
+    }
+    if (err) {
+        return err;
+    }
+    *numBytes = offset;
+    return kHAPError_None;
+}
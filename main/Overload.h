@@ -0,0 +1,129 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Overload control.
+//
+// When the accessory is saturated everything slows down together, door commands included. Once per second the run
+// loop is probed for:
+//
+//   sessions   All HAP session slots are in use.
+//   latency    A callback scheduled from another task took longer than GARAGE_OVERLOAD_RUN_LOOP_LATENCY_MS to run.
+//   heap       Less than GARAGE_OVERLOAD_MIN_FREE_HEAP_BYTES of internal heap is free.
+//
+// If any of them holds for kOverload_NumEnterProbes probes in a row, the accessory switches into a degraded mode
+// that sheds everything but the actuation path:
+//
+//   - MQTT health reports and benchmark runs are suspended.
+//   - Per-request logging of the app is skipped, and ESP-IDF log output is lowered to errors. HAP logs are compiled
+//     in at HAP_LOG_LEVEL and cannot be lowered at run time, so callers check OverloadIsDegraded instead.
+//   - Flash writes are held back, up to GARAGE_FLASH_WRITE_MAX_DEFERRAL_MS (FlashWriteScheduler.h).
+//   - Controller reads of the informational characteristics (DB.c) are limited to GARAGE_OVERLOAD_SESSION_READS_PER_S
+//     per session. Further reads in the same second are answered with a busy status. The door characteristics are
+//     never limited, since the ADK also reads them for events and write responses. Writes are never limited.
+//
+// Normal operation resumes after kOverload_NumExitProbes probes in a row without any condition. To avoid flapping,
+// the conditions are stricter on the way out: two free session slots, half the latency threshold and a quarter
+// more free heap than the threshold. Mode transitions are logged, traced (PerfSnapshot.h) and kept for
+// OverloadSerialize.
+
+#ifndef OVERLOAD_H
+#define OVERLOAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Interval between probes.
+ */
+#define kOverload_ProbeIntervalMS ((HAPTime) 1000)
+
+/**
+ * Number of consecutive overloaded probes after which the degraded mode is entered.
+ */
+#define kOverload_NumEnterProbes ((uint32_t) 2)
+
+/**
+ * Number of consecutive calm probes after which normal operation resumes.
+ */
+#define kOverload_NumExitProbes ((uint32_t) 15)
+
+/**
+ * Number of most recent mode transitions that are kept.
+ */
+#define kOverload_NumTransitions ((size_t) 8)
+
+/**
+ * Buffer size that fits the JSON object of OverloadSerialize.
+ */
+#define kOverload_MaxSerializedBytes ((size_t) 1024)
+
+/**
+ * Overload conditions.
+ */
+typedef enum {
+    /** All HAP session slots are in use. */
+    kOverloadCondition_Sessions = 1U << 0,
+
+    /** The run loop falls behind. */
+    kOverloadCondition_RunLoopLatency = 1U << 1,
+
+    /** Internal heap runs low. */
+    kOverloadCondition_Heap = 1U << 2
+} OverloadCondition;
+
+/**
+ * Starts probing. Must be called after the run loop has been created.
+ */
+void OverloadStart(void);
+
+/**
+ * Whether the accessory is in the degraded mode, e.g. to skip logging on request paths. May be called from any task.
+ */
+HAP_RESULT_USE_CHECK
+bool OverloadIsDegraded(void);
+
+/**
+ * Counts a characteristic read on a session against its budget. Only for reads that can only come from a controller
+ * GET, i.e. of characteristics that support neither events nor writes. Must be called on the run loop.
+ *
+ * @param      session              Session that the read was received on.
+ *
+ * @return true                     If the read must be answered with kHAPError_Busy.
+ * @return false                    Otherwise. Always while not degraded.
+ */
+HAP_RESULT_USE_CHECK
+bool OverloadShouldThrottleRead(const HAPSessionRef* session);
+
+/**
+ * Serializes the current mode, the most recent probe, counters and the most recent mode transitions as a JSON
+ * object. May be called from any task.
+ *
+ * @param[out] bytes                Buffer.
+ * @param      maxBytes             Capacity of buffer.
+ * @param[out] numBytes             Length of the JSON object, excluding the NULL terminator.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the buffer is too small.
+ */
+HAP_RESULT_USE_CHECK
+HAPError OverloadSerialize(char* bytes, size_t maxBytes, size_t* numBytes);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
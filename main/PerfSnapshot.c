@@ -0,0 +1,185 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "PerfSnapshot.h"
+
+#include "Metrics.h"
+#include "Placement.h"
+#include "ReportFormat.h"
+
+#include <stdlib.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+/**
+ * Marks the snapshot as initialized. Change when the layout of Snapshot changes.
+ */
+#define kPerfSnapshot_Magic ((uint32_t) 0x50534E31)
+
+#define kPerfSnapshot_NumTraceEntries ((size_t) 32)
+#define kPerfSnapshot_NumCommands     ((size_t) 8)
+#define kPerfSnapshot_MaxReportBytes  ((size_t) 4096)
+
+typedef struct {
+    uint32_t timeMs;
+    uint32_t event;
+    uint32_t arg;
+} TraceEntry;
+
+typedef struct {
+    uint32_t timeMs;
+    uint8_t source;
+    uint8_t targetDoorState;
+    uint32_t latencyUs;
+} CommandSummary;
+
+typedef struct {
+    uint32_t magic;
+
+    /** Number of trace entries ever written. The ring holds the most recent ones. */
+    uint32_t numTraceEntries;
+    TraceEntry trace[kPerfSnapshot_NumTraceEntries];
+
+    /** Number of commands ever recorded. The ring holds the most recent ones. */
+    uint32_t numCommands;
+    CommandSummary commands[kPerfSnapshot_NumCommands];
+} Snapshot;
+
+/**
+ * Survives panic, watchdog and brown-out resets.
+ */
+static RTC_NOINIT_ATTR Snapshot snapshot;
+
+static portMUX_TYPE snapshotLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Report of the previous boot, if it ended in a crash and nobody has taken it yet.
+ */
+static char* _Nullable report;
+
+//----------------------------------------------------------------------------------------------------------------------
+
+HAP_RESULT_USE_CHECK
+static HAPError SerializeSnapshot(char* bytes, size_t maxBytes, esp_reset_reason_t reason) {
+    HAPError err;
+    size_t offset = 0;
+
+    err = ReportFormatAppend(bytes, maxBytes, &offset, "{\"resetReason\":%d,\"metrics\":", (int) reason);
+    if (err) {
+        return err;
+    }
+    size_t numBytes;
+    err = MetricsSerialize(&bytes[offset], maxBytes - offset, &numBytes);
+    if (err) {
+        return err;
+    }
+    offset += numBytes;
+
+    err = ReportFormatAppend(bytes, maxBytes, &offset, ",\"commands\":[");
+    if (err) {
+        return err;
+    }
+    uint32_t first = snapshot.numCommands > kPerfSnapshot_NumCommands ?
+                             snapshot.numCommands - kPerfSnapshot_NumCommands :
+                             0;
+    for (uint32_t i = first; i < snapshot.numCommands; i++) {
+        const CommandSummary* command = &snapshot.commands[i % kPerfSnapshot_NumCommands];
+        err = ReportFormatAppend(
+                bytes,
+                maxBytes,
+                &offset,
+                "%s{\"t\":%u,\"source\":%u,\"targetDoorState\":%u,\"latency\":%u}",
+                i == first ? "" : ",",
+                (unsigned int) command->timeMs,
+                command->source,
+                command->targetDoorState,
+                (unsigned int) command->latencyUs);
+        if (err) {
+            return err;
+        }
+    }
+
+    err = ReportFormatAppend(bytes, maxBytes, &offset, "],\"trace\":[");
+    if (err) {
+        return err;
+    }
+    first = snapshot.numTraceEntries > kPerfSnapshot_NumTraceEntries ?
+                    snapshot.numTraceEntries - kPerfSnapshot_NumTraceEntries :
+                    0;
+    for (uint32_t i = first; i < snapshot.numTraceEntries; i++) {
+        const TraceEntry* entry = &snapshot.trace[i % kPerfSnapshot_NumTraceEntries];
+        err = ReportFormatAppend(
+                bytes,
+                maxBytes,
+                &offset,
+                "%s[%u,%u,%u]",
+                i == first ? "" : ",",
+                (unsigned int) entry->timeMs,
+                (unsigned int) entry->event,
+                (unsigned int) entry->arg);
+        if (err) {
+            return err;
+        }
+    }
+    return ReportFormatAppend(bytes, maxBytes, &offset, "]}");
+}
+
+void PerfSnapshotInitialize(void) {
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool isCrash = reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT ||
+                   reason == ESP_RST_WDT || reason == ESP_RST_BROWNOUT;
+
+    if (isCrash && snapshot.magic == kPerfSnapshot_Magic) {
+        report = PlacementAllocateBulk(kPerfSnapshot_MaxReportBytes);
+        if (report && SerializeSnapshot(report, kPerfSnapshot_MaxReportBytes, reason)) {
+            HAPLogError(&kHAPLog_Default, "%s: Snapshot of previous boot does not fit the report.", __func__);
+            free(report);
+            report = NULL;
+        }
+        if (report) {
+            HAPLog(&kHAPLog_Default, "Snapshot of previous boot: %s", report);
+        }
+    }
+
+    HAPRawBufferZero(&snapshot, sizeof snapshot);
+    snapshot.magic = kPerfSnapshot_Magic;
+    MetricsClear();
+}
+
+void PerfSnapshotTrace(PerfSnapshotEvent event, uint32_t arg) {
+    uint32_t timeMs = (uint32_t)(esp_timer_get_time() / 1000);
+
+    portENTER_CRITICAL_SAFE(&snapshotLock);
+    TraceEntry* entry = &snapshot.trace[snapshot.numTraceEntries % kPerfSnapshot_NumTraceEntries];
+    entry->timeMs = timeMs;
+    entry->event = (uint32_t) event;
+    entry->arg = arg;
+    snapshot.numTraceEntries++;
+    portEXIT_CRITICAL_SAFE(&snapshotLock);
+}
+
+void PerfSnapshotRecordCommand(AppCommandSource source, uint8_t targetDoorState, uint32_t latencyUs) {
+    uint32_t timeMs = (uint32_t)(esp_timer_get_time() / 1000);
+
+    portENTER_CRITICAL_SAFE(&snapshotLock);
+    CommandSummary* command = &snapshot.commands[snapshot.numCommands % kPerfSnapshot_NumCommands];
+    command->timeMs = timeMs;
+    command->source = (uint8_t) source;
+    command->targetDoorState = targetDoorState;
+    command->latencyUs = latencyUs;
+    snapshot.numCommands++;
+    portEXIT_CRITICAL_SAFE(&snapshotLock);
+}
+
+char* _Nullable PerfSnapshotTakeReport(void) {
+    portENTER_CRITICAL_SAFE(&snapshotLock);
+    char* _Nullable taken = report;
+    report = NULL;
+    portEXIT_CRITICAL_SAFE(&snapshotLock);
+    return taken;
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Crash-persistent performance snapshot.
+//
+// A trace ring, the latency histograms of Metrics.h and summaries of the last door commands are kept in RTC memory
+// that is not initialized on reset. After a panic, watchdog or brown-out reset the previous contents are turned into
+// a report once on the next boot; on any other reset they are discarded.
+
+#ifndef PERF_SNAPSHOT_H
+#define PERF_SNAPSHOT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#include "App.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Trace events.
+ */
+typedef enum {
+    /** Door command received. Argument: source << 8 | target door state. */
+    kPerfSnapshotEvent_CommandReceived = 1,
+
+    /** Relay switched on. */
+    kPerfSnapshotEvent_RelayOn,
+
+    /** Relay switched off. */
+    kPerfSnapshotEvent_RelayOff,
+
+    /** Accessory state persisted. Argument: duration of the key-value store write in microseconds. */
+    kPerfSnapshotEvent_StateSaved,
+
+    /** Wi-Fi station connected. */
+    kPerfSnapshotEvent_WiFiConnected,
+
+    /** Wi-Fi station disconnected. Argument: reason code. */
+    kPerfSnapshotEvent_WiFiDisconnected,
+
+    /** SoftAP started because no access point was reachable. */
+    kPerfSnapshotEvent_SoftAPStarted,
+
+    /** SoftAP stopped because the access point is back. */
+    kPerfSnapshotEvent_SoftAPStopped,
+
+    /** Supply level changed. Argument: level << 16 | supply voltage in millivolts. */
+    kPerfSnapshotEvent_SupplyLevelChanged,
+
+    /** Overload degraded mode entered or left (Overload.h). Argument: isDegraded << 8 | conditions. */
+    kPerfSnapshotEvent_OverloadChanged
+} PerfSnapshotEvent;
+
+/**
+ * Take over the snapshot of the previous boot. Must be called before anything is recorded.
+ */
+void PerfSnapshotInitialize(void);
+
+/**
+ * Append an event to the trace ring. May be called from any task.
+ */
+void PerfSnapshotTrace(PerfSnapshotEvent event, uint32_t arg);
+
+/**
+ * Record a summary of a door command. May be called from any task.
+ */
+void PerfSnapshotRecordCommand(AppCommandSource source, uint8_t targetDoorState, uint32_t latencyUs);
+
+/**
+ * Take ownership of the JSON report of the snapshot left by a crash of the previous boot.
+ *
+ * The report is handed out only once. The caller releases it with free().
+ *
+ * @return Report, or NULL if there is none or it has already been taken.
+ */
+HAP_RESULT_USE_CHECK
+char* _Nullable PerfSnapshotTakeReport(void);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
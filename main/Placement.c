@@ -0,0 +1,14 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "Placement.h"
+
+#include <esp_heap_caps.h>
+
+HAP_RESULT_USE_CHECK
+void* _Nullable PlacementAllocateBulk(size_t numBytes) {
+    return heap_caps_malloc_prefer(numBytes, 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT, MALLOC_CAP_DEFAULT);
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Buffer placement.
+//
+// On modules with PSRAM, buffers are split into two classes:
+//
+// - Hot buffers are touched on every HAP request or by DMA: session inbound and outbound buffers, event notification
+//   tables, RMT and ADC buffers. They stay in internal DRAM, which is faster and remains accessible while the flash
+//   cache is disabled. This is the default for statics and malloc.
+// - Bulk buffers are large and latency-tolerant: the HAP scratch buffer, the BLE procedure buffer, the telemetry
+//   history and journal staging, crash reports. Statics are marked with EXT_RAM_ATTR, heap buffers are allocated with
+//   PlacementAllocateBulk.
+//
+// Bulk statics only move to PSRAM with SPIRAM and SPIRAM_ALLOW_BSS_SEG_EXTERNAL_MEMORY enabled; otherwise
+// EXT_RAM_ATTR has no effect. Bulk buffers must not be accessed while the flash cache is disabled, nor be used for
+// DMA.
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#include <esp_attr.h>
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Allocates a bulk buffer, in PSRAM if available and in internal RAM otherwise. Released with free().
+ *
+ * @param      numBytes             Size of the buffer.
+ *
+ * @return Buffer, or NULL if out of memory.
+ */
+HAP_RESULT_USE_CHECK
+void* _Nullable PlacementAllocateBulk(size_t numBytes);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,27 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "ReportFormat.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+HAPError ReportFormatAppend(char* bytes, size_t maxBytes, size_t* offset, const char* format, ...) {
+    HAPPrecondition(bytes);
+    HAPPrecondition(offset);
+    HAPPrecondition(*offset <= maxBytes);
+    HAPPrecondition(format);
+
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(&bytes[*offset], maxBytes - *offset, format, args);
+    va_end(args);
+    if (n < 0 || (size_t) n >= maxBytes - *offset) {
+        return kHAPError_OutOfResources;
+    }
+    *offset += (size_t) n;
+    return kHAPError_None;
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Formatting of the JSON reports served by local control, e.g. MetricsSerialize and CpuUsageSerialize.
+
+#ifndef REPORT_FORMAT_H
+#define REPORT_FORMAT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Appends formatted text to a report and advances the offset. The report stays NULL-terminated.
+ *
+ * @param      bytes                Report buffer.
+ * @param      maxBytes             Capacity of the report buffer.
+ * @param[in,out] offset            Length of the report so far.
+ * @param      format               printf format string.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the text does not fit. The offset is not advanced.
+ */
+HAP_RESULT_USE_CHECK
+HAPError ReportFormatAppend(char* bytes, size_t maxBytes, size_t* offset, const char* format, ...)
+        __attribute__((format(printf, 4, 5)));
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,338 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "RfCalibration.h"
+
+#include "Actuator.h"
+#include "App.h"
+#include "CommandSlo.h"
+#include "Metrics.h"
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <stdio.h>
+
+/**
+ * Time to wait for the code beyond the end of the actuation pattern before a trial fails.
+ */
+#define kRfCalibration_TrialTimeoutMarginMS ((HAPTime) 500)
+
+/**
+ * Pause between trials, so the remote and the door controller settle.
+ */
+#define kRfCalibration_TrialIntervalMS ((HAPTime) 3 * HAPSecond)
+
+/**
+ * Time to wait for the code beyond the end of the actuation pattern before an activation counts as unconfirmed.
+ */
+#define kRfCalibration_ConfirmationMarginUs ((int64_t) 1000 * 1000)
+
+static struct {
+    HAPPlatformKeyValueStoreRef _Nullable keyValueStore;
+
+    /** Learned code and calibrated press length. pressMs is 0 if not calibrated. */
+    uint32_t code;
+    uint32_t pressMs;
+
+    /** Calibration run. */
+    bool isCalibrating;
+    bool hasRunCode;
+    uint32_t runCode;
+    uint32_t numTrials;
+    uint32_t maxPressUs;
+    int64_t trialStartedAt;
+    HAPPlatformTimerRef timer;
+
+    /** Confirmation of the last activation. 0 if no confirmation is pending. */
+    int64_t actuatedAt;
+    int64_t confirmationDeadline;
+
+    uint32_t numAttempts;
+    uint32_t numConfirmed;
+} calibration;
+
+static portMUX_TYPE calibrationLock = portMUX_INITIALIZER_UNLOCKED;
+
+static void ApplyPressLength(void) {
+    if (!calibration.pressMs) {
+        return;
+    }
+    char description[16];
+    snprintf(description, sizeof description, "1:%lu", (unsigned long) calibration.pressMs);
+    if (ActuatorSetPattern(description)) {
+        HAPLogError(&kHAPLog_Default, "%s: Calibrated press length %s rejected.", __func__, description);
+    }
+}
+
+void RfCalibrationCreate(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+
+    calibration.keyValueStore = keyValueStore;
+
+    // Called again after a factory reset, which purges the stored calibration.
+    portENTER_CRITICAL(&calibrationLock);
+    calibration.code = 0;
+    calibration.pressMs = 0;
+    calibration.confirmationDeadline = 0;
+    portEXIT_CRITICAL(&calibrationLock);
+
+    uint8_t bytes[8];
+    bool found;
+    size_t numBytes;
+    HAPError err = HAPPlatformKeyValueStoreGet(
+            keyValueStore,
+            kAppKeyValueStoreDomain_Configuration,
+            kAppKeyValueStoreKey_Configuration_RfCalibration,
+            bytes,
+            sizeof bytes,
+            &numBytes,
+            &found);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        HAPFatalError();
+    }
+    if (!found || numBytes != sizeof bytes) {
+        HAPLogInfo(&kHAPLog_Default, "No RF calibration stored, using the configured actuation pattern.");
+        if (ActuatorSetPattern(CONFIG_GARAGE_ACTUATION_PATTERN)) {
+            HAPFatalError();
+        }
+        return;
+    }
+    calibration.code = HAPReadLittleUInt32(&bytes[0]);
+    calibration.pressMs = HAPReadLittleUInt32(&bytes[4]);
+    HAPLogInfo(
+            &kHAPLog_Default,
+            "RF calibration: code %06lX, press length %lu ms.",
+            (unsigned long) calibration.code,
+            (unsigned long) calibration.pressMs);
+    ApplyPressLength();
+}
+
+static void StartTrial(HAPPlatformTimerRef timer, void* _Nullable context);
+static void HandleTrialTimeout(HAPPlatformTimerRef timer, void* _Nullable context);
+
+static void ScheduleTimer(HAPTime delay, HAPPlatformTimerCallback callback) {
+    HAPError err = HAPPlatformTimerRegister(&calibration.timer, HAPPlatformClockGetCurrent() + delay, callback, NULL);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLogError(&kHAPLog_Default, "%s: Not enough timers available.", __func__);
+        HAPFatalError();
+    }
+}
+
+static void FinishCalibration(bool isSuccessful) {
+    HAPPrecondition(calibration.isCalibrating);
+
+    if (calibration.timer) {
+        HAPPlatformTimerDeregister(calibration.timer);
+        calibration.timer = 0;
+    }
+    if (!isSuccessful) {
+        portENTER_CRITICAL(&calibrationLock);
+        calibration.isCalibrating = false;
+        portEXIT_CRITICAL(&calibrationLock);
+        ApplyPressLength();
+        return;
+    }
+
+    uint32_t pressMs =
+            (calibration.maxPressUs / 1000 + 1) * (100 + CONFIG_GARAGE_RF_CALIBRATION_MARGIN_PERCENT) / 100;
+    portENTER_CRITICAL(&calibrationLock);
+    calibration.isCalibrating = false;
+    calibration.code = calibration.runCode;
+    calibration.pressMs = pressMs;
+    portEXIT_CRITICAL(&calibrationLock);
+    HAPLogInfo(
+            &kHAPLog_Default,
+            "RF calibration finished: code %06lX, longest press %lu us, press length %lu ms.",
+            (unsigned long) calibration.code,
+            (unsigned long) calibration.maxPressUs,
+            (unsigned long) calibration.pressMs);
+
+    uint8_t bytes[8];
+    HAPWriteLittleUInt32(&bytes[0], calibration.code);
+    HAPWriteLittleUInt32(&bytes[4], calibration.pressMs);
+    HAPError err = HAPPlatformKeyValueStoreSet(
+            HAPNonnull(calibration.keyValueStore),
+            kAppKeyValueStoreDomain_Configuration,
+            kAppKeyValueStoreKey_Configuration_RfCalibration,
+            bytes,
+            sizeof bytes);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        HAPFatalError();
+    }
+    ApplyPressLength();
+}
+
+static void StartTrial(HAPPlatformTimerRef timer HAP_UNUSED, void* _Nullable context HAP_UNUSED) {
+    HAPPrecondition(calibration.isCalibrating);
+
+    calibration.timer = 0;
+    HAPLogInfo(
+            &kHAPLog_Default,
+            "RF calibration trial %lu of %d.",
+            (unsigned long) calibration.numTrials + 1,
+            CONFIG_GARAGE_RF_CALIBRATION_TRIALS);
+    ActuatorStart();
+    calibration.trialStartedAt = esp_timer_get_time();
+    ScheduleTimer(
+            ActuatorGetPatternDurationUs() / 1000 + kRfCalibration_TrialTimeoutMarginMS, HandleTrialTimeout);
+}
+
+static void HandleTrialTimeout(HAPPlatformTimerRef timer HAP_UNUSED, void* _Nullable context HAP_UNUSED) {
+    HAPPrecondition(calibration.isCalibrating);
+
+    calibration.timer = 0;
+    ActuatorStop();
+    HAPLogError(
+            &kHAPLog_Default,
+            "RF calibration failed: code not received in trial %lu.",
+            (unsigned long) calibration.numTrials + 1);
+    FinishCalibration(false);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError RfCalibrationStart(void) {
+    HAPPrecondition(calibration.keyValueStore);
+
+    if (calibration.isCalibrating) {
+        return kHAPError_InvalidState;
+    }
+
+    // Trials use the configured pattern. It is assumed to be long enough for the remote to be heard.
+    if (ActuatorSetPattern(CONFIG_GARAGE_ACTUATION_PATTERN)) {
+        HAPFatalError();
+    }
+    portENTER_CRITICAL(&calibrationLock);
+    calibration.isCalibrating = true;
+    calibration.hasRunCode = false;
+    calibration.numTrials = 0;
+    calibration.maxPressUs = 0;
+    calibration.confirmationDeadline = 0;
+    portEXIT_CRITICAL(&calibrationLock);
+    StartTrial(0, NULL);
+    return kHAPError_None;
+}
+
+bool RfCalibrationHandleActuationStarting(void) {
+    if (calibration.isCalibrating) {
+        // Release the button first, the door command restarts the actuator right away.
+        ActuatorStop();
+        HAPLogInfo(&kHAPLog_Default, "RF calibration aborted by door command.");
+        FinishCalibration(false);
+    }
+    if (!calibration.pressMs) {
+        // Without a learned code there is nothing to listen for.
+        return false;
+    }
+
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&calibrationLock);
+    calibration.actuatedAt = now;
+    calibration.confirmationDeadline = now + ActuatorGetPatternDurationUs() + kRfCalibration_ConfirmationMarginUs;
+    calibration.numAttempts++;
+    portEXIT_CRITICAL(&calibrationLock);
+    return true;
+}
+
+static void HandleTrialCode(const RfCode* code, int64_t receivedAt) {
+    if (!calibration.timer) {
+        // Between trials.
+        return;
+    }
+    if (calibration.hasRunCode && code->code != calibration.runCode) {
+        HAPLogInfo(&kHAPLog_Default, "RF calibration: ignoring foreign code %06lX.", (unsigned long) code->code);
+        return;
+    }
+    ActuatorStop();
+    HAPPlatformTimerDeregister(calibration.timer);
+    calibration.timer = 0;
+
+    uint32_t pressUs = (uint32_t)(receivedAt - calibration.trialStartedAt);
+    calibration.hasRunCode = true;
+    calibration.runCode = code->code;
+    if (pressUs > calibration.maxPressUs) {
+        calibration.maxPressUs = pressUs;
+    }
+    calibration.numTrials++;
+    HAPLogInfo(
+            &kHAPLog_Default,
+            "RF calibration: code %06lX (T = %u us) decoded after %lu us.",
+            (unsigned long) code->code,
+            code->unitUs,
+            (unsigned long) pressUs);
+
+    if (calibration.numTrials == CONFIG_GARAGE_RF_CALIBRATION_TRIALS) {
+        FinishCalibration(true);
+    } else {
+        ScheduleTimer(kRfCalibration_TrialIntervalMS, StartTrial);
+    }
+}
+
+HAP_RESULT_USE_CHECK
+bool RfCalibrationHandleCode(const RfCode* code, int64_t receivedAt) {
+    HAPPrecondition(code);
+
+    if (calibration.isCalibrating) {
+        HandleTrialCode(code, receivedAt);
+        return true;
+    }
+    if (!calibration.pressMs || code->code != calibration.code) {
+        return false;
+    }
+    if (!calibration.confirmationDeadline) {
+        // Our remote pressed by hand.
+        return true;
+    }
+    if (receivedAt > calibration.confirmationDeadline) {
+        HAPLogInfo(&kHAPLog_Default, "Activation not confirmed on air.");
+        calibration.confirmationDeadline = 0;
+        return true;
+    }
+
+    uint32_t latency = (uint32_t)(receivedAt - calibration.actuatedAt);
+    portENTER_CRITICAL(&calibrationLock);
+    calibration.confirmationDeadline = 0;
+    calibration.numConfirmed++;
+    portEXIT_CRITICAL(&calibrationLock);
+    MetricsRecord(kMetric_RfConfirmationLatency, latency);
+    CommandSloHandleConfirmed(receivedAt);
+    HAPLogInfo(&kHAPLog_Default, "Activation confirmed on air after %lu us.", (unsigned long) latency);
+    return true;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError RfCalibrationSerialize(char* bytes, size_t maxBytes, size_t* numBytes) {
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    portENTER_CRITICAL(&calibrationLock);
+    bool isCalibrating = calibration.isCalibrating;
+    uint32_t numTrials = calibration.numTrials;
+    uint32_t code = calibration.code;
+    uint32_t pressMs = calibration.pressMs;
+    uint32_t numAttempts = calibration.numAttempts;
+    uint32_t numConfirmed = calibration.numConfirmed;
+    portEXIT_CRITICAL(&calibrationLock);
+
+    int n = snprintf(
+            bytes,
+            maxBytes,
+            "{\"calibrating\":%s,\"trials\":%lu,\"code\":\"%06lX\",\"pressMs\":%lu,"
+            "\"attempts\":%lu,\"confirmed\":%lu}",
+            isCalibrating ? "true" : "false",
+            (unsigned long) numTrials,
+            (unsigned long) code,
+            (unsigned long) pressMs,
+            (unsigned long) numAttempts,
+            (unsigned long) numConfirmed);
+    if (n < 0 || (size_t) n >= maxBytes) {
+        return kHAPError_OutOfResources;
+    }
+    *numBytes = (size_t) n;
+    return kHAPError_None;
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Press length calibration and activation confirmation through the RF receiver.
+//
+// Calibration presses the remote a number of times with the configured actuation pattern and releases the button as
+// soon as its code has been decoded on air. The longest of these presses plus a safety margin becomes the new press
+// length. The first code heard during calibration is learned as the code of our remote.
+//
+// In normal operation, every activation opens a confirmation window. Hearing the learned code within the window
+// confirms the activation and records the time from switching the relay until the code was decoded.
+//
+// All functions except RfCalibrationSerialize must be called on the run loop.
+
+#ifndef RF_CALIBRATION_H
+#define RF_CALIBRATION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#include "RfDecoder.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Loads the stored calibration and applies the calibrated press length, or the configured actuation pattern if
+ * nothing is stored. Called again after a factory reset.
+ *
+ * @param      keyValueStore        Key-value store.
+ */
+void RfCalibrationCreate(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Starts a calibration run. Each trial operates the door.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_InvalidState   If a calibration is already running.
+ */
+HAP_RESULT_USE_CHECK
+HAPError RfCalibrationStart(void);
+
+/**
+ * Informs the calibration that the remote is about to be pressed for a door command. Aborts a running calibration
+ * and opens the confirmation window for the activation. A confirmation is reported to CommandSlo.h.
+ *
+ * @return true                     If the activation will be confirmed, i.e. our remote's code is known.
+ * @return false                    Otherwise.
+ */
+bool RfCalibrationHandleActuationStarting(void);
+
+/**
+ * Handles a received code.
+ *
+ * @param      code                 Code.
+ * @param      receivedAt           Time the code was decoded, from esp_timer_get_time.
+ *
+ * @return true                     If the code is our own remote's or has been consumed by a calibration run.
+ * @return false                    If the code is foreign.
+ */
+HAP_RESULT_USE_CHECK
+bool RfCalibrationHandleCode(const RfCode* code, int64_t receivedAt);
+
+/**
+ * Serializes the calibration and confirmation statistics as a JSON object. May be called from any task.
+ *
+ * @param[out] bytes                Buffer.
+ * @param      maxBytes             Capacity of buffer.
+ * @param[out] numBytes             Length of the JSON object, excluding the NULL terminator.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the buffer is too small.
+ */
+HAP_RESULT_USE_CHECK
+HAPError RfCalibrationSerialize(char* bytes, size_t maxBytes, size_t* numBytes);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,175 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "RfCodeBook.h"
+
+#include "App.h"
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <stdio.h>
+
+/**
+ * How long learning waits for a code.
+ */
+#define kRfCodeBook_LearningWindowUs ((int64_t) 30 * 1000 * 1000)
+
+static struct {
+    HAPPlatformKeyValueStoreRef _Nullable keyValueStore;
+
+    uint32_t codes[kRfCodeBook_MaxCodes];
+    size_t numCodes;
+
+    /** Learning ends at this time. 0 if not learning. */
+    int64_t learningDeadline;
+} codeBook;
+
+static portMUX_TYPE codeBookLock = portMUX_INITIALIZER_UNLOCKED;
+
+void RfCodeBookCreate(HAPPlatformKeyValueStoreRef keyValueStore) {
+    HAPPrecondition(keyValueStore);
+
+    codeBook.keyValueStore = keyValueStore;
+
+    // Called again after a factory reset, which purges the code book.
+    portENTER_CRITICAL(&codeBookLock);
+    codeBook.numCodes = 0;
+    codeBook.learningDeadline = 0;
+    portEXIT_CRITICAL(&codeBookLock);
+
+    uint8_t bytes[kRfCodeBook_MaxCodes * sizeof(uint32_t)];
+    bool found;
+    size_t numBytes;
+    HAPError err = HAPPlatformKeyValueStoreGet(
+            keyValueStore,
+            kAppKeyValueStoreDomain_Configuration,
+            kAppKeyValueStoreKey_Configuration_RfCodeBook,
+            bytes,
+            sizeof bytes,
+            &numBytes,
+            &found);
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        HAPFatalError();
+    }
+    if (!found || numBytes % sizeof(uint32_t)) {
+        return;
+    }
+    portENTER_CRITICAL(&codeBookLock);
+    codeBook.numCodes = numBytes / sizeof(uint32_t);
+    for (size_t i = 0; i < codeBook.numCodes; i++) {
+        codeBook.codes[i] = HAPReadLittleUInt32(&bytes[i * sizeof(uint32_t)]);
+    }
+    portEXIT_CRITICAL(&codeBookLock);
+    HAPLogInfo(&kHAPLog_Default, "%zu door codes learned.", codeBook.numCodes);
+}
+
+static void SaveCodeBook(void) {
+    HAPPrecondition(codeBook.keyValueStore);
+
+    uint8_t bytes[kRfCodeBook_MaxCodes * sizeof(uint32_t)];
+    for (size_t i = 0; i < codeBook.numCodes; i++) {
+        HAPWriteLittleUInt32(&bytes[i * sizeof(uint32_t)], codeBook.codes[i]);
+    }
+    HAPError err = HAPPlatformKeyValueStoreSet(
+            HAPNonnull(codeBook.keyValueStore),
+            kAppKeyValueStoreDomain_Configuration,
+            kAppKeyValueStoreKey_Configuration_RfCodeBook,
+            bytes,
+            codeBook.numCodes * sizeof(uint32_t));
+    if (err) {
+        HAPAssert(err == kHAPError_Unknown);
+        HAPFatalError();
+    }
+}
+
+HAP_RESULT_USE_CHECK
+HAPError RfCodeBookStartLearning(void) {
+    if (codeBook.numCodes == kRfCodeBook_MaxCodes) {
+        return kHAPError_OutOfResources;
+    }
+    codeBook.learningDeadline = esp_timer_get_time() + kRfCodeBook_LearningWindowUs;
+    HAPLogInfo(&kHAPLog_Default, "Learning door code, press the remote now.");
+    return kHAPError_None;
+}
+
+void RfCodeBookClear(void) {
+    portENTER_CRITICAL(&codeBookLock);
+    codeBook.numCodes = 0;
+    portEXIT_CRITICAL(&codeBookLock);
+    SaveCodeBook();
+    HAPLogInfo(&kHAPLog_Default, "Door codes cleared.");
+}
+
+static bool IsKnownCode(uint32_t code) {
+    for (size_t i = 0; i < codeBook.numCodes; i++) {
+        if (codeBook.codes[i] == code) {
+            return true;
+        }
+    }
+    return false;
+}
+
+HAP_RESULT_USE_CHECK
+bool RfCodeBookHandleCode(const RfCode* code, int64_t receivedAt) {
+    HAPPrecondition(code);
+
+    if (IsKnownCode(code->code)) {
+        return true;
+    }
+    if (!codeBook.learningDeadline) {
+        return false;
+    }
+    if (receivedAt > codeBook.learningDeadline) {
+        HAPLogInfo(&kHAPLog_Default, "No door code heard, learning stopped.");
+        codeBook.learningDeadline = 0;
+        return false;
+    }
+
+    codeBook.learningDeadline = 0;
+    portENTER_CRITICAL(&codeBookLock);
+    codeBook.codes[codeBook.numCodes++] = code->code;
+    portEXIT_CRITICAL(&codeBookLock);
+    SaveCodeBook();
+    HAPLogInfo(
+            &kHAPLog_Default,
+            "Learned door code %06lX (T = %u us).",
+            (unsigned long) code->code,
+            code->unitUs);
+    return true;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError RfCodeBookSerialize(char* bytes, size_t maxBytes, size_t* numBytes) {
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    uint32_t codes[kRfCodeBook_MaxCodes];
+    portENTER_CRITICAL(&codeBookLock);
+    size_t numCodes = codeBook.numCodes;
+    HAPRawBufferCopyBytes(codes, codeBook.codes, numCodes * sizeof codes[0]);
+    portEXIT_CRITICAL(&codeBookLock);
+
+    size_t offset = 0;
+    for (size_t i = 0; i < numCodes; i++) {
+        int n = snprintf(
+                &bytes[offset], maxBytes - offset, "%s\"%06lX\"", i ? "," : "[", (unsigned long) codes[i]);
+        if (n < 0 || (size_t) n >= maxBytes - offset) {
+            return kHAPError_OutOfResources;
+        }
+        offset += (size_t) n;
+    }
+    if (offset + (numCodes ? 2 : 3) > maxBytes) {
+        return kHAPError_OutOfResources;
+    }
+    if (!numCodes) {
+        bytes[offset++] = '[';
+    }
+    bytes[offset++] = ']';
+    bytes[offset] = '\0';
+    *numBytes = offset;
+    return kHAPError_None;
+}
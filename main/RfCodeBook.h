@@ -0,0 +1,88 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Codes of other remotes that operate the same door.
+//
+// Codes are learned one at a time: after RfCodeBookStartLearning, the next foreign code that is heard is added.
+// The code book is kept in the key-value store.
+//
+// All functions except RfCodeBookSerialize must be called on the run loop.
+
+#ifndef RF_CODE_BOOK_H
+#define RF_CODE_BOOK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#include "RfDecoder.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Maximum number of learned codes.
+ */
+#define kRfCodeBook_MaxCodes ((size_t) 8)
+
+/**
+ * Loads the code book. Called again after a factory reset, which leaves it empty.
+ *
+ * @param      keyValueStore        Key-value store.
+ */
+void RfCodeBookCreate(HAPPlatformKeyValueStoreRef keyValueStore);
+
+/**
+ * Adds the next foreign code that is received within a short time to the code book.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the code book is full.
+ */
+HAP_RESULT_USE_CHECK
+HAPError RfCodeBookStartLearning(void);
+
+/**
+ * Removes all learned codes.
+ */
+void RfCodeBookClear(void);
+
+/**
+ * Handles a foreign code, i.e. one that is not our own remote's.
+ *
+ * @param      code                 Code.
+ * @param      receivedAt           Time the code was decoded, from esp_timer_get_time.
+ *
+ * @return true                     If the code is a known door code and the door has been operated.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+bool RfCodeBookHandleCode(const RfCode* code, int64_t receivedAt);
+
+/**
+ * Serializes the learned codes as a JSON array. May be called from any task.
+ *
+ * @param[out] bytes                Buffer.
+ * @param      maxBytes             Capacity of buffer.
+ * @param[out] numBytes             Length of the JSON array, excluding the NULL terminator.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the buffer is too small.
+ */
+HAP_RESULT_USE_CHECK
+HAPError RfCodeBookSerialize(char* bytes, size_t maxBytes, size_t* numBytes);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
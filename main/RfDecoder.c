@@ -0,0 +1,91 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "RfDecoder.h"
+
+/**
+ * Accepted range of the unit time, in microseconds.
+ */
+#define kRfDecoder_MinUnitUs ((uint32_t) 100)
+#define kRfDecoder_MaxUnitUs ((uint32_t) 1000)
+
+/**
+ * A low level that is longer than this multiple of the preceding high level is a sync gap.
+ */
+#define kRfDecoder_SyncRatio ((uint32_t) 20)
+
+void RfDecoderReset(RfDecoder* decoder) {
+    HAPPrecondition(decoder);
+
+    HAPRawBufferZero(decoder, sizeof *decoder);
+}
+
+/**
+ * Handles a sync gap that follows a high level of the given duration.
+ */
+static bool HandleSync(RfDecoder* decoder, uint32_t highUs, RfCode* code) {
+    bool isDecoded = false;
+    if (decoder->isCollecting && decoder->numBits == kRfDecoder_NumBits) {
+        if (decoder->hasFrame && decoder->frame == decoder->bits) {
+            code->code = decoder->bits;
+            code->unitUs = decoder->unitUs;
+            isDecoded = true;
+        }
+        decoder->hasFrame = true;
+        decoder->frame = decoder->bits;
+    } else {
+        decoder->hasFrame = false;
+    }
+
+    decoder->isCollecting = highUs >= kRfDecoder_MinUnitUs && highUs <= kRfDecoder_MaxUnitUs;
+    decoder->numBits = 0;
+    decoder->bits = 0;
+    decoder->unitUs = (uint16_t) highUs;
+    return isDecoded;
+}
+
+bool RfDecoderFeed(RfDecoder* decoder, bool level, uint32_t durationUs, RfCode* code) {
+    HAPPrecondition(decoder);
+    HAPPrecondition(code);
+
+    if (level) {
+        decoder->highUs += durationUs;
+        return false;
+    }
+    uint32_t highUs = decoder->highUs;
+    uint32_t lowUs = durationUs;
+    decoder->highUs = 0;
+    if (!highUs) {
+        return false;
+    }
+
+    if (lowUs == kRfDecoder_EndOfCaptureUs || lowUs > kRfDecoder_SyncRatio * highUs) {
+        return HandleSync(decoder, highUs, code);
+    }
+    if (!decoder->isCollecting) {
+        return false;
+    }
+
+    // A bit lasts 4T and is split 1:3 (0) or 3:1 (1). Allow generous tolerance for receiver distortion, which is
+    // relatively largest at short unit times.
+    uint32_t unitUs = decoder->unitUs;
+    uint32_t totalUs = highUs + lowUs;
+    bool isValid = totalUs >= 2 * unitUs + unitUs / 2 && totalUs <= 5 * unitUs + unitUs / 2;
+    if (isValid && 2 * lowUs >= 3 * highUs) {
+        decoder->bits <<= 1;
+    } else if (isValid && 2 * highUs >= 3 * lowUs) {
+        decoder->bits = decoder->bits << 1 | 1;
+    } else {
+        decoder->isCollecting = false;
+        decoder->hasFrame = false;
+        return false;
+    }
+    if (++decoder->numBits > kRfDecoder_NumBits) {
+        decoder->isCollecting = false;
+        decoder->hasFrame = false;
+    }
+    return false;
+}
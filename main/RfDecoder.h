@@ -0,0 +1,97 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Decoder for fixed-code 433 MHz remotes (EV1527 / PT2262 style).
+//
+// A frame consists of 24 bits followed by a sync gap. With a unit time T of roughly 150-600 us, a 0 bit is sent as
+// T high and 3T low, a 1 bit as 3T high and T low, and the sync as T high and about 31T low. Remotes repeat the frame
+// for as long as the button is held; a code is only reported once two consecutive frames agree.
+//
+// The decoder consumes the demodulated receiver output as a sequence of levels and durations. It is
+// platform-independent and does not allocate.
+
+#ifndef RF_DECODER_H
+#define RF_DECODER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Number of bits per frame.
+ */
+#define kRfDecoder_NumBits ((uint8_t) 24)
+
+/**
+ * Duration to feed for the idle line at the end of a capture. It is always taken as a sync gap, whatever the unit
+ * time, since the capture hardware cuts long sync gaps short.
+ */
+#define kRfDecoder_EndOfCaptureUs UINT32_MAX
+
+/**
+ * Decoded code.
+ */
+typedef struct {
+    /** Code bits, most significant bit first. */
+    uint32_t code;
+
+    /** Measured unit time T in microseconds. */
+    uint16_t unitUs;
+} RfCode;
+
+/**
+ * Decoder state.
+ */
+typedef struct {
+    /** Duration of the pending high level, 0 if none. */
+    uint32_t highUs;
+
+    /** Whether a sync has been seen and bits are being collected. */
+    bool isCollecting;
+    uint8_t numBits;
+    uint32_t bits;
+    uint16_t unitUs;
+
+    /** Previous complete frame. */
+    bool hasFrame;
+    uint32_t frame;
+} RfDecoder;
+
+/**
+ * Resets a decoder.
+ */
+void RfDecoderReset(RfDecoder* decoder);
+
+/**
+ * Feeds one level of the receiver output.
+ *
+ * @param      decoder              Decoder.
+ * @param      level                Level, true while the carrier is present.
+ * @param      durationUs           Duration of the level. The end of a capture is fed as a low level of
+ *                                  kRfDecoder_EndOfCaptureUs.
+ * @param[out] code                 Code, if one has been decoded.
+ *
+ * @return true                     If a code has been decoded.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+bool RfDecoderFeed(RfDecoder* decoder, bool level, uint32_t durationUs, RfCode* code);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
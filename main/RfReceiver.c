@@ -0,0 +1,145 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "RfReceiver.h"
+
+#include <driver/rmt.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/ringbuf.h>
+#include <freertos/task.h>
+
+/**
+ * RX channel. Uses memory blocks 2-5, next to the actuator's TX channel 0.
+ */
+#define kRfReceiver_Channel        RMT_CHANNEL_2
+#define kRfReceiver_NumMemoryBlocks ((uint8_t) 4)
+
+/**
+ * A capture ends after the line has been low for this long. Shorter than the sync gap of remotes with a unit time
+ * above ~260 us, so their frames arrive as separate captures and are decoded without waiting for the remote to
+ * release. The cut sync gap is fed to the decoder as kRfDecoder_EndOfCaptureUs.
+ */
+#define kRfReceiver_IdleThresholdUs ((uint16_t) 8000)
+
+/**
+ * Size of the ring buffer that holds captures until they are decoded.
+ */
+#define kRfReceiver_RingBufferBytes ((size_t) 2048)
+
+/**
+ * Further frames of the same code within this time belong to the same button press.
+ */
+#define kRfReceiver_RepeatHoldoffUs ((int64_t) 300 * 1000)
+
+static struct {
+    RfReceiverCodeCallback callback;
+    RingbufHandle_t ringBuffer;
+    RfDecoder decoder;
+
+    uint32_t lastCode;
+    int64_t lastCodeAt;
+
+    int64_t startedAt;
+    RfReceiverStats stats;
+} receiver;
+
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+typedef struct {
+    RfCode code;
+    int64_t receivedAt;
+} ReceivedCodeContext;
+
+static void HandleReceivedCode(void* _Nullable context, size_t contextSize) {
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(ReceivedCodeContext));
+    const ReceivedCodeContext* receivedCode = context;
+
+    receiver.callback(&receivedCode->code, receivedCode->receivedAt);
+}
+
+static void Feed(bool level, uint32_t durationUs) {
+    RfCode code;
+    if (!RfDecoderFeed(&receiver.decoder, level, durationUs, &code)) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    bool isNewPress = code.code != receiver.lastCode || now - receiver.lastCodeAt > kRfReceiver_RepeatHoldoffUs;
+    receiver.lastCode = code.code;
+    receiver.lastCodeAt = now;
+    if (!isNewPress) {
+        return;
+    }
+    portENTER_CRITICAL(&statsLock);
+    receiver.stats.numCodes++;
+    portEXIT_CRITICAL(&statsLock);
+
+    ReceivedCodeContext context = { .code = code, .receivedAt = now };
+    HAPError err = HAPPlatformRunLoopScheduleCallback(HandleReceivedCode, &context, sizeof context);
+    if (err) {
+        HAPLogError(&kHAPLog_Default, "%s: Failed to schedule code: %u.", __func__, err);
+    }
+}
+
+static void ReceiveTask(void* _Nullable arg HAP_UNUSED) {
+    for (;;) {
+        size_t numBytes;
+        const rmt_item32_t* _Nullable items = xRingbufferReceive(receiver.ringBuffer, &numBytes, portMAX_DELAY);
+        if (!items) {
+            continue;
+        }
+        int64_t startedAt = esp_timer_get_time();
+        for (size_t i = 0; i < numBytes / sizeof *items; i++) {
+            Feed(items[i].level0, items[i].duration0);
+            // A zero duration marks the end of the capture, i.e. the line has been idle for the threshold.
+            Feed(items[i].level1, items[i].duration1 ? items[i].duration1 : kRfDecoder_EndOfCaptureUs);
+        }
+        vRingbufferReturnItem(receiver.ringBuffer, (void*) items);
+
+        int64_t busyUs = esp_timer_get_time() - startedAt;
+        portENTER_CRITICAL(&statsLock);
+        receiver.stats.numCaptures++;
+        receiver.stats.busyUs += (uint64_t) busyUs;
+        portEXIT_CRITICAL(&statsLock);
+    }
+}
+
+void RfReceiverStart(RfReceiverCodeCallback callback) {
+    HAPPrecondition(callback);
+    HAPPrecondition(!receiver.callback);
+
+    receiver.callback = callback;
+    receiver.startedAt = esp_timer_get_time();
+    RfDecoderReset(&receiver.decoder);
+
+    // 1 us ticks from the 1 MHz REF_TICK.
+    rmt_config_t config = RMT_DEFAULT_CONFIG_RX(CONFIG_GARAGE_RF_RECEIVER_GPIO, kRfReceiver_Channel);
+    config.clk_div = 1;
+    config.flags = RMT_CHANNEL_FLAGS_AWARE_DFS;
+    config.mem_block_num = kRfReceiver_NumMemoryBlocks;
+    config.rx_config.idle_threshold = kRfReceiver_IdleThresholdUs;
+    config.rx_config.filter_en = true;
+    config.rx_config.filter_ticks_thresh = UINT8_MAX;
+    ESP_ERROR_CHECK(rmt_config(&config));
+    ESP_ERROR_CHECK(rmt_driver_install(kRfReceiver_Channel, kRfReceiver_RingBufferBytes, 0));
+    ESP_ERROR_CHECK(rmt_get_ringbuf_handle(kRfReceiver_Channel, &receiver.ringBuffer));
+    ESP_ERROR_CHECK(rmt_rx_start(kRfReceiver_Channel, true));
+
+    // Below the HAP run loop, decoding only uses otherwise idle CPU time.
+    BaseType_t ok = xTaskCreate(ReceiveTask, "rf_receiver", 3 * 1024, NULL, tskIDLE_PRIORITY + 3, NULL);
+    HAPAssert(ok == pdPASS);
+}
+
+void RfReceiverGetStats(RfReceiverStats* stats) {
+    HAPPrecondition(stats);
+
+    portENTER_CRITICAL(&statsLock);
+    *stats = receiver.stats;
+    portEXIT_CRITICAL(&statsLock);
+    stats->uptimeUs = (uint64_t)(esp_timer_get_time() - receiver.startedAt);
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// 433 MHz receive pipeline.
+//
+// The output of an OOK receiver module is captured by an RMT channel. A low-priority task decodes the captures
+// (RfDecoder.h) and hands each button press, i.e. the first frame of a code after a short silence, to the run loop.
+// The receiver runs continuously, so the time spent decoding is measured and reported by RfReceiverGetStats.
+
+#ifndef RF_RECEIVER_H
+#define RF_RECEIVER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#include "RfDecoder.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Callback that is invoked on the run loop for each received button press.
+ *
+ * @param      code                 Code.
+ * @param      receivedAt           Time the code was decoded, from esp_timer_get_time.
+ */
+typedef void (*RfReceiverCodeCallback)(const RfCode* code, int64_t receivedAt);
+
+/**
+ * Receiver statistics.
+ */
+typedef struct {
+    /** Number of captures, i.e. bursts of activity on the receiver output. */
+    uint32_t numCaptures;
+
+    /** Number of button presses handed to the run loop. */
+    uint32_t numCodes;
+
+    /** Time spent decoding, in microseconds. */
+    uint64_t busyUs;
+
+    /** Time since the receiver was started, in microseconds. */
+    uint64_t uptimeUs;
+} RfReceiverStats;
+
+/**
+ * Starts capturing and decoding on the configured pin. Must be called after the run loop has been created.
+ *
+ * @param      callback             Function to call with received codes.
+ */
+void RfReceiverStart(RfReceiverCodeCallback callback);
+
+/**
+ * Copies the receiver statistics. May be called from any task.
+ *
+ * @param[out] stats                Statistics.
+ */
+void RfReceiverGetStats(RfReceiverStats* stats);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
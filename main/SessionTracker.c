@@ -0,0 +1,184 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "SessionTracker.h"
+
+#include "ReportFormat.h"
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+/**
+ * A command that arrives within this time after its session was accepted is considered to have opened the session.
+ */
+#define kSessionTracker_ColdWindowUs ((int64_t) 10 * 1000 * 1000)
+
+#define kSessionTracker_WarmWindowUs ((int64_t) CONFIG_GARAGE_HAP_SESSION_WARM_WINDOW_S * 1000 * 1000)
+
+typedef struct {
+    const HAPSessionRef* _Nullable session;
+    int64_t acceptedAt;
+
+    /** Time of the last request, or of the accept if there was none. */
+    int64_t lastActiveAt;
+    uint32_t numRequests;
+    uint32_t numCommands;
+} TrackedSession;
+
+static TrackedSession sessions[CONFIG_GARAGE_HAP_SESSIONS];
+
+/**
+ * Protects sessions against torn reads by SessionTrackerSerialize. Only the run loop writes.
+ */
+static portMUX_TYPE sessionsLock = portMUX_INITIALIZER_UNLOCKED;
+
+static TrackedSession* _Nullable FindSession(const HAPSessionRef* _Nullable session) {
+    for (size_t i = 0; i < HAPArrayCount(sessions); i++) {
+        if (sessions[i].session == session) {
+            return &sessions[i];
+        }
+    }
+    return NULL;
+}
+
+void SessionTrackerHandleAccept(const HAPSessionRef* session) {
+    HAPPrecondition(session);
+
+    TrackedSession* _Nullable trackedSession = FindSession(session);
+    if (!trackedSession) {
+        trackedSession = FindSession(NULL);
+    }
+    if (!trackedSession) {
+        HAPLogError(&kHAPLog_Default, "%s: No free slot to track session.", __func__);
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&sessionsLock);
+    trackedSession->session = session;
+    trackedSession->acceptedAt = now;
+    trackedSession->lastActiveAt = now;
+    trackedSession->numRequests = 0;
+    trackedSession->numCommands = 0;
+    portEXIT_CRITICAL(&sessionsLock);
+}
+
+void SessionTrackerHandleInvalidate(const HAPSessionRef* session) {
+    HAPPrecondition(session);
+
+    TrackedSession* _Nullable trackedSession = FindSession(session);
+    if (trackedSession) {
+        HAPLogDebug(
+                &kHAPLog_Default,
+                "Session closed after %lld s with %u requests and %u commands.",
+                (long long) ((esp_timer_get_time() - trackedSession->acceptedAt) / 1000000),
+                (unsigned int) trackedSession->numRequests,
+                (unsigned int) trackedSession->numCommands);
+        portENTER_CRITICAL(&sessionsLock);
+        HAPRawBufferZero(trackedSession, sizeof *trackedSession);
+        portEXIT_CRITICAL(&sessionsLock);
+    }
+}
+
+void SessionTrackerHandleRequest(const HAPSessionRef* session) {
+    HAPPrecondition(session);
+
+    TrackedSession* _Nullable trackedSession = FindSession(session);
+    if (trackedSession) {
+        int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&sessionsLock);
+        trackedSession->lastActiveAt = now;
+        trackedSession->numRequests++;
+        portEXIT_CRITICAL(&sessionsLock);
+    }
+}
+
+SessionClass SessionTrackerClassifyCommand(const HAPSessionRef* session, int64_t receivedAt, int64_t* startedAt) {
+    HAPPrecondition(session);
+    HAPPrecondition(startedAt);
+
+    TrackedSession* _Nullable trackedSession = FindSession(session);
+    if (!trackedSession) {
+        *startedAt = receivedAt;
+        return kSessionClass_Cold;
+    }
+
+    SessionClass sessionClass;
+    if (!trackedSession->numCommands && receivedAt - trackedSession->acceptedAt <= kSessionTracker_ColdWindowUs) {
+        *startedAt = trackedSession->acceptedAt;
+        sessionClass = kSessionClass_Cold;
+    } else if (receivedAt - trackedSession->lastActiveAt > kSessionTracker_WarmWindowUs) {
+        *startedAt = receivedAt;
+        sessionClass = kSessionClass_Idle;
+    } else {
+        *startedAt = receivedAt;
+        sessionClass = kSessionClass_Warm;
+    }
+    portENTER_CRITICAL(&sessionsLock);
+    trackedSession->lastActiveAt = receivedAt;
+    trackedSession->numRequests++;
+    trackedSession->numCommands++;
+    portEXIT_CRITICAL(&sessionsLock);
+    return sessionClass;
+}
+
+size_t SessionTrackerGetNumSessions(void) {
+    size_t numSessions = 0;
+    for (size_t i = 0; i < HAPArrayCount(sessions); i++) {
+        if (sessions[i].session) {
+            numSessions++;
+        }
+    }
+    return numSessions;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError SessionTrackerSerialize(char* bytes, size_t maxBytes, size_t* numBytes) {
+    HAPPrecondition(bytes);
+    HAPPrecondition(numBytes);
+
+    TrackedSession snapshot[HAPArrayCount(sessions)];
+    portENTER_CRITICAL(&sessionsLock);
+    HAPRawBufferCopyBytes(snapshot, sessions, sizeof sessions);
+    portEXIT_CRITICAL(&sessionsLock);
+    int64_t now = esp_timer_get_time();
+
+    size_t offset = 0;
+    HAPError err = ReportFormatAppend(
+            bytes,
+            maxBytes,
+            &offset,
+            "{\"slots\":%u,\"warmWindowS\":%u,\"sessions\":[",
+            (unsigned int) CONFIG_GARAGE_HAP_SESSIONS,
+            (unsigned int) CONFIG_GARAGE_HAP_SESSION_WARM_WINDOW_S);
+    bool isFirst = true;
+    for (size_t i = 0; !err && i < HAPArrayCount(snapshot); i++) {
+        const TrackedSession* trackedSession = &snapshot[i];
+        if (!trackedSession->session) {
+            continue;
+        }
+        int64_t idleUs = now - trackedSession->lastActiveAt;
+        err = ReportFormatAppend(
+                bytes,
+                maxBytes,
+                &offset,
+                "%s{\"ageS\":%lu,\"idleS\":%lu,\"warm\":%s,\"requests\":%lu,\"commands\":%lu}",
+                isFirst ? "" : ",",
+                (unsigned long) ((now - trackedSession->acceptedAt) / 1000000),
+                (unsigned long) (idleUs / 1000000),
+                idleUs <= kSessionTracker_WarmWindowUs ? "true" : "false",
+                (unsigned long) trackedSession->numRequests,
+                (unsigned long) trackedSession->numCommands);
+        isFirst = false;
+    }
+    if (!err) {
+        err = ReportFormatAppend(bytes, maxBytes, &offset, "]}");
+    }
+    if (err) {
+        return err;
+    }
+    *numBytes = offset;
+    return kHAPError_None;
+}
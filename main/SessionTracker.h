@@ -0,0 +1,104 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Tracking of HAP sessions to classify door commands by how warm the controller's connection was.
+//
+//   Cold     The session was accepted shortly before the command and carried no command before, so the controller
+//            had to open a TCP connection and run Pair Verify first. Latency is measured from the session accept.
+//   Warm     The session already existed and had been active within the warm window.
+//   Idle     The session already existed but had been idle for longer than the warm window. It was verified long
+//            ago and had not been closed yet. HAP session resume (BLE only) has no counterpart over IP.
+//
+// A session is active whenever a request arrives on it: reads, including the reads that deliver its event
+// notifications, subscriptions and commands.
+//
+// The tracker only observes sessions. The IP accessory server of the ADK decides when idle sessions are closed, and
+// it has no interface to prefer the sessions of paired controllers. Sessions are retained by giving the server
+// enough slots. The levers are the number of session slots (GARAGE_HAP_SESSIONS), which trades RAM for warm hits,
+// and the idle timeout after which a session no longer counts as warm (GARAGE_HAP_SESSION_WARM_WINDOW_S). Both are
+// reported by SessionTrackerSerialize together with the open sessions, and the warm and idle histograms show how many
+// commands still found their session open.
+//
+// All functions except SessionTrackerSerialize must be called on the run loop.
+
+#ifndef SESSION_TRACKER_H
+#define SESSION_TRACKER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Buffer size that fits the JSON object of SessionTrackerSerialize.
+ */
+#define kSessionTracker_MaxSerializedBytes ((size_t) 1536)
+
+/**
+ * Session class of a command.
+ */
+typedef enum { kSessionClass_Cold, kSessionClass_Warm, kSessionClass_Idle } SessionClass;
+
+/**
+ * Records that a session has been accepted.
+ */
+void SessionTrackerHandleAccept(const HAPSessionRef* session);
+
+/**
+ * Records that a session has been invalidated.
+ */
+void SessionTrackerHandleInvalidate(const HAPSessionRef* session);
+
+/**
+ * Marks a session as active because a request other than a command has been received on it.
+ */
+void SessionTrackerHandleRequest(const HAPSessionRef* session);
+
+/**
+ * Classifies a command received on a session and marks the session as active.
+ *
+ * @param      session              Session that the command was received on.
+ * @param      receivedAt           Time the command was received, from esp_timer_get_time.
+ * @param[out] startedAt            Time from which the latency of the command is measured.
+ *
+ * @return Session class of the command.
+ */
+HAP_RESULT_USE_CHECK
+SessionClass SessionTrackerClassifyCommand(const HAPSessionRef* session, int64_t receivedAt, int64_t* startedAt);
+
+/**
+ * Returns the number of sessions that are currently open.
+ */
+HAP_RESULT_USE_CHECK
+size_t SessionTrackerGetNumSessions(void);
+
+/**
+ * Serializes the retention settings and the open sessions as a JSON object. May be called from any task.
+ *
+ * @param[out] bytes                Buffer.
+ * @param      maxBytes             Capacity of buffer.
+ * @param[out] numBytes             Length of the JSON object, excluding the NULL terminator.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the buffer is too small.
+ */
+HAP_RESULT_USE_CHECK
+HAPError SessionTrackerSerialize(char* bytes, size_t maxBytes, size_t* numBytes);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "SubscriptionIndex.h"
+
+static SubscriptionIndexEntry subscriptionIndexEntries[kSubscriptionIndex_MaxCharacteristics];
+
+static SubscriptionIndexTable subscriptionIndex = {
+    .entries = subscriptionIndexEntries,
+    .maxEntries = HAPArrayCount(subscriptionIndexEntries),
+};
+
+static SubscriptionIndexEntry* _Nullable FindEntry(
+        const SubscriptionIndexTable* table,
+        const HAPCharacteristic* characteristic) {
+    for (size_t i = 0; i < table->numEntries; i++) {
+        if (table->entries[i].characteristic == characteristic) {
+            return &table->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void RemoveSession(SubscriptionIndexEntry* entry, HAPSessionRef* session) {
+    for (size_t i = 0; i < entry->numSessions; i++) {
+        if (entry->sessions[i] == session) {
+            entry->sessions[i] = entry->sessions[--entry->numSessions];
+            entry->sessions[entry->numSessions] = NULL;
+            return;
+        }
+    }
+}
+
+void SubscriptionIndexTableSubscribe(
+        SubscriptionIndexTable* table,
+        const HAPCharacteristic* characteristic,
+        HAPSessionRef* session) {
+    HAPPrecondition(table);
+    HAPPrecondition(characteristic);
+    HAPPrecondition(session);
+
+    SubscriptionIndexEntry* _Nullable entry = FindEntry(table, characteristic);
+    if (!entry) {
+        HAPAssert(table->numEntries < table->maxEntries);
+        entry = &table->entries[table->numEntries++];
+        entry->characteristic = characteristic;
+    }
+    for (size_t i = 0; i < entry->numSessions; i++) {
+        if (entry->sessions[i] == session) {
+            return;
+        }
+    }
+    HAPAssert(entry->numSessions < HAPArrayCount(entry->sessions));
+    entry->sessions[entry->numSessions++] = session;
+}
+
+HAP_RESULT_USE_CHECK
+bool SubscriptionIndexTableEnumerate(
+        const SubscriptionIndexTable* table,
+        const HAPCharacteristic* characteristic,
+        SubscriptionIndexEnumerateCallback callback,
+        void* _Nullable context) {
+    HAPPrecondition(table);
+    HAPPrecondition(characteristic);
+    HAPPrecondition(callback);
+
+    const SubscriptionIndexEntry* _Nullable entry = FindEntry(table, characteristic);
+    if (!entry) {
+        return false;
+    }
+    for (size_t i = 0; i < entry->numSessions; i++) {
+        callback(context, HAPNonnull(entry->sessions[i]));
+    }
+    return true;
+}
+
+void SubscriptionIndexHandleSubscribe(const HAPCharacteristic* characteristic, HAPSessionRef* session) {
+    SubscriptionIndexTableSubscribe(&subscriptionIndex, characteristic, session);
+}
+
+void SubscriptionIndexHandleUnsubscribe(const HAPCharacteristic* characteristic, HAPSessionRef* session) {
+    HAPPrecondition(characteristic);
+    HAPPrecondition(session);
+
+    SubscriptionIndexEntry* _Nullable entry = FindEntry(&subscriptionIndex, characteristic);
+    if (entry) {
+        RemoveSession(entry, session);
+    }
+}
+
+void SubscriptionIndexHandleSessionInvalidate(HAPSessionRef* session) {
+    HAPPrecondition(session);
+
+    for (size_t i = 0; i < subscriptionIndex.numEntries; i++) {
+        RemoveSession(&subscriptionIndex.entries[i], session);
+    }
+}
+
+void SubscriptionIndexRaiseEvent(
+        HAPAccessoryServerRef* server,
+        const HAPCharacteristic* characteristic,
+        const HAPService* service,
+        const HAPAccessory* accessory) {
+    HAPPrecondition(server);
+    HAPPrecondition(characteristic);
+    HAPPrecondition(service);
+    HAPPrecondition(accessory);
+
+    const SubscriptionIndexEntry* _Nullable entry = FindEntry(&subscriptionIndex, characteristic);
+    if (!entry) {
+        HAPAccessoryServerRaiseEvent(server, characteristic, service, accessory);
+        return;
+    }
+    for (size_t i = 0; i < entry->numSessions; i++) {
+        HAPAccessoryServerRaiseEventOnSession(
+                server, characteristic, service, accessory, HAPNonnull(entry->sessions[i]));
+    }
+}
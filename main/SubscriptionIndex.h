@@ -0,0 +1,141 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Subscribers of event-capable characteristics.
+//
+// HAPAccessoryServerRaiseEvent walks every session and looks the characteristic up in the session's event
+// notification table, whether anybody is subscribed or not. This index tracks the subscribed sessions of each
+// characteristic from the subscribe and unsubscribe callbacks, so raising an event only touches those sessions and
+// costs nothing when there are none.
+//
+// The accessory's index is kept internally. The SubscriptionIndexTable functions work on a separate index over
+// caller-provided entries, which the benchmark suite (Benchmark.h) uses to measure the fan-out on a bridge-sized
+// database with synthetic sessions. They may be called from any task that owns the table.
+//
+// All other functions must be called on the run loop.
+
+#ifndef SUBSCRIPTION_INDEX_H
+#define SUBSCRIPTION_INDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Maximum number of characteristics that can be indexed.
+ */
+#define kSubscriptionIndex_MaxCharacteristics ((size_t) 4)
+
+/**
+ * Subscribers of one characteristic.
+ */
+typedef struct {
+    const HAPCharacteristic* _Nullable characteristic;
+    HAPSessionRef* _Nullable sessions[CONFIG_GARAGE_HAP_SESSIONS];
+    size_t numSessions;
+} SubscriptionIndexEntry;
+
+/**
+ * Index over caller-provided entries.
+ */
+typedef struct {
+    /** Entries. Must be zeroed initially. */
+    SubscriptionIndexEntry* entries;
+
+    /** Capacity of entries. */
+    size_t maxEntries;
+
+    /** Number of entries in use. */
+    size_t numEntries;
+} SubscriptionIndexTable;
+
+/**
+ * Callback that is invoked for each session subscribed to a characteristic.
+ *
+ * @param      context              Context.
+ * @param      session              Subscribed session.
+ */
+typedef void (*SubscriptionIndexEnumerateCallback)(void* _Nullable context, HAPSessionRef* session);
+
+/**
+ * Records a subscription.
+ *
+ * @param      characteristic       Characteristic.
+ * @param      session              Subscribing session.
+ */
+void SubscriptionIndexHandleSubscribe(const HAPCharacteristic* characteristic, HAPSessionRef* session);
+
+/**
+ * Removes a subscription.
+ *
+ * @param      characteristic       Characteristic.
+ * @param      session              Unsubscribing session.
+ */
+void SubscriptionIndexHandleUnsubscribe(const HAPCharacteristic* characteristic, HAPSessionRef* session);
+
+/**
+ * Removes all subscriptions of a session that is going away.
+ *
+ * @param      session              Session.
+ */
+void SubscriptionIndexHandleSessionInvalidate(HAPSessionRef* session);
+
+/**
+ * Raises an event on the sessions subscribed to a characteristic.
+ *
+ * Characteristics that have never been subscribed to through this index fall back to HAPAccessoryServerRaiseEvent.
+ */
+void SubscriptionIndexRaiseEvent(
+        HAPAccessoryServerRef* server,
+        const HAPCharacteristic* characteristic,
+        const HAPService* service,
+        const HAPAccessory* accessory);
+
+/**
+ * Records a subscription in a table.
+ *
+ * @param      table                Table. Must have room for the characteristic if it is not indexed yet.
+ * @param      characteristic       Characteristic.
+ * @param      session              Subscribing session.
+ */
+void SubscriptionIndexTableSubscribe(
+        SubscriptionIndexTable* table,
+        const HAPCharacteristic* characteristic,
+        HAPSessionRef* session);
+
+/**
+ * Enumerates the sessions subscribed to a characteristic in a table.
+ *
+ * @param      table                Table.
+ * @param      characteristic       Characteristic.
+ * @param      callback             Function to call on each subscribed session.
+ * @param      context              Context that is passed to the callback.
+ *
+ * @return true                     If the characteristic is indexed.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+bool SubscriptionIndexTableEnumerate(
+        const SubscriptionIndexTable* table,
+        const HAPCharacteristic* characteristic,
+        SubscriptionIndexEnumerateCallback callback,
+        void* _Nullable context);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "SupplyLevel.h"
+
+void SupplyLevelClassifierCreate(
+        SupplyLevelClassifier* classifier,
+        uint32_t lowMV,
+        uint32_t criticalMV,
+        uint32_t hysteresisMV) {
+    HAPPrecondition(classifier);
+    HAPPrecondition(criticalMV <= lowMV);
+
+    HAPRawBufferZero(classifier, sizeof *classifier);
+    classifier->lowMV = lowMV;
+    classifier->criticalMV = criticalMV;
+    classifier->hysteresisMV = hysteresisMV;
+    classifier->level = kSupplyLevel_Normal;
+}
+
+bool SupplyLevelClassifierFeed(SupplyLevelClassifier* classifier, uint32_t supplyMV) {
+    HAPPrecondition(classifier);
+
+    SupplyLevel level;
+    if (supplyMV < classifier->criticalMV) {
+        level = kSupplyLevel_Critical;
+    } else if (supplyMV < classifier->lowMV) {
+        level = kSupplyLevel_Low;
+    } else {
+        level = kSupplyLevel_Normal;
+    }
+
+    // Recovering requires the margin above the threshold that has been crossed.
+    if (level < classifier->level) {
+        uint32_t thresholdMV = classifier->level == kSupplyLevel_Critical ? classifier->criticalMV : classifier->lowMV;
+        if (supplyMV < thresholdMV + classifier->hysteresisMV) {
+            return false;
+        }
+        if (level == kSupplyLevel_Normal && classifier->level == kSupplyLevel_Critical &&
+            supplyMV < classifier->lowMV + classifier->hysteresisMV) {
+            level = kSupplyLevel_Low;
+        }
+    }
+    if (level == classifier->level) {
+        return false;
+    }
+    classifier->level = level;
+    return true;
+}
+
+const char* SupplyLevelGetName(SupplyLevel level) {
+    switch (level) {
+        case kSupplyLevel_Normal: {
+            return "normal";
+        }
+        case kSupplyLevel_Low: {
+            return "low";
+        }
+        case kSupplyLevel_Critical: {
+            return "critical";
+        }
+    }
+    HAPFatalError();
+}
@@ -0,0 +1,93 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Supply level classification.
+//
+// Classifies averaged supply voltages against a low and a critical threshold. The level drops as soon as a voltage
+// is below a threshold and only recovers once the voltage is back above the threshold plus the hysteresis, so a
+// supply that hovers around a threshold does not toggle load shedding.
+//
+// The classifier consumes voltages in millivolts. It is platform-independent and does not allocate, so recorded
+// voltage traces can be replayed through it (host_test/SupplyLevelTest.c).
+
+#ifndef SUPPLY_LEVEL_H
+#define SUPPLY_LEVEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Supply level, ordered by severity.
+ */
+typedef enum {
+    kSupplyLevel_Normal,
+
+    /** Below the low threshold. Loads are shed that are not needed to operate the door. */
+    kSupplyLevel_Low,
+
+    /** Below the critical threshold. A brown-out is imminent, actuations are refused. */
+    kSupplyLevel_Critical
+} SupplyLevel;
+
+/**
+ * Classifier state.
+ */
+typedef struct {
+    uint32_t lowMV;
+    uint32_t criticalMV;
+    uint32_t hysteresisMV;
+
+    SupplyLevel level;
+} SupplyLevelClassifier;
+
+/**
+ * Initializes a classifier at kSupplyLevel_Normal.
+ *
+ * @param[out] classifier           Classifier.
+ * @param      lowMV                Low threshold.
+ * @param      criticalMV           Critical threshold. Must not exceed the low threshold.
+ * @param      hysteresisMV         Margin above a threshold for the level to recover.
+ */
+void SupplyLevelClassifierCreate(
+        SupplyLevelClassifier* classifier,
+        uint32_t lowMV,
+        uint32_t criticalMV,
+        uint32_t hysteresisMV);
+
+/**
+ * Classifies the next averaged voltage.
+ *
+ * @param      classifier           Classifier.
+ * @param      supplyMV             Supply voltage.
+ *
+ * @return true                     If the level has changed. It is available in classifier->level.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+bool SupplyLevelClassifierFeed(SupplyLevelClassifier* classifier, uint32_t supplyMV);
+
+/**
+ * Returns the name of a level for logging and reports.
+ */
+HAP_RESULT_USE_CHECK
+const char* SupplyLevelGetName(SupplyLevel level);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
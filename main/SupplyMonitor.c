@@ -0,0 +1,168 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "SupplyMonitor.h"
+
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/**
+ * Lowest sample rate of the ESP32 continuous mode.
+ */
+#define kSupplyMonitor_SampleRateHz ((uint32_t) 20000)
+
+/**
+ * Bytes per conversion frame, i.e. per wake-up of the monitor task. 2000 samples of 2 bytes, 100 ms at the sample
+ * rate.
+ */
+#define kSupplyMonitor_FrameBytes ((uint32_t) 4000)
+
+/**
+ * ADC input range up to about 2.5 V.
+ */
+#define kSupplyMonitor_Attenuation ADC_ATTEN_DB_11
+
+/**
+ * Reference voltage for chips without eFuse calibration.
+ */
+#define kSupplyMonitor_DefaultVrefMV ((uint32_t) 1100)
+
+static struct {
+    SupplyMonitorLevelCallback callback;
+    SupplyLevelClassifier classifier;
+    esp_adc_cal_characteristics_t characteristics;
+    uint8_t frame[kSupplyMonitor_FrameBytes];
+
+    SupplyMonitorStats stats;
+} monitor;
+
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+typedef struct {
+    SupplyLevel level;
+    uint32_t supplyMV;
+} LevelChangedContext;
+
+static void HandleLevelChanged(void* _Nullable context, size_t contextSize) {
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(LevelChangedContext));
+    const LevelChangedContext* levelChanged = context;
+
+    monitor.callback(levelChanged->level, levelChanged->supplyMV);
+}
+
+/**
+ * Returns the average raw value of the monitored channel in a frame, or UINT32_MAX if it has no samples.
+ */
+static uint32_t AverageFrame(const uint8_t* bytes, uint32_t numBytes) {
+    uint32_t sum = 0;
+    uint32_t numSamples = 0;
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= numBytes; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        const adc_digi_output_data_t* sample = (const adc_digi_output_data_t*) &bytes[i];
+        if (sample->type1.channel != CONFIG_GARAGE_SUPPLY_MONITOR_ADC_CHANNEL) {
+            continue;
+        }
+        sum += sample->type1.data;
+        numSamples++;
+    }
+    return numSamples ? sum / numSamples : UINT32_MAX;
+}
+
+static void MonitorTask(void* _Nullable arg HAP_UNUSED) {
+    for (;;) {
+        uint32_t numBytes = 0;
+        esp_err_t err = adc_digi_read_bytes(monitor.frame, sizeof monitor.frame, &numBytes, ADC_MAX_DELAY);
+        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+            continue;
+        }
+        // ESP_ERR_INVALID_STATE reports that older frames have been dropped, the data read is still valid.
+        uint32_t raw = AverageFrame(monitor.frame, numBytes);
+        if (raw == UINT32_MAX) {
+            continue;
+        }
+        uint32_t adcMV = esp_adc_cal_raw_to_voltage(raw, &monitor.characteristics);
+        uint32_t supplyMV = adcMV * CONFIG_GARAGE_SUPPLY_DIVIDER_GAIN_PERCENT / 100;
+
+        bool isLevelChanged = SupplyLevelClassifierFeed(&monitor.classifier, supplyMV);
+        portENTER_CRITICAL(&statsLock);
+        monitor.stats.level = monitor.classifier.level;
+        monitor.stats.supplyMV = supplyMV;
+        if (!monitor.stats.numFrames || supplyMV < monitor.stats.minSupplyMV) {
+            monitor.stats.minSupplyMV = supplyMV;
+        }
+        monitor.stats.numFrames++;
+        if (isLevelChanged) {
+            monitor.stats.numLevelChanges++;
+        }
+        portEXIT_CRITICAL(&statsLock);
+
+        if (isLevelChanged) {
+            LevelChangedContext context = { .level = monitor.classifier.level, .supplyMV = supplyMV };
+            HAPError hapErr = HAPPlatformRunLoopScheduleCallback(HandleLevelChanged, &context, sizeof context);
+            if (hapErr) {
+                HAPLogError(&kHAPLog_Default, "%s: Failed to schedule level change: %u.", __func__, hapErr);
+            }
+        }
+    }
+}
+
+void SupplyMonitorStart(SupplyMonitorLevelCallback callback) {
+    HAPPrecondition(callback);
+    HAPPrecondition(!monitor.callback);
+
+    monitor.callback = callback;
+    SupplyLevelClassifierCreate(
+            &monitor.classifier,
+            CONFIG_GARAGE_SUPPLY_LOW_MV,
+            CONFIG_GARAGE_SUPPLY_CRITICAL_MV,
+            CONFIG_GARAGE_SUPPLY_HYSTERESIS_MV);
+    esp_adc_cal_characterize(
+            ADC_UNIT_1,
+            kSupplyMonitor_Attenuation,
+            ADC_WIDTH_BIT_12,
+            kSupplyMonitor_DefaultVrefMV,
+            &monitor.characteristics);
+
+    adc_digi_init_config_t initConfig = {
+        .max_store_buf_size = 2 * kSupplyMonitor_FrameBytes,
+        .conv_num_each_intr = kSupplyMonitor_FrameBytes,
+        .adc1_chan_mask = BIT(CONFIG_GARAGE_SUPPLY_MONITOR_ADC_CHANNEL),
+        .adc2_chan_mask = 0,
+    };
+    ESP_ERROR_CHECK(adc_digi_initialize(&initConfig));
+
+    adc_digi_pattern_config_t pattern = {
+        .atten = kSupplyMonitor_Attenuation,
+        .channel = CONFIG_GARAGE_SUPPLY_MONITOR_ADC_CHANNEL,
+        .unit = 0,
+        .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+    };
+    adc_digi_configuration_t config = {
+        .conv_limit_en = true,
+        .conv_limit_num = 250,
+        .pattern_num = 1,
+        .adc_pattern = &pattern,
+        .sample_freq_hz = kSupplyMonitor_SampleRateHz,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+    };
+    ESP_ERROR_CHECK(adc_digi_controller_configure(&config));
+    ESP_ERROR_CHECK(adc_digi_start());
+
+    // Averaging a frame takes well below a millisecond; the priority only needs to keep level changes timely.
+    BaseType_t ok = xTaskCreate(MonitorTask, "supply_monitor", 3 * 1024, NULL, tskIDLE_PRIORITY + 3, NULL);
+    HAPAssert(ok == pdPASS);
+}
+
+void SupplyMonitorGetStats(SupplyMonitorStats* stats) {
+    HAPPrecondition(stats);
+
+    portENTER_CRITICAL(&statsLock);
+    *stats = monitor.stats;
+    portEXIT_CRITICAL(&statsLock);
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Supply voltage monitor.
+//
+// Samples the supply through a voltage divider on an ADC1 channel in continuous mode. The samples are moved by DMA;
+// the monitor task is only woken once per conversion frame of about 100 ms, averages the frame and converts it to
+// the supply voltage with the eFuse calibration. Frame averages are classified with SupplyLevel.h, level changes are
+// reported on the run loop.
+
+#ifndef SUPPLY_MONITOR_H
+#define SUPPLY_MONITOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#include "SupplyLevel.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Callback that is invoked on the run loop when the supply level changes.
+ *
+ * @param      level                New level.
+ * @param      supplyMV             Averaged supply voltage that caused the change.
+ */
+typedef void (*SupplyMonitorLevelCallback)(SupplyLevel level, uint32_t supplyMV);
+
+/**
+ * Monitor statistics.
+ */
+typedef struct {
+    SupplyLevel level;
+
+    /** Most recent frame average. */
+    uint32_t supplyMV;
+
+    /** Lowest frame average since the monitor was started. */
+    uint32_t minSupplyMV;
+
+    /** Number of frames. */
+    uint32_t numFrames;
+
+    /** Number of level changes. */
+    uint32_t numLevelChanges;
+} SupplyMonitorStats;
+
+/**
+ * Starts sampling. Must be called after the run loop has been created.
+ *
+ * @param      callback             Function to call on level changes.
+ */
+void SupplyMonitorStart(SupplyMonitorLevelCallback callback);
+
+/**
+ * Copies the monitor statistics. May be called from any task.
+ *
+ * @param[out] stats                Statistics.
+ */
+void SupplyMonitorGetStats(SupplyMonitorStats* stats);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
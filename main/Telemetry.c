@@ -0,0 +1,317 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "Telemetry.h"
+
+#include "CommandSlo.h"
+#include "CpuUsage.h"
+#include "FlashWriteScheduler.h"
+#include "Metrics.h"
+#include "Placement.h"
+#include "TelemetryJournal.h"
+#include "TelemetryStore.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+/**
+ * Columns of the history.
+ */
+typedef enum {
+    /** Wi-Fi RSSI in dBm, 0 if not connected. */
+    kColumn_RSSI,
+
+    /** Free heap in bytes. */
+    kColumn_FreeHeap,
+
+    /** Delay until a callback scheduled from another task runs on the run loop, in microseconds. */
+    kColumn_RunLoopLatency,
+
+    /** Mean command latency since the previous sample, in microseconds. 0 if there was no command. */
+    kColumn_CommandLatency,
+
+    /** Idle time of core 0 and core 1 since the previous sample, in permille (CpuUsage.h). */
+    kColumn_Core0Idle,
+    kColumn_Core1Idle,
+
+    /** CPU time of the HAP run loop since the previous sample, in permille of one core. */
+    kColumn_RunLoopCPU,
+
+    /** CPU time of the Wi-Fi and lwIP tasks since the previous sample, in permille of one core. */
+    kColumn_NetworkCPU,
+
+    /** Door commands that met their objective over the window, in permille (CommandSlo.h). */
+    kColumn_SloCompliance,
+
+    /** 95th percentile of the door command end latency over the window, in milliseconds. */
+    kColumn_SloP95,
+
+    kColumn_Count
+} Column;
+HAP_STATIC_ASSERT(kColumn_Count <= kTelemetryStore_MaxColumns, Telemetry_columns);
+
+static const TelemetryColumnType columnTypes[kColumn_Count] = {
+    [kColumn_RSSI] = kTelemetryColumnType_Int,
+    [kColumn_FreeHeap] = kTelemetryColumnType_Int,
+    [kColumn_RunLoopLatency] = kTelemetryColumnType_Int,
+    [kColumn_CommandLatency] = kTelemetryColumnType_Int,
+    [kColumn_Core0Idle] = kTelemetryColumnType_Int,
+    [kColumn_Core1Idle] = kTelemetryColumnType_Int,
+    [kColumn_RunLoopCPU] = kTelemetryColumnType_Int,
+    [kColumn_NetworkCPU] = kTelemetryColumnType_Int,
+    [kColumn_SloCompliance] = kTelemetryColumnType_Int,
+    [kColumn_SloP95] = kTelemetryColumnType_Int,
+};
+
+static const char kCSVHeader[] =
+        "time,rssi,freeHeap,runLoopLatency,commandLatency,core0Idle,core1Idle,runLoopCpu,networkCpu,sloCompliance,"
+        "sloP95,level\n";
+
+/**
+ * Metrics that contribute to the command latency column.
+ */
+static const Metric commandLatencyMetrics[] = {
+    kMetric_CommandLatencyHAP,
+    kMetric_CommandLatencyLocalControl,
+    kMetric_CommandLatencyMQTT,
+};
+
+#define kTelemetry_NumBlocks (CONFIG_GARAGE_TELEMETRY_BUDGET_BYTES / sizeof(TelemetryBlock))
+HAP_STATIC_ASSERT(kTelemetry_NumBlocks >= 3 && kTelemetry_NumBlocks <= UINT8_MAX, TelemetryBudget_out_of_range);
+
+/**
+ * Bulk storage (Placement.h). Touched once per sampling interval and by exports.
+ */
+static EXT_RAM_ATTR struct {
+    TelemetryBlock blocks[kTelemetry_NumBlocks];
+    uint8_t order[kTelemetry_NumBlocks];
+
+    /** Protects the store. Appends happen on the run loop, exports on the consumer's task. */
+    SemaphoreHandle_t lock;
+    TelemetryStore store;
+
+    esp_timer_handle_t timer;
+
+    /** Command latency totals at the previous sample. */
+    uint64_t commandLatencySumUs;
+    uint32_t commandCount;
+
+    /** Sealed block waiting to be journaled. Only accessed on the run loop. */
+    TelemetryBlock sealedBlock;
+} telemetry;
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static void Sample(void* _Nullable context, size_t contextSize) {
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(int64_t));
+
+    int64_t scheduledAt = *(const int64_t*) context;
+    int64_t now = esp_timer_get_time();
+
+    uint64_t commandLatencySumUs = 0;
+    uint32_t commandCount = 0;
+    for (size_t i = 0; i < HAPArrayCount(commandLatencyMetrics); i++) {
+        MetricsHistogram histogram;
+        MetricsGetHistogram(commandLatencyMetrics[i], &histogram);
+        commandLatencySumUs += histogram.sumUs;
+        commandCount += histogram.count;
+    }
+
+    wifi_ap_record_t apInfo;
+    TelemetryValue values[kColumn_Count];
+    values[kColumn_RSSI].intValue = esp_wifi_sta_get_ap_info(&apInfo) == ESP_OK ? apInfo.rssi : 0;
+    values[kColumn_FreeHeap].intValue = (int32_t) esp_get_free_heap_size();
+    values[kColumn_RunLoopLatency].intValue = (int32_t)(now - scheduledAt);
+    values[kColumn_CommandLatency].intValue =
+            commandCount != telemetry.commandCount ?
+                    (int32_t)((commandLatencySumUs - telemetry.commandLatencySumUs) /
+                              (commandCount - telemetry.commandCount)) :
+                    0;
+    telemetry.commandLatencySumUs = commandLatencySumUs;
+    telemetry.commandCount = commandCount;
+
+    CpuUsageSummary cpuUsage;
+    CpuUsageSample(&cpuUsage);
+    values[kColumn_Core0Idle].intValue = cpuUsage.idlePermille[0];
+    values[kColumn_Core1Idle].intValue = cpuUsage.idlePermille[1];
+    values[kColumn_RunLoopCPU].intValue = cpuUsage.runLoopPermille;
+    values[kColumn_NetworkCPU].intValue = cpuUsage.networkPermille;
+
+    CommandSloSummary slo;
+    CommandSloGetSummary(&slo);
+    values[kColumn_SloCompliance].intValue = slo.compliancePermille;
+    values[kColumn_SloP95].intValue = (int32_t)(slo.p95Us / 1000);
+
+    xSemaphoreTake(telemetry.lock, portMAX_DELAY);
+    TelemetryStoreAppend(&telemetry.store, (uint32_t)(now / 1000), values);
+    xSemaphoreGive(telemetry.lock);
+}
+
+static void WriteSealedBlock(void) {
+    TelemetryJournalAppend(&telemetry.sealedBlock);
+}
+
+static FlashWrite sealedBlockWrite = { .name = "telemetry journal", .callback = WriteSealedBlock };
+
+static void HandleBlockSealed(void* _Nullable context HAP_UNUSED, const TelemetryBlock* block) {
+    if (sealedBlockWrite.requestedAt) {
+        // The previous block has not been written yet. Blocks take minutes to fill, so this is rare.
+        WriteSealedBlock();
+    }
+    telemetry.sealedBlock = *block;
+    FlashWriteSchedulerRequest(&sealedBlockWrite);
+}
+
+static void HandleSampleTimer(void* arg HAP_UNUSED) {
+    // Sampling on the run loop measures how long it takes to get there.
+    int64_t scheduledAt = esp_timer_get_time();
+    HAPError err = HAPPlatformRunLoopScheduleCallback(Sample, &scheduledAt, sizeof scheduledAt);
+    if (err) {
+        HAPLogError(&kHAPLog_Default, "%s: Failed to schedule sample: %u.", __func__, err);
+    }
+}
+
+void TelemetryStart(void) {
+    HAPPrecondition(!telemetry.lock);
+
+    telemetry.lock = xSemaphoreCreateMutex();
+    HAPAssert(telemetry.lock);
+    TelemetryStoreCreate(
+            &telemetry.store,
+            columnTypes,
+            kColumn_Count,
+            telemetry.blocks,
+            telemetry.order,
+            HAPArrayCount(telemetry.blocks));
+    if (!TelemetryJournalOpen()) {
+        TelemetryStoreSetBlockSealedCallback(&telemetry.store, HandleBlockSealed, NULL);
+    }
+
+    const esp_timer_create_args_t timerArgs = { .callback = HandleSampleTimer, .name = "telemetry" };
+    ESP_ERROR_CHECK(esp_timer_create(&timerArgs, &telemetry.timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(telemetry.timer, CONFIG_GARAGE_TELEMETRY_INTERVAL_S * 1000000LL));
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Context for exporting the history as CSV.
+ */
+typedef struct {
+    TelemetryExportCallback callback;
+    void* _Nullable context;
+    HAPError err;
+
+    /** Newest exported timestamp. Skips samples that are seen twice because the history was compacted. */
+    uint32_t time;
+    bool hasTime;
+
+    size_t numBytes;
+    char bytes[512];
+} ExportContext;
+
+static void FlushExport(ExportContext* export) {
+    if (!export->err && export->numBytes) {
+        export->err = export->callback(export->context, export->bytes, export->numBytes);
+    }
+    export->numBytes = 0;
+}
+
+static void ExportSample(
+        void* _Nullable context,
+        uint32_t time,
+        const TelemetryValue* values,
+        uint8_t level,
+        bool* shouldContinue) {
+    HAPPrecondition(context);
+    ExportContext* export = context;
+
+    if (export->hasTime && time <= export->time) {
+        return;
+    }
+    export->time = time;
+    export->hasTime = true;
+
+    if (sizeof export->bytes - export->numBytes < 120) {
+        FlushExport(export);
+        if (export->err) {
+            *shouldContinue = false;
+            return;
+        }
+    }
+    int n = snprintf(
+            &export->bytes[export->numBytes],
+            sizeof export->bytes - export->numBytes,
+            "%u,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%u\n",
+            (unsigned int) time,
+            (int) values[kColumn_RSSI].intValue,
+            (int) values[kColumn_FreeHeap].intValue,
+            (int) values[kColumn_RunLoopLatency].intValue,
+            (int) values[kColumn_CommandLatency].intValue,
+            (int) values[kColumn_Core0Idle].intValue,
+            (int) values[kColumn_Core1Idle].intValue,
+            (int) values[kColumn_RunLoopCPU].intValue,
+            (int) values[kColumn_NetworkCPU].intValue,
+            (int) values[kColumn_SloCompliance].intValue,
+            (int) values[kColumn_SloP95].intValue,
+            level);
+    export->numBytes += (size_t) n;
+}
+
+HAPError TelemetryExportCSV(TelemetryExportCallback callback, void* _Nullable context) {
+    HAPPrecondition(callback);
+    HAPPrecondition(telemetry.lock);
+
+    ExportContext* export = calloc(1, sizeof *export);
+    TelemetryBlock* block = PlacementAllocateBulk(sizeof *block);
+    if (!export || !block) {
+        free(export);
+        free(block);
+        return kHAPError_OutOfResources;
+    }
+    export->callback = callback;
+    export->context = context;
+    export->err = callback(context, kCSVHeader, sizeof kCSVHeader - 1);
+
+    for (size_t age = 0; !export->err; age++) {
+        xSemaphoreTake(telemetry.lock, portMAX_DELAY);
+        const TelemetryBlock* _Nullable storedBlock = TelemetryStoreGetBlock(&telemetry.store, age);
+        if (storedBlock) {
+            *block = *storedBlock;
+        }
+        xSemaphoreGive(telemetry.lock);
+        if (!storedBlock) {
+            break;
+        }
+        TelemetryBlockEnumerateSamples(block, columnTypes, kColumn_Count, ExportSample, export);
+    }
+    FlushExport(export);
+
+    HAPError err = export->err;
+    free(export);
+    free(block);
+    return err;
+}
+
+void TelemetryGetUsage(size_t* numSamples, size_t* numBytes) {
+    HAPPrecondition(numSamples);
+    HAPPrecondition(numBytes);
+
+    if (!telemetry.lock) {
+        *numSamples = 0;
+        *numBytes = 0;
+        return;
+    }
+    xSemaphoreTake(telemetry.lock, portMAX_DELAY);
+    TelemetryStoreGetUsage(&telemetry.store, numSamples, numBytes);
+    xSemaphoreGive(telemetry.lock);
+}
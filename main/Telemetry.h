@@ -0,0 +1,64 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// On-device telemetry history.
+//
+// Samples Wi-Fi RSSI, free heap, run loop latency, the mean command latency, CPU utilization (CpuUsage.h) and door
+// command objective compliance (CommandSlo.h) at a fixed interval into a compressed time-series store
+// (TelemetryStore.h) with a fixed RAM budget.
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Start sampling. Must be called after the run loop has been created.
+ */
+void TelemetryStart(void);
+
+/**
+ * Callback that receives exported data.
+ *
+ * @param      context              Context.
+ * @param      bytes                Chunk of data.
+ * @param      numBytes             Length of the chunk.
+ *
+ * @return kHAPError_None           To continue the export.
+ * @return Any other error          To abort the export. The error is returned by the export function.
+ */
+typedef HAPError (*TelemetryExportCallback)(void* _Nullable context, const char* bytes, size_t numBytes);
+
+/**
+ * Stream the history as CSV, oldest sample first. May be called from any task.
+ *
+ * The store is only locked while copying one block at a time, so sampling is not held up by slow consumers.
+ */
+HAP_RESULT_USE_CHECK
+HAPError TelemetryExportCSV(TelemetryExportCallback callback, void* _Nullable context);
+
+/**
+ * Returns the number of samples in the history and the number of bytes they occupy.
+ */
+void TelemetryGetUsage(size_t* numSamples, size_t* numBytes);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,229 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "TelemetryJournal.h"
+
+#include <stddef.h>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include <esp_spi_flash.h>
+#include <esp_timer.h>
+
+/**
+ * Label of the journal partition.
+ */
+#define kTelemetryJournal_PartitionLabel "history"
+
+/**
+ * Marks a written record. Change when the layout of JournalRecord or the telemetry columns change.
+ */
+#define kTelemetryJournal_Magic ((uint32_t) 0x544A5233)
+
+#define kTelemetryJournal_SectorBytes ((size_t) SPI_FLASH_SEC_SIZE)
+
+/**
+ * Record of one telemetry block. Records never straddle a sector, so a sector erase only ever removes whole records.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;
+
+    /** CRC-32 of the remaining fields. */
+    uint32_t crc;
+
+    uint16_t numSamples;
+    uint16_t numBits;
+    uint8_t level;
+    uint8_t reserved[3];
+    uint8_t bytes[kTelemetryStore_BlockBytes];
+} JournalRecord;
+
+#define kTelemetryJournal_RecordsPerSector (kTelemetryJournal_SectorBytes / sizeof(JournalRecord))
+
+static struct {
+    const esp_partition_t* _Nullable partition;
+    size_t numSlots;
+
+    /** Slot that the next record is written to. */
+    size_t nextSlot;
+    uint32_t sequence;
+} journal;
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static size_t GetSlotOffset(size_t slot) {
+    return (slot / kTelemetryJournal_RecordsPerSector) * kTelemetryJournal_SectorBytes +
+           (slot % kTelemetryJournal_RecordsPerSector) * sizeof(JournalRecord);
+}
+
+static uint32_t GetRecordCRC(const JournalRecord* record) {
+    size_t start = offsetof(JournalRecord, numSamples);
+    return esp_rom_crc32_le(0, (const uint8_t*) record + start, (uint32_t)(sizeof *record - start));
+}
+
+static bool IsErased(const uint8_t* bytes, size_t numBytes) {
+    for (size_t i = 0; i < numBytes; i++) {
+        if (bytes[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+HAPError TelemetryJournalOpen(void) {
+    HAPPrecondition(!journal.partition);
+
+    const esp_partition_t* _Nullable partition = esp_partition_find_first(
+            ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, kTelemetryJournal_PartitionLabel);
+    if (!partition || partition->size < 2 * kTelemetryJournal_SectorBytes) {
+        HAPLogError(&kHAPLog_Default, "%s: No usable \"%s\" partition.", __func__, kTelemetryJournal_PartitionLabel);
+        return kHAPError_Unknown;
+    }
+    size_t numSlots = (partition->size / kTelemetryJournal_SectorBytes) * kTelemetryJournal_RecordsPerSector;
+
+    const void* mapped;
+    spi_flash_mmap_handle_t handle;
+    esp_err_t err = esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, &mapped, &handle);
+    if (err != ESP_OK) {
+        HAPLogError(&kHAPLog_Default, "%s: Failed to map partition: %d.", __func__, err);
+        return kHAPError_Unknown;
+    }
+
+    // Resume after the newest valid record.
+    bool found = false;
+    size_t newestSlot = 0;
+    uint32_t newestSequence = 0;
+    for (size_t slot = 0; slot < numSlots; slot++) {
+        const JournalRecord* record = (const JournalRecord*) ((const uint8_t*) mapped + GetSlotOffset(slot));
+        if (record->magic != kTelemetryJournal_Magic || record->crc != GetRecordCRC(record)) {
+            continue;
+        }
+        if (!found || (int32_t)(record->sequence - newestSequence) > 0) {
+            found = true;
+            newestSlot = slot;
+            newestSequence = record->sequence;
+        }
+    }
+    size_t nextSlot = found ? (newestSlot + 1) % numSlots : 0;
+
+    // A write that was interrupted by a reset leaves a partial record. Continue in the next sector, which is erased
+    // before it is written. A slot at the start of a sector is erased by the next append anyway, and usually still
+    // holds an old record once the journal has wrapped.
+    if (nextSlot % kTelemetryJournal_RecordsPerSector != 0 &&
+        !IsErased((const uint8_t*) mapped + GetSlotOffset(nextSlot), sizeof(JournalRecord))) {
+        size_t nextSector = nextSlot / kTelemetryJournal_RecordsPerSector + 1;
+        nextSlot = (nextSector * kTelemetryJournal_RecordsPerSector) % numSlots;
+    }
+    spi_flash_munmap(handle);
+
+    journal.partition = partition;
+    journal.numSlots = numSlots;
+    journal.nextSlot = nextSlot;
+    journal.sequence = found ? newestSequence + 1 : 0;
+    HAPLogInfo(
+            &kHAPLog_Default,
+            "Telemetry journal: %u slots, resuming at slot %u.",
+            (unsigned int) numSlots,
+            (unsigned int) nextSlot);
+    return kHAPError_None;
+}
+
+void TelemetryJournalAppend(const TelemetryBlock* block) {
+    HAPPrecondition(block);
+
+    if (!journal.partition) {
+        return;
+    }
+
+    size_t offset = GetSlotOffset(journal.nextSlot);
+    esp_err_t err;
+    if (journal.nextSlot % kTelemetryJournal_RecordsPerSector == 0) {
+        err = esp_partition_erase_range(journal.partition, offset, kTelemetryJournal_SectorBytes);
+        if (err != ESP_OK) {
+            HAPLogError(
+                    &kHAPLog_Default,
+                    "%s: Failed to erase sector at 0x%x: %d.",
+                    __func__,
+                    (unsigned int) offset,
+                    err);
+            return;
+        }
+    }
+
+    JournalRecord record = {
+        .magic = kTelemetryJournal_Magic,
+        .sequence = journal.sequence,
+        .numSamples = block->numSamples,
+        .numBits = block->numBits,
+        .level = block->level,
+    };
+    HAPRawBufferCopyBytes(record.bytes, block->bytes, sizeof record.bytes);
+    record.crc = GetRecordCRC(&record);
+
+    err = esp_partition_write(journal.partition, offset, &record, sizeof record);
+    if (err != ESP_OK) {
+        HAPLogError(
+                &kHAPLog_Default, "%s: Failed to write record at 0x%x: %d.", __func__, (unsigned int) offset, err);
+    }
+    journal.nextSlot = (journal.nextSlot + 1) % journal.numSlots;
+    journal.sequence++;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+HAPError TelemetryJournalExport(size_t offset, TelemetryJournalExportCallback callback, void* _Nullable context) {
+    HAPPrecondition(callback);
+
+    const esp_partition_t* _Nullable partition = journal.partition;
+    if (!partition) {
+        return kHAPError_InvalidState;
+    }
+    if (offset > partition->size) {
+        return kHAPError_InvalidData;
+    }
+
+    const void* mapped;
+    spi_flash_mmap_handle_t handle;
+    if (esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, &mapped, &handle) != ESP_OK) {
+        return kHAPError_OutOfResources;
+    }
+
+    HAPError err = kHAPError_None;
+    int64_t startTime = esp_timer_get_time();
+    size_t numBytesExported = 0;
+    while (!err && offset < partition->size) {
+        // Frames after a resumed offset are realigned to frame boundaries.
+        size_t numBytes = kTelemetryJournal_MaxFrameBytes - offset % kTelemetryJournal_MaxFrameBytes;
+        if (numBytes > partition->size - offset) {
+            numBytes = partition->size - offset;
+        }
+        const uint8_t* payload = (const uint8_t*) mapped + offset;
+
+        uint8_t header[kTelemetryJournal_FrameHeaderBytes];
+        HAPWriteLittleUInt32(&header[0], (uint32_t) offset);
+        HAPWriteLittleUInt32(&header[4], (uint32_t) numBytes);
+        HAPWriteLittleUInt32(&header[8], esp_rom_crc32_le(0, payload, (uint32_t) numBytes));
+        err = callback(context, header, sizeof header);
+        if (!err) {
+            err = callback(context, payload, numBytes);
+        }
+        if (!err) {
+            offset += numBytes;
+            numBytesExported += numBytes;
+        }
+    }
+    spi_flash_munmap(handle);
+
+    int64_t durationUs = esp_timer_get_time() - startTime;
+    HAPLogInfo(
+            &kHAPLog_Default,
+            "Telemetry journal export: %u bytes in %lld ms (%lld KiB/s)%s.",
+            (unsigned int) numBytesExported,
+            (long long) (durationUs / 1000),
+            (long long) (durationUs ? (int64_t) numBytesExported * 1000000 / 1024 / durationUs : 0),
+            err ? ", aborted" : "");
+    return err;
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Flash journal of telemetry blocks.
+//
+// Completed telemetry blocks are appended to the "history" data partition, which is used as a ring of fixed-size
+// records. Each record holds one block together with a sequence number and a CRC, so a reader can order the records
+// and skip torn or erased ones.
+//
+// The partition is exported without copying it into RAM: it is memory-mapped and streamed straight from the mapped
+// pages as a sequence of frames, each consisting of a 12-byte little-endian header followed by the payload:
+//
+//   uint32_t offset     Offset of the payload within the partition.
+//   uint32_t numBytes   Length of the payload.
+//   uint32_t crc        CRC-32 (IEEE 802.3) of the payload.
+//
+// An interrupted export is resumed by requesting the offset after the last frame with a valid CRC. A frame whose
+// CRC does not match was torn by a concurrent journal write and should be requested again.
+
+#ifndef TELEMETRY_JOURNAL_H
+#define TELEMETRY_JOURNAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#include "TelemetryStore.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Size of the frame header of an export.
+ */
+#define kTelemetryJournal_FrameHeaderBytes ((size_t) 12)
+
+/**
+ * Maximum payload size of a frame of an export.
+ */
+#define kTelemetryJournal_MaxFrameBytes ((size_t) 4096)
+
+/**
+ * Opens the journal and finds the position of the next record.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the partition does not exist. The journal stays disabled.
+ */
+HAP_RESULT_USE_CHECK
+HAPError TelemetryJournalOpen(void);
+
+/**
+ * Appends a block. Must be called on the run loop.
+ */
+void TelemetryJournalAppend(const TelemetryBlock* block);
+
+/**
+ * Callback for streaming an export.
+ *
+ * @param      context              Context.
+ * @param      bytes                Bytes to send. May point into memory-mapped flash.
+ * @param      numBytes             Length of bytes.
+ *
+ * @return kHAPError_None           If successful. Any other error aborts the export.
+ */
+typedef HAPError (*TelemetryJournalExportCallback)(void* _Nullable context, const void* bytes, size_t numBytes);
+
+/**
+ * Streams the journal partition from the given offset to its end.
+ *
+ * @param      offset               Offset within the partition to resume from.
+ * @param      callback             Function to call with the frame headers and payloads.
+ * @param      context              Context passed to the callback.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_InvalidState   If the journal is not open.
+ * @return kHAPError_InvalidData    If the offset is beyond the end of the partition.
+ * @return kHAPError_OutOfResources If the partition could not be mapped.
+ * @return Any error returned by the callback.
+ */
+HAP_RESULT_USE_CHECK
+HAPError TelemetryJournalExport(size_t offset, TelemetryJournalExportCallback callback, void* _Nullable context);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,516 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "TelemetryStore.h"
+
+#define kTelemetryStore_BlockBits (kTelemetryStore_BlockBytes * 8)
+
+/**
+ * Marks a column that has no XOR window yet.
+ */
+#define kNoWindow ((uint8_t) 0xFF)
+
+/**
+ * Variable-length bucket: a unary prefix selects the number of value bits.
+ */
+typedef struct {
+    uint8_t prefix;
+    uint8_t numPrefixBits;
+    uint8_t numValueBits;
+} Bucket;
+
+/**
+ * Buckets for non-zero timestamp delta-of-deltas (signed). A zero delta-of-delta is encoded as a single 0 bit.
+ */
+static const Bucket kTimeBuckets[] = {
+    { 0x2, 2, 7 },
+    { 0x6, 3, 9 },
+    { 0xE, 4, 12 },
+    { 0xF, 4, 32 },
+};
+
+/**
+ * Buckets for non-zero zigzag-encoded integer deltas (unsigned). A zero delta is encoded as a single 0 bit.
+ */
+static const Bucket kIntBuckets[] = {
+    { 0x2, 2, 6 },
+    { 0x6, 3, 13 },
+    { 0xE, 4, 20 },
+    { 0xF, 4, 32 },
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static void WriteBits(TelemetryBlock* block, uint32_t value, unsigned int numBits, bool* overflowed) {
+    if (*overflowed || block->numBits + numBits > kTelemetryStore_BlockBits) {
+        *overflowed = true;
+        return;
+    }
+    for (unsigned int i = numBits; i-- > 0;) {
+        if ((value >> i) & 1) {
+            block->bytes[block->numBits >> 3] |= (uint8_t)(0x80 >> (block->numBits & 7));
+        }
+        block->numBits++;
+    }
+}
+
+/**
+ * Truncates a block to the given number of bits.
+ */
+static void TruncateBits(TelemetryBlock* block, uint16_t numBits) {
+    size_t byte = numBits >> 3;
+    if (numBits & 7) {
+        block->bytes[byte] &= (uint8_t) ~(0xFF >> (numBits & 7));
+        byte++;
+    }
+    HAPRawBufferZero(&block->bytes[byte], sizeof block->bytes - byte);
+    block->numBits = numBits;
+}
+
+typedef struct {
+    const TelemetryBlock* block;
+    size_t position;
+} BitReader;
+
+static uint32_t ReadBits(BitReader* reader, unsigned int numBits) {
+    uint32_t value = 0;
+    for (unsigned int i = 0; i < numBits; i++) {
+        size_t position = reader->position++;
+        value = value << 1 | ((reader->block->bytes[position >> 3] >> (7 - (position & 7))) & 1);
+    }
+    return value;
+}
+
+/**
+ * Reads the unary bucket prefix that follows a leading 1 bit.
+ */
+static const Bucket* ReadBucket(BitReader* reader, const Bucket* buckets) {
+    size_t i = 0;
+    while (i < 3 && ReadBits(reader, 1)) {
+        i++;
+    }
+    return &buckets[i];
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static void EncodeTime(TelemetryBlock* block, TelemetryCodecState* state, uint32_t time, bool* overflowed) {
+    uint32_t delta = time - state->time;
+    int32_t deltaOfDelta = (int32_t)(delta - state->timeDelta);
+    if (!deltaOfDelta) {
+        WriteBits(block, 0, 1, overflowed);
+    } else {
+        for (size_t i = 0; i < HAPArrayCount(kTimeBuckets); i++) {
+            const Bucket* bucket = &kTimeBuckets[i];
+            int32_t limit = bucket->numValueBits == 32 ? INT32_MAX : (int32_t) 1 << (bucket->numValueBits - 1);
+            if (bucket->numValueBits == 32 || (deltaOfDelta >= -limit && deltaOfDelta < limit)) {
+                WriteBits(block, bucket->prefix, bucket->numPrefixBits, overflowed);
+                WriteBits(
+                        block,
+                        (uint32_t) deltaOfDelta & (uint32_t)((1ULL << bucket->numValueBits) - 1),
+                        bucket->numValueBits,
+                        overflowed);
+                break;
+            }
+        }
+    }
+    state->timeDelta = delta;
+    state->time = time;
+}
+
+static void DecodeTime(BitReader* reader, TelemetryCodecState* state) {
+    int32_t deltaOfDelta = 0;
+    if (ReadBits(reader, 1)) {
+        const Bucket* bucket = ReadBucket(reader, kTimeBuckets);
+        uint32_t raw = ReadBits(reader, bucket->numValueBits);
+        unsigned int shift = 32 - bucket->numValueBits;
+        deltaOfDelta = (int32_t)(raw << shift) >> shift;
+    }
+    state->timeDelta += (uint32_t) deltaOfDelta;
+    state->time += state->timeDelta;
+}
+
+static void EncodeInt(TelemetryBlock* block, uint32_t* previous, uint32_t value, bool* overflowed) {
+    int32_t delta = (int32_t)(value - *previous);
+    uint32_t zigzag = ((uint32_t) delta << 1) ^ (uint32_t)(delta >> 31);
+    if (!zigzag) {
+        WriteBits(block, 0, 1, overflowed);
+    } else {
+        for (size_t i = 0; i < HAPArrayCount(kIntBuckets); i++) {
+            const Bucket* bucket = &kIntBuckets[i];
+            if (bucket->numValueBits == 32 || zigzag < (uint32_t) 1 << bucket->numValueBits) {
+                WriteBits(block, bucket->prefix, bucket->numPrefixBits, overflowed);
+                WriteBits(block, zigzag, bucket->numValueBits, overflowed);
+                break;
+            }
+        }
+    }
+    *previous = value;
+}
+
+static void DecodeInt(BitReader* reader, uint32_t* previous) {
+    if (ReadBits(reader, 1)) {
+        const Bucket* bucket = ReadBucket(reader, kIntBuckets);
+        uint32_t zigzag = ReadBits(reader, bucket->numValueBits);
+        *previous += (zigzag >> 1) ^ (uint32_t) - (int32_t)(zigzag & 1);
+    }
+}
+
+static void EncodeFloat(
+        TelemetryBlock* block,
+        uint32_t* previous,
+        uint8_t* leadingZeros,
+        uint8_t* trailingZeros,
+        uint32_t value,
+        bool* overflowed) {
+    uint32_t xor = value ^ *previous;
+    if (!xor) {
+        WriteBits(block, 0, 1, overflowed);
+    } else {
+        uint8_t leading = (uint8_t) __builtin_clz(xor);
+        uint8_t trailing = (uint8_t) __builtin_ctz(xor);
+        if (*leadingZeros != kNoWindow && leading >= *leadingZeros && trailing >= *trailingZeros) {
+            // Meaningful bits fit into the previous window.
+            WriteBits(block, 0x2, 2, overflowed);
+            WriteBits(block, xor >> *trailingZeros, 32 - *leadingZeros - *trailingZeros, overflowed);
+        } else {
+            unsigned int numMeaningfulBits = 32 - leading - trailing;
+            WriteBits(block, 0x3, 2, overflowed);
+            WriteBits(block, leading, 5, overflowed);
+            WriteBits(block, numMeaningfulBits - 1, 5, overflowed);
+            WriteBits(block, xor >> trailing, numMeaningfulBits, overflowed);
+            *leadingZeros = leading;
+            *trailingZeros = trailing;
+        }
+    }
+    *previous = value;
+}
+
+static void DecodeFloat(BitReader* reader, uint32_t* previous, uint8_t* leadingZeros, uint8_t* trailingZeros) {
+    if (!ReadBits(reader, 1)) {
+        return;
+    }
+    if (ReadBits(reader, 1)) {
+        *leadingZeros = (uint8_t) ReadBits(reader, 5);
+        unsigned int numMeaningfulBits = ReadBits(reader, 5) + 1;
+        *trailingZeros = (uint8_t)(32 - *leadingZeros - numMeaningfulBits);
+    }
+    *previous ^= ReadBits(reader, 32 - *leadingZeros - *trailingZeros) << *trailingZeros;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+static void EncodeSample(
+        TelemetryBlock* block,
+        TelemetryCodecState* state,
+        const TelemetryColumnType* columnTypes,
+        size_t numColumns,
+        uint32_t time,
+        const TelemetryValue* values,
+        bool* overflowed) {
+    if (!block->numSamples) {
+        // The first sample of a block is stored raw so that every block can be decoded on its own.
+        WriteBits(block, time, 32, overflowed);
+        state->time = time;
+        state->timeDelta = 0;
+        for (size_t i = 0; i < numColumns; i++) {
+            WriteBits(block, (uint32_t) values[i].intValue, 32, overflowed);
+            state->values[i] = (uint32_t) values[i].intValue;
+            state->leadingZeros[i] = kNoWindow;
+            state->trailingZeros[i] = 0;
+        }
+    } else {
+        EncodeTime(block, state, time, overflowed);
+        for (size_t i = 0; i < numColumns; i++) {
+            switch (columnTypes[i]) {
+                case kTelemetryColumnType_Int: {
+                    EncodeInt(block, &state->values[i], (uint32_t) values[i].intValue, overflowed);
+                } break;
+                case kTelemetryColumnType_Float: {
+                    EncodeFloat(
+                            block,
+                            &state->values[i],
+                            &state->leadingZeros[i],
+                            &state->trailingZeros[i],
+                            (uint32_t) values[i].intValue,
+                            overflowed);
+                } break;
+            }
+        }
+    }
+    if (!*overflowed) {
+        block->numSamples++;
+    }
+}
+
+/**
+ * Appends a sample to a block. Leaves the block and the codec state untouched if the sample does not fit.
+ *
+ * @return true                     If the sample was appended.
+ * @return false                    If the block is full.
+ */
+static bool AppendToBlock(
+        TelemetryBlock* block,
+        TelemetryCodecState* state,
+        const TelemetryColumnType* columnTypes,
+        size_t numColumns,
+        uint32_t time,
+        const TelemetryValue* values) {
+    TelemetryCodecState savedState = *state;
+    uint16_t savedNumBits = block->numBits;
+    bool overflowed = false;
+    EncodeSample(block, state, columnTypes, numColumns, time, values, &overflowed);
+    if (overflowed) {
+        TruncateBits(block, savedNumBits);
+        *state = savedState;
+        return false;
+    }
+    return true;
+}
+
+bool TelemetryBlockEnumerateSamples(
+        const TelemetryBlock* block,
+        const TelemetryColumnType* columnTypes,
+        size_t numColumns,
+        TelemetryStoreEnumerateSamplesCallback callback,
+        void* _Nullable context) {
+    HAPPrecondition(block);
+    HAPPrecondition(columnTypes);
+    HAPPrecondition(numColumns <= kTelemetryStore_MaxColumns);
+    HAPPrecondition(callback);
+
+    BitReader reader = { .block = block, .position = 0 };
+    TelemetryCodecState state;
+    TelemetryValue values[kTelemetryStore_MaxColumns];
+
+    for (size_t sample = 0; sample < block->numSamples; sample++) {
+        if (!sample) {
+            state.time = ReadBits(&reader, 32);
+            state.timeDelta = 0;
+            for (size_t i = 0; i < numColumns; i++) {
+                state.values[i] = ReadBits(&reader, 32);
+                state.leadingZeros[i] = kNoWindow;
+                state.trailingZeros[i] = 0;
+            }
+        } else {
+            DecodeTime(&reader, &state);
+            for (size_t i = 0; i < numColumns; i++) {
+                switch (columnTypes[i]) {
+                    case kTelemetryColumnType_Int: {
+                        DecodeInt(&reader, &state.values[i]);
+                    } break;
+                    case kTelemetryColumnType_Float: {
+                        DecodeFloat(&reader, &state.values[i], &state.leadingZeros[i], &state.trailingZeros[i]);
+                    } break;
+                }
+            }
+        }
+        for (size_t i = 0; i < numColumns; i++) {
+            values[i].intValue = (int32_t) state.values[i];
+        }
+
+        bool shouldContinue = true;
+        callback(context, state.time, values, block->level, &shouldContinue);
+        if (!shouldContinue) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Largest stride tried when merging two blocks.
+ */
+#define kTelemetryStore_MaxMergeStride ((size_t) 4)
+
+/**
+ * Context for re-encoding every n-th sample of two blocks into one.
+ */
+typedef struct {
+    const TelemetryStore* store;
+    TelemetryBlock* block;
+    TelemetryCodecState state;
+    size_t stride;
+    size_t index;
+    bool overflowed;
+} MergeContext;
+
+static void MergeSample(
+        void* _Nullable context,
+        uint32_t time,
+        const TelemetryValue* values,
+        uint8_t level HAP_UNUSED,
+        bool* shouldContinue) {
+    HAPPrecondition(context);
+    MergeContext* merge = context;
+
+    if (!(merge->index++ % merge->stride)) {
+        if (!AppendToBlock(
+                    merge->block,
+                    &merge->state,
+                    merge->store->columnTypes,
+                    merge->store->numColumns,
+                    time,
+                    values)) {
+            merge->overflowed = true;
+            *shouldContinue = false;
+        }
+    }
+}
+
+/**
+ * Merges two blocks of the same level into the first one, keeping every second sample. Decimated samples compress
+ * worse than the originals, so larger strides are tried if the result does not fit.
+ *
+ * @return true                     If the blocks were merged. The second block can be released.
+ * @return false                    If the merged samples do not fit into one block.
+ */
+static bool MergeBlocks(const TelemetryStore* store, TelemetryBlock* first, const TelemetryBlock* second) {
+    TelemetryBlock merged;
+    for (size_t stride = 2; stride <= kTelemetryStore_MaxMergeStride; stride++) {
+        HAPRawBufferZero(&merged, sizeof merged);
+        merged.level = (uint8_t)(first->level + 1);
+
+        MergeContext context = { .store = store, .block = &merged, .stride = stride };
+        TelemetryBlockEnumerateSamples(first, store->columnTypes, store->numColumns, MergeSample, &context);
+        if (!context.overflowed) {
+            TelemetryBlockEnumerateSamples(second, store->columnTypes, store->numColumns, MergeSample, &context);
+        }
+        if (!context.overflowed) {
+            *first = merged;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Removes a block from the order and returns it to the free blocks.
+ */
+static void ReleaseBlock(TelemetryStore* store, size_t age) {
+    uint8_t index = store->order[age];
+    for (size_t i = age; i + 1 < store->numUsedBlocks; i++) {
+        store->order[i] = store->order[i + 1];
+    }
+    store->numUsedBlocks--;
+    store->order[store->numUsedBlocks] = index;
+}
+
+/**
+ * Frees a block by merging the oldest pair of blocks with the same level, or by dropping the oldest block.
+ * The newest block is never merged so that recent history stays at full resolution.
+ */
+static void FreeBlock(TelemetryStore* store) {
+    for (size_t age = 0; age + 2 < store->numUsedBlocks; age++) {
+        TelemetryBlock* first = &store->blocks[store->order[age]];
+        const TelemetryBlock* second = &store->blocks[store->order[age + 1]];
+        if (first->level == second->level && first->level < kTelemetryStore_MaxLevel &&
+            MergeBlocks(store, first, second)) {
+            ReleaseBlock(store, age + 1);
+            return;
+        }
+    }
+    store->numDroppedSamples += store->blocks[store->order[0]].numSamples;
+    ReleaseBlock(store, 0);
+}
+
+static TelemetryBlock* StartBlock(TelemetryStore* store) {
+    if (store->numUsedBlocks == store->numBlocks) {
+        FreeBlock(store);
+    }
+    TelemetryBlock* block = &store->blocks[store->order[store->numUsedBlocks++]];
+    HAPRawBufferZero(block, sizeof *block);
+    return block;
+}
+
+void TelemetryStoreCreate(
+        TelemetryStore* store,
+        const TelemetryColumnType* columnTypes,
+        size_t numColumns,
+        TelemetryBlock* blocks,
+        uint8_t* order,
+        size_t numBlocks) {
+    HAPPrecondition(store);
+    HAPPrecondition(columnTypes);
+    HAPPrecondition(numColumns && numColumns <= kTelemetryStore_MaxColumns);
+    HAPPrecondition(blocks);
+    HAPPrecondition(order);
+    HAPPrecondition(numBlocks >= 3 && numBlocks <= UINT8_MAX);
+
+    HAPRawBufferZero(store, sizeof *store);
+    store->columnTypes = columnTypes;
+    store->numColumns = numColumns;
+    store->blocks = blocks;
+    store->numBlocks = numBlocks;
+    store->order = order;
+    for (size_t i = 0; i < numBlocks; i++) {
+        order[i] = (uint8_t) i;
+    }
+}
+
+void TelemetryStoreSetBlockSealedCallback(
+        TelemetryStore* store,
+        TelemetryStoreBlockSealedCallback _Nullable callback,
+        void* _Nullable context) {
+    HAPPrecondition(store);
+
+    store->handleBlockSealed = callback;
+    store->handleBlockSealedContext = context;
+}
+
+void TelemetryStoreAppend(TelemetryStore* store, uint32_t time, const TelemetryValue* values) {
+    HAPPrecondition(store);
+    HAPPrecondition(values);
+
+    TelemetryBlock* block = store->numUsedBlocks ? &store->blocks[store->order[store->numUsedBlocks - 1]] :
+                                                   StartBlock(store);
+    if (AppendToBlock(block, &store->state, store->columnTypes, store->numColumns, time, values)) {
+        return;
+    }
+    if (store->handleBlockSealed) {
+        store->handleBlockSealed(store->handleBlockSealedContext, block);
+    }
+    block = StartBlock(store);
+    bool appended = AppendToBlock(block, &store->state, store->columnTypes, store->numColumns, time, values);
+    HAPAssert(appended);
+}
+
+const TelemetryBlock* _Nullable TelemetryStoreGetBlock(const TelemetryStore* store, size_t age) {
+    HAPPrecondition(store);
+
+    return age < store->numUsedBlocks ? &store->blocks[store->order[age]] : NULL;
+}
+
+void TelemetryStoreEnumerateSamples(
+        const TelemetryStore* store,
+        TelemetryStoreEnumerateSamplesCallback callback,
+        void* _Nullable context) {
+    HAPPrecondition(store);
+    HAPPrecondition(callback);
+
+    for (size_t age = 0; age < store->numUsedBlocks; age++) {
+        if (!TelemetryBlockEnumerateSamples(
+                    &store->blocks[store->order[age]], store->columnTypes, store->numColumns, callback, context)) {
+            return;
+        }
+    }
+}
+
+void TelemetryStoreGetUsage(const TelemetryStore* store, size_t* numSamples, size_t* numBytes) {
+    HAPPrecondition(store);
+    HAPPrecondition(numSamples);
+    HAPPrecondition(numBytes);
+
+    *numSamples = 0;
+    *numBytes = 0;
+    for (size_t age = 0; age < store->numUsedBlocks; age++) {
+        const TelemetryBlock* block = &store->blocks[store->order[age]];
+        *numSamples += block->numSamples;
+        *numBytes += (block->numBits + 7u) / 8;
+    }
+}
@@ -0,0 +1,223 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Compressed time-series store with a fixed memory budget.
+//
+// Samples consist of a millisecond timestamp and a fixed set of columns. They are bit-packed into blocks:
+//
+//   - Timestamps are stored as delta-of-delta, so a sampler running at a steady interval costs one bit per sample.
+//   - Integer columns are stored as zigzag-encoded deltas in variable-length buckets.
+//   - Float columns are XORed with the previous value and only the meaningful bits are stored.
+//
+// Each block starts with one raw sample and can be decoded on its own, which allows exporting the store block by
+// block. When all blocks are in use, the two oldest blocks of the same resolution are merged into one with every
+// second sample dropped, so old history is kept at decreasing resolution instead of being discarded.
+//
+// The store is not thread-safe.
+
+#ifndef TELEMETRY_STORE_H
+#define TELEMETRY_STORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Maximum number of columns per sample.
+ */
+#define kTelemetryStore_MaxColumns ((size_t) 10)
+
+/**
+ * Size of the encoded data of a block.
+ */
+#define kTelemetryStore_BlockBytes ((size_t) 256)
+
+/**
+ * Highest resolution level. Blocks at this level are dropped instead of merged.
+ */
+#define kTelemetryStore_MaxLevel ((uint8_t) 4)
+
+/**
+ * Column type.
+ */
+typedef enum { kTelemetryColumnType_Int, kTelemetryColumnType_Float } TelemetryColumnType;
+
+/**
+ * Column value.
+ */
+typedef union {
+    int32_t intValue;
+    float floatValue;
+} TelemetryValue;
+
+/**
+ * Block of encoded samples.
+ */
+typedef struct {
+    /** Number of samples in the block. */
+    uint16_t numSamples;
+
+    /** Number of used bits in bytes. */
+    uint16_t numBits;
+
+    /** Resolution level. Each merge halves the resolution and increments the level. */
+    uint8_t level;
+
+    uint8_t bytes[kTelemetryStore_BlockBytes];
+} TelemetryBlock;
+
+/**
+ * Encoder or decoder state.
+ */
+typedef struct {
+    uint32_t time;
+    uint32_t timeDelta;
+    uint32_t values[kTelemetryStore_MaxColumns];
+    uint8_t leadingZeros[kTelemetryStore_MaxColumns];
+    uint8_t trailingZeros[kTelemetryStore_MaxColumns];
+} TelemetryCodecState;
+
+/**
+ * Callback that is invoked when a block is full, before the next block is started.
+ *
+ * @param      context              Context.
+ * @param      block                Block that has been completed. Only valid for the duration of the callback.
+ */
+typedef void (*TelemetryStoreBlockSealedCallback)(void* _Nullable context, const TelemetryBlock* block);
+
+/**
+ * Time-series store.
+ */
+typedef struct {
+    const TelemetryColumnType* columnTypes;
+    size_t numColumns;
+
+    TelemetryBlock* blocks;
+    size_t numBlocks;
+
+    /** Indices into blocks in order of age, oldest first. The last one is being appended to. */
+    uint8_t* order;
+    size_t numUsedBlocks;
+
+    /** Encoder state of the block that is being appended to. */
+    TelemetryCodecState state;
+
+    /** Number of samples dropped because the oldest block could not be merged. */
+    uint32_t numDroppedSamples;
+
+    TelemetryStoreBlockSealedCallback _Nullable handleBlockSealed;
+    void* _Nullable handleBlockSealedContext;
+} TelemetryStore;
+
+/**
+ * Initializes a store.
+ *
+ * @param      store                Store to initialize.
+ * @param      columnTypes          Type of each column. Must remain valid while the store is in use.
+ * @param      numColumns           Number of columns.
+ * @param      blocks               Block storage. Its size is the memory budget of the store.
+ * @param      order                Storage for the block order. Must have numBlocks elements.
+ * @param      numBlocks            Number of blocks. At least 3, at most 255.
+ */
+void TelemetryStoreCreate(
+        TelemetryStore* store,
+        const TelemetryColumnType* columnTypes,
+        size_t numColumns,
+        TelemetryBlock* blocks,
+        uint8_t* order,
+        size_t numBlocks);
+
+/**
+ * Sets a callback that is invoked with each block once it is full, e.g. to persist it.
+ *
+ * @param      store                Store.
+ * @param      callback             Callback, or NULL to remove it.
+ * @param      context              Context passed to the callback.
+ */
+void TelemetryStoreSetBlockSealedCallback(
+        TelemetryStore* store,
+        TelemetryStoreBlockSealedCallback _Nullable callback,
+        void* _Nullable context);
+
+/**
+ * Appends a sample. Timestamps must not decrease.
+ *
+ * @param      store                Store.
+ * @param      time                 Timestamp in milliseconds.
+ * @param      values               One value per column.
+ */
+void TelemetryStoreAppend(TelemetryStore* store, uint32_t time, const TelemetryValue* values);
+
+/**
+ * Returns the block with the given age, 0 being the oldest.
+ *
+ * @return Block, or NULL if there are not that many blocks in use.
+ */
+HAP_RESULT_USE_CHECK
+const TelemetryBlock* _Nullable TelemetryStoreGetBlock(const TelemetryStore* store, size_t age);
+
+/**
+ * Callback for enumerating samples.
+ *
+ * @param      context              Context.
+ * @param      time                 Timestamp in milliseconds.
+ * @param      values               One value per column.
+ * @param      level                Resolution level of the block the sample belongs to.
+ * @param[in,out] shouldContinue    True if enumeration shall continue, False otherwise. Is set to true on input.
+ */
+typedef void (*TelemetryStoreEnumerateSamplesCallback)(
+        void* _Nullable context,
+        uint32_t time,
+        const TelemetryValue* values,
+        uint8_t level,
+        bool* shouldContinue);
+
+/**
+ * Decodes the samples of a block.
+ *
+ * @param      block                Block. May be a copy taken from TelemetryStoreGetBlock.
+ * @param      columnTypes          Type of each column.
+ * @param      numColumns           Number of columns.
+ * @param      callback             Function to call on each sample.
+ * @param      context              Context passed to the callback.
+ *
+ * @return True if all samples have been enumerated, False if the callback stopped the enumeration.
+ */
+bool TelemetryBlockEnumerateSamples(
+        const TelemetryBlock* block,
+        const TelemetryColumnType* columnTypes,
+        size_t numColumns,
+        TelemetryStoreEnumerateSamplesCallback callback,
+        void* _Nullable context);
+
+/**
+ * Decodes all samples of the store, oldest first.
+ */
+void TelemetryStoreEnumerateSamples(
+        const TelemetryStore* store,
+        TelemetryStoreEnumerateSamplesCallback callback,
+        void* _Nullable context);
+
+/**
+ * Returns the number of samples and encoded bytes currently held by the store.
+ */
+void TelemetryStoreGetUsage(const TelemetryStore* store, size_t* numSamples, size_t* numBytes);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,101 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "WifiReachability.h"
+
+void WifiReachabilityCreate(WifiReachability* reachability, WifiReachabilityMode mode) {
+    HAPPrecondition(reachability);
+
+    HAPRawBufferZero(reachability, sizeof *reachability);
+    reachability->mode = mode;
+    reachability->isSoftAPActive = mode == kWifiReachabilityMode_Concurrent;
+    reachability->isFallbackTimerActive = mode == kWifiReachabilityMode_Fallback;
+    reachability->unreachableSinceUs = 0;
+}
+
+static void HandleReachable(WifiReachability* reachability, int64_t nowUs, WifiReachabilityActions* actions) {
+    if (reachability->unreachableSinceUs < 0) {
+        return;
+    }
+    actions->reachableAfterUs = nowUs - reachability->unreachableSinceUs;
+    reachability->unreachableSinceUs = -1;
+}
+
+static void HandleLinkLost(WifiReachability* reachability, int64_t nowUs) {
+    if (!reachability->stationHasAddress && !reachability->numClients && reachability->unreachableSinceUs < 0) {
+        reachability->unreachableSinceUs = nowUs;
+    }
+}
+
+static void StopSoftAPIfUnused(WifiReachability* reachability, WifiReachabilityActions* actions) {
+    if (reachability->mode == kWifiReachabilityMode_Fallback && reachability->isSoftAPActive &&
+        reachability->stationHasAddress && !reachability->numClients) {
+        reachability->isSoftAPActive = false;
+        actions->stopSoftAP = true;
+    }
+}
+
+void WifiReachabilityHandleEvent(
+        WifiReachability* reachability,
+        WifiReachabilityEvent event,
+        int64_t nowUs,
+        WifiReachabilityActions* actions) {
+    HAPPrecondition(reachability);
+    HAPPrecondition(actions);
+
+    HAPRawBufferZero(actions, sizeof *actions);
+    actions->reachableAfterUs = -1;
+
+    switch (event) {
+        case kWifiReachabilityEvent_StationAddress: {
+            reachability->stationHasAddress = true;
+            HandleReachable(reachability, nowUs, actions);
+            if (reachability->isFallbackTimerActive) {
+                reachability->isFallbackTimerActive = false;
+                actions->stopFallbackTimer = true;
+            }
+            StopSoftAPIfUnused(reachability, actions);
+            return;
+        }
+        case kWifiReachabilityEvent_StationLost: {
+            reachability->stationHasAddress = false;
+            HandleLinkLost(reachability, nowUs);
+            if (reachability->mode == kWifiReachabilityMode_Fallback && !reachability->isSoftAPActive &&
+                !reachability->isFallbackTimerActive) {
+                reachability->isFallbackTimerActive = true;
+                actions->startFallbackTimer = true;
+            }
+            return;
+        }
+        case kWifiReachabilityEvent_ClientJoined: {
+            reachability->numClients++;
+            return;
+        }
+        case kWifiReachabilityEvent_ClientLeft: {
+            if (reachability->numClients) {
+                reachability->numClients--;
+            }
+            HandleLinkLost(reachability, nowUs);
+            StopSoftAPIfUnused(reachability, actions);
+            return;
+        }
+        case kWifiReachabilityEvent_ClientAddress: {
+            HandleReachable(reachability, nowUs, actions);
+            return;
+        }
+        case kWifiReachabilityEvent_FallbackTimeout: {
+            reachability->isFallbackTimerActive = false;
+            // The timer may have expired just before the station got its address.
+            if (reachability->stationHasAddress || reachability->isSoftAPActive) {
+                return;
+            }
+            reachability->isSoftAPActive = true;
+            actions->startSoftAP = true;
+            return;
+        }
+    }
+    HAPFatalError();
+}
@@ -0,0 +1,135 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Wi-Fi reachability.
+//
+// Decides when the SoftAP is started and stopped (GARAGE_WIFI_MODE) and measures the time to reachable. In fallback
+// mode the SoftAP is started once the station has had no address for the fallback timeout, and stopped again when
+// the station is back and no clients are left. The accessory is unreachable while the station has no address and no
+// SoftAP client is connected, and becomes reachable once the station or a SoftAP client has been assigned an address.
+// Time to reachable is measured from boot or from losing the last link.
+//
+// The tracker consumes link events with their time and returns the actions to take. It is platform-independent, so
+// link sequences can be replayed through it on the host (host_test/WifiReachabilityTest.c). app_wifi.c feeds it the
+// ESP-IDF Wi-Fi and IP events and owns the timer and the radio.
+
+#ifndef WIFI_REACHABILITY_H
+#define WIFI_REACHABILITY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * When the SoftAP is up.
+ */
+typedef enum {
+    /** Never. */
+    kWifiReachabilityMode_Station,
+
+    /** While no access point is reachable. */
+    kWifiReachabilityMode_Fallback,
+
+    /** Always. */
+    kWifiReachabilityMode_Concurrent
+} WifiReachabilityMode;
+
+/**
+ * Link events.
+ */
+typedef enum {
+    /** The station has been assigned an address. */
+    kWifiReachabilityEvent_StationAddress,
+
+    /** The station has been disconnected or has lost its address. */
+    kWifiReachabilityEvent_StationLost,
+
+    /** A client has joined the SoftAP. */
+    kWifiReachabilityEvent_ClientJoined,
+
+    /** A client has left the SoftAP. */
+    kWifiReachabilityEvent_ClientLeft,
+
+    /** A SoftAP client has been assigned an address. */
+    kWifiReachabilityEvent_ClientAddress,
+
+    /** The fallback timer has expired. */
+    kWifiReachabilityEvent_FallbackTimeout
+} WifiReachabilityEvent;
+
+/**
+ * Actions to take after an event.
+ */
+typedef struct {
+    /** Start the fallback timer. */
+    bool startFallbackTimer : 1;
+
+    /** Stop the fallback timer. */
+    bool stopFallbackTimer : 1;
+
+    /** Start the SoftAP alongside the station. */
+    bool startSoftAP : 1;
+
+    /** Stop the SoftAP. */
+    bool stopSoftAP : 1;
+
+    /** Time since which the accessory had been unreachable, if it has just become reachable, -1 otherwise. */
+    int64_t reachableAfterUs;
+} WifiReachabilityActions;
+
+/**
+ * Tracker state.
+ */
+typedef struct {
+    WifiReachabilityMode mode;
+
+    bool stationHasAddress;
+    uint32_t numClients;
+    bool isSoftAPActive;
+    bool isFallbackTimerActive;
+
+    /** Time since which the accessory has not been reachable, -1 while it is. */
+    int64_t unreachableSinceUs;
+} WifiReachability;
+
+/**
+ * Initializes a tracker at boot. The accessory is unreachable since boot. The SoftAP is active in concurrent mode, and
+ * the fallback timer must be started along with the station in fallback mode.
+ *
+ * @param[out] reachability         Tracker.
+ * @param      mode                 Wi-Fi mode.
+ */
+void WifiReachabilityCreate(WifiReachability* reachability, WifiReachabilityMode mode);
+
+/**
+ * Handles a link event.
+ *
+ * @param      reachability         Tracker.
+ * @param      event                Event.
+ * @param      nowUs                Time of the event since boot.
+ * @param[out] actions              Actions to take.
+ */
+void WifiReachabilityHandleEvent(
+        WifiReachability* reachability,
+        WifiReachabilityEvent event,
+        int64_t nowUs,
+        WifiReachabilityActions* actions);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,160 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+#include "WriteRequest.h"
+
+#include <cJSON.h>
+
+/**
+ * Longest instance or accessory ID accepted by the fast path. Larger numbers might not survive the generic parser's
+ * conversion to double unchanged.
+ */
+#define kWriteRequest_MaxIDDigits ((size_t) 15)
+
+/**
+ * Longest value accepted by the fast path.
+ */
+#define kWriteRequest_MaxValueDigits ((size_t) 10)
+
+/**
+ * Longest timed write identifier accepted by the fast path.
+ */
+#define kWriteRequest_MaxPIDDigits ((size_t) 20)
+
+typedef struct {
+    const char* bytes;
+    size_t numBytes;
+    size_t offset;
+} Scanner;
+
+static void SkipWhitespace(Scanner* scanner) {
+    while (scanner->offset < scanner->numBytes) {
+        char c = scanner->bytes[scanner->offset];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            return;
+        }
+        scanner->offset++;
+    }
+}
+
+/**
+ * Consumes a token after optional whitespace.
+ */
+static bool ScanToken(Scanner* scanner, const char* token, size_t numTokenBytes) {
+    SkipWhitespace(scanner);
+    if (scanner->numBytes - scanner->offset < numTokenBytes ||
+        !HAPRawBufferAreEqual(&scanner->bytes[scanner->offset], token, numTokenBytes)) {
+        return false;
+    }
+    scanner->offset += numTokenBytes;
+    return true;
+}
+
+#define SCAN_TOKEN(scanner, token) ScanToken(scanner, token, sizeof token - 1)
+
+/**
+ * Consumes a non-negative integer without sign, fraction, exponent or leading zeros after optional whitespace.
+ */
+static bool ScanUInt(Scanner* scanner, size_t maxDigits, uint64_t* value) {
+    SkipWhitespace(scanner);
+    size_t numDigits = 0;
+    *value = 0;
+    while (scanner->offset < scanner->numBytes) {
+        char c = scanner->bytes[scanner->offset];
+        if (c < '0' || c > '9') {
+            break;
+        }
+        if (numDigits == maxDigits || (numDigits == 1 && *value == 0)) {
+            return false;
+        }
+        *value = *value * 10 + (uint64_t)(c - '0');
+        numDigits++;
+        scanner->offset++;
+    }
+    if (!numDigits || scanner->offset == scanner->numBytes) {
+        return false;
+    }
+    // Fractions and exponents continue the number.
+    char c = scanner->bytes[scanner->offset];
+    return c != '.' && c != 'e' && c != 'E';
+}
+
+HAP_RESULT_USE_CHECK
+bool WriteRequestParseFast(const char* bytes, size_t numBytes, WriteRequest* request) {
+    HAPPrecondition(bytes);
+    HAPPrecondition(request);
+
+    Scanner scanner = { .bytes = bytes, .numBytes = numBytes };
+    uint64_t aid;
+    uint64_t iid;
+    uint64_t value;
+    if (!SCAN_TOKEN(&scanner, "{") || !SCAN_TOKEN(&scanner, "\"characteristics\"") || !SCAN_TOKEN(&scanner, ":") ||
+        !SCAN_TOKEN(&scanner, "[") || !SCAN_TOKEN(&scanner, "{") || !SCAN_TOKEN(&scanner, "\"aid\"") ||
+        !SCAN_TOKEN(&scanner, ":") || !ScanUInt(&scanner, kWriteRequest_MaxIDDigits, &aid) ||
+        !SCAN_TOKEN(&scanner, ",") || !SCAN_TOKEN(&scanner, "\"iid\"") || !SCAN_TOKEN(&scanner, ":") ||
+        !ScanUInt(&scanner, kWriteRequest_MaxIDDigits, &iid) || !SCAN_TOKEN(&scanner, ",") ||
+        !SCAN_TOKEN(&scanner, "\"value\"") || !SCAN_TOKEN(&scanner, ":") ||
+        !ScanUInt(&scanner, kWriteRequest_MaxValueDigits, &value) || !SCAN_TOKEN(&scanner, "}") ||
+        !SCAN_TOKEN(&scanner, "]")) {
+        return false;
+    }
+    if (SCAN_TOKEN(&scanner, ",")) {
+        uint64_t pid;
+        if (!SCAN_TOKEN(&scanner, "\"pid\"") || !SCAN_TOKEN(&scanner, ":") ||
+            !ScanUInt(&scanner, kWriteRequest_MaxPIDDigits, &pid)) {
+            return false;
+        }
+    }
+    if (!SCAN_TOKEN(&scanner, "}")) {
+        return false;
+    }
+    SkipWhitespace(&scanner);
+    if (scanner.offset != numBytes || value > INT32_MAX) {
+        return false;
+    }
+
+    request->aid = aid;
+    request->iid = iid;
+    request->value = (int32_t) value;
+    return true;
+}
+
+/**
+ * Converts a JSON number that must be a non-negative integer.
+ */
+static bool GetID(const cJSON* _Nullable item, uint64_t* value) {
+    if (!cJSON_IsNumber(item) || HAPNonnull(item)->valuedouble < 0 ||
+        HAPNonnull(item)->valuedouble >= (double) UINT64_MAX) {
+        return false;
+    }
+    *value = (uint64_t) HAPNonnull(item)->valuedouble;
+    return (double) *value == HAPNonnull(item)->valuedouble;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError WriteRequestParse(const char* body, WriteRequest* request) {
+    HAPPrecondition(body);
+    HAPPrecondition(request);
+
+    HAPError err = kHAPError_InvalidData;
+    cJSON* root = cJSON_Parse(body);
+    if (!root) {
+        return kHAPError_InvalidData;
+    }
+    const cJSON* writes = cJSON_GetObjectItemCaseSensitive(root, "characteristics");
+    if (cJSON_IsArray(writes) && cJSON_GetArraySize(writes) == 1) {
+        const cJSON* write = cJSON_GetArrayItem(writes, 0);
+        const cJSON* value = cJSON_GetObjectItemCaseSensitive(write, "value");
+        if (GetID(cJSON_GetObjectItemCaseSensitive(write, "aid"), &request->aid) &&
+            GetID(cJSON_GetObjectItemCaseSensitive(write, "iid"), &request->iid) && cJSON_IsNumber(value) &&
+            value->valuedouble == (double) value->valueint) {
+            request->value = value->valueint;
+            err = kHAPError_None;
+        }
+    }
+    cJSON_Delete(root);
+    return err;
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+
+// Characteristic write request bodies.
+//
+// Parses a body in the HAP characteristic write format that carries a single write, e.g.
+//
+//   {"characteristics":[{"aid":1,"iid":52,"value":1}]}
+//
+// Only PUT /characteristics of the local control API (LocalControl.h) parses its bodies here. HAP writes are parsed
+// inside the ADK's IP accessory server, which has no hook for request bodies, and do not take this path.
+//
+// Door commands almost always arrive in exactly this shape. WriteRequestParseFast recognizes it with a single pass
+// over the bytes and no allocation, and declines anything unusual: keys in another order, extra keys, signs,
+// fractions, exponents, leading zeros or escapes. Declined bodies go through WriteRequestParse, which uses the
+// generic JSON parser. Both agree on every body the fast path accepts (host_test/WriteRequestTest.c), and
+// host_test/WriteRequestBenchmark.c compares them.
+//
+// A top-level "pid" (the identifier of a prepared timed write) is accepted after the characteristics and ignored, as
+// it is by the generic parser.
+
+#ifndef WRITE_REQUEST_H
+#define WRITE_REQUEST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAP.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**
+ * Single characteristic write.
+ */
+typedef struct {
+    uint64_t aid;
+    uint64_t iid;
+    int32_t value;
+} WriteRequest;
+
+/**
+ * Recognizes the common shape of a single write.
+ *
+ * @param      bytes                Body.
+ * @param      numBytes             Length of body.
+ * @param[out] request              Write.
+ *
+ * @return true                     If the body has been recognized.
+ * @return false                    If the body must be parsed with WriteRequestParse.
+ */
+HAP_RESULT_USE_CHECK
+bool WriteRequestParseFast(const char* bytes, size_t numBytes, WriteRequest* request);
+
+/**
+ * Parses a single write with the generic JSON parser.
+ *
+ * @param      body                 NULL-terminated body.
+ * @param[out] request              Write.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_InvalidData    If the body is malformed or does not carry exactly one integer write.
+ */
+HAP_RESULT_USE_CHECK
+HAPError WriteRequestParse(const char* body, WriteRequest* request);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -13,6 +13,9 @@
 #include <freertos/task.h>
 #include "App.h"
 #include "DB.h"
+#include "PerfSnapshot.h"
+#include "Placement.h"
+#include "app_wifi.h"
 
 #define IP 1 
 #define BLE 0
@@ -38,8 +41,6 @@ static bool requestedFactoryReset = false;
 static bool clearPairings = false;
 
 #define PREFERRED_ADVERTISING_INTERVAL (HAPBLEAdvertisingIntervalCreateFromMilliseconds(417.5f))
-void app_wifi_init(void);
-esp_err_t app_wifi_connect(void);
 
 /**
  * Global platform objects.
@@ -79,6 +80,7 @@ void HandleUpdatedState(HAPAccessoryServerRef* _Nonnull server, void* _Nullable
  * Functions provided by App.c for each accessory application.
  */
 extern void AppRelease(void);
+extern void AppPrepareFactoryReset(void);
 extern void AppCreate(HAPAccessoryServerRef* server, HAPPlatformKeyValueStoreRef keyValueStore);
 extern void AppInitialize(
         HAPAccessoryServerOptions* hapAccessoryServerOptions,
@@ -121,7 +123,7 @@ static void InitializePlatform() {
     HAPPlatformTCPStreamManagerCreate(&platform.tcpStreamManager, &(const HAPPlatformTCPStreamManagerOptions) {
         /* Listen on all available network interfaces. */
         .port = 0 /* Listen on unused port number from the ephemeral port range. */,
-        .maxConcurrentTCPStreams = 9
+        .maxConcurrentTCPStreams = CONFIG_GARAGE_HAP_SESSIONS + 1
     });
 
     // Service discovery.
@@ -211,7 +213,8 @@ void HandleUpdatedState(HAPAccessoryServerRef* _Nonnull server, void* _Nullable
 
         HAPLogInfo(&kHAPLog_Default, "A factory reset has been requested.");
 
-        // Purge app state.
+        // Drop pending app state writes, then purge app state.
+        AppPrepareFactoryReset();
         err = HAPPlatformKeyValueStorePurgeDomain(&platform.keyValueStore, ((HAPPlatformKeyValueStoreDomain) 0x00));
         if (err) {
             HAPAssert(err == kHAPError_Unknown);
@@ -253,9 +256,11 @@ void HandleUpdatedState(HAPAccessoryServerRef* _Nonnull server, void* _Nullable
 }
 
 #if IP
+HAP_STATIC_ASSERT(CONFIG_GARAGE_HAP_SESSIONS >= kHAPIPSessionStorage_MinimumNumElements, GarageHAPSessions_too_small);
+
 static void InitializeIP() {
-    // Prepare accessory server storage.
-    static HAPIPSession ipSessions[kHAPIPSessionStorage_MinimumNumElements];
+    // Prepare accessory server storage. Session buffers are hot, the scratch buffer is bulk (Placement.h).
+    static HAPIPSession ipSessions[CONFIG_GARAGE_HAP_SESSIONS];
     static uint8_t ipInboundBuffers[HAPArrayCount(ipSessions)][kHAPIPSession_MinimumInboundBufferSize];
     static uint8_t ipOutboundBuffers[HAPArrayCount(ipSessions)][kHAPIPSession_MinimumOutboundBufferSize];
     static HAPIPEventNotificationRef ipEventNotifications[HAPArrayCount(ipSessions)][kAttributeCount];
@@ -269,7 +274,7 @@ static void InitializeIP() {
     }
     static HAPIPReadContextRef ipReadContexts[kAttributeCount];
     static HAPIPWriteContextRef ipWriteContexts[kAttributeCount];
-    static uint8_t ipScratchBuffer[kHAPIPSession_MinimumScratchBufferSize];
+    static EXT_RAM_ATTR uint8_t ipScratchBuffer[kHAPIPSession_MinimumScratchBufferSize];
     static HAPIPAccessoryServerStorage ipAccessoryServerStorage = {
         .sessions = ipSessions,
         .numSessions = HAPArrayCount(ipSessions),
@@ -295,7 +300,7 @@ static void InitializeBLE() {
     static HAPBLEGATTTableElementRef gattTableElements[kAttributeCount];
     static HAPBLESessionCacheElementRef sessionCacheElements[kHAPBLESessionCache_MinElements];
     static HAPSessionRef session;
-    static uint8_t procedureBytes[2048];
+    static EXT_RAM_ATTR uint8_t procedureBytes[2048];
     static HAPBLEProcedureRef procedures[1];
 
     static HAPBLEAccessoryServerStorage bleAccessoryServerStorage = {
@@ -363,6 +368,9 @@ void main_task()
 
 void app_main()
 {
+    // Pick up the snapshot of a crashed previous boot before anything records into it.
+    PerfSnapshotInitialize();
+
     // HAPLogInfo(&kHAPLog_Default, "Main run!!!!");
     xTaskCreate(main_task, "main_task", 6 * 1024, NULL, 6, NULL);
 }
@@ -1,4 +1,4 @@
-/* WiFi station connection
+/* WiFi station and SoftAP connection
 
    This example code is in the Public Domain (or CC0 licensed, at your option.)
 
@@ -11,11 +11,18 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
 #include "nvs_flash.h"
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
 
+#include "app_wifi.h"
+#include "Metrics.h"
+#include "PerfSnapshot.h"
+#include "WifiReachability.h"
+
 /* The examples use WiFi configuration that you can set via project configuration menu
 
    If you'd rather not, just change the below entries to strings with
@@ -24,19 +31,141 @@
 #define EXAMPLE_ESP_WIFI_SSID      CONFIG_EXAMPLE_WIFI_SSID
 #define EXAMPLE_ESP_WIFI_PASS      CONFIG_EXAMPLE_WIFI_PASSWORD
 
+/* Without an access point the accessory serves HAP on its own network (GARAGE_WIFI_MODE). WifiReachability.h
+   decides when the SoftAP is started and stopped and measures the time to reachable. While the SoftAP is up,
+   reconnect attempts of the station are spaced out, because the scans take the radio off the SoftAP channel.
+*/
+#if !CONFIG_GARAGE_WIFI_MODE_STATION
+#define SOFTAP_SSID                CONFIG_GARAGE_SOFTAP_SSID
+#define SOFTAP_PASS                CONFIG_GARAGE_SOFTAP_PASSWORD
+#define SOFTAP_RETRY_INTERVAL_US   (10 * 1000 * 1000)
+
+/* An open SoftAP would hand the local control key and the door commands to anyone in range. */
+_Static_assert(sizeof SOFTAP_PASS - 1 >= 8 && sizeof SOFTAP_PASS - 1 <= 63,
+               "GARAGE_SOFTAP_PASSWORD must be a WPA2 passphrase of 8 to 63 characters");
+#endif
+
+#if CONFIG_GARAGE_WIFI_MODE_FALLBACK
+#define WIFI_REACHABILITY_MODE     kWifiReachabilityMode_Fallback
+#elif CONFIG_GARAGE_WIFI_MODE_CONCURRENT
+#define WIFI_REACHABILITY_MODE     kWifiReachabilityMode_Concurrent
+#else
+#define WIFI_REACHABILITY_MODE     kWifiReachabilityMode_Station
+#endif
+
 static const char *TAG = "wifi station";
 
+/* Fed from the event loop and from the fallback timer. */
+static WifiReachability s_reachability;
+static portMUX_TYPE s_reachability_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#if !CONFIG_GARAGE_WIFI_MODE_STATION
+static esp_timer_handle_t s_retry_timer;
+#endif
+#if CONFIG_GARAGE_WIFI_MODE_FALLBACK
+static esp_timer_handle_t s_fallback_timer;
+#endif
+
+#if !CONFIG_GARAGE_WIFI_MODE_STATION
+static void set_softap_config(void)
+{
+    wifi_config_t ap_config = {
+        .ap = {
+            .ssid = SOFTAP_SSID,
+            .ssid_len = strlen(SOFTAP_SSID),
+            .password = SOFTAP_PASS,
+            .channel = CONFIG_GARAGE_SOFTAP_CHANNEL,
+            .max_connection = 2,
+            .authmode = WIFI_AUTH_WPA2_PSK,
+        },
+    };
+    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_AP, &ap_config) );
+}
+
+static void retry_timer_callback(void* arg)
+{
+    esp_wifi_connect();
+}
+#endif
+
+/* Feeds an event to the tracker and takes the resulting actions. Returns whether the SoftAP is active. */
+static bool handle_reachability_event(WifiReachabilityEvent event, Metric metric)
+{
+    WifiReachabilityActions actions;
+    portENTER_CRITICAL(&s_reachability_lock);
+    WifiReachabilityHandleEvent(&s_reachability, event, esp_timer_get_time(), &actions);
+    bool softap_active = s_reachability.isSoftAPActive;
+    portEXIT_CRITICAL(&s_reachability_lock);
+
+    if (actions.reachableAfterUs >= 0) {
+        MetricsRecord(metric, actions.reachableAfterUs > UINT32_MAX ? UINT32_MAX : (uint32_t) actions.reachableAfterUs);
+    }
+#if CONFIG_GARAGE_WIFI_MODE_FALLBACK
+    if (actions.stopFallbackTimer) {
+        esp_timer_stop(s_fallback_timer);
+    }
+    if (actions.startFallbackTimer) {
+        esp_timer_start_once(s_fallback_timer, (uint64_t) CONFIG_GARAGE_WIFI_FALLBACK_TIMEOUT_S * 1000 * 1000);
+    }
+    if (actions.startSoftAP) {
+        ESP_LOGW(TAG, "No access point for %d s. Starting SoftAP \"%s\".",
+                 CONFIG_GARAGE_WIFI_FALLBACK_TIMEOUT_S, SOFTAP_SSID);
+        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA) );
+        set_softap_config();
+        PerfSnapshotTrace(kPerfSnapshotEvent_SoftAPStarted, 0);
+    }
+    if (actions.stopSoftAP) {
+        ESP_LOGI(TAG, "Access point is back. Stopping SoftAP.");
+        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA) );
+        PerfSnapshotTrace(kPerfSnapshotEvent_SoftAPStopped, 0);
+    }
+#endif
+    return softap_active;
+}
+
+#if CONFIG_GARAGE_WIFI_MODE_FALLBACK
+static void fallback_timer_callback(void* arg)
+{
+    (void) handle_reachability_event(kWifiReachabilityEvent_FallbackTimeout, kMetric_Count);
+}
+#endif
+
 static void event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data)
 {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         esp_wifi_connect();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        wifi_event_sta_disconnected_t* event = (wifi_event_sta_disconnected_t*) event_data;
+        PerfSnapshotTrace(kPerfSnapshotEvent_WiFiDisconnected, event->reason);
+        bool softap_active = handle_reachability_event(kWifiReachabilityEvent_StationLost, kMetric_Count);
+#if !CONFIG_GARAGE_WIFI_MODE_STATION
+        if (softap_active) {
+            if (!esp_timer_is_active(s_retry_timer)) {
+                esp_timer_start_once(s_retry_timer, SOFTAP_RETRY_INTERVAL_US);
+            }
+            return;
+        }
+#else
+        (void) softap_active;
+#endif
         esp_wifi_connect();
         ESP_LOGW(TAG, "Connect to the AP failed. Retrying.");
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
+        PerfSnapshotTrace(kPerfSnapshotEvent_WiFiConnected, 0);
+        (void) handle_reachability_event(kWifiReachabilityEvent_StationAddress, kMetric_TimeToReachableStation);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_LOST_IP) {
+        (void) handle_reachability_event(kWifiReachabilityEvent_StationLost, kMetric_Count);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_AP_STACONNECTED) {
+        (void) handle_reachability_event(kWifiReachabilityEvent_ClientJoined, kMetric_Count);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_AP_STADISCONNECTED) {
+        (void) handle_reachability_event(kWifiReachabilityEvent_ClientLeft, kMetric_Count);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_AP_STAIPASSIGNED) {
+        ip_event_ap_staipassigned_t* event = (ip_event_ap_staipassigned_t*) event_data;
+        ESP_LOGI(TAG, "SoftAP client got ip:" IPSTR, IP2STR(&event->ip));
+        (void) handle_reachability_event(kWifiReachabilityEvent_ClientAddress, kMetric_TimeToReachableSoftAP);
     }
 }
 
@@ -46,6 +175,9 @@ void app_wifi_init(void)
     ESP_ERROR_CHECK(esp_netif_init());
 
     esp_netif_create_default_wifi_sta();
+#if !CONFIG_GARAGE_WIFI_MODE_STATION
+    esp_netif_create_default_wifi_ap();
+#endif
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
@@ -53,29 +185,67 @@ void app_wifi_init(void)
 
 esp_err_t app_wifi_connect(void)
 {
+    /* Time to reachable is measured from boot. */
+    WifiReachabilityCreate(&s_reachability, WIFI_REACHABILITY_MODE);
 
     esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
+    esp_event_handler_instance_t instance_ip_any_id;
     ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
                                                         ESP_EVENT_ANY_ID,
                                                         &event_handler,
                                                         NULL,
                                                         &instance_any_id));
     ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
-                                                        IP_EVENT_STA_GOT_IP,
+                                                        ESP_EVENT_ANY_ID,
                                                         &event_handler,
                                                         NULL,
-                                                        &instance_got_ip));
+                                                        &instance_ip_any_id));
+#if !CONFIG_GARAGE_WIFI_MODE_STATION
+    const esp_timer_create_args_t retry_timer_args = { .callback = retry_timer_callback, .name = "wifi_retry" };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_timer_args, &s_retry_timer));
+#endif
+#if CONFIG_GARAGE_WIFI_MODE_FALLBACK
+    const esp_timer_create_args_t fallback_timer_args = {
+        .callback = fallback_timer_callback,
+        .name = "wifi_fallback"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&fallback_timer_args, &s_fallback_timer));
+#endif
+
     wifi_config_t wifi_config = {
         .sta = {
             .ssid = EXAMPLE_ESP_WIFI_SSID,
             .password = EXAMPLE_ESP_WIFI_PASS
         },
     };
+#if CONFIG_GARAGE_WIFI_MODE_CONCURRENT
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA) );
+    set_softap_config();
+#else
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA) );
+#endif
     ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config) );
     ESP_ERROR_CHECK(esp_wifi_start() );
+#if CONFIG_GARAGE_WIFI_MODE_FALLBACK
+    esp_timer_start_once(s_fallback_timer, (uint64_t) CONFIG_GARAGE_WIFI_FALLBACK_TIMEOUT_S * 1000 * 1000);
+#endif
 
     ESP_LOGI(TAG, "wifi_init_sta finished.");
     return ESP_OK;
 }
+
+void app_wifi_set_low_power(bool low_power)
+{
+    /* Transmit power in 0.25 dBm: 11 dBm instead of the default 19.5 dBm. */
+    ESP_ERROR_CHECK(esp_wifi_set_ps(low_power ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM) );
+    ESP_ERROR_CHECK(esp_wifi_set_max_tx_power(low_power ? 44 : 78) );
+}
+
+app_wifi_link_t app_wifi_get_link(void)
+{
+    portENTER_CRITICAL(&s_reachability_lock);
+    app_wifi_link_t link = s_reachability.stationHasAddress ? APP_WIFI_LINK_STATION :
+                           s_reachability.numClients ? APP_WIFI_LINK_SOFTAP : APP_WIFI_LINK_NONE;
+    portEXIT_CRITICAL(&s_reachability_lock);
+    return link;
+}
@@ -0,0 +1,38 @@
+/* WiFi station and SoftAP connection
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Link over which the accessory is currently reachable.
+
+   The station link is reported whenever it has an address, also when SoftAP clients are connected at the same time.
+   Without DHCP on the access point the station falls back to a 169.254/16 link-local address (LWIP_AUTOIP).
+*/
+typedef enum {
+    APP_WIFI_LINK_NONE,
+    APP_WIFI_LINK_STATION,
+    APP_WIFI_LINK_SOFTAP,
+} app_wifi_link_t;
+
+void app_wifi_init(void);
+esp_err_t app_wifi_connect(void);
+app_wifi_link_t app_wifi_get_link(void);
+
+/* Trades latency for supply current: maximum modem sleep and reduced transmit power. */
+void app_wifi_set_low_power(bool low_power);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Generates main/hotpath.lf from a HotPathProfiler report.
+
+Usage:
+    curl -H "Authorization: Bearer <key>" http://<accessory>:<port>/hotpaths > hotpaths.json
+    tools/hotpath_lf.py hotpaths.json build/Garage.map [--budget BYTES] [--output main/hotpath.lf]
+
+The report lists function addresses of the profiling build. The map file of the same build resolves them to
+symbol, size, archive and object file. Functions that already run from IRAM are skipped; the others are taken in
+order of instruction fetch stall cycles for as long as their code fits the budget. The budget defaults to
+CONFIG_GARAGE_HOTPATH_IRAM_BUDGET_BYTES from sdkconfig, which is only set with GARAGE_HOTPATH_IRAM enabled.
+
+Sizes in the profiling build include the instrumentation calls, so the selection stays within the budget when the
+fragment is applied to a build without profiling.
+"""
+
+import argparse
+import collections
+import json
+import os
+import re
+import sys
+
+# Code fetched through the flash cache. IRAM is below this address.
+FLASH_TEXT_START = 0x400C2000
+
+Symbol = collections.namedtuple('Symbol', 'name size archive obj')
+
+
+def parse_map(path):
+    """Returns the .text.<name> input sections of a GNU ld map file by address."""
+    symbols = {}
+    section = None
+    pattern = re.compile(r'^\s*(?:(\.(?:literal|text)\.\S+)\s+)?0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S+)$')
+    with open(path) as f:
+        for line in f:
+            if re.match(r'^ \.(?:literal|text)\.\S+$', line.rstrip()):
+                section = line.strip()
+                continue
+            m = pattern.match(line.rstrip())
+            if not m:
+                section = None
+                continue
+            name = m.group(1) or section
+            section = None
+            if not name or not name.startswith('.text.'):
+                continue
+            archive_match = re.match(r'^(?:.*/)?([^/(]+\.a)\(([^)]+)\)$', m.group(4))
+            if not archive_match:
+                continue
+            obj = re.sub(r'\.(?:c|cpp|S)?\.?o(?:bj)?$', '', archive_match.group(2))
+            symbols[int(m.group(2), 16)] = Symbol(
+                name[len('.text.'):], int(m.group(3), 16), archive_match.group(1), obj)
+    return symbols
+
+
+def read_budget(sdkconfig):
+    with open(sdkconfig) as f:
+        for line in f:
+            m = re.match(r'^CONFIG_GARAGE_HOTPATH_IRAM_BUDGET_BYTES=(\d+)$', line.strip())
+            if m:
+                return int(m.group(1))
+    sys.exit('CONFIG_GARAGE_HOTPATH_IRAM_BUDGET_BYTES not found in %s (it is only set with GARAGE_HOTPATH_IRAM), '
+             'pass --budget.' % sdkconfig)
+
+
+def main():
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('report')
+    parser.add_argument('map')
+    parser.add_argument('--budget', type=int)
+    parser.add_argument('--sdkconfig', default=os.path.join(root, 'sdkconfig'))
+    parser.add_argument('--output', default=os.path.join(root, 'main', 'hotpath.lf'))
+    args = parser.parse_args()
+
+    budget = args.budget if args.budget is not None else read_budget(args.sdkconfig)
+    with open(args.report) as f:
+        report = json.load(f)
+    symbols = parse_map(args.map)
+
+    selected = collections.OrderedDict()
+    used = 0
+    total_stalls = sum(function['stallCycles'] for function in report['functions'])
+    selected_stalls = 0
+    for function in sorted(report['functions'], key=lambda function: -function['stallCycles']):
+        address = int(function['address'], 16)
+        symbol = symbols.get(address)
+        if address < FLASH_TEXT_START or not symbol:
+            continue
+        if used + symbol.size > budget:
+            continue
+        used += symbol.size
+        selected_stalls += function['stallCycles']
+        selected.setdefault(symbol.archive, []).append(symbol)
+
+    with open(args.output, 'w') as f:
+        f.write('# Functions placed in IRAM with GARAGE_HOTPATH_IRAM.\n#\n')
+        f.write('# Generated by tools/hotpath_lf.py: %d of %d bytes, %d of %d profiled stall cycles.\n'
+                % (used, budget, selected_stalls, total_stalls))
+        for archive, archive_symbols in selected.items():
+            f.write('\n[mapping:hotpath_%s]\n' % re.sub(r'\W', '_', archive[:-len('.a')]))
+            f.write('archive: %s\nentries:\n' % archive)
+            for symbol in archive_symbols:
+                f.write('    %s:%s (noflash)\n' % (symbol.obj, symbol.name))
+
+    print('%d functions, %d of %d bytes, %.0f%% of stall cycles -> %s'
+          % (sum(len(s) for s in selected.values()), used, budget,
+             100.0 * selected_stalls / total_stalls if total_stalls else 0, args.output))
+
+
+if __name__ == '__main__':
+    main()
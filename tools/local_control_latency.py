@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Compares door command latency of the local control API with the HAP path.
+
+Usage:
+    tools/local_control_latency.py <accessory> --key <key> [--port PORT] [--count N] [--interval SECONDS]
+                                   [--hap-command COMMAND]
+
+Each round writes the 'Target Door State' characteristic through PUT /characteristics on the local control port,
+alternating between open and closed, and times the request on the client. With --hap-command, the same value is
+also written through the HAP path by running COMMAND, in which {value} is replaced by the target state, e.g. with a
+paired homekit_python controller:
+
+    --hap-command "python3 -m homekit.put_characteristic -f pairing.json -a garage -c 1.52 {value}"
+
+Both paths switch the relay, so every write presses the remote. The interval between writes must leave the door
+time to settle.
+
+At the end, the device-side histograms of GET /metrics are printed next to the client timings. They count from
+receiving the request until the relay is switched, so the difference to the client timings is the network and
+response overhead of each path. The device-side histograms are cumulative since boot.
+"""
+
+import argparse
+import http.client
+import json
+import shlex
+import statistics
+import subprocess
+import sys
+import time
+
+# Instance ID of 'Target Door State', see kIID_GarageDoorOpenerTargetDoorState in main/DB.c.
+TARGET_DOOR_STATE_IID = 0x34
+
+# Device-side histograms of main/Metrics.c that are compared.
+METRICS = ('commandLatencyLocalControl', 'commandLatencyHAP')
+
+
+def put_target_door_state(connection, key, value):
+    """Writes the target door state and returns the round trip in microseconds."""
+    body = json.dumps({'characteristics': [{'aid': 1, 'iid': TARGET_DOOR_STATE_IID, 'value': value}]},
+                      separators=(',', ':'))
+    start = time.perf_counter()
+    connection.request('PUT', '/characteristics', body, {
+        'Authorization': 'Bearer ' + key,
+        'Content-Type': 'application/hap+json',
+    })
+    response = connection.getresponse()
+    response.read()
+    elapsed = time.perf_counter() - start
+    if response.status != 204:
+        raise RuntimeError('PUT /characteristics failed: {} {}'.format(response.status, response.reason))
+    return elapsed * 1e6
+
+
+def run_hap_command(command, value):
+    """Runs the HAP write command and returns its duration in microseconds."""
+    start = time.perf_counter()
+    subprocess.run(shlex.split(command.format(value=value)), check=True, stdout=subprocess.DEVNULL)
+    return (time.perf_counter() - start) * 1e6
+
+
+def get_metrics(connection, key):
+    connection.request('GET', '/metrics', headers={'Authorization': 'Bearer ' + key})
+    response = connection.getresponse()
+    body = response.read()
+    if response.status != 200:
+        raise RuntimeError('GET /metrics failed: {} {}'.format(response.status, response.reason))
+    return json.loads(body)
+
+
+def summarize(samples):
+    if not samples:
+        return 'no samples'
+    ordered = sorted(samples)
+    return 'count={} mean={:.0f} p50={:.0f} p90={:.0f} max={:.0f}'.format(
+        len(ordered), statistics.mean(ordered), ordered[len(ordered) // 2], ordered[int(len(ordered) * 0.9)],
+        ordered[-1])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('accessory', help='host name or address of the accessory')
+    parser.add_argument('--key', required=True, help='CONFIG_GARAGE_LOCAL_CONTROL_PSK')
+    parser.add_argument('--port', type=int, default=8080, help='CONFIG_GARAGE_LOCAL_CONTROL_PORT')
+    parser.add_argument('--count', type=int, default=4, help='number of rounds')
+    parser.add_argument('--interval', type=float, default=30.0, help='seconds between writes')
+    parser.add_argument('--hap-command', help='command that writes {value} through HAP')
+    args = parser.parse_args()
+
+    # One persistent connection, as an automation client would keep it.
+    connection = http.client.HTTPConnection(args.accessory, args.port, timeout=10)
+    local = []
+    hap = []
+    value = 0
+    for i in range(args.count):
+        if i:
+            time.sleep(args.interval)
+        local.append(put_target_door_state(connection, args.key, value))
+        value ^= 1
+        if args.hap_command:
+            time.sleep(args.interval)
+            hap.append(run_hap_command(args.hap_command, value))
+            value ^= 1
+        print('round {}: local {:.0f} us{}'.format(
+            i + 1, local[-1], ', hap {:.0f} us'.format(hap[-1]) if hap else ''), file=sys.stderr)
+
+    metrics = get_metrics(connection, args.key)
+    connection.close()
+
+    print('client local control (us): ' + summarize(local))
+    if args.hap_command:
+        print('client hap command (us):   ' + summarize(hap))
+    for name in METRICS:
+        histogram = metrics[name]
+        print('device {} (us): count={} mean={} p50={} p90={} p99={} max={}'.format(
+            name, histogram['count'], histogram['mean'], histogram['p50'], histogram['p90'], histogram['p99'],
+            histogram['max']))
+
+
+if __name__ == '__main__':
+    main()